@@ -538,6 +538,102 @@ void	btQuantizedBvh::walkStacklessTreeAgainstRay(btNodeOverlapCallback* nodeCall
 
 
 
+///STK: same as walkStacklessTreeAgainstRay (without box cast extents), but for
+///several rays at once. A ray which does not overlap an internal node skips its
+///subtree (it is inactive till the escape index of that node is reached), and the
+///tree is only descended if any active ray overlaps a node. So each ray gets the
+///same nodes reported in the same order as with its own traversal.
+void	btQuantizedBvh::walkStacklessTreeAgainstRayPacket(btNodeOverlapCallback** nodeCallbacks, int numRays, const btVector3* raySources, const btVector3* rayTargets) const
+{
+	btAssert(!m_useQuantization);
+	btAssert(numRays <= BT_MAX_RAY_PACKET_SIZE);
+
+	const btOptimizedBvhNode* rootNode = &m_contiguousNodes[0];
+	int escapeIndex, curIndex = 0;
+	bool isLeafNode;
+	//PCK: unsigned instead of bool
+	unsigned aabbOverlap=0;
+	unsigned rayBoxOverlap=0;
+	bool anyRayBoxOverlap;
+	const btVector3 aabbMin(0,0,0);
+	const btVector3 aabbMax(0,0,0);
+
+	btVector3 rayAabbMin[BT_MAX_RAY_PACKET_SIZE];
+	btVector3 rayAabbMax[BT_MAX_RAY_PACKET_SIZE];
+	btVector3 rayDirectionInverse[BT_MAX_RAY_PACKET_SIZE];
+	unsigned int sign[BT_MAX_RAY_PACKET_SIZE][3];
+	btScalar lambda_max[BT_MAX_RAY_PACKET_SIZE];
+	/* Index of the node at which a ray is active again */
+	int activeIndex[BT_MAX_RAY_PACKET_SIZE];
+
+	for (int i=0;i<numRays;i++)
+	{
+		const btVector3& raySource = raySources[i];
+		const btVector3& rayTarget = rayTargets[i];
+		rayAabbMin[i] = raySource;
+		rayAabbMax[i] = raySource;
+		rayAabbMin[i].setMin(rayTarget);
+		rayAabbMax[i].setMax(rayTarget);
+		rayAabbMin[i] += aabbMin;
+		rayAabbMax[i] += aabbMax;
+
+		btVector3 rayDir = (rayTarget-raySource);
+		rayDir.normalize ();
+		lambda_max[i] = rayDir.dot(rayTarget-raySource);
+		rayDirectionInverse[i][0] = rayDir[0] == btScalar(0.0) ? btScalar(BT_LARGE_FLOAT) : btScalar(1.0) / rayDir[0];
+		rayDirectionInverse[i][1] = rayDir[1] == btScalar(0.0) ? btScalar(BT_LARGE_FLOAT) : btScalar(1.0) / rayDir[1];
+		rayDirectionInverse[i][2] = rayDir[2] == btScalar(0.0) ? btScalar(BT_LARGE_FLOAT) : btScalar(1.0) / rayDir[2];
+		sign[i][0] = rayDirectionInverse[i][0] < 0.0;
+		sign[i][1] = rayDirectionInverse[i][1] < 0.0;
+		sign[i][2] = rayDirectionInverse[i][2] < 0.0;
+		activeIndex[i] = 0;
+	}
+
+	btVector3 bounds[2];
+
+	while (curIndex < m_curNodeIndex)
+	{
+		bounds[0] = rootNode->m_aabbMinOrg;
+		bounds[1] = rootNode->m_aabbMaxOrg;
+		/* Add box cast extents */
+		bounds[0] -= aabbMax;
+		bounds[1] -= aabbMin;
+
+		isLeafNode = rootNode->m_escapeIndex == -1;
+		anyRayBoxOverlap = false;
+
+		for (int i=0;i<numRays;i++)
+		{
+			if (curIndex < activeIndex[i])
+				continue;
+			btScalar param = 1.0;
+			aabbOverlap = TestAabbAgainstAabb2(rayAabbMin[i],rayAabbMax[i],rootNode->m_aabbMinOrg,rootNode->m_aabbMaxOrg);
+			rayBoxOverlap = aabbOverlap ? btRayAabb2 (raySources[i], rayDirectionInverse[i], sign[i], bounds, param, 0.0f, lambda_max[i]) : false;
+			if (rayBoxOverlap != 0)
+			{
+				anyRayBoxOverlap = true;
+				if (isLeafNode)
+					nodeCallbacks[i]->processNode(rootNode->m_subPart,rootNode->m_triangleIndex);
+			}
+			else if (!isLeafNode)
+			{
+				activeIndex[i] = curIndex + rootNode->m_escapeIndex;
+			}
+		}
+
+		if (anyRayBoxOverlap || isLeafNode)
+		{
+			rootNode++;
+			curIndex++;
+		} else
+		{
+			escapeIndex = rootNode->m_escapeIndex;
+			rootNode += escapeIndex;
+			curIndex += escapeIndex;
+		}
+	}
+}
+
 void	btQuantizedBvh::walkStacklessQuantizedTreeAgainstRay(btNodeOverlapCallback* nodeCallback, const btVector3& raySource, const btVector3& rayTarget, const btVector3& aabbMin, const btVector3& aabbMax, int startNodeIndex,int endNodeIndex) const
 {
 	btAssert(m_useQuantization);
@@ -759,6 +855,20 @@ void	btQuantizedBvh::reportRayOverlappingNodex (btNodeOverlapCallback* nodeCallb
 }
 
 
+void	btQuantizedBvh::reportRayPacketOverlappingNodex(btNodeOverlapCallback** nodeCallbacks, int numRays, const btVector3* raySources, const btVector3* rayTargets) const
+{
+	if (m_useQuantization || numRays > BT_MAX_RAY_PACKET_SIZE)
+	{
+		for (int i=0;i<numRays;i++)
+			reportRayOverlappingNodex(nodeCallbacks[i],raySources[i],rayTargets[i]);
+	}
+	else
+	{
+		walkStacklessTreeAgainstRayPacket(nodeCallbacks, numRays, raySources, rayTargets);
+	}
+}
+
+
 void	btQuantizedBvh::reportBoxCastOverlappingNodex(btNodeOverlapCallback* nodeCallback, const btVector3& raySource, const btVector3& rayTarget, const btVector3& aabbMin,const btVector3& aabbMax) const
 {
 	//always use stackless
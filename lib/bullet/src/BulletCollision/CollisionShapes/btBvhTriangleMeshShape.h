@@ -55,6 +55,8 @@ public:
 
 	
 	void performRaycast (btTriangleCallback* callback, const btVector3& raySource, const btVector3& rayTarget);
+	///STK: performs several raycasts with a single bvh traversal, each ray reports to its own callback
+	void performRaycasts (btTriangleCallback** callbacks, int numRays, const btVector3* raySources, const btVector3* rayTargets);
 	void performConvexcast (btTriangleCallback* callback, const btVector3& boxSource, const btVector3& boxTarget, const btVector3& boxMin, const btVector3& boxMax);
 
 	virtual void	processAllTriangles(btTriangleCallback* callback,const btVector3& aabbMin,const btVector3& aabbMax) const;
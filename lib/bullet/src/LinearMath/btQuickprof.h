@@ -16,7 +16,10 @@
 #define BT_QUICK_PROF_H
 
 //To disable built-in profiling, please comment out next line
-//#define BT_NO_PROFILE 1
+///STK: the profiler is not used by STK, and its tree of samples is global
+///and not thread safe (islands can be solved on several threads, see
+///ParallelIslandSolver)
+#define BT_NO_PROFILE 1
 #ifndef BT_NO_PROFILE
 #include <stdio.h>//@todo remove this, backwards compatibility
 #include "btScalar.h"
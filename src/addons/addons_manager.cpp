@@ -397,7 +397,9 @@ void AddonsManager::downloadIcons()
             public:
                 IconRequest(const std::string &filename,
                             const std::string &url,
-                            Addon *addon     ) : HTTPRequest(filename, true, 1)
+                            Addon *addon     )
+                    : HTTPRequest(filename, true,
+                                  Online::RequestManager::HTTP_BULK_PRIORITY)
                 {
                     m_addon = addon;  setURL(url);
                 }   // IconRequest
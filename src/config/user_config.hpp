@@ -443,6 +443,12 @@ namespace UserConfigParams
                             &m_race_setup_group,
                             "Game mode. 0=standard, 1=time trial, 2=follow "
                             "the leader, 3=3 strikes") );
+    PARAM_PREFIX IntUserConfigParam          m_physics_threads
+            PARAM_DEFAULT(  IntUserConfigParam(0, "physics_threads",
+                            &m_race_setup_group,
+                            "Number of threads used to solve independent "
+                            "groups of physics objects, 0 to let bullet "
+                            "solve them as usual.") );
     PARAM_PREFIX StringUserConfigParam m_default_kart
             PARAM_DEFAULT( StringUserConfigParam("tux", "kart",
                            "Kart to select by default (the last used kart)") );
@@ -1002,6 +1008,15 @@ namespace UserConfigParams
                                                 &m_addon_group,
                                         "Time addon-list was updated last.") );
 
+    PARAM_PREFIX IntUserConfigParam         m_max_http_connections
+            PARAM_DEFAULT(  IntUserConfigParam(6, "max_http_connections",
+                                               &m_addon_group,
+                                               "Maximum number of concurrent "
+                                               "http transfers. Two of them "
+                                               "are always kept free for "
+                                               "requests which are not bulk "
+                                               "downloads (e.g. addon icons).") );
+
     PARAM_PREFIX StringUserConfigParam      m_language
             PARAM_DEFAULT( StringUserConfigParam("system", "language",
                         "Which language to use (language code or 'system')") );
@@ -114,6 +114,7 @@ void FontWithFace::reset()
     m_new_char_holder.clear();
     m_character_area_map.clear();
     m_character_glyph_info_map.clear();
+    m_layout_cache.clear();
     for (unsigned int i = 0; i < m_spritebank->getTextureCount(); i++)
     {
         STKTexManager::getInstance()->removeTexture(
@@ -377,13 +378,12 @@ const FontWithFace::FontArea&
     FontWithFace::getAreaFromCharacter(const wchar_t c,
                                        bool* fallback_font) const
 {
-    std::map<wchar_t, FontArea>::const_iterator n =
-        m_character_area_map.find(c);
-    if (n != m_character_area_map.end())
+    const FontArea* area = m_character_area_map.find(c);
+    if (area != NULL)
     {
         if (fallback_font != NULL)
             *fallback_font = false;
-        return n->second;
+        return *area;
     }
     else if (m_fallback_font != NULL && fallback_font != NULL)
     {
@@ -394,7 +394,7 @@ const FontWithFace::FontArea&
     // Not found, return the first font area, which is a white-space
     if (fallback_font != NULL)
         *fallback_font = false;
-    return m_character_area_map.begin()->second;
+    return *m_character_area_map.getLowest();
 
 }   // getAreaFromCharacter
 
@@ -415,16 +415,44 @@ core::dimension2d<u32> FontWithFace::getDimension(const wchar_t* text,
         return core::dimension2d<u32>(1, 1);
 
     const float scale = font_settings ? font_settings->getScale() : 1.0f;
+    const TextLayoutCache::Layout& layout = getLayout(text, scale,
+                                                      false/*billboard*/);
+    return core::dimension2d<u32>(layout.m_width, layout.m_height);
+#endif
+}   // getDimension
+
+// ----------------------------------------------------------------------------
+/** Returns the glyph run of a text, laying it out if it is not cached. The
+ *  layout computes the dimension of the text, and for each character the
+ *  sprite to use, its offset from the pen position and its advance. When
+ *  the text is laid out it will also do checking for missing characters in
+ *  font and lazy load them.
+ *  \param text The text to be laid out.
+ *  \param scale The scaling of the characters.
+ *  \param billboard If the offsets for billboard text are used.
+ */
+const TextLayoutCache::Layout& FontWithFace::getLayout(const wchar_t* text,
+                                                       float scale,
+                                                       bool billboard)
+{
+    const TextLayoutCache::Layout* cached =
+        m_layout_cache.find(text, scale, billboard);
+    if (cached)
+        return *cached;
+
     // Test if lazy load char is needed
     insertCharacters(text);
     updateCharactersList();
 
     assert(m_character_area_map.size() > 0);
+    TextLayoutCache::Layout* layout =
+        m_layout_cache.insert(text, scale, billboard);
     core::dimension2d<float> dim(0.0f, 0.0f);
     core::dimension2d<float> this_line(0.0f, m_font_max_height * scale);
 
     for (const wchar_t* p = text; *p; ++p)
     {
+        TextLayoutCache::Glyph glyph;
         if (*p == L'\r'  ||      // Windows breaks
             *p == L'\n'      )   // Unix breaks
         {
@@ -434,26 +462,38 @@ core::dimension2d<u32> FontWithFace::getDimension(const wchar_t* text,
             if (dim.Width < this_line.Width)
                 dim.Width = this_line.Width;
             this_line.Width = 0;
+            glyph.m_offset_x = glyph.m_offset_y = glyph.m_advance = 0.0f;
+            glyph.m_sprite = -1;
+            glyph.m_fallback = false;
+            glyph.m_line_break = true;
+            layout->m_glyphs.push_back(glyph);
             continue;
         }
 
         bool fallback = false;
         const FontArea &area = getAreaFromCharacter(*p, &fallback);
-
-        this_line.Width += getCharWidth(area, fallback, scale);
+        const float cur_scale = fallback ? m_fallback_font_scale : scale;
+        glyph.m_offset_x = area.bearing_x * cur_scale;
+        // Billboard text specific, use offset_y_bt instead
+        glyph.m_offset_y = (billboard ? area.offset_y_bt : area.offset_y) *
+            cur_scale;
+        glyph.m_advance = getCharWidth(area, fallback, scale);
+        glyph.m_sprite = area.spriteno;
+        glyph.m_fallback = fallback;
+        glyph.m_line_break = false;
+        layout->m_glyphs.push_back(glyph);
+
+        this_line.Width += glyph.m_advance;
     }
 
     dim.Height += this_line.Height;
     if (dim.Width < this_line.Width)
         dim.Width = this_line.Width;
 
-    core::dimension2d<u32> ret_dim(0, 0);
-    ret_dim.Width  = (u32)(dim.Width + 0.9f); // round up
-    ret_dim.Height = (u32)(dim.Height + 0.9f);
-
-    return ret_dim;
-#endif
-}   // getDimension
+    layout->m_width  = (u32)(dim.Width + 0.9f); // round up
+    layout->m_height = (u32)(dim.Height + 0.9f);
+    return *layout;
+}   // getLayout
                                   
 // ----------------------------------------------------------------------------
 /** Calculate the index of the character in the text on a specific position.
@@ -535,12 +575,13 @@ void FontWithFace::render(const core::stringw& text,
 
     core::position2d<float> offset(float(position.UpperLeftCorner.X),
         float(position.UpperLeftCorner.Y));
-    core::dimension2d<s32> text_dimension;
+    const TextLayoutCache::Layout& layout = getLayout(text.c_str(), scale,
+        char_collector != NULL/*billboard*/);
+    const core::dimension2d<s32> text_dimension(layout.m_width,
+                                                layout.m_height);
 
     if (rtl || hcenter || vcenter || clip)
     {
-        text_dimension = getDimension(text.c_str(), font_settings);
-
         if (hcenter)
             offset.X += (position.getWidth() - text_dimension.Width) / 2;
         else if (rtl)
@@ -558,25 +599,16 @@ void FontWithFace::render(const core::stringw& text,
     }
 
     // Collect character locations
-    const unsigned int text_size = text.size();
-    core::array<s32> indices(text_size);
-    core::array<core::position2d<float>> offsets(text_size);
-    std::vector<bool> fallback(text_size);
-
-    // Test again if lazy load char is needed,
-    // as some text isn't drawn with getDimension
-    insertCharacters(text.c_str());
-    updateCharactersList();
+    const unsigned int glyph_count = (unsigned int)layout.m_glyphs.size();
+    core::array<s32> indices(glyph_count);
+    core::array<core::position2d<float>> offsets(glyph_count);
+    std::vector<bool> fallback;
+    fallback.reserve(glyph_count);
 
-    for (u32 i = 0; i < text_size; i++)
+    for (const TextLayoutCache::Glyph& glyph : layout.m_glyphs)
     {
-        wchar_t c = text[i];
-
-        if (c == L'\r' ||          // Windows breaks
-            c == L'\n'    )        // Unix breaks
+        if (glyph.m_line_break)
         {
-            if (c==L'\r' && text[i+1]==L'\n')
-                c = text[++i];
             offset.Y += m_font_max_height * scale;
             offset.X  = float(position.UpperLeftCorner.X);
             if (hcenter)
@@ -584,38 +616,16 @@ void FontWithFace::render(const core::stringw& text,
             continue;
         }   // if lineBreak
 
-        bool use_fallback_font = false;
-        const FontArea &area   = getAreaFromCharacter(c, &use_fallback_font);
-        fallback[i]            = use_fallback_font;
-        if (char_collector == NULL)
-        {
-            float glyph_offset_x = area.bearing_x *
-                (fallback[i] ? m_fallback_font_scale : scale);
-            float glyph_offset_y = area.offset_y *
-                (fallback[i] ? m_fallback_font_scale : scale);
-            offset.X += glyph_offset_x;
-            offset.Y += glyph_offset_y;
-            offsets.push_back(offset);
-            offset.X -= glyph_offset_x;
-            offset.Y -= glyph_offset_y;
-        }
-        else
-        {
-            // Billboard text specific, use offset_y_bt instead
-            float glyph_offset_x = area.bearing_x *
-                (fallback[i] ? m_fallback_font_scale : scale);
-            float glyph_offset_y = area.offset_y_bt *
-                (fallback[i] ? m_fallback_font_scale : scale);
-            offset.X += glyph_offset_x;
-            offset.Y += glyph_offset_y;
-            offsets.push_back(offset);
-            offset.X -= glyph_offset_x;
-            offset.Y -= glyph_offset_y;
-        }
+        offset.X += glyph.m_offset_x;
+        offset.Y += glyph.m_offset_y;
+        offsets.push_back(offset);
+        offset.X -= glyph.m_offset_x;
+        offset.Y -= glyph.m_offset_y;
 
-        indices.push_back(area.spriteno);
-        offset.X += getCharWidth(area, fallback[i], scale);
-    }   // for i < text_size
+        indices.push_back(glyph.m_sprite);
+        fallback.push_back(glyph.m_fallback);
+        offset.X += glyph.m_advance;
+    }   // for glyph in layout
 
     // Do the actual rendering
     const int indice_amount                 = indices.size();
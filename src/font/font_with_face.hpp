@@ -19,13 +19,14 @@
 #ifndef HEADER_FONT_WITH_FACE_HPP
 #define HEADER_FONT_WITH_FACE_HPP
 
+#include "font/glyph_table.hpp"
+#include "font/text_layout_cache.hpp"
 #include "utils/cpp2011.hpp"
 #include "utils/leak_check.hpp"
 #include "utils/no_copy.hpp"
 
 #include <algorithm>
 #include <cassert>
-#include <map>
 #include <set>
 #include <string>
 
@@ -177,10 +178,13 @@ private:
     unsigned int                 m_face_dpi;
 
     /** Store a list of supported character to a \ref FontArea. */
-    std::map<wchar_t, FontArea>  m_character_area_map;
+    GlyphTable<FontArea>         m_character_area_map;
 
     /** Store a list of loaded and tested character to a \ref GlyphInfo. */
-    std::map<wchar_t, GlyphInfo> m_character_glyph_info_map;
+    GlyphTable<GlyphInfo>        m_character_glyph_info_map;
+
+    /** Glyph runs of recently used strings. */
+    TextLayoutCache              m_layout_cache;
 
     // ------------------------------------------------------------------------
     /** Return a character width.
@@ -201,11 +205,7 @@ private:
      *  \return True if tested. */
     bool loadedChar(wchar_t c) const
     {
-        std::map<wchar_t, GlyphInfo>::const_iterator n =
-            m_character_glyph_info_map.find(c);
-        if (n != m_character_glyph_info_map.end())
-            return true;
-        return false;
+        return m_character_glyph_info_map.find(c) != NULL;
     }
     // ------------------------------------------------------------------------
     /** Get the \ref GlyphInfo from \ref m_character_glyph_info_map about a
@@ -214,11 +214,10 @@ private:
      *  \return \ref GlyphInfo of this character. */
     const GlyphInfo& getGlyphInfo(wchar_t c) const
     {
-        std::map<wchar_t, GlyphInfo>::const_iterator n =
-            m_character_glyph_info_map.find(c);
+        const GlyphInfo* gi = m_character_glyph_info_map.find(c);
         // Make sure we always find GlyphInfo
-        assert(n != m_character_glyph_info_map.end());
-        return n->second;
+        assert(gi != NULL);
+        return *gi;
     }
     // ------------------------------------------------------------------------
     /** Tells whether a character is supported by all TTFs in \ref m_face_ttf
@@ -227,13 +226,8 @@ private:
      *  \return True if it's supported. */
     bool supportChar(wchar_t c)
     {
-        std::map<wchar_t, GlyphInfo>::const_iterator n =
-            m_character_glyph_info_map.find(c);
-        if (n != m_character_glyph_info_map.end())
-        {
-            return n->second.glyph_index > 0;
-        }
-        return false;
+        const GlyphInfo* gi = m_character_glyph_info_map.find(c);
+        return gi != NULL && gi->glyph_index > 0;
     }
     // ------------------------------------------------------------------------
     void loadGlyphInfo(wchar_t c);
@@ -245,6 +239,9 @@ private:
     // ------------------------------------------------------------------------
     void insertGlyph(wchar_t c, const GlyphInfo& gi);
     // ------------------------------------------------------------------------
+    const TextLayoutCache::Layout& getLayout(const wchar_t* text, float scale,
+                                             bool billboard);
+    // ------------------------------------------------------------------------
     void setDPI();
     // ------------------------------------------------------------------------
     /** Override it if sub-class should not do lazy loading characters. */
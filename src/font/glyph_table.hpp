@@ -0,0 +1,134 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_GLYPH_TABLE_HPP
+#define HEADER_GLYPH_TABLE_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+/** Maps characters to glyph data. Characters of the basic multilingual
+ *  plane are looked up directly in pages of 256 entries, which are only
+ *  allocated when a character of the page is inserted. Other code points
+ *  are stored in a hash map. References to values stay valid until
+ *  \ref clear is called.
+ *  \ingroup font
+ */
+template<typename T>
+class GlyphTable : public NoCopy
+{
+private:
+    static const unsigned PAGE_SIZE = 256;
+    static const unsigned PAGE_COUNT = 0x10000 / PAGE_SIZE;
+
+    struct Page
+    {
+        T    m_values[PAGE_SIZE];
+        bool m_used[PAGE_SIZE];
+        Page()
+        {
+            for (unsigned i = 0; i < PAGE_SIZE; i++)
+                m_used[i] = false;
+        }
+    };   // Page
+
+    std::unique_ptr<Page> m_pages[PAGE_COUNT];
+
+    /** Characters outside of the basic multilingual plane. */
+    std::unordered_map<uint32_t, T> m_others;
+
+    /** Number of characters stored. */
+    size_t m_size;
+
+    /** The smallest character stored. */
+    uint32_t m_lowest;
+
+public:
+    // ------------------------------------------------------------------------
+    GlyphTable() : m_size(0), m_lowest(0)                                   {}
+    // ------------------------------------------------------------------------
+    /** Returns the value of a character, or NULL if it is not stored. */
+    const T* find(uint32_t c) const
+    {
+        if (c < 0x10000)
+        {
+            const Page* page = m_pages[c / PAGE_SIZE].get();
+            if (page && page->m_used[c % PAGE_SIZE])
+                return &page->m_values[c % PAGE_SIZE];
+            return NULL;
+        }
+        auto it = m_others.find(c);
+        return it == m_others.end() ? NULL : &it->second;
+    }   // find
+    // ------------------------------------------------------------------------
+    /** Returns the value of a character, inserting a default value if it is
+     *  not stored yet. */
+    T& operator[](uint32_t c)
+    {
+        if (c < 0x10000)
+        {
+            std::unique_ptr<Page>& page = m_pages[c / PAGE_SIZE];
+            if (!page)
+                page.reset(new Page());
+            if (!page->m_used[c % PAGE_SIZE])
+            {
+                page->m_used[c % PAGE_SIZE] = true;
+                page->m_values[c % PAGE_SIZE] = T();
+                if (m_size == 0 || c < m_lowest)
+                    m_lowest = c;
+                m_size++;
+            }
+            return page->m_values[c % PAGE_SIZE];
+        }
+        auto it = m_others.find(c);
+        if (it != m_others.end())
+            return it->second;
+        if (m_size == 0 || c < m_lowest)
+            m_lowest = c;
+        m_size++;
+        return m_others[c];
+    }   // operator[]
+    // ------------------------------------------------------------------------
+    void clear()
+    {
+        for (unsigned i = 0; i < PAGE_COUNT; i++)
+            m_pages[i].reset();
+        m_others.clear();
+        m_size = 0;
+        m_lowest = 0;
+    }   // clear
+    // ------------------------------------------------------------------------
+    size_t size() const                                     { return m_size; }
+    // ------------------------------------------------------------------------
+    bool empty() const                                 { return m_size == 0; }
+    // ------------------------------------------------------------------------
+    /** Returns the value of the smallest character stored, or NULL if the
+     *  table is empty. */
+    const T* getLowest() const
+    {
+        return m_size == 0 ? NULL : find(m_lowest);
+    }   // getLowest
+
+};   // GlyphTable
+
+#endif
+/* EOF */
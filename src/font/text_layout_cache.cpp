@@ -0,0 +1,185 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "font/text_layout_cache.hpp"
+
+#include "font/glyph_table.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <cwchar>
+
+// ----------------------------------------------------------------------------
+TextLayoutCache::TextLayoutCache(unsigned int capacity)
+{
+    m_capacity = capacity > 0 ? capacity : 1;
+    m_hits = 0;
+    m_misses = 0;
+}   // TextLayoutCache
+
+// ----------------------------------------------------------------------------
+/** FNV-1a hash of the text and the layout parameters. */
+uint64_t TextLayoutCache::getKey(const wchar_t* text, size_t length,
+                                 float scale, bool billboard)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](uint32_t value)
+        {
+            for (unsigned i = 0; i < 4; i++)
+            {
+                hash ^= (value >> (i * 8)) & 0xff;
+                hash *= 1099511628211ULL;
+            }
+        };
+    for (size_t i = 0; i < length; i++)
+        add((uint32_t)text[i]);
+    uint32_t scale_bits;
+    memcpy(&scale_bits, &scale, 4);
+    add(scale_bits);
+    add(billboard ? 1 : 0);
+    return hash;
+}   // getKey
+
+// ----------------------------------------------------------------------------
+/** Returns the cached layout of a text, or NULL if it is not cached. A found
+ *  entry becomes the most recently used one.
+ */
+const TextLayoutCache::Layout*
+    TextLayoutCache::find(const wchar_t* text, float scale, bool billboard)
+{
+    const size_t length = wcslen(text);
+    auto it = m_index.find(getKey(text, length, scale, billboard));
+    if (it == m_index.end() || it->second->m_scale != scale ||
+        it->second->m_billboard != billboard ||
+        it->second->m_text.compare(0, std::wstring::npos, text, length) != 0)
+    {
+        m_misses++;
+        return NULL;
+    }
+    m_hits++;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return &it->second->m_layout;
+}   // find
+
+// ----------------------------------------------------------------------------
+/** Adds an empty layout for a text (replacing an entry with the same key),
+ *  which is then filled in by the caller. Removes the least recently used
+ *  entry if the cache is full.
+ */
+TextLayoutCache::Layout*
+    TextLayoutCache::insert(const wchar_t* text, float scale, bool billboard)
+{
+    const size_t length = wcslen(text);
+    const uint64_t key = getKey(text, length, scale, billboard);
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+    {
+        m_entries.erase(it->second);
+        m_index.erase(it);
+    }
+    else if (m_entries.size() >= m_capacity)
+    {
+        m_index.erase(m_entries.back().m_key);
+        m_entries.pop_back();
+    }
+    m_entries.emplace_front();
+    Entry& e = m_entries.front();
+    e.m_key = key;
+    e.m_text.assign(text, length);
+    e.m_scale = scale;
+    e.m_billboard = billboard;
+    e.m_layout.m_width = 0;
+    e.m_layout.m_height = 0;
+    m_index[key] = m_entries.begin();
+    return &e.m_layout;
+}   // insert
+
+// ----------------------------------------------------------------------------
+void TextLayoutCache::clear()
+{
+    m_entries.clear();
+    m_index.clear();
+}   // clear
+
+// ----------------------------------------------------------------------------
+/** Tests the glyph table and the layout cache, neither needs graphics.
+ */
+void TextLayoutCache::unitTesting()
+{
+    // Glyph table: direct pages, the hashed fallback and the lowest entry
+    GlyphTable<int> table;
+    assert(table.empty() && table.find(L'a') == NULL);
+    assert(table.getLowest() == NULL);
+    table[L'b'] = 2;
+    table[L' '] = 1;
+    table[0x4e2d] = 3;
+    table[0x1f600] = 4;
+    assert(table.size() == 4);
+    assert(*table.find(L'b') == 2 && *table.find(0x4e2d) == 3);
+    assert(*table.find(0x1f600) == 4 && table.find(0x1f601) == NULL);
+    assert(table.find(L'c') == NULL && table.find(0x4e2e) == NULL);
+    assert(*table.getLowest() == 1);
+    const int* b = table.find(L'b');
+    for (uint32_t c = 0x100; c < 0x200; c++)
+        table[c] = (int)c;
+    table[0x1f601] = 5;
+    // References stay valid when other characters are added
+    assert(b == table.find(L'b') && table.size() == 261);
+    table[L'b'] = 7;
+    assert(*b == 7 && table.size() == 261);
+    table.clear();
+    assert(table.empty() && table.find(L'b') == NULL);
+    assert(table.find(0x1f600) == NULL);
+
+    // Layout cache: lookup by text, scale and billboard flag
+    TextLayoutCache cache(3);
+    assert(cache.find(L"Lap 1/3", 1.0f, false) == NULL);
+    Layout* l = cache.insert(L"Lap 1/3", 1.0f, false);
+    l->m_width = 42;
+    l->m_glyphs.resize(7);
+    const Layout* found = cache.find(L"Lap 1/3", 1.0f, false);
+    assert(found == l && found->m_width == 42 && found->m_glyphs.size() == 7);
+    assert(cache.find(L"Lap 1/3", 0.5f, false) == NULL);
+    assert(cache.find(L"Lap 1/3", 1.0f, true) == NULL);
+    assert(cache.find(L"Lap 2/3", 1.0f, false) == NULL);
+    assert(cache.find(L"Lap 1/", 1.0f, false) == NULL);
+
+    // Least recently used entries are removed
+    cache.insert(L"A", 1.0f, false)->m_width = 1;
+    cache.insert(L"B", 1.0f, false)->m_width = 2;
+    assert(cache.size() == 3);
+    // Use "Lap 1/3", so "A" is the least recently used entry
+    assert(cache.find(L"Lap 1/3", 1.0f, false) != NULL);
+    cache.insert(L"C", 1.0f, false)->m_width = 3;
+    assert(cache.size() == 3);
+    assert(cache.find(L"A", 1.0f, false) == NULL);
+    assert(cache.find(L"B", 1.0f, false)->m_width == 2);
+    assert(cache.find(L"C", 1.0f, false)->m_width == 3);
+    assert(cache.find(L"Lap 1/3", 1.0f, false)->m_width == 42);
+
+    // Inserting an existing text replaces the entry
+    cache.insert(L"C", 1.0f, false)->m_width = 4;
+    assert(cache.size() == 3);
+    assert(cache.find(L"C", 1.0f, false)->m_width == 4);
+    assert(cache.getHits() > 0 && cache.getMisses() > 0);
+
+    cache.clear();
+    assert(cache.size() == 0 && cache.find(L"C", 1.0f, false) == NULL);
+    (void)b;
+    (void)found;
+}   // unitTesting
@@ -0,0 +1,107 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_TEXT_LAYOUT_CACHE_HPP
+#define HEADER_TEXT_LAYOUT_CACHE_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** Caches the glyph runs of recently laid out strings of one
+ *  \ref FontWithFace, so that strings drawn every frame (race GUI,
+ *  scoreboard, chat ...) don't need to look up each character and check
+ *  for missing glyphs again. Entries are keyed by the text, the scale and
+ *  whether the layout is for billboard text, and the least recently used
+ *  entry is removed when the cache is full.
+ *  \ingroup font
+ */
+class TextLayoutCache : public NoCopy
+{
+public:
+    /** A laid out character. */
+    struct Glyph
+    {
+        /** Offset of the glyph from the pen position. */
+        float m_offset_x;
+        float m_offset_y;
+        /** How far the pen moves after this glyph. */
+        float m_advance;
+        /** Index in the sprite bank, of the fallback font if m_fallback. */
+        int   m_sprite;
+        bool  m_fallback;
+        /** True if this is a line break instead of a glyph. */
+        bool  m_line_break;
+    };   // Glyph
+
+    struct Layout
+    {
+        std::vector<Glyph> m_glyphs;
+        unsigned int       m_width;
+        unsigned int       m_height;
+    };   // Layout
+
+private:
+    struct Entry
+    {
+        uint64_t     m_key;
+        std::wstring m_text;
+        float        m_scale;
+        bool         m_billboard;
+        Layout       m_layout;
+    };   // Entry
+
+    /** All entries, the most recently used first. */
+    std::list<Entry> m_entries;
+
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> m_index;
+
+    unsigned int m_capacity;
+
+    uint64_t m_hits, m_misses;
+
+    // ------------------------------------------------------------------------
+    static uint64_t getKey(const wchar_t* text, size_t length, float scale,
+                           bool billboard);
+
+public:
+    // ------------------------------------------------------------------------
+    TextLayoutCache(unsigned int capacity = 256);
+    // ------------------------------------------------------------------------
+    const Layout* find(const wchar_t* text, float scale, bool billboard);
+    // ------------------------------------------------------------------------
+    Layout* insert(const wchar_t* text, float scale, bool billboard);
+    // ------------------------------------------------------------------------
+    void clear();
+    // ------------------------------------------------------------------------
+    size_t size() const                           { return m_entries.size(); }
+    // ------------------------------------------------------------------------
+    uint64_t getHits() const                                { return m_hits; }
+    // ------------------------------------------------------------------------
+    uint64_t getMisses() const                            { return m_misses; }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // TextLayoutCache
+
+#endif
+/* EOF */
@@ -207,6 +207,7 @@ void DrawCalls::prepareDrawCalls(scene::ICameraSceneNode *camnode)
     parseSceneManager(
         irr_driver->getSceneManager()->getRootSceneNode()->getChildren(),
         camnode);
+    SP::cullObjects();
     SP::handleDynamicDrawCall();
     SP::updateModelMatrix();
     PROFILER_POP_CPU_MARKER();
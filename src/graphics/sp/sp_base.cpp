@@ -31,6 +31,7 @@
 #include "graphics/render_info.hpp"
 #include "graphics/rtts.hpp"
 #include "graphics/shaders.hpp"
+#include "graphics/sp/sp_culling.hpp"
 #include "graphics/sp/sp_dynamic_draw_call.hpp"
 #include "graphics/sp/sp_instanced_data.hpp"
 #include "graphics/sp/sp_per_object_uniform.hpp"
@@ -53,6 +54,7 @@
 #include <array>
 #include <cassert>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -105,6 +107,28 @@ std::vector<std::shared_ptr<SPDynamicDrawCall> > g_dy_dc;
 // ----------------------------------------------------------------------------
 float g_frustums[5][24] = { { } };
 // ----------------------------------------------------------------------------
+/** Mesh buffers added by addObject in this frame, culled in cullObjects. */
+struct CullingEntry
+{
+    SPMeshNode* m_node;
+    SPShader* m_shader;
+    unsigned m_mb_id;
+    bool m_handle_shadow;
+};
+std::vector<CullingEntry> g_culling_entries;
+// ----------------------------------------------------------------------------
+/** Bitmask of visible frustums for each culling entry. */
+std::vector<uint8_t> g_culling_visible;
+// ----------------------------------------------------------------------------
+/** Instance data generated for each chunk of culling entries, merged in chunk
+ *  order so draw calls are the same as with serial culling. */
+std::vector<std::vector<std::pair<unsigned, SPInstancedData> > >
+    g_culling_instances;
+// ----------------------------------------------------------------------------
+SPCulling* g_culling = NULL;
+// ----------------------------------------------------------------------------
+const unsigned CULLING_CHUNK_SIZE = 64;
+// ----------------------------------------------------------------------------
 unsigned sp_solid_poly_count = 0;
 // ----------------------------------------------------------------------------
 unsigned sp_shadow_poly_count = 0;
@@ -431,6 +455,10 @@ void init()
     }
 
     initSkinning();
+    // Main thread culls too, so at most 3 more threads
+    unsigned culling_threads =
+        std::min(std::thread::hardware_concurrency(), 4u);
+    g_culling = new SPCulling(culling_threads > 1 ? culling_threads - 1 : 0);
     for (unsigned i = 0; i < MAX_PLAYER_COUNT; i++)
     {
         for (int j = 0; j < 3; j++)
@@ -588,6 +616,10 @@ void init()
 void destroy()
 {
     g_dy_dc.clear();
+    delete g_culling;
+    g_culling = NULL;
+    g_culling_entries.clear();
+    g_culling_instances.clear();
     SPTextureManager::get()->stopThreads();
     SPShaderManager::destroy();
     g_glow_shader = NULL;
@@ -783,9 +815,12 @@ void prepareDrawCalls()
     }
     g_glow_meshes.clear();
     g_instances.clear();
-}
+    g_culling_entries.clear();
+}   // prepareDrawCalls
 
 // ----------------------------------------------------------------------------
+/** Queues the mesh buffers of a node for culling, the actual work is done
+ *  for all nodes at once in cullObjects. */
 void addObject(SPMeshNode* node)
 {
     if (!sp_culling)
@@ -798,57 +833,83 @@ void addObject(SPMeshNode* node)
         return;
     }
 
-    const core::matrix4& model_matrix = node->getAbsoluteTransformation();
-    bool added_for_skinning = false;
     for (unsigned m = 0; m < node->getSPM()->getMeshBufferCount(); m++)
     {
-        SPMeshBuffer* mb = node->getSPM()->getSPMeshBuffer(m);
         SPShader* shader = node->getShader(m);
         if (shader == NULL)
         {
             continue;
         }
-        core::aabbox3df bb = mb->getBoundingBox();
-        model_matrix.transformBoxEx(bb);
-        std::vector<bool> discard;
-        const bool handle_shadow = node->isInShadowPass() &&
+        CullingEntry ce;
+        ce.m_node = node;
+        ce.m_shader = shader;
+        ce.m_mb_id = m;
+        ce.m_handle_shadow = node->isInShadowPass() &&
             g_handle_shadow && shader->hasShader(RP_SHADOW);
-        discard.resize((handle_shadow ? 5 : 1), false);
+        g_culling_entries.push_back(ce);
+    }
+}   // addObject
 
-        for (int dc_type = 0; dc_type < (handle_shadow ? 5 : 1); dc_type++)
+// ----------------------------------------------------------------------------
+/** Culls all mesh buffers added by addObject against the camera and shadow
+ *  frustums, and generates their instance data. Bounding box transformation,
+ *  plane tests and instance data generation run in parallel chunks, anything
+ *  touching OpenGL or the global draw call lists stays on this thread and is
+ *  done in the order the objects were added.
+ */
+void cullObjects()
+{
+    if (!sp_culling || g_culling_entries.empty())
+    {
+        return;
+    }
+
+    const unsigned count = (unsigned)g_culling_entries.size();
+    const unsigned frustum_count = g_handle_shadow ? 5 : 1;
+    const bool bb_viz = irr_driver->getBoundingBoxesViz();
+    g_culling->resize(count);
+    g_culling_visible.resize(count);
+    g_culling->parallelFor(count, CULLING_CHUNK_SIZE,
+        [frustum_count](unsigned /*chunk*/, unsigned begin, unsigned end)
         {
-            for (int i = 0; i < 24; i += 4)
+            for (unsigned i = begin; i < end; i++)
             {
-                bool outside = true;
-                for (int j = 0; j < 8; j++)
-                {
-                    const float dist =
-                        getCorner(bb, j).X * g_frustums[dc_type][i] +
-                        getCorner(bb, j).Y * g_frustums[dc_type][i + 1] +
-                        getCorner(bb, j).Z * g_frustums[dc_type][i + 2] +
-                        g_frustums[dc_type][i + 3];
-                    outside = outside && dist < 0.0f;
-                    if (!outside)
-                    {
-                        break;
-                    }
-                }
-                if (outside)
-                {
-                    discard[dc_type] = true;
-                    break;
-                }
+                const CullingEntry& ce = g_culling_entries[i];
+                core::aabbox3df bb = ce.m_node->getSPM()
+                    ->getSPMeshBuffer(ce.m_mb_id)->getBoundingBox();
+                ce.m_node->getAbsoluteTransformation().transformBoxEx(bb);
+                g_culling->setBox(i, bb);
+            }
+            g_culling->cull(g_frustums, frustum_count, begin, end,
+                g_culling_visible.data());
+            for (unsigned i = begin; i < end; i++)
+            {
+                if (!g_culling_entries[i].m_handle_shadow)
+                    g_culling_visible[i] &= 1;
             }
+        });
+
+    // Serial part 1: GL upload and skinning offsets, instance data
+    // generation below needs the skinning offset
+    SPMeshNode* skinning_node = NULL;
+    SPMeshNode* failed_node = NULL;
+    for (unsigned i = 0; i < count; i++)
+    {
+        const CullingEntry& ce = g_culling_entries[i];
+        if (g_culling_visible[i] == 0)
+        {
+            continue;
         }
-        if (handle_shadow ?
-            (discard[0] && discard[1] && discard[2] && discard[3] &&
-            discard[4]) : discard[0])
+        if (ce.m_node == failed_node)
         {
+            g_culling_visible[i] = 0;
             continue;
         }
-
-        if (irr_driver->getBoundingBoxesViz())
+        SPMeshBuffer* mb = ce.m_node->getSPM()->getSPMeshBuffer(ce.m_mb_id);
+        if (bb_viz)
         {
+            core::aabbox3df bb = mb->getBoundingBox();
+            ce.m_node->getAbsoluteTransformation().transformBoxEx(bb);
             addEdgeForViz(getCorner(bb, 0), getCorner(bb, 1));
             addEdgeForViz(getCorner(bb, 1), getCorner(bb, 5));
             addEdgeForViz(getCorner(bb, 5), getCorner(bb, 4));
@@ -865,99 +926,139 @@ void addObject(SPMeshNode* node)
 
         mb->uploadGLMesh();
         // For first frame only need the vbo to be initialized
-        if (!added_for_skinning && node->getAnimationState())
+        if (skinning_node != ce.m_node && ce.m_node->getAnimationState())
         {
-            added_for_skinning = true;
-            int skinning_offset = g_skinning_offset + node->getTotalJoints();
+            skinning_node = ce.m_node;
+            int skinning_offset =
+                g_skinning_offset + ce.m_node->getTotalJoints();
             if (skinning_offset > int(stk_config->m_max_skinning_bones))
             {
                 Log::error("SPBase", "No enough space to render skinned"
                     " mesh %s! Max joints can hold: %d",
-                    node->getName(), stk_config->m_max_skinning_bones);
-                return;
+                    ce.m_node->getName(), stk_config->m_max_skinning_bones);
+                failed_node = ce.m_node;
+                g_culling_visible[i] = 0;
+                continue;
             }
-            node->setSkinningOffset(g_skinning_offset);
-            g_skinning_mesh.push_back(node);
+            ce.m_node->setSkinningOffset(g_skinning_offset);
+            g_skinning_mesh.push_back(ce.m_node);
             g_skinning_offset = skinning_offset;
         }
+    }
 
-        float hue = node->getRenderInfo(m) ?
-            node->getRenderInfo(m)->getHue() : 0.0f;
-        SPInstancedData id = SPInstancedData
-            (node->getAbsoluteTransformation(), node->getTextureMatrix(m)[0],
-            node->getTextureMatrix(m)[1], hue,
-            (short)node->getSkinningOffset());
-
-        for (int dc_type = 0; dc_type < (handle_shadow ? 5 : 1); dc_type++)
+    const unsigned chunk_count =
+        (count + CULLING_CHUNK_SIZE - 1) / CULLING_CHUNK_SIZE;
+    if (g_culling_instances.size() < chunk_count)
+    {
+        g_culling_instances.resize(chunk_count);
+    }
+    g_culling->parallelFor(count, CULLING_CHUNK_SIZE,
+        [](unsigned chunk, unsigned begin, unsigned end)
         {
-            if (discard[dc_type])
-            {
-                continue;
-            }
-            if (dc_type == 0)
-            {
-                sp_solid_poly_count += mb->getIndexCount() / 3;
-            }
-            else
+            auto& instances = g_culling_instances[chunk];
+            instances.clear();
+            for (unsigned i = begin; i < end; i++)
             {
-                sp_shadow_poly_count += mb->getIndexCount() / 3;
+                if (g_culling_visible[i] == 0)
+                {
+                    continue;
+                }
+                const CullingEntry& ce = g_culling_entries[i];
+                SPMeshNode* node = ce.m_node;
+                const unsigned m = ce.m_mb_id;
+                float hue = node->getRenderInfo(m) ?
+                    node->getRenderInfo(m)->getHue() : 0.0f;
+                instances.emplace_back(i, SPInstancedData
+                    (node->getAbsoluteTransformation(),
+                    node->getTextureMatrix(m)[0],
+                    node->getTextureMatrix(m)[1], hue,
+                    (short)node->getSkinningOffset()));
             }
-            if (shader->isTransparent())
+        });
+
+    // Serial part 2: merge into draw calls in the order of objects added
+    for (unsigned chunk = 0; chunk < chunk_count; chunk++)
+    {
+        for (auto& inst : g_culling_instances[chunk])
+        {
+            const CullingEntry& ce = g_culling_entries[inst.first];
+            const SPInstancedData& id = inst.second;
+            SPMeshNode* node = ce.m_node;
+            SPShader* shader = ce.m_shader;
+            SPMeshBuffer* mb = node->getSPM()->getSPMeshBuffer(ce.m_mb_id);
+            for (int dc_type = 0; dc_type < (ce.m_handle_shadow ? 5 : 1);
+                dc_type++)
             {
-                // Transparent shader should always uses mesh samplers
-                // All transparent draw calls go DCT_TRANSPARENT
+                if ((g_culling_visible[inst.first] & (1 << dc_type)) == 0)
+                {
+                    continue;
+                }
                 if (dc_type == 0)
                 {
-                    auto& ret = g_draw_calls[DCT_TRANSPARENT][shader];
-                    for (auto& p : mb->getTextureCompare())
-                    {
-                        ret[p.first].insert(mb);
-                    }
-                    mb->addInstanceData(id, DCT_TRANSPARENT);
+                    sp_solid_poly_count += mb->getIndexCount() / 3;
                 }
                 else
                 {
-                    continue;
+                    sp_shadow_poly_count += mb->getIndexCount() / 3;
                 }
-            }
-            else
-            {
-                // Check if shader for render pass uses mesh samplers
-                const RenderPass check_pass =
-                    dc_type == DCT_NORMAL ? RP_1ST : RP_SHADOW;
-                const bool sampler_less = shader->samplerLess(check_pass);
-                auto& ret = g_draw_calls[dc_type][shader];
-                if (sampler_less)
+                if (shader->isTransparent())
                 {
-                    ret[""].insert(mb);
+                    // Transparent shader should always uses mesh samplers
+                    // All transparent draw calls go DCT_TRANSPARENT
+                    if (dc_type == 0)
+                    {
+                        auto& ret = g_draw_calls[DCT_TRANSPARENT][shader];
+                        for (auto& p : mb->getTextureCompare())
+                        {
+                            ret[p.first].insert(mb);
+                        }
+                        mb->addInstanceData(id, DCT_TRANSPARENT);
+                    }
+                    else
+                    {
+                        continue;
+                    }
                 }
                 else
                 {
-                    for (auto& p : mb->getTextureCompare())
+                    // Check if shader for render pass uses mesh samplers
+                    const RenderPass check_pass =
+                        dc_type == DCT_NORMAL ? RP_1ST : RP_SHADOW;
+                    const bool sampler_less = shader->samplerLess(check_pass);
+                    auto& ret = g_draw_calls[dc_type][shader];
+                    if (sampler_less)
                     {
-                        ret[p.first].insert(mb);
+                        ret[""].insert(mb);
                     }
-                }
-                mb->addInstanceData(id, (DrawCallType)dc_type);
-                if (UserConfigParams::m_glow && node->hasGlowColor() &&
-                    CVS->isDeferredEnabled() && dc_type == DCT_NORMAL)
-                {
-                    video::SColorf gc = node->getGlowColor();
-                    unsigned key = gc.toSColor().color;
-                    auto ret = g_glow_meshes.find(key);
-                    if (ret == g_glow_meshes.end())
+                    else
                     {
-                        g_glow_meshes[key] = std::make_pair(
-                            core::vector3df(gc.r, gc.g, gc.b),
-                            std::unordered_set<SPMeshBuffer*>());
+                        for (auto& p : mb->getTextureCompare())
+                        {
+                            ret[p.first].insert(mb);
+                        }
+                    }
+                    mb->addInstanceData(id, (DrawCallType)dc_type);
+                    if (UserConfigParams::m_glow && node->hasGlowColor() &&
+                        CVS->isDeferredEnabled() && dc_type == DCT_NORMAL)
+                    {
+                        video::SColorf gc = node->getGlowColor();
+                        unsigned key = gc.toSColor().color;
+                        auto ret = g_glow_meshes.find(key);
+                        if (ret == g_glow_meshes.end())
+                        {
+                            g_glow_meshes[key] = std::make_pair(
+                                core::vector3df(gc.r, gc.g, gc.b),
+                                std::unordered_set<SPMeshBuffer*>());
+                        }
+                        g_glow_meshes.at(key).second.insert(mb);
                     }
-                    g_glow_meshes.at(key).second.insert(mb);
                 }
+                g_instances.insert(mb);
             }
-            g_instances.insert(mb);
         }
     }
-}
+    g_culling_entries.clear();
+}   // cullObjects
 
 // ----------------------------------------------------------------------------
 void handleDynamicDrawCall()
@@ -1311,7 +1412,7 @@ void draw(RenderPass rp, DrawCallType dct)
 {
     std::stringstream profiler_name;
     profiler_name << "SP::Draw " << dct << " with " << rp;
-    PROFILER_PUSH_CPU_MARKER(profiler_name.str().c_str(),
+    PROFILER_PUSH_DYNAMIC_CPU_MARKER(profiler_name.str().c_str(),
         (uint8_t)(float(dct + rp + 2) / float(DCT_FOR_VAO + RP_COUNT) * 255.0f),
         (uint8_t)(float(dct + 1) / (float)DCT_FOR_VAO * 255.0f) ,
         (uint8_t)(float(rp + 1) / (float)RP_COUNT * 255.0f));
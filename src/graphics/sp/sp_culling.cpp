@@ -0,0 +1,265 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "graphics/sp/sp_culling.hpp"
+#include "utils/log.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <random>
+
+#if __SSE2__ || _M_X64 || _M_IX86_FP >= 2
+ #include <emmintrin.h>
+ #define SIMD_SSE2_SUPPORT (1)
+#endif
+
+namespace SP
+{
+// ----------------------------------------------------------------------------
+SPCulling::SPCulling(unsigned worker_count)
+         : m_pool(worker_count, "SPCull")
+{
+}   // SPCulling
+
+// ----------------------------------------------------------------------------
+/** Splits [0, count) into chunks of chunk_size items and runs the job for
+ *  each of them on the worker threads and the calling thread. Returns when
+ *  all chunks are done. Chunk ids are increasing with the item indices, so
+ *  per-chunk results can be merged in a deterministic order.
+ *  \param count Number of items.
+ *  \param chunk_size Items per chunk.
+ *  \param job Function called with chunk id, first and one-past-last item.
+ */
+void SPCulling::parallelFor(unsigned count, unsigned chunk_size,
+                            const std::function<void(unsigned, unsigned,
+                            unsigned)>& job)
+{
+    assert(chunk_size > 0);
+    if (count == 0)
+        return;
+    const unsigned chunk_count = (count + chunk_size - 1) / chunk_size;
+    m_pool.parallelFor(chunk_count, [chunk_size, count, &job]
+        (unsigned chunk, unsigned /*thread*/)
+        {
+            const unsigned begin = chunk * chunk_size;
+            job(chunk, begin, std::min(begin + chunk_size, count));
+        });
+}   // parallelFor
+
+// ----------------------------------------------------------------------------
+/** Reference test of a box against 6 planes by checking all 8 corners, the
+ *  box is outside if all corners are behind any plane. */
+bool SPCulling::isOutside(const float* frustum, const core::aabbox3df& bb)
+{
+    core::vector3df edges[8];
+    for (int j = 0; j < 8; j++)
+    {
+        edges[j].X = (j & 1) ? bb.MaxEdge.X : bb.MinEdge.X;
+        edges[j].Y = (j & 2) ? bb.MaxEdge.Y : bb.MinEdge.Y;
+        edges[j].Z = (j & 4) ? bb.MaxEdge.Z : bb.MinEdge.Z;
+    }
+    for (int i = 0; i < 24; i += 4)
+    {
+        bool outside = true;
+        for (int j = 0; j < 8; j++)
+        {
+            const float dist = edges[j].X * frustum[i] +
+                edges[j].Y * frustum[i + 1] + edges[j].Z * frustum[i + 2] +
+                frustum[i + 3];
+            outside = outside && dist < 0.0f;
+            if (!outside)
+                break;
+        }
+        if (outside)
+            return true;
+    }
+    return false;
+}   // isOutside
+
+// ----------------------------------------------------------------------------
+/** Tests boxes [begin, end) against frustum_count (at most 8) frustums.
+ *  Instead of all 8 corners only the corner furthest along each plane
+ *  normal is tested. The per-axis terms are summed in the same order as
+ *  \ref isOutside, and floating point addition is monotonic, so the result
+ *  is identical to testing every corner.
+ *  \param visible For each box one byte, bit n set if inside frustum n.
+ */
+void SPCulling::cull(const float (*frustums)[24], unsigned frustum_count,
+                     unsigned begin, unsigned end, uint8_t* visible) const
+{
+    assert(frustum_count <= 8);
+    assert(end <= size());
+    unsigned i = begin;
+#ifdef SIMD_SSE2_SUPPORT
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= end; i += 4)
+    {
+        const __m128 min_x = _mm_loadu_ps(&m_min_x[i]);
+        const __m128 min_y = _mm_loadu_ps(&m_min_y[i]);
+        const __m128 min_z = _mm_loadu_ps(&m_min_z[i]);
+        const __m128 max_x = _mm_loadu_ps(&m_max_x[i]);
+        const __m128 max_y = _mm_loadu_ps(&m_max_y[i]);
+        const __m128 max_z = _mm_loadu_ps(&m_max_z[i]);
+        uint8_t result[4] = {};
+        for (unsigned f = 0; f < frustum_count; f++)
+        {
+            __m128 outside = _mm_setzero_ps();
+            for (int p = 0; p < 24; p += 4)
+            {
+                const __m128 a = _mm_set1_ps(frustums[f][p]);
+                const __m128 b = _mm_set1_ps(frustums[f][p + 1]);
+                const __m128 c = _mm_set1_ps(frustums[f][p + 2]);
+                const __m128 d = _mm_set1_ps(frustums[f][p + 3]);
+                const __m128 tx =
+                    _mm_max_ps(_mm_mul_ps(min_x, a), _mm_mul_ps(max_x, a));
+                const __m128 ty =
+                    _mm_max_ps(_mm_mul_ps(min_y, b), _mm_mul_ps(max_y, b));
+                const __m128 tz =
+                    _mm_max_ps(_mm_mul_ps(min_z, c), _mm_mul_ps(max_z, c));
+                const __m128 dist =
+                    _mm_add_ps(_mm_add_ps(_mm_add_ps(tx, ty), tz), d);
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, zero));
+            }
+            const int mask = _mm_movemask_ps(outside);
+            for (int j = 0; j < 4; j++)
+            {
+                if ((mask & (1 << j)) == 0)
+                    result[j] |= (uint8_t)(1 << f);
+            }
+        }
+        for (int j = 0; j < 4; j++)
+            visible[i + j] = result[j];
+    }
+#endif
+    for (; i < end; i++)
+    {
+        uint8_t result = 0;
+        for (unsigned f = 0; f < frustum_count; f++)
+        {
+            bool outside = false;
+            for (int p = 0; p < 24 && !outside; p += 4)
+            {
+                const float a = frustums[f][p];
+                const float b = frustums[f][p + 1];
+                const float c = frustums[f][p + 2];
+                const float tx = std::max(m_min_x[i] * a, m_max_x[i] * a);
+                const float ty = std::max(m_min_y[i] * b, m_max_y[i] * b);
+                const float tz = std::max(m_min_z[i] * c, m_max_z[i] * c);
+                const float dist = tx + ty + tz + frustums[f][p + 3];
+                outside = dist < 0.0f;
+            }
+            if (!outside)
+                result |= (uint8_t)(1 << f);
+        }
+        visible[i] = result;
+    }
+}   // cull
+
+// ----------------------------------------------------------------------------
+void SPCulling::unitTesting()
+{
+    std::mt19937 rg(1234);
+    std::uniform_real_distribution<float> pos(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> extent(0.0f, 20.0f);
+    std::uniform_real_distribution<float> normal(-1.0f, 1.0f);
+
+    // Frustum 0: axis aligned cube of size 40 around the origin
+    float frustums[5][24] =
+    {
+        {
+             1.0f,  0.0f,  0.0f, 20.0f,
+            -1.0f,  0.0f,  0.0f, 20.0f,
+             0.0f,  1.0f,  0.0f, 20.0f,
+             0.0f, -1.0f,  0.0f, 20.0f,
+             0.0f,  0.0f,  1.0f, 20.0f,
+             0.0f,  0.0f, -1.0f, 20.0f
+        }
+    };
+    // Others: random planes
+    for (int f = 1; f < 5; f++)
+    {
+        for (int p = 0; p < 24; p += 4)
+        {
+            core::vector3df n(normal(rg), normal(rg), normal(rg));
+            n.normalize();
+            frustums[f][p] = n.X;
+            frustums[f][p + 1] = n.Y;
+            frustums[f][p + 2] = n.Z;
+            frustums[f][p + 3] = 60.0f;
+        }
+    }
+
+    // Odd count to test the non-SIMD tail too
+    const unsigned count = 1001;
+    SPCulling culling(2);
+    culling.resize(count);
+    std::vector<core::aabbox3df> boxes;
+    for (unsigned i = 0; i < count; i++)
+    {
+        core::vector3df min(pos(rg), pos(rg), pos(rg));
+        core::aabbox3df bb(min, min + core::vector3df(extent(rg),
+            extent(rg), extent(rg)));
+        boxes.push_back(bb);
+        culling.setBox(i, bb);
+    }
+    // Box touching a plane exactly is inside
+    boxes[0] = core::aabbox3df(core::vector3df(20.0f, 0.0f, 0.0f),
+        core::vector3df(30.0f, 1.0f, 1.0f));
+    culling.setBox(0, boxes[0]);
+    assert(!isOutside(frustums[0], boxes[0]));
+    boxes[1] = core::aabbox3df(core::vector3df(20.001f, 0.0f, 0.0f),
+        core::vector3df(30.0f, 1.0f, 1.0f));
+    culling.setBox(1, boxes[1]);
+    assert(isOutside(frustums[0], boxes[1]));
+
+    std::vector<uint8_t> visible(count, 0xff);
+    culling.cull(frustums, 5, 0, count, visible.data());
+    unsigned inside_count = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        for (unsigned f = 0; f < 5; f++)
+        {
+            const bool inside = (visible[i] & (1 << f)) != 0;
+            assert(inside == !isOutside(frustums[f], boxes[i]));
+            if (inside && f == 0)
+                inside_count++;
+        }
+        assert((visible[i] & 0xe0) == 0);
+    }
+    // Make sure the test covers both results
+    assert(inside_count > 0 && inside_count < count);
+
+    // Chunked in parallel with unaligned chunk size must give the same
+    std::vector<uint8_t> visible_mt(count, 0xff);
+    std::vector<unsigned> chunk_sum((count + 6) / 7, 0);
+    culling.parallelFor(count, 7, [&](unsigned chunk, unsigned begin,
+                                     unsigned end)
+        {
+            culling.cull(frustums, 5, begin, end, visible_mt.data());
+            for (unsigned i = begin; i < end; i++)
+                chunk_sum[chunk] += i;
+        });
+    assert(visible == visible_mt);
+    unsigned total = 0;
+    for (unsigned sum : chunk_sum)
+        total += sum;
+    assert(total == count * (count - 1) / 2);
+    Log::info("SPCulling::unitTesting", "%d of %d boxes inside.",
+        inside_count, count);
+}   // unitTesting
+
+}
@@ -0,0 +1,100 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SP_CULLING_HPP
+#define HEADER_SP_CULLING_HPP
+
+#include "utils/no_copy.hpp"
+#include "utils/worker_pool.hpp"
+
+#include "aabbox3d.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+using namespace irr;
+
+namespace SP
+{
+
+/** Frustum culling of a flat (structure of arrays) list of axis aligned
+ *  bounding boxes. Each box is tested against up to 8 frustums (6 planes
+ *  of 4 floats each, as computed in sp_base.cpp), the result is a bitmask
+ *  per box with bit n set if the box is (partially) inside frustum n.
+ *  4 boxes are tested at once with SSE if available. Nothing here uses
+ *  OpenGL, so it can be used (and unit tested) without a GPU.
+ *  It also owns a small pool of worker threads so that the callers can
+ *  split the culling (and any per object work) into chunks. */
+class SPCulling : public NoCopy
+{
+private:
+    std::vector<float> m_min_x, m_min_y, m_min_z;
+
+    std::vector<float> m_max_x, m_max_y, m_max_z;
+
+    /** Worker threads, the calling thread of \ref parallelFor always works
+     *  on chunks too. */
+    WorkerPool m_pool;
+
+public:
+    // ------------------------------------------------------------------------
+    SPCulling(unsigned worker_count);
+    // ------------------------------------------------------------------------
+    /** Resizes the box arrays, content of new boxes is undefined until
+     *  \ref setBox is called. */
+    void resize(unsigned count)
+    {
+        m_min_x.resize(count);
+        m_min_y.resize(count);
+        m_min_z.resize(count);
+        m_max_x.resize(count);
+        m_max_y.resize(count);
+        m_max_z.resize(count);
+    }
+    // ------------------------------------------------------------------------
+    unsigned size() const                  { return (unsigned)m_min_x.size(); }
+    // ------------------------------------------------------------------------
+    /** Different indices can be set from different threads at once. */
+    void setBox(unsigned i, const core::aabbox3df& bb)
+    {
+        m_min_x[i] = bb.MinEdge.X;
+        m_min_y[i] = bb.MinEdge.Y;
+        m_min_z[i] = bb.MinEdge.Z;
+        m_max_x[i] = bb.MaxEdge.X;
+        m_max_y[i] = bb.MaxEdge.Y;
+        m_max_z[i] = bb.MaxEdge.Z;
+    }
+    // ------------------------------------------------------------------------
+    void cull(const float (*frustums)[24], unsigned frustum_count,
+              unsigned begin, unsigned end, uint8_t* visible) const;
+    // ------------------------------------------------------------------------
+    unsigned getWorkerCount() const       { return m_pool.getWorkerCount(); }
+    // ------------------------------------------------------------------------
+    void parallelFor(unsigned count, unsigned chunk_size,
+                     const std::function<void(unsigned /*chunk_id*/,
+                     unsigned /*begin*/, unsigned /*end*/)>& job);
+    // ------------------------------------------------------------------------
+    static bool isOutside(const float* frustum, const core::aabbox3df& bb);
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // SPCulling
+
+}
+
+#endif
@@ -46,6 +46,11 @@ extern "C"
 
 #include <numeric>
 
+#if __SSE2__ || _M_X64 || _M_IX86_FP >= 2
+ #include <emmintrin.h>
+ #define SIMD_SSE2_SUPPORT (1)
+#endif
+
 #if !defined(ANDROID)
 static const uint8_t CACHE_VERSION = 1;
 #endif
@@ -78,6 +83,13 @@ SPTexture::SPTexture(const std::string& path, Material* m, bool undo_srgb,
         cache_subdir = StringUtils::insertValues("resized_%i",
             (int)UserConfigParams::m_max_texture_size);
     }
+    // The mipmaps are part of the cache, and compressTexture uses the box
+    // filter without high quality mipmaps (caches written before had high
+    // quality mipmaps only, so they keep their directory)
+    if (!UserConfigParams::m_hq_mipmap)
+    {
+        cache_subdir += "-box-mipmap";
+    }
     
 #ifdef USE_GLES2
     if (m_undo_srgb && !CVS->isEXTTextureCompressionS3TCSRGBUsable())
@@ -657,25 +669,72 @@ void SPTexture::applyMask(video::IImage* texture, video::IImage* mask)
 }   // applyMask
 
 // ----------------------------------------------------------------------------
-void SPTexture::generateQuickMipmap(std::shared_ptr<video::IImage> first_image,
+/** Generates mipmap levels 1 and above with a 2x2 box filter, each level is
+ *  downsampled from the previous one and written straight into out (which
+ *  has the same layout as generateHQMipmap output).
+ *  \param in RGBA8 data of mipmap level 0.
+ */
+void SPTexture::generateQuickMipmap(const uint8_t* in,
                                     const std::vector<std::pair
                                     <core::dimension2du, unsigned> >& mms,
                                     uint8_t* out)
 {
-#ifndef SERVER_ONLY
+    const uint8_t* src = in;
     for (unsigned mip = 1; mip < mms.size(); mip++)
     {
-        video::IImage* ti = irr_driver->getVideoDriver()
-            ->createImage(video::ECF_A8R8G8B8,
-            core::dimension2du(mms[mip].first.Width,
-            mms[mip].first.Height));
-        first_image->copyToScaling(ti);
-        const unsigned copy_size = ti->getDimension().getArea() * 4;
-        memcpy(out, ti->lock(), copy_size);
-        ti->drop();
-        out += copy_size;
-    }
+        const unsigned src_w = mms[mip - 1].first.Width;
+        const unsigned src_h = mms[mip - 1].first.Height;
+        const unsigned dst_w = mms[mip].first.Width;
+        const unsigned dst_h = mms[mip].first.Height;
+        for (unsigned y = 0; y < dst_h; y++)
+        {
+            // Rows / columns are repeated if that dimension is already 1
+            const uint8_t* row0 = src + (y * 2 < src_h ? y * 2 : 0) *
+                src_w * 4;
+            const uint8_t* row1 = src + (y * 2 + 1 < src_h ? y * 2 + 1 :
+                src_h - 1) * src_w * 4;
+            uint8_t* dst = out + y * dst_w * 4;
+            unsigned x = 0;
+#ifdef SIMD_SSE2_SUPPORT
+            if (src_w == dst_w * 2)
+            {
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i two = _mm_set1_epi16(2);
+                for (; x + 2 <= dst_w; x += 2)
+                {
+                    // 4 source pixels of both rows give 2 destination ones
+                    __m128i r0 = _mm_loadu_si128((const __m128i*)
+                        (row0 + x * 8));
+                    __m128i r1 = _mm_loadu_si128((const __m128i*)
+                        (row1 + x * 8));
+                    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(r0, zero),
+                        _mm_unpacklo_epi8(r1, zero));
+                    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(r0, zero),
+                        _mm_unpackhi_epi8(r1, zero));
+                    __m128i sum = _mm_add_epi16(
+                        _mm_unpacklo_epi64(lo, hi),
+                        _mm_unpackhi_epi64(lo, hi));
+                    sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+                    _mm_storel_epi64((__m128i*)(dst + x * 4),
+                        _mm_packus_epi16(sum, zero));
+                }
+            }
 #endif
+            for (; x < dst_w; x++)
+            {
+                const unsigned x0 = x * 2 < src_w ? x * 2 : 0;
+                const unsigned x1 = x * 2 + 1 < src_w ? x * 2 + 1 : src_w - 1;
+                for (unsigned c = 0; c < 4; c++)
+                {
+                    dst[x * 4 + c] = uint8_t((row0[x0 * 4 + c] +
+                        row0[x1 * 4 + c] + row1[x0 * 4 + c] +
+                        row1[x1 * 4 + c] + 2) >> 2);
+                }
+            }
+        }
+        src = out;
+        out += dst_w * dst_h * 4;
+    }
 }   // generateQuickMipmap
 
 // ----------------------------------------------------------------------------
@@ -713,51 +772,117 @@ void SPTexture::generateHQMipmap(void* in,
 }   // generateHQMipmap
 
 // ----------------------------------------------------------------------------
-void SPTexture::squishCompressImage(uint8_t* rgba, int width, int height,
-                                    int pitch, void* blocks, unsigned flags)
+/** Compresses one row of 4x4 blocks starting at pixel row y. */
+void SPTexture::squishCompressBlockRow(uint8_t* rgba, int width, int height,
+                                       int pitch, int y, void* blocks,
+                                       unsigned flags)
 {
 #if !(defined(SERVER_ONLY) || defined(ANDROID))
     // This function is copied from CompressImage in libsquish to avoid omp
     // if enabled by shared libsquish, because we are already using
     // multiple thread
-    for (int y = 0; y < height; y += 4)
+
+    // initialise the block output
+    uint8_t* target_block = reinterpret_cast<uint8_t*>(blocks);
+    target_block += ((y >> 2) * ((width + 3) >> 2)) * 16;
+    for (int x = 0; x < width; x += 4)
     {
-        // initialise the block output
-        uint8_t* target_block = reinterpret_cast<uint8_t*>(blocks);
-        target_block += ((y >> 2) * ((width + 3) >> 2)) * 16;
-        for (int x = 0; x < width; x += 4)
+        // build the 4x4 block of pixels
+        uint8_t source_rgba[16 * 4];
+        uint8_t* target_pixel = source_rgba;
+        int mask = 0;
+        for (int py = 0; py < 4; py++)
         {
-            // build the 4x4 block of pixels
-            uint8_t source_rgba[16 * 4];
-            uint8_t* target_pixel = source_rgba;
-            int mask = 0;
-            for (int py = 0; py < 4; py++)
+            for (int px = 0; px < 4; px++)
             {
-                for (int px = 0; px < 4; px++)
+                // get the source pixel in the image
+                int sx = x + px;
+                int sy = y + py;
+                // enable if we're in the image
+                if (sx < width && sy < height)
                 {
-                    // get the source pixel in the image
-                    int sx = x + px;
-                    int sy = y + py;
-                    // enable if we're in the image
-                    if (sx < width && sy < height)
-                    {
-                        // copy the rgba value
-                        uint8_t* source_pixel = rgba + pitch * sy + 4 * sx;
-                        memcpy(target_pixel, source_pixel, 4);
-                        // enable this pixel
-                        mask |= (1 << (4 * py + px));
-                    }
-                    // advance to the next pixel
-                    target_pixel += 4;
+                    // copy the rgba value
+                    uint8_t* source_pixel = rgba + pitch * sy + 4 * sx;
+                    memcpy(target_pixel, source_pixel, 4);
+                    // enable this pixel
+                    mask |= (1 << (4 * py + px));
                 }
+                // advance to the next pixel
+                target_pixel += 4;
             }
-            // compress it into the output
-            squish::CompressMasked(source_rgba, mask, target_block, flags);
-            // advance
-            target_block += 16;
         }
+        // compress it into the output
+        squish::CompressMasked(source_rgba, mask, target_block, flags);
+        // advance
+        target_block += 16;
     }
 #endif
+}   // squishCompressBlockRow
+
+// ----------------------------------------------------------------------------
+/** Compresses an image, large images are split into rows of blocks which
+ *  idle threads of SPTextureManager help with. This is called from a
+ *  texture manager thread itself, so it never waits for rows which are not
+ *  being compressed already, otherwise all threads could end up waiting for
+ *  each other.
+ */
+void SPTexture::squishCompressImage(uint8_t* rgba, int width, int height,
+                                    int pitch, void* blocks, unsigned flags)
+{
+#if !(defined(SERVER_ONLY) || defined(ANDROID))
+    const int block_rows = (height + 3) >> 2;
+    const int block_count = block_rows * ((width + 3) >> 2);
+    const int helpers = std::min(block_rows,
+        (int)SPTextureManager::get()->getThreadCount()) - 1;
+    // Not worth it for small mipmaps
+    if (block_count < 1024 || helpers < 1)
+    {
+        for (int y = 0; y < height; y += 4)
+        {
+            squishCompressBlockRow(rgba, width, height, pitch, y, blocks,
+                flags);
+        }
+        return;
+    }
+
+    struct RowState
+    {
+        std::atomic<int> m_next_row, m_finished_rows;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+    };
+    // Helpers may start after all rows are done and this function returned,
+    // so the state is shared and the image pointers are only used after
+    // claiming a row
+    std::shared_ptr<RowState> state = std::make_shared<RowState>();
+    state->m_next_row.store(0);
+    state->m_finished_rows.store(0);
+    std::function<bool()> compress_rows =
+        [state, rgba, width, height, pitch, blocks, flags, block_rows]()
+        {
+            while (true)
+            {
+                const int row = state->m_next_row.fetch_add(1);
+                if (row >= block_rows)
+                    return true;
+                squishCompressBlockRow(rgba, width, height, pitch, row * 4,
+                    blocks, flags);
+                if (state->m_finished_rows.fetch_add(1) + 1 == block_rows)
+                {
+                    std::lock_guard<std::mutex> lock(state->m_mutex);
+                    state->m_cv.notify_all();
+                }
+            }
+        };
+    for (int i = 0; i < helpers; i++)
+        SPTextureManager::get()->addThreadedFunction(compress_rows);
+    compress_rows();
+    std::unique_lock<std::mutex> ul(state->m_mutex);
+    state->m_cv.wait(ul, [state, block_rows]
+        {
+            return state->m_finished_rows.load() == block_rows;
+        });
+#endif
 }   // squishCompressImage
 
 // ----------------------------------------------------------------------------
@@ -789,7 +914,14 @@ std::vector<std::pair<core::dimension2du, unsigned> >
     uint8_t* tmp = new uint8_t[image->getDimension().getArea() * 4]();
     uint8_t* ptr_loc = tmp + compressed_size;
 
-    generateHQMipmap(image->lock(), mipmap_sizes, ptr_loc);
+    if (UserConfigParams::m_hq_mipmap)
+    {
+        generateHQMipmap(image->lock(), mipmap_sizes, ptr_loc);
+    }
+    else
+    {
+        generateQuickMipmap((uint8_t*)image->lock(), mipmap_sizes, ptr_loc);
+    }
     squishCompressImage((uint8_t*)image->lock(),
         mipmap_sizes[0].first.Width, mipmap_sizes[0].first.Height,
         mipmap_sizes[0].first.Width * 4, tmp, tc_flag);
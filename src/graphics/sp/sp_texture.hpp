@@ -58,6 +58,10 @@ private:
 
     const bool m_undo_srgb;
 
+    // ------------------------------------------------------------------------
+    static void squishCompressBlockRow(uint8_t* rgba, int width, int height,
+                                       int pitch, int y, void* blocks,
+                                       unsigned flags);
     // ------------------------------------------------------------------------
     void squishCompressImage(uint8_t* rgba, int width, int height, int pitch,
                              void* blocks, unsigned flags);
@@ -66,7 +70,7 @@ private:
                           const std::vector<std::pair<core::dimension2du,
                           unsigned> >&, uint8_t* out);
     // ------------------------------------------------------------------------
-    void generateQuickMipmap(std::shared_ptr<video::IImage> first_image,
+    void generateQuickMipmap(const uint8_t* in,
                              const std::vector<std::pair<core::dimension2du,
                              unsigned> >&, uint8_t* out);
     // ------------------------------------------------------------------------
@@ -19,12 +19,18 @@
 
 #include "graphics/sp/sp_texture_manager.hpp"
 #include "graphics/sp/sp_base.hpp"
+#include "graphics/sp/sp_shader.hpp"
+#include "graphics/sp/sp_shader_manager.hpp"
 #include "graphics/sp/sp_texture.hpp"
 #include "graphics/central_settings.hpp"
 #include "graphics/irr_driver.hpp"
+#include "graphics/material.hpp"
+#include "graphics/material_manager.hpp"
+#include "io/file_manager.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/vs.hpp"
 
+#include <set>
 #include <string>
 
 namespace SP
@@ -34,7 +40,7 @@ SPTextureManager* SPTextureManager::m_sptm = NULL;
 SPTextureManager::SPTextureManager()
                 : m_max_threaded_load_obj
                   ((unsigned)std::thread::hardware_concurrency()),
-                  m_gl_cmd_function_count(0)
+                  m_gl_cmd_function_count(0), m_threaded_function_count(0)
 {
     if (m_max_threaded_load_obj.load() == 0)
     {
@@ -68,6 +74,7 @@ SPTextureManager::SPTextureManager()
                     {
                         addThreadedFunction(copied);
                     }
+                    m_threaded_function_count.fetch_sub(1);
                 }
             });
     }
@@ -230,6 +237,97 @@ core::stringw SPTextureManager::reloadTexture(const core::stringw& name)
     return result + "reloaded.";
 }   // reloadTexture
 
+// ----------------------------------------------------------------------------
+/** Waits until all queued threaded functions (including the ones they queue
+ *  themselves, like saving of texture cache) are done, while running GL
+ *  commands they add.
+ */
+void SPTextureManager::waitForThreadedFunctions()
+{
+    while (m_threaded_function_count.load() != 0)
+    {
+        checkForGLCommand();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    checkForGLCommand(true/*before_scene*/);
+}   // waitForThreadedFunctions
+
+// ----------------------------------------------------------------------------
+/** Compresses all textures in a kart or track directory and saves them in
+ *  the texture cache, without loading any model. Used by
+ *  --prepare-texture-cache so that the first start is as fast as later ones.
+ *  \param dir Directory with the textures, ending with "/".
+ *  \param container_id Same as used when loading that kart or track, like
+ *         "tracks/<ident>".
+ */
+void SPTextureManager::prepareTextureCache(const std::string& dir,
+                                           const std::string& container_id)
+{
+#ifndef SERVER_ONLY
+    if (!CVS->isTextureCompressionEnabled())
+    {
+        return;
+    }
+    file_manager->pushTextureSearchPath(dir, container_id);
+    SPShaderManager::get()->loadSPShaders(dir);
+    const bool has_materials =
+        file_manager->fileExists(dir + "materials.xml");
+    if (has_materials)
+    {
+        material_manager->pushTempMaterial(dir + "materials.xml");
+    }
+
+    std::set<std::string> files;
+    file_manager->listFiles(files, dir);
+    std::vector<std::shared_ptr<SPTexture> > textures;
+    std::set<std::string> loaded;
+    for (const std::string& file : files)
+    {
+        const std::string ext =
+            StringUtils::toLowerCase(StringUtils::getExtension(file));
+        if (ext != "png" && ext != "jpg" && ext != "jpeg")
+        {
+            continue;
+        }
+        Material* m = material_manager->getMaterialSPM(file, "");
+        if (m == NULL || m->getContainerId().empty())
+        {
+            continue;
+        }
+        std::shared_ptr<SPShader> sps =
+            SPShaderManager::get()->getSPShader(m->getShaderName());
+        for (unsigned j = 0; j < 6; j++)
+        {
+            const std::string& path = m->getSamplerPath(j);
+            if (path.empty() || path == "unicolor_white" ||
+                (sps && !sps->hasTextureLayer(j)) ||
+                loaded.find(path) != loaded.end())
+            {
+                continue;
+            }
+            loaded.insert(path);
+            std::shared_ptr<SPTexture> t = std::make_shared<SPTexture>(path,
+                j == 0 ? m : NULL,
+                sps ? sps->isSrgbForTextureLayer(j) : j == 0,
+                m->getContainerId());
+            addThreadedFunction(std::bind(&SPTexture::threadedLoad, t));
+            textures.push_back(t);
+        }
+    }
+    waitForThreadedFunctions();
+    Log::info("SPTextureManager", "%d texture(s) cached for %s.",
+        (int)textures.size(), container_id.c_str());
+    textures.clear();
+
+    if (has_materials)
+    {
+        material_manager->popTempMaterial();
+    }
+    file_manager->popTextureSearchPath();
+    SPShaderManager::get()->removeUnusedShaders();
+#endif
+}   // prepareTextureCache
+
 // ----------------------------------------------------------------------------
 }
 
@@ -54,6 +54,9 @@ private:
 
     std::atomic_int m_gl_cmd_function_count;
 
+    /** Threaded functions queued or running. */
+    std::atomic_int m_threaded_function_count;
+
     std::list<std::function<bool()> > m_threaded_functions;
 
     std::list<std::function<bool()> > m_gl_cmd_functions;
@@ -104,10 +107,15 @@ public:
     void addThreadedFunction(std::function<bool()> threaded_function)
     {
         std::lock_guard<std::mutex> lock(m_thread_obj_mutex);
+        m_threaded_function_count.fetch_add(1);
         m_threaded_functions.push_back(threaded_function);
         m_thread_obj_cv.notify_one();
     }
     // ------------------------------------------------------------------------
+    unsigned getThreadCount() const   { return m_max_threaded_load_obj.load(); }
+    // ------------------------------------------------------------------------
+    void waitForThreadedFunctions();
+    // ------------------------------------------------------------------------
     void addGLCommandFunction(std::function<bool()> function)
     {
         std::lock_guard<std::mutex> lock(m_gl_cmd_mutex);
@@ -126,6 +134,9 @@ public:
     void dumpAllTextures();
     // ------------------------------------------------------------------------
     irr::core::stringw reloadTexture(const irr::core::stringw& name);
+    // ------------------------------------------------------------------------
+    void prepareTextureCache(const std::string& dir,
+                             const std::string& container_id);
 
 };
 
@@ -17,22 +17,302 @@
 
 #include "graphics/sp_mesh_loader.hpp"
 
+#include "graphics/sp/sp_animation.hpp"
 #include "graphics/sp/sp_mesh.hpp"
 #include "graphics/sp/sp_mesh_buffer.hpp"
 #include "graphics/central_settings.hpp"
 #include "graphics/material_manager.hpp"
 #include "graphics/stk_tex_manager.hpp"
+#include "io/file_manager.hpp"
 #include "utils/constants.hpp"
 #include "utils/mini_glm.hpp"
+#include "utils/worker_pool.hpp"
 
 #include "../../lib/irrlicht/source/Irrlicht/CSkinnedMesh.h"
 const uint8_t VERSION_NOW = 1;
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <tuple>
 #include <IVideoDriver.h>
 #include <IFileSystem.h>
 
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+// ----------------------------------------------------------------------------
+/** Read only view of a whole spm file. If possible the file is memory
+ *  mapped, otherwise it is read with a single read call. It implements
+ *  IReadFile so that the armatures can read from it, but it is final so the
+ *  many small reads while decoding vertices are inlined memcpys. */
+class SPMeshLoader::SPMFile final : public io::IReadFile
+{
+private:
+    const uint8_t* m_data;
+
+    long m_size;
+
+    long m_pos;
+
+    io::path m_file_name;
+
+    /** Used if the file could not be mapped. */
+    std::vector<uint8_t> m_buffer;
+
+    void* m_mapping;
+
+#ifdef WIN32
+    HANDLE m_file_handle, m_mapping_handle;
+#endif
+
+    // ------------------------------------------------------------------------
+    SPMFile(const io::path& file_name)
+    {
+        m_data = NULL;
+        m_size = 0;
+        m_pos = 0;
+        m_file_name = file_name;
+        m_mapping = NULL;
+#ifdef WIN32
+        m_file_handle = INVALID_HANDLE_VALUE;
+        m_mapping_handle = NULL;
+#endif
+    }   // SPMFile
+    // ------------------------------------------------------------------------
+    /** Maps the file with the given name, returns false if it failed. */
+    bool map(const std::string& path, long expected_size)
+    {
+        if (expected_size <= 0)
+            return false;
+#ifdef WIN32
+        m_file_handle = CreateFileA(path.c_str(), GENERIC_READ,
+            FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+            NULL);
+        if (m_file_handle == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file_handle, &size) ||
+            size.QuadPart != expected_size)
+            return false;
+        m_mapping_handle = CreateFileMappingA(m_file_handle, NULL,
+            PAGE_READONLY, 0, 0, NULL);
+        if (m_mapping_handle == NULL)
+            return false;
+        m_mapping = MapViewOfFile(m_mapping_handle, FILE_MAP_READ, 0, 0, 0);
+        if (m_mapping == NULL)
+            return false;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size != expected_size)
+        {
+            close(fd);
+            return false;
+        }
+        void* mapping = mmap(NULL, (size_t)expected_size, PROT_READ,
+            MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED)
+            return false;
+        m_mapping = mapping;
+#endif
+        m_data = (const uint8_t*)m_mapping;
+        m_size = expected_size;
+        return true;
+    }   // map
+
+public:
+    // ------------------------------------------------------------------------
+    /** Creates a view of the file opened by irrlicht. It is mapped if it is
+     *  a plain file on disk (and not e.g. in an archive). */
+    static SPMFile* create(io::IReadFile* f)
+    {
+        SPMFile* spm = new SPMFile(f->getFileName());
+        const long size = f->getSize();
+        if (f->getPos() == 0 && spm->map(f->getFileName().c_str(), size))
+            return spm;
+        // Read the rest of the file from the current position
+        spm->m_buffer.resize(size > f->getPos() ? size - f->getPos() : 0);
+        const s32 read = spm->m_buffer.empty() ? 0 :
+            f->read(spm->m_buffer.data(), (u32)spm->m_buffer.size());
+        spm->m_buffer.resize(read > 0 ? read : 0);
+        spm->m_data = spm->m_buffer.data();
+        spm->m_size = (long)spm->m_buffer.size();
+        return spm;
+    }   // create
+    // ------------------------------------------------------------------------
+    /** Creates a view of a file on disk, returns NULL if it can't be read. */
+    static SPMFile* create(const std::string& path)
+    {
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (!fp)
+            return NULL;
+        fseek(fp, 0, SEEK_END);
+        const long size = ftell(fp);
+        SPMFile* spm = new SPMFile(path.c_str());
+        if (spm->map(path, size))
+        {
+            fclose(fp);
+            return spm;
+        }
+        fseek(fp, 0, SEEK_SET);
+        spm->m_buffer.resize(size > 0 ? size : 0);
+        if (fread(spm->m_buffer.data(), 1, spm->m_buffer.size(), fp) !=
+            spm->m_buffer.size())
+        {
+            fclose(fp);
+            spm->drop();
+            return NULL;
+        }
+        fclose(fp);
+        spm->m_data = spm->m_buffer.data();
+        spm->m_size = (long)spm->m_buffer.size();
+        return spm;
+    }   // create
+    // ------------------------------------------------------------------------
+    ~SPMFile()
+    {
+#ifdef WIN32
+        if (m_mapping)
+            UnmapViewOfFile(m_mapping);
+        if (m_mapping_handle)
+            CloseHandle(m_mapping_handle);
+        if (m_file_handle != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file_handle);
+#else
+        if (m_mapping)
+            munmap(m_mapping, (size_t)m_size);
+#endif
+    }   // ~SPMFile
+    // ------------------------------------------------------------------------
+    /** Reads are clamped to the end of the file, the rest of the buffer is
+     *  zeroed so that truncated files can't leave values uninitialized. */
+    virtual s32 read(void* buffer, u32 size_to_read)
+    {
+        long size = std::min((long)size_to_read, m_size - m_pos);
+        if (size > 0)
+        {
+            memcpy(buffer, m_data + m_pos, size);
+            m_pos += size;
+        }
+        else
+            size = 0;
+        if ((u32)size < size_to_read)
+            memset((uint8_t*)buffer + size, 0, size_to_read - size);
+        return (s32)size;
+    }   // read
+    // ------------------------------------------------------------------------
+    virtual bool seek(long final_pos, bool relative_movement = false)
+    {
+        const long pos = relative_movement ? m_pos + final_pos : final_pos;
+        if (pos < 0 || pos > m_size)
+            return false;
+        m_pos = pos;
+        return true;
+    }   // seek
+    // ------------------------------------------------------------------------
+    virtual long getSize() const                            { return m_size; }
+    // ------------------------------------------------------------------------
+    virtual long getPos() const                              { return m_pos; }
+    // ------------------------------------------------------------------------
+    virtual const io::path& getFileName() const        { return m_file_name; }
+
+};   // SPMFile
+
+// ----------------------------------------------------------------------------
+/** Decodes one spm file. Everything in \ref decode can be done in any
+ *  thread, \ref finish must be called in the main thread since it creates
+ *  the materials and textures. */
+class SPMeshLoader::Decoder
+{
+private:
+    enum SPVertexType: unsigned int
+    {
+        SPVT_NORMAL,
+        SPVT_SKINNED
+    };
+    // ------------------------------------------------------------------------
+    unsigned m_bind_frame, m_joint_count, m_frame_count;
+    // ------------------------------------------------------------------------
+    std::vector<SP::Armature> m_all_armatures;
+    // ------------------------------------------------------------------------
+    std::vector<core::matrix4> m_to_bind_pose_matrices;
+    // ------------------------------------------------------------------------
+    std::vector<std::vector<
+        std::pair<std::array<short, 4>, std::array<float, 4> > > > m_joints;
+    // ------------------------------------------------------------------------
+    /** Both texture names of each material. */
+    std::vector<std::pair<std::string, std::string> > m_textures;
+    // ------------------------------------------------------------------------
+    /** The material id of each mesh buffer. */
+    std::vector<uint16_t> m_buffer_materials;
+
+    scene::ISkinnedMesh* m_mesh;
+
+    bool m_real_spm;
+
+    // ------------------------------------------------------------------------
+    void decompress(SPMFile* spm, unsigned vertices_count,
+                    unsigned indices_count, bool read_normal, bool read_vcolor,
+                    bool read_tangent, bool uv_one, bool uv_two,
+                    SPVertexType vt);
+    // ------------------------------------------------------------------------
+    void decompressSPM(SPMFile* spm, unsigned vertices_count,
+                       unsigned indices_count, bool read_normal,
+                       bool read_vcolor, bool read_tangent, bool uv_one,
+                       bool uv_two, SPVertexType vt);
+    // ------------------------------------------------------------------------
+    void createAnimationData(SPMFile* spm);
+    // ------------------------------------------------------------------------
+    void convertIrrlicht();
+    // ------------------------------------------------------------------------
+    bool failed()
+    {
+        m_mesh->drop();
+        m_mesh = NULL;
+        return false;
+    }   // failed
+
+public:
+    // ------------------------------------------------------------------------
+    Decoder(bool real_spm)
+    {
+        m_bind_frame = 0;
+        m_joint_count = 0;
+        m_frame_count = 0;
+        m_mesh = NULL;
+        m_real_spm = real_spm;
+    }   // Decoder
+    // ------------------------------------------------------------------------
+    ~Decoder()
+    {
+        if (m_mesh)
+            m_mesh->drop();
+    }   // ~Decoder
+    // ------------------------------------------------------------------------
+    bool decode(SPMFile* f);
+    // ------------------------------------------------------------------------
+    scene::IAnimatedMesh* finish(io::IFileSystem* fs,
+                                 const std::string& base_path);
+
+};   // Decoder
+
+// ----------------------------------------------------------------------------
+std::map<std::string, SPMeshLoader::Decoder*> SPMeshLoader::m_predecoded;
+std::mutex SPMeshLoader::m_predecoded_mutex;
+
 // ----------------------------------------------------------------------------
 bool SPMeshLoader::isALoadableFileExtension(const io::path& filename) const
 {
@@ -56,21 +336,108 @@ scene::IAnimatedMesh* SPMeshLoader::createMesh(io::IReadFile* f)
     {
         return NULL;
     }
-    m_bind_frame = 0;
-    m_joint_count = 0;
-    m_frame_count = 0;
-    m_mesh = NULL;
-    m_mesh = real_spm ? new SP::SPMesh() : m_scene_manager->createSkinnedMesh();
     io::IFileSystem* fs = m_scene_manager->getFileSystem();
     std::string base_path = fs->getFileDir(f->getFileName()).c_str();
+
+    Decoder* decoder = NULL;
+    {
+        std::lock_guard<std::mutex> lock(m_predecoded_mutex);
+        if (!m_predecoded.empty())
+        {
+            auto it = m_predecoded.find(
+                fs->getAbsolutePath(f->getFileName()).c_str());
+            if (it != m_predecoded.end())
+            {
+                decoder = it->second;
+                m_predecoded.erase(it);
+            }
+        }
+    }
+    if (decoder == NULL)
+    {
+        decoder = new Decoder(real_spm);
+        SPMFile* spm = SPMFile::create(f);
+        decoder->decode(spm);
+        spm->drop();
+    }
+    scene::IAnimatedMesh* mesh = decoder->finish(fs, base_path);
+    delete decoder;
+    return mesh;
+}   // createMesh
+
+// ----------------------------------------------------------------------------
+/** Decodes .spm files in parallel. They are then taken by \ref createMesh
+ *  instead of reading the file again, the rest is freed by
+ *  \ref clearPredecoded.
+ *  \param spm_files Full paths of the files, e.g. the meshes referenced by
+ *         the scene of the track that is being loaded.
+ */
+void SPMeshLoader::predecodeFiles(const std::vector<std::string>& spm_files)
+{
+    clearPredecoded();
+    if (!IS_LITTLE_ENDIAN || spm_files.empty())
+        return;
+#ifndef SERVER_ONLY
+    const bool real_spm = CVS->isGLSL();
+#else
+    const bool real_spm = false;
+#endif
+    // The main thread decodes too
+    const unsigned thread_count = std::min((unsigned)spm_files.size(),
+        std::max(std::thread::hardware_concurrency(), 1u));
+    std::vector<Decoder*> results(spm_files.size(), NULL);
+    WorkerPool pool(thread_count - 1, "SPMDecode");
+    pool.parallelFor((unsigned)spm_files.size(),
+        [&spm_files, &results, real_spm](unsigned i, unsigned /*thread*/)
+        {
+            SPMFile* spm = SPMFile::create(spm_files[i]);
+            if (!spm)
+                return;
+            Decoder* decoder = new Decoder(real_spm);
+            decoder->decode(spm);
+            spm->drop();
+            results[i] = decoder;
+        });
+
+    io::IFileSystem* fs = file_manager->getFileSystem();
+    std::lock_guard<std::mutex> lock(m_predecoded_mutex);
+    for (unsigned i = 0; i < spm_files.size(); i++)
+    {
+        if (results[i])
+        {
+            m_predecoded[fs->getAbsolutePath(spm_files[i].c_str()).c_str()] =
+                results[i];
+        }
+    }
+}   // predecodeFiles
+
+// ----------------------------------------------------------------------------
+/** Frees all predecoded meshes that were not used. */
+void SPMeshLoader::clearPredecoded()
+{
+    std::lock_guard<std::mutex> lock(m_predecoded_mutex);
+    for (auto& p : m_predecoded)
+        delete p.second;
+    m_predecoded.clear();
+}   // clearPredecoded
+
+// ----------------------------------------------------------------------------
+/** Reads the texture names and decodes all mesh buffers and the animation.
+ *  \return False if the file is not a valid spm file.
+ */
+bool SPMeshLoader::Decoder::decode(SPMFile* f)
+{
+    if (m_real_spm)
+        m_mesh = new SP::SPMesh();
+    else
+        m_mesh = new scene::CSkinnedMesh();
     std::string header;
     header.resize(2);
     f->read(&header.front(), 2);
     if (header != "SP")
     {
         Log::error("SPMeshLoader", "Not a spm file.");
-        m_mesh->drop();
-        return NULL;
+        return failed();
     }
     uint8_t byte = 0;
     f->read(&byte, 1);
@@ -79,16 +446,14 @@ scene::IAnimatedMesh* SPMeshLoader::createMesh(io::IReadFile* f)
     {
         Log::error("SPMeshLoader", "Version mismatch, file %d SP %d", version,
             VERSION_NOW);
-        m_mesh->drop();
-        return NULL;
+        return failed();
     }
     byte &= ~0x08;
     header = byte == 0 ? "SPMS" : byte == 1 ? "SPMA" : "SPMN";
     if (header == "SPMS")
     {
         Log::error("SPMeshLoader", "Space partitioned mesh not supported.");
-        m_mesh->drop();
-        return NULL;
+        return failed();
     }
     f->read(&byte, 1);
     bool read_normal = byte & 0x01;
@@ -100,11 +465,6 @@ scene::IAnimatedMesh* SPMeshLoader::createMesh(io::IReadFile* f)
     f->read(bbox, 24);
     uint16_t size_num = 0;
     f->read(&size_num, 2);
-    unsigned id = 0;
-    std::unordered_map<unsigned, std::tuple<video::SMaterial, bool,
-        bool> > mat_map;
-    std::unordered_map<unsigned, std::tuple<Material*, bool,
-        bool> > sp_mat_map;
     while (size_num != 0)
     {
         uint8_t tex_size;
@@ -121,7 +481,79 @@ scene::IAnimatedMesh* SPMeshLoader::createMesh(io::IReadFile* f)
             tex_name_2.resize(tex_size);
             f->read(&tex_name_2.front(), tex_size);
         }
-        if (real_spm)
+        m_textures.emplace_back(tex_name_1, tex_name_2);
+        size_num--;
+    }
+    f->read(&size_num, 2);
+    while (size_num != 0)
+    {
+        uint16_t mat_size;
+        f->read(&mat_size, 2);
+        while (mat_size != 0)
+        {
+            uint32_t vertices_count, indices_count;
+            uint16_t mat_id;
+            f->read(&vertices_count, 4);
+            if (vertices_count > 65535)
+            {
+                Log::error("SPMeshLoader", "32bit index not supported.");
+                return failed();
+            }
+            f->read(&indices_count, 4);
+            f->read(&mat_id, 2);
+            if (mat_id >= m_textures.size() || vertices_count == 0 ||
+                indices_count == 0)
+            {
+                Log::error("SPMeshLoader", "Invalid mesh buffer in '%s'.",
+                    f->getFileName().c_str());
+                return failed();
+            }
+            m_buffer_materials.push_back(mat_id);
+            const bool uv_one = !m_textures[mat_id].first.empty();
+            const bool uv_two = !m_textures[mat_id].second.empty();
+            if (m_real_spm)
+            {
+                decompressSPM(f, vertices_count, indices_count, read_normal,
+                    read_vcolor, read_tangent, uv_one, uv_two, vt);
+            }
+            else
+            {
+                decompress(f, vertices_count, indices_count, read_normal,
+                    read_vcolor, read_tangent, uv_one, uv_two, vt);
+            }
+            mat_size--;
+        }
+        size_num--;
+    }
+    if (header == "SPMA")
+    {
+        createAnimationData(f);
+        convertIrrlicht();
+    }
+    return true;
+}   // decode
+
+// ----------------------------------------------------------------------------
+/** Creates the materials of the decoded mesh and finalizes it. Must be
+ *  called in the main thread.
+ *  \param fs The irrlicht file system.
+ *  \param base_path Directory of the spm file, textures are searched there
+ *         first.
+ *  \return The mesh, or NULL if decoding failed.
+ */
+scene::IAnimatedMesh* SPMeshLoader::Decoder::finish(io::IFileSystem* fs,
+                                                    const std::string& base_path)
+{
+    if (m_mesh == NULL)
+        return NULL;
+
+    std::vector<Material*> sp_materials;
+    std::vector<video::SMaterial> materials;
+    for (auto& textures : m_textures)
+    {
+        std::string tex_name_1 = textures.first;
+        std::string tex_name_2 = textures.second;
+        if (m_real_spm)
         {
             if (!tex_name_1.empty())
             {
@@ -131,10 +563,8 @@ scene::IAnimatedMesh* SPMeshLoader::createMesh(io::IReadFile* f)
                     tex_name_1 = full_path;
                 }
             }
-            sp_mat_map[id] =
-                std::make_tuple(
-                material_manager->getMaterialSPM(tex_name_1, tex_name_2),
-                !tex_name_1.empty(), !tex_name_2.empty());
+            sp_materials.push_back(
+                material_manager->getMaterialSPM(tex_name_1, tex_name_2));
         }
         else
         {
@@ -174,70 +604,29 @@ scene::IAnimatedMesh* SPMeshLoader::createMesh(io::IReadFile* f)
             {
                 m.setTexture(1, textures[1]);
             }
-            mat_map[id] =
-                std::make_tuple(m, !tex_name_1.empty(), !tex_name_2.empty());
+            materials.push_back(m);
         }
-        size_num--;
-        id++;
     }
-    f->read(&size_num, 2);
-    while (size_num != 0)
+
+    for (unsigned i = 0; i < m_buffer_materials.size(); i++)
     {
-        uint16_t mat_size;
-        f->read(&mat_size, 2);
-        while (mat_size != 0)
+        if (m_real_spm)
         {
-            uint32_t vertices_count, indices_count;
-            uint16_t mat_id;
-            f->read(&vertices_count, 4);
-            if (vertices_count > 65535)
-            {
-                Log::error("SPMeshLoader", "32bit index not supported.");
-                m_mesh->drop();
-                return NULL;
-            }
-            f->read(&indices_count, 4);
-            f->read(&mat_id, 2);
-            if (real_spm)
-            {
-                assert(mat_id < sp_mat_map.size());
-                decompressSPM(f, vertices_count, indices_count, read_normal,
-                    read_vcolor, read_tangent, std::get<1>(sp_mat_map[mat_id]),
-                    std::get<2>(sp_mat_map[mat_id]), vt,
-                    std::get<0>(sp_mat_map[mat_id]));
-            }
-            else
-            {
-                assert(mat_id < mat_map.size());
-                decompress(f, vertices_count, indices_count, read_normal,
-                    read_vcolor, read_tangent, std::get<1>(mat_map[mat_id]),
-                    std::get<2>(mat_map[mat_id]), vt,
-                    std::get<0>(mat_map[mat_id]));
-            }
-            mat_size--;
+            static_cast<SP::SPMesh*>(m_mesh)->m_buffer[i]
+                ->setSTKMaterial(sp_materials[m_buffer_materials[i]]);
         }
-        if (header == "SPMS")
+        else
         {
-            // Reserved, never used
-            assert(false);
-            f->read(bbox, 24);
+            const video::SMaterial& m = materials[m_buffer_materials[i]];
+            if (m.TextureLayer[0].Texture != NULL)
+            {
+                m_mesh->getMeshBuffers()[i]->Material = m;
+            }
         }
-        size_num--;
-    }
-    if (header == "SPMA")
-    {
-        createAnimationData(f);
-        convertIrrlicht();
-    }
-    else if (header == "SPMS")
-    {
-        // Reserved, never used
-        assert(false);
-        uint16_t pre_computed_size = 0;
-        f->read(&pre_computed_size, 2);
     }
+
     const bool has_armature = !m_all_armatures.empty();
-    if (real_spm)
+    if (m_real_spm)
     {
         SP::SPMesh* spm = static_cast<SP::SPMesh*>(m_mesh);
         spm->m_bind_frame = m_bind_frame;
@@ -256,25 +645,24 @@ scene::IAnimatedMesh* SPMeshLoader::createMesh(io::IReadFile* f)
         spm->m_all_armatures = std::move(m_all_armatures);
     }
     m_mesh->finalize();
-    if (!real_spm && has_armature)
+    if (!m_real_spm && has_armature)
     {
         // Because the last frame in spm is usable
         static_cast<scene::CSkinnedMesh*>(m_mesh)->AnimationFrames =
             (float)m_frame_count + 1.0f;
     }
-    m_all_armatures.clear();
-    m_to_bind_pose_matrices.clear();
-    m_joints.clear();
-    return m_mesh;
-}   // createMesh
+    scene::IAnimatedMesh* mesh = m_mesh;
+    m_mesh = NULL;
+    return mesh;
+}   // finish
 
 // ----------------------------------------------------------------------------
-void SPMeshLoader::decompressSPM(irr::io::IReadFile* spm,
-                                 unsigned vertices_count,
-                                 unsigned indices_count, bool read_normal,
-                                 bool read_vcolor, bool read_tangent,
-                                 bool uv_one, bool uv_two, SPVertexType vt,
-                                 Material* m)
+void SPMeshLoader::Decoder::decompressSPM(SPMFile* spm,
+                                          unsigned vertices_count,
+                                          unsigned indices_count,
+                                          bool read_normal, bool read_vcolor,
+                                          bool read_tangent, bool uv_one,
+                                          bool uv_two, SPVertexType vt)
 {
     assert(vertices_count != 0);
     assert(indices_count != 0);
@@ -283,9 +671,10 @@ void SPMeshLoader::decompressSPM(irr::io::IReadFile* spm,
     SPMeshBuffer* mb = new SPMeshBuffer();
     static_cast<SPMesh*>(m_mesh)->m_buffer.push_back(mb);
     const unsigned idx_size = vertices_count > 255 ? 2 : 1;
+    std::vector<video::S3DVertexSkinnedMesh> vertices(vertices_count);
     for (unsigned i = 0; i < vertices_count; i++)
     {
-        video::S3DVertexSkinnedMesh vertex = {};
+        video::S3DVertexSkinnedMesh& vertex = vertices[i];
         // 3 * float position
         spm->read(&vertex.m_position, 12);
         if (read_normal)
@@ -350,8 +739,8 @@ void SPMeshLoader::decompressSPM(irr::io::IReadFile* spm,
                 vertex.m_weight[0] = 15360;
             }
         }
-        mb->addSPMVertex(vertex);
     }
+    mb->setSPMVertices(vertices);
 
     std::vector<uint16_t> indices;
     indices.resize(indices_count);
@@ -370,16 +759,15 @@ void SPMeshLoader::decompressSPM(irr::io::IReadFile* spm,
         }
     }
     mb->setIndices(indices);
-    mb->setSTKMaterial(m);
 
 }   // decompressSPM
 
 // ----------------------------------------------------------------------------
-void SPMeshLoader::decompress(irr::io::IReadFile* spm, unsigned vertices_count,
-                              unsigned indices_count, bool read_normal,
-                              bool read_vcolor, bool read_tangent, bool uv_one,
-                              bool uv_two, SPVertexType vt,
-                              const video::SMaterial& m)
+void SPMeshLoader::Decoder::decompress(SPMFile* spm, unsigned vertices_count,
+                                       unsigned indices_count,
+                                       bool read_normal, bool read_vcolor,
+                                       bool read_tangent, bool uv_one,
+                                       bool uv_two, SPVertexType vt)
 {
     assert(vertices_count != 0);
     assert(indices_count != 0);
@@ -387,6 +775,11 @@ void SPMeshLoader::decompress(irr::io::IReadFile* spm, unsigned vertices_count,
     if (uv_two)
     {
         mb->convertTo2TCoords();
+        mb->Vertices_2TCoords.reallocate(vertices_count);
+    }
+    else
+    {
+        mb->Vertices_Standard.reallocate(vertices_count);
     }
     using namespace MiniGLM;
     const unsigned idx_size = vertices_count > 255 ? 2 : 1;
@@ -479,10 +872,6 @@ void SPMeshLoader::decompress(irr::io::IReadFile* spm, unsigned vertices_count,
     {
         m_joints.emplace_back(std::move(cur_joints));
     }
-    if (m.TextureLayer[0].Texture != NULL)
-    {
-        mb->Material = m;
-    }
     mb->Indices.set_used(indices_count);
     if (idx_size == 2)
     {
@@ -518,7 +907,7 @@ void SPMeshLoader::decompress(irr::io::IReadFile* spm, unsigned vertices_count,
 }   // decompress
 
 // ----------------------------------------------------------------------------
-void SPMeshLoader::createAnimationData(irr::io::IReadFile* spm)
+void SPMeshLoader::Decoder::createAnimationData(SPMFile* spm)
 {
     uint8_t armature_size = 0;
     spm->read(&armature_size, 1);
@@ -588,7 +977,7 @@ void SPMeshLoader::createAnimationData(irr::io::IReadFile* spm)
 }   // createAnimationData
 
 // ----------------------------------------------------------------------------
-void SPMeshLoader::convertIrrlicht()
+void SPMeshLoader::Decoder::convertIrrlicht()
 {
     // Only for legacy device
     if (m_joints.empty())
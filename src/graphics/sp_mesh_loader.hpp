@@ -18,57 +18,36 @@
 #ifndef HEADER_SP_MESH_LOADER_HPP
 #define HEADER_SP_MESH_LOADER_HPP
 
-#include "graphics/sp/sp_animation.hpp"
+#include "utils/no_copy.hpp"
 
 #include <IMeshLoader.h>
 #include <ISceneManager.h>
-#include <ISkinnedMesh.h>
 #include <IReadFile.h>
-#include <array>
+#include <map>
+#include <mutex>
+#include <string>
 #include <vector>
 
 using namespace irr;
 
-class Material;
-
+/** Loader for .spm files. The whole file is memory mapped (or read at once
+ *  if it can't be mapped), and the vertices and indices are decoded directly
+ *  into the final mesh buffers. Decoding doesn't need the main thread, only
+ *  creating the materials does, so all meshes of a track can be decoded in
+ *  parallel before the track is loaded, see \ref predecodeFiles. */
 class SPMeshLoader : public scene::IMeshLoader
 {
 private:
-
-    // ------------------------------------------------------------------------
-    unsigned m_bind_frame, m_joint_count, m_frame_count;
-    // ------------------------------------------------------------------------
-    std::vector<SP::Armature> m_all_armatures;
-    // ------------------------------------------------------------------------
-    std::vector<core::matrix4> m_to_bind_pose_matrices;
-    // ------------------------------------------------------------------------
-    enum SPVertexType: unsigned int
-    {
-        SPVT_NORMAL,
-        SPVT_SKINNED
-    };
-    // ------------------------------------------------------------------------
-    void decompress(irr::io::IReadFile* spm, unsigned vertices_count,
-                    unsigned indices_count, bool read_normal, bool read_vcolor,
-                    bool read_tangent, bool uv_one, bool uv_two,
-                    SPVertexType vt, const video::SMaterial& m);
-    // ------------------------------------------------------------------------
-    void decompressSPM(irr::io::IReadFile* spm, unsigned vertices_count,
-                       unsigned indices_count, bool read_normal,
-                       bool read_vcolor, bool read_tangent, bool uv_one,
-                       bool uv_two, SPVertexType vt,
-                       Material* m);
-    // ------------------------------------------------------------------------
-    void createAnimationData(irr::io::IReadFile* spm);
-    // ------------------------------------------------------------------------
-    void convertIrrlicht();
-
-    scene::ISkinnedMesh* m_mesh;
+    class SPMFile;
+    class Decoder;
 
     scene::ISceneManager* m_scene_manager;
 
-    std::vector<std::vector<
-        std::pair<std::array<short, 4>, std::array<float, 4> > > > m_joints;
+    /** Meshes decoded by \ref predecodeFiles, indexed by the absolute
+     *  file name. */
+    static std::map<std::string, Decoder*> m_predecoded;
+
+    static std::mutex m_predecoded_mutex;
 
 public:
     // ------------------------------------------------------------------------
@@ -77,8 +56,20 @@ public:
     virtual bool isALoadableFileExtension(const io::path& filename) const;
     // ------------------------------------------------------------------------
     virtual scene::IAnimatedMesh* createMesh(io::IReadFile* file);
+    // ------------------------------------------------------------------------
+    static void predecodeFiles(const std::vector<std::string>& spm_files);
+    // ------------------------------------------------------------------------
+    static void clearPredecoded();
+
+    // ========================================================================
+    /** Frees the predecoded meshes when it goes out of scope, so that they
+     *  are not kept if loading the track throws. */
+    class PredecodedScope : public NoCopy
+    {
+    public:
+        ~PredecodedScope()                             { clearPredecoded(); }
+    };   // PredecodedScope
 
 };
 
 #endif
-
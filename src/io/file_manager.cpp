@@ -247,6 +247,7 @@ FileManager::FileManager()
     checkAndCreateScreenshotDir();
     checkAndCreateReplayDir();
     checkAndCreateCachedTexturesDir();
+    checkAndCreateCachedXMLDir();
     checkAndCreateGPDir();
 
     redirectOutput();
@@ -1062,6 +1063,32 @@ void FileManager::checkAndCreateCachedTexturesDir()
 
 }   // checkAndCreateCachedTexturesDir
 
+// ----------------------------------------------------------------------------
+/** Creates the directory for the binary cache of parsed XML files, which is
+ *  next to the cached textures. This will set m_cached_xml_dir, or leave it
+ *  empty (which disables the cache) if it can not be created.
+ */
+void FileManager::checkAndCreateCachedXMLDir()
+{
+#if defined(WIN32) || defined(__CYGWIN__)
+    m_cached_xml_dir = m_user_config_dir + "cached-xml/";
+#elif defined(__APPLE__)
+    m_cached_xml_dir = getenv("HOME");
+    m_cached_xml_dir += "/Library/Application Support/SuperTuxKart/CachedXML/";
+#else
+    m_cached_xml_dir = checkAndCreateLinuxDir("XDG_CACHE_HOME", "supertuxkart", ".cache/", ".");
+    m_cached_xml_dir += "cached-xml/";
+#endif
+
+    if (!checkAndCreateDirectory(m_cached_xml_dir))
+    {
+        Log::warn("FileManager", "Can not create cached XML directory '%s', "
+            "XML files will not be cached.", m_cached_xml_dir.c_str());
+        m_cached_xml_dir = "";
+    }
+
+}   // checkAndCreateCachedXMLDir
+
 // ----------------------------------------------------------------------------
 /** Creates the directories for user-defined grand prix. This will set m_gp_dir
  *  with the appropriate path.
@@ -1484,3 +1511,20 @@ bool FileManager::fileIsNewer(const std::string& f1, const std::string& f2) cons
     stat(f2.c_str(), &stat2);
     return stat1.st_mtime > stat2.st_mtime;
 }   // fileIsNewer
+
+// ----------------------------------------------------------------------------
+/** Returns the modification time of a file or directory, or 0 if it does not
+ *  exist.
+ *  \param path Name of the file or directory.
+ */
+uint64_t FileManager::getModificationTime(const std::string& path) const
+{
+    struct stat mystat;
+    std::string s(path);
+    // At least on windows stat returns an error if there is
+    // a '/' at the end of the path.
+    if (!s.empty() && s[s.size()-1]=='/')
+        s.erase(s.end()-1, s.end());
+    if (stat(s.c_str(), &mystat) < 0) return 0;
+    return (uint64_t)mystat.st_mtime;
+}   // getModificationTime
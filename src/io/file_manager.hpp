@@ -99,6 +99,10 @@ private:
     /** Directory where resized textures are cached. */
     std::string       m_cached_textures_dir;
 
+    /** Directory where pre-parsed XML files are cached, empty if no cache
+     *  should be used. */
+    std::string       m_cached_xml_dir;
+
     /** Directory where user-defined grand prix are stored. */
     std::string       m_gp_dir;
 
@@ -126,6 +130,7 @@ private:
     void              checkAndCreateScreenshotDir();
     void              checkAndCreateReplayDir();
     void              checkAndCreateCachedTexturesDir();
+    void              checkAndCreateCachedXMLDir();
     void              checkAndCreateGPDir();
     void              discoverPaths();
 #if !defined(WIN32) && !defined(__CYGWIN__) && !defined(__APPLE__)
@@ -149,6 +154,7 @@ public:
     std::string       getScreenshotDir() const;
     std::string       getReplayDir() const;
     std::string       getCachedTexturesDir() const;
+    const std::string& getCachedXMLDir() const { return m_cached_xml_dir; }
     std::string       getGPDir() const;
     bool              checkAndCreateDirectory(const std::string &path);
     bool              checkAndCreateDirectoryP(const std::string &path);
@@ -204,6 +210,7 @@ public:
     void       redirectOutput();
 
     bool       fileIsNewer(const std::string& f1, const std::string& f2) const;
+    uint64_t   getModificationTime(const std::string& path) const;
     // ------------------------------------------------------------------------
     const std::string& getUserConfigDir() const   { return m_user_config_dir; }
     // ------------------------------------------------------------------------
@@ -21,7 +21,116 @@
 #include "utils/interpolation_array.hpp"
 #include "utils/vec3.hpp"
 
+#include <cstdio>
+#include <cstring>
 #include <stdexcept>
+#include <thread>
+
+namespace
+{
+    /** Bump if the format of the binary cache changes. */
+    const uint8_t XML_CACHE_VERSION = 2;
+    const char XML_CACHE_MAGIC[4] = { 'S', 'X', 'M', 'C' };
+
+    // ------------------------------------------------------------------------
+    template<typename T>
+    void writeValue(std::string* out, const T& value)
+    {
+        out->append((const char*)&value, sizeof(T));
+    }   // writeValue
+
+    // ------------------------------------------------------------------------
+    template<typename T>
+    bool readValue(const char** cursor, const char* end, T* value)
+    {
+        if (end - *cursor < (ptrdiff_t)sizeof(T))
+            return false;
+        memcpy(value, *cursor, sizeof(T));
+        *cursor += sizeof(T);
+        return true;
+    }   // readValue
+
+    // ------------------------------------------------------------------------
+    void writeString(std::string* out, const std::string& str)
+    {
+        writeValue(out, (uint32_t)str.size());
+        out->append(str);
+    }   // writeString
+
+    // ------------------------------------------------------------------------
+    bool readString(const char** cursor, const char* end, std::string* str)
+    {
+        uint32_t len;
+        if (!readValue(cursor, end, &len) || (uint32_t)(end - *cursor) < len)
+            return false;
+        str->assign(*cursor, len);
+        *cursor += len;
+        return true;
+    }   // readString
+
+    // ------------------------------------------------------------------------
+    const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+
+    /** FNV-1a, used to name the cache file of an XML file and to check that
+     *  the content of the file is unchanged. */
+    uint64_t hashBytes(const char* data, size_t len,
+                       uint64_t hash = FNV_OFFSET_BASIS)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            hash ^= (uint8_t)data[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }   // hashBytes
+
+    // ------------------------------------------------------------------------
+    /** Hashes the content of a file. A modification time only has a
+     *  resolution of a second on some file systems, so an edit which keeps
+     *  the size could not be noticed with it.
+     *  \return False if the file can't be read.
+     */
+    bool hashFile(const std::string& path, uint64_t* hash, uint64_t* size)
+    {
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (!fp)
+            return false;
+        *hash = FNV_OFFSET_BASIS;
+        *size = 0;
+        char buffer[16384];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        {
+            *hash = hashBytes(buffer, read, *hash);
+            *size += read;
+        }
+        fclose(fp);
+        return true;
+    }   // hashFile
+
+    // ------------------------------------------------------------------------
+    /** Converts all space separated tokens of an attribute value to floats,
+     *  the same way as get(float) and get(vector<float>) do it.
+     *  \return False (with floats empty) if any token isn't a float.
+     */
+    bool parseFloats(const core::stringw& value, std::vector<float>* floats)
+    {
+        floats->clear();
+        std::vector<std::string> v =
+            StringUtils::split(std::string(core::stringc(value).c_str()), ' ');
+        for (const std::string& token : v)
+        {
+            float f;
+            if (!StringUtils::parseString<float>(token, &f))
+            {
+                floats->clear();
+                return false;
+            }
+            floats->push_back(f);
+        }
+        return true;
+    }   // parseFloats
+}   // namespace
 
 XMLNode::XMLNode(io::IXMLReader *xml)
 {
@@ -39,6 +148,27 @@ XMLNode::XMLNode(const std::string &filename)
 {
     m_file_name = filename;
 
+    // Use the pre-parsed binary version if the XML file is unchanged.
+    // Files in the user config directory are rewritten by STK itself
+    // (possibly several times per second), so they are not cached.
+    std::string cache_file;
+    uint64_t size = 0, content_hash = 0;
+    if (file_manager && !file_manager->getCachedXMLDir().empty() &&
+        !StringUtils::startsWith(filename, file_manager->getUserConfigDir()))
+    {
+        std::string full_path = file_manager->getFileSystem()
+            ->getAbsolutePath(filename.c_str()).c_str();
+        if (hashFile(full_path, &content_hash, &size))
+        {
+            char hash[17];
+            sprintf(hash, "%016llx", (unsigned long long)
+                hashBytes(full_path.data(), full_path.size()));
+            cache_file = file_manager->getCachedXMLDir() + hash + ".xmlc";
+            if (loadCache(cache_file, size, content_hash))
+                return;
+        }
+    }
+
     io::IXMLReader *xml = file_manager->createXMLReader(filename);
     
     if (xml == NULL)
@@ -71,6 +201,9 @@ XMLNode::XMLNode(const std::string &filename)
         }   // switch
     }   // while
     xml->drop();
+
+    if (!cache_file.empty() && !m_name.empty())
+        saveCache(cache_file, size, content_hash);
 }   // XMLNode
 
 // ----------------------------------------------------------------------------
@@ -96,7 +229,7 @@ void XMLNode::readXML(io::IXMLReader *xml)
     {
         std::string   name  = core::stringc(xml->getAttributeName(i)).c_str();
         core::stringw value = xml->getAttributeValue(i);
-        m_attributes[name] = value;
+        m_attributes[name].m_value = value;
     }   // for i
 
     // If no children, we are done
@@ -127,6 +260,208 @@ void XMLNode::readXML(io::IXMLReader *xml)
     }   // while
 }   // readXML
 
+// ----------------------------------------------------------------------------
+const XMLNode::Attribute* XMLNode::findAttribute(const std::string& name) const
+{
+    if (m_attributes.empty()) return NULL;
+    std::map<std::string, Attribute>::const_iterator o =
+        m_attributes.find(name);
+    if (o == m_attributes.end()) return NULL;
+    return &o->second;
+}   // findAttribute
+
+// ----------------------------------------------------------------------------
+/** Adds all element and attribute names of this subtree to names, which are
+ *  saved only once in the binary cache. */
+void XMLNode::collectNames(std::map<std::string, uint32_t>* names) const
+{
+    if (names->find(m_name) == names->end())
+        (*names)[m_name] = (uint32_t)names->size();
+    for (auto& p : m_attributes)
+    {
+        if (names->find(p.first) == names->end())
+            (*names)[p.first] = (uint32_t)names->size();
+    }
+    for (XMLNode* node : m_nodes)
+        node->collectNames(names);
+}   // collectNames
+
+// ----------------------------------------------------------------------------
+/** Writes this node and its children into the binary cache. The floats of
+ *  the attributes are only converted here, so a tree which is not cached
+ *  doesn't pay for them. */
+void XMLNode::writeBinary(std::string* out,
+                          const std::map<std::string, uint32_t>& names) const
+{
+    writeValue(out, names.at(m_name));
+    writeValue(out, (uint32_t)m_attributes.size());
+    std::vector<float> floats;
+    for (auto& p : m_attributes)
+    {
+        writeValue(out, names.at(p.first));
+        writeValue(out, (uint32_t)p.second.m_value.size());
+        out->append((const char*)p.second.m_value.c_str(),
+            p.second.m_value.size() * sizeof(wchar_t));
+        parseFloats(p.second.m_value, &floats);
+        writeValue(out, (uint32_t)floats.size());
+        if (!floats.empty())
+        {
+            out->append((const char*)floats.data(),
+                floats.size() * sizeof(float));
+        }
+    }
+    writeValue(out, (uint32_t)m_nodes.size());
+    for (XMLNode* node : m_nodes)
+        node->writeBinary(out, names);
+}   // writeBinary
+
+// ----------------------------------------------------------------------------
+/** Reads this node and its children from the binary cache.
+ *  \return False if the data is truncated or invalid.
+ */
+bool XMLNode::readBinary(const char** cursor, const char* end,
+                         const std::vector<std::string>& names)
+{
+    uint32_t name_id, count;
+    if (!readValue(cursor, end, &name_id) || name_id >= names.size() ||
+        !readValue(cursor, end, &count))
+        return false;
+    m_name = names[name_id];
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t attr_id, len;
+        if (!readValue(cursor, end, &attr_id) || attr_id >= names.size() ||
+            !readValue(cursor, end, &len) ||
+            (uint64_t)(end - *cursor) < (uint64_t)len * sizeof(wchar_t))
+            return false;
+        Attribute& attr = m_attributes[names[attr_id]];
+        std::vector<wchar_t> value(len + 1, 0);
+        memcpy(value.data(), *cursor, len * sizeof(wchar_t));
+        *cursor += len * sizeof(wchar_t);
+        attr.m_value = value.data();
+        uint32_t float_count;
+        if (!readValue(cursor, end, &float_count) ||
+            (uint64_t)(end - *cursor) < (uint64_t)float_count * sizeof(float))
+            return false;
+        attr.m_floats.resize(float_count);
+        if (float_count > 0)
+        {
+            memcpy(attr.m_floats.data(), *cursor,
+                float_count * sizeof(float));
+            *cursor += float_count * sizeof(float);
+        }
+    }
+    if (!readValue(cursor, end, &count))
+        return false;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        XMLNode* node = new XMLNode();
+        node->m_file_name = m_file_name;
+        m_nodes.push_back(node);
+        if (!node->readBinary(cursor, end, names))
+            return false;
+    }
+    return true;
+}   // readBinary
+
+// ----------------------------------------------------------------------------
+/** Loads this tree from the binary cache file if it was created from the
+ *  same XML file with the same size and content hash.
+ *  \return True if the cache was used.
+ */
+bool XMLNode::loadCache(const std::string& cache_file, uint64_t size,
+                        uint64_t content_hash)
+{
+    FILE* fp = fopen(cache_file.c_str(), "rb");
+    if (!fp)
+        return false;
+    std::string data;
+    char buffer[16384];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        data.append(buffer, read);
+    fclose(fp);
+
+    const char* cursor = data.data();
+    const char* end = cursor + data.size();
+    char magic[4];
+    uint8_t version, wchar_size;
+    uint64_t cached_size, cached_hash;
+    std::string path;
+    uint32_t name_count;
+    if (!readValue(&cursor, end, &magic) ||
+        memcmp(magic, XML_CACHE_MAGIC, 4) != 0 ||
+        !readValue(&cursor, end, &version) ||
+        version != XML_CACHE_VERSION ||
+        !readValue(&cursor, end, &wchar_size) ||
+        wchar_size != sizeof(wchar_t) ||
+        !readValue(&cursor, end, &cached_size) || cached_size != size ||
+        !readValue(&cursor, end, &cached_hash) ||
+        cached_hash != content_hash ||
+        !readString(&cursor, end, &path) || path != m_file_name ||
+        !readValue(&cursor, end, &name_count))
+        return false;
+
+    std::vector<std::string> names(name_count);
+    bool success = true;
+    for (uint32_t i = 0; i < name_count && success; i++)
+        success = readString(&cursor, end, &names[i]);
+    if (success)
+        success = readBinary(&cursor, end, names) && cursor == end;
+    if (!success)
+    {
+        Log::warn("[XMLNode]", "Invalid cache file '%s' for '%s', ignored.",
+            cache_file.c_str(), m_file_name.c_str());
+        for (XMLNode* node : m_nodes)
+            delete node;
+        m_nodes.clear();
+        m_attributes.clear();
+        m_name.clear();
+    }
+    return success;
+}   // loadCache
+
+// ----------------------------------------------------------------------------
+/** Saves this tree into the binary cache. A temporary file is renamed to the
+ *  cache file, so other threads never read a half written one. */
+void XMLNode::saveCache(const std::string& cache_file, uint64_t size,
+                        uint64_t content_hash) const
+{
+    std::map<std::string, uint32_t> names;
+    collectNames(&names);
+    std::vector<const std::string*> ordered_names(names.size());
+    for (auto& p : names)
+        ordered_names[p.second] = &p.first;
+
+    std::string out;
+    out.append(XML_CACHE_MAGIC, 4);
+    writeValue(&out, XML_CACHE_VERSION);
+    writeValue(&out, (uint8_t)sizeof(wchar_t));
+    writeValue(&out, size);
+    writeValue(&out, content_hash);
+    writeString(&out, m_file_name);
+    writeValue(&out, (uint32_t)ordered_names.size());
+    for (const std::string* name : ordered_names)
+        writeString(&out, *name);
+    writeBinary(&out, names);
+
+    std::string tmp_file = cache_file + "." + StringUtils::toString(
+        std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    FILE* fp = fopen(tmp_file.c_str(), "wb");
+    if (!fp)
+        return;
+    const bool written = fwrite(out.data(), 1, out.size(), fp) == out.size();
+    fclose(fp);
+    if (written)
+    {
+        // Windows doesn't allow renaming to an existing file
+        remove(cache_file.c_str());
+        if (rename(tmp_file.c_str(), cache_file.c_str()) == 0)
+            return;
+    }
+    remove(tmp_file.c_str());
+}   // saveCache
+
 // ----------------------------------------------------------------------------
 /** Returns the i.th node.
  *  \param i Number of node to return.
@@ -173,31 +508,25 @@ const void XMLNode::getNodes(const std::string &s, std::vector<XMLNode*>& out) c
 */
 int XMLNode::get(const std::string &attribute, std::string *value) const
 {
-    if(m_attributes.empty()) return 0;
-    std::map<std::string, core::stringw>::const_iterator o;
-    o = m_attributes.find(attribute);
-    if(o==m_attributes.end()) return 0;
-    *value=core::stringc(o->second).c_str();
+    const Attribute* attr = findAttribute(attribute);
+    if(!attr) return 0;
+    *value=core::stringc(attr->m_value).c_str();
     return 1;
 }   // get
 // ----------------------------------------------------------------------------
 int XMLNode::get(const std::string &attribute, core::stringw *value) const
 {
-    if(m_attributes.empty()) return 0;
-    std::map<std::string, core::stringw>::const_iterator o;
-    o = m_attributes.find(attribute);
-    if(o==m_attributes.end()) return 0;
-    *value = o->second;
+    const Attribute* attr = findAttribute(attribute);
+    if(!attr) return 0;
+    *value = attr->m_value;
     return 1;
 }   // get
 // ----------------------------------------------------------------------------
 int XMLNode::getAndDecode(const std::string &attribute, core::stringw *value) const
 {
-    if (m_attributes.empty()) return 0;
-    std::map<std::string, core::stringw>::const_iterator o;
-    o = m_attributes.find(attribute);
-    if (o == m_attributes.end()) return 0;
-    std::string raw_value = core::stringc(o->second).c_str();
+    const Attribute* attr = findAttribute(attribute);
+    if (!attr) return 0;
+    std::string raw_value = core::stringc(attr->m_value).c_str();
     *value = StringUtils::xmlDecode(raw_value);
     return 1;
 }   // get
@@ -227,6 +556,15 @@ int XMLNode::get(const std::string &attribute, core::vector3df *value) const
 // ----------------------------------------------------------------------------
 int XMLNode::get(const std::string &attribute, Vec3 *value) const
 {
+    const Attribute* attr = findAttribute(attribute);
+    if (attr && attr->m_floats.size() == 3)
+    {
+        value->setX(attr->m_floats[0]);
+        value->setY(attr->m_floats[1]);
+        value->setZ(attr->m_floats[2]);
+        return 1;
+    }
+
     std::string s = "";
     if(!get(attribute, &s)) return 0;
 
@@ -375,6 +713,13 @@ int XMLNode::get(const std::string &attribute, uint32_t *value) const
 // ----------------------------------------------------------------------------
 int XMLNode::get(const std::string &attribute, float *value) const
 {
+    const Attribute* attr = findAttribute(attribute);
+    if (attr && attr->m_floats.size() == 1)
+    {
+        *value = attr->m_floats[0];
+        return 1;
+    }
+
     std::string s;
     if(!get(attribute, &s)) return 0;
 
@@ -444,6 +789,13 @@ int XMLNode::get(const std::string &attribute,
 int XMLNode::get(const std::string &attribute,
                  std::vector<float> *value) const
 {
+    const Attribute* attr = findAttribute(attribute);
+    if (attr && !attr->m_floats.empty())
+    {
+        *value = attr->m_floats;
+        return (int) value->size();
+    }
+
     std::string s;
     if(!get(attribute, &s)) return 0;
 
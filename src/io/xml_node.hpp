@@ -48,14 +48,36 @@ class Vec3;
 class XMLNode : public NoCopy
 {
 private:
+    /** An attribute value, together with its space separated tokens already
+     *  converted to float (empty if any of them isn't a float). The floats
+     *  are only available in trees loaded from the binary cache, they are
+     *  converted when the cache is written. This avoids parsing the same
+     *  strings again for each get(float) etc. */
+    struct Attribute
+    {
+        core::stringw      m_value;
+        std::vector<float> m_floats;
+    };
     /** Name of this element. */
     std::string                          m_name;
     /** List of all attributes. */
-    std::map<std::string, core::stringw> m_attributes;
+    std::map<std::string, Attribute>     m_attributes;
     /** List of all sub nodes. */
     std::vector<XMLNode *>               m_nodes;
 
     void readXML(io::IXMLReader *xml);
+    const Attribute* findAttribute(const std::string& name) const;
+
+    XMLNode() {}
+    bool readBinary(const char** cursor, const char* end,
+                    const std::vector<std::string>& names);
+    void collectNames(std::map<std::string, uint32_t>* names) const;
+    void writeBinary(std::string* out,
+                     const std::map<std::string, uint32_t>& names) const;
+    bool loadCache(const std::string& cache_file, uint64_t size,
+                   uint64_t content_hash);
+    void saveCache(const std::string& cache_file, uint64_t size,
+                   uint64_t content_hash) const;
 
     std::string                          m_file_name;
 
@@ -262,6 +262,12 @@ public:
     // ------------------------------------------------------------------------
     virtual void restoreState(BareNetworkString *buffer, int count) OVERRIDE;
     // ------------------------------------------------------------------------
+    virtual bool getRelevancePosition(Vec3* xyz) const OVERRIDE
+    {
+        *xyz = getXYZ();
+        return true;
+    }
+    // ------------------------------------------------------------------------
     /* Return true if still in game state, or otherwise can be deleted. */
     bool hasServerState() const                  { return m_has_server_state; }
     // ------------------------------------------------------------------------
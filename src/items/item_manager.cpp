@@ -28,6 +28,7 @@
 #include "modes/easter_egg_hunt.hpp"
 #include "modes/profile_world.hpp"
 #include "network/network_config.hpp"
+#include "network/network_string.hpp"
 #include "network/race_event_manager.hpp"
 #include "physics/triangle_mesh.hpp"
 #include "tracks/arena_graph.hpp"
@@ -577,6 +578,90 @@ void ItemManager::switchItemsInternal(std::vector<ItemState*> &all_items)
 
 }   // switchItems
 
+//-----------------------------------------------------------------------------
+/** Copies the given item states to the current items. Items which only exist
+ *  in the given states are created, and items which are not in the given
+ *  states are removed.
+ *  \param states The item states, indexed like m_all_items, NULL for
+ *         removed items.
+ */
+void ItemManager::setItemStates(const std::vector<ItemState*>& states)
+{
+    // Either vector can be the larger one (states: when a new item was
+    // dropped; m_all_items: if an item is not part of the given states)
+    size_t max_index = std::max(states.size(), m_all_items.size());
+    m_all_items.resize(max_index, NULL);
+
+    for(unsigned int i=0; i<max_index; i++)
+    {
+        ItemState *item     = m_all_items[i];
+        const ItemState *is = i < states.size() ? states[i] : NULL;
+        // For every *(ItemState*)item = *is, all deactivated ticks, item id
+        // ... will be copied from item state to item
+        if (is && item)
+        {
+            *(ItemState*)item = *is;
+        }
+        else if (is && !item)
+        {
+            // A new item was dropped that is not yet part of the current
+            // state --> create new item
+            Vec3 xyz = is->getXYZ();
+            Vec3 normal = is->getNormal();
+            Item *item_new = dropNewItem(is->getType(), is->getPreviousOwner(),
+                                         &xyz, &normal );
+            *((ItemState*)item_new) = *is;
+            m_all_items[i] = item_new;
+            insertItemInQuad(item_new);
+        }
+        else if (!is && item)
+        {
+            deleteItemInQuad(item);
+            delete item;
+            m_all_items[i] = NULL;
+        }
+    }   // for i < max_index
+    // Clean up the rest
+    m_all_items.resize(states.size());
+}   // setItemStates
+
+//-----------------------------------------------------------------------------
+/** Saves the complete state of all items, which is used by the history
+ *  checkpoints (and works without the NetworkItemManager).
+ *  \param buffer The buffer to save the state to.
+ */
+void ItemManager::saveItemStates(BareNetworkString* buffer) const
+{
+    buffer->addUInt32(m_switch_ticks).addUInt32((uint32_t)m_all_items.size());
+    for (const ItemState* item : m_all_items)
+    {
+        buffer->addUInt8(item ? 1 : 0);
+        if (item)
+            item->saveCompleteState(buffer);
+    }
+}   // saveItemStates
+
+//-----------------------------------------------------------------------------
+/** Restores the state of all items saved by saveItemStates().
+ *  \param buffer The buffer with the state.
+ */
+void ItemManager::restoreItemStates(const BareNetworkString& buffer)
+{
+    m_switch_ticks = buffer.getUInt32();
+    const uint32_t all_items = buffer.getUInt32();
+    std::vector<ItemState*> states;
+    for (unsigned i = 0; i < all_items; i++)
+    {
+        if (buffer.getUInt8() == 1)
+            states.push_back(new ItemState(buffer));
+        else
+            states.push_back(NULL);
+    }
+    setItemStates(states);
+    for (ItemState* is : states)
+        delete is;
+}   // restoreItemStates
+
 //-----------------------------------------------------------------------------
 bool ItemManager::randomItemsForArena(const AlignedArray<btTransform>& pos)
 {
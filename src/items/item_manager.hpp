@@ -35,6 +35,7 @@
 #include <string>
 #include <vector>
 
+class BareNetworkString;
 class Kart;
 class STKPeer;
 
@@ -127,6 +128,7 @@ protected:
     void setSwitchItems(const std::vector<int> &switch_items);
     void insertItemInQuad(Item *item);
     void deleteItemInQuad(ItemState *item);
+    void setItemStates(const std::vector<ItemState*>& states);
              ItemManager();
 public:
     virtual ~ItemManager();
@@ -144,6 +146,8 @@ public:
     virtual void   collectedItem   (ItemState *item, AbstractKart *kart);
     virtual void   switchItems     ();
     bool           randomItemsForArena(const AlignedArray<btTransform>& pos);
+    void           saveItemStates(BareNetworkString* buffer) const;
+    void           restoreItemStates(const BareNetworkString& buffer);
 
     // ------------------------------------------------------------------------
     /** Returns true if the items are switched atm. */
@@ -470,47 +470,9 @@ void NetworkItemManager::restoreState(BareNetworkString *buffer, int count)
 
     // 4. Copy the confirmed state to the current item state
     // ======================================================
-    
-    // We need to test all items - and confirmed or all_items could
-    // be the larger group (confirmed: when a new item was dropped
-    // by a remote kart; all_items: if an item is predicted on
-    // the client, but not yet confirmed). So 
-    size_t max_index = std::max(m_confirmed_state.size(),
-                                      m_all_items.size()        );
-    m_all_items.resize(max_index, NULL);
-
-    for(unsigned int i=0; i<max_index; i++)
-    {
-        ItemState *item     = m_all_items[i];
-        const ItemState *is = i < m_confirmed_state.size() 
-                            ? m_confirmed_state[i] : NULL;
-        // For every *(ItemState*)item = *is, all deactivated ticks, item id
-        // ... will be copied from item state to item
-        if (is && item)
-        {
-            *(ItemState*)item = *is;
-        }
-        else if (is && !item)
-        {
-            // A new item was dropped according to the server that is not
-            // yet part of the current state --> create new item
-            Vec3 xyz = is->getXYZ();
-            Vec3 normal = is->getNormal();
-            Item *item_new = dropNewItem(is->getType(), is->getPreviousOwner(),
-                                         &xyz, &normal );
-            *((ItemState*)item_new) = *is;
-            m_all_items[i] = item_new;
-            insertItemInQuad(item_new);
-        }
-        else if (!is && item)
-        {
-            deleteItemInQuad(item);
-            delete item;
-            m_all_items[i] = NULL;
-        }
-    }   // for i < max_index
-    // Clean up the rest
-    m_all_items.resize(m_confirmed_state.size());
+    // Items which were predicted but not confirmed are removed, and items
+    // which were dropped according to the server are created.
+    setItemStates(m_confirmed_state);
 
     // Now set the clock back to the 'rewindto' time:
     world->setTicksForRewind(rewind_to_time);
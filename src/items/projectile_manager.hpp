@@ -89,6 +89,10 @@ public:
     // ------------------------------------------------------------------------
     void removeByUID(const std::string& uid)
                                            { m_active_projectiles.erase(uid); }
+    // ------------------------------------------------------------------------
+    /** Returns true if any projectile is moving on the track. */
+    bool hasActiveProjectiles() const
+                                      { return !m_active_projectiles.empty(); }
 };
 
 extern ProjectileManager *projectile_manager;
@@ -2466,7 +2466,12 @@ void SkiddingAI::checkCrashes(const Vec3& pos )
         m_crashes.m_kart = slip->getSlipstreamTarget()->getWorldKartId();
     }
 
-    const size_t NUM_KARTS = m_world->getNumKarts();
+    // Read the other karts from the snapshot, which has all karts at the
+    // end of the last tick
+    const KartStateSnapshot& snapshot = m_world->getKartSnapshot();
+    const size_t NUM_KARTS = snapshot.getNumKarts();
+    const unsigned int my_id = m_kart->getWorldKartId();
+    const float forward_speed = m_kart->getVelocityLC().getZ();
 
     float speed = m_kart->getVelocity().length();
     // If the velocity is zero, no sense in checking for crashes in time
@@ -2496,15 +2501,15 @@ void SkiddingAI::checkCrashes(const Vec3& pos )
         {
             for( unsigned int j = 0; j < NUM_KARTS; ++j )
             {
-                const AbstractKart* kart = m_world->getKart(j);
                 // Ignore eliminated karts
-                if(kart==m_kart||kart->isEliminated()||kart->isGhostKart()) continue;
-                const AbstractKart *other_kart = m_world->getKart(j);
+                if(j==my_id ||
+                   snapshot.hasFlag(j, KartStateSnapshot::KF_ELIMINATED) ||
+                   snapshot.hasFlag(j, KartStateSnapshot::KF_GHOST)) continue;
                 // Ignore karts ahead that are faster than this kart.
-                if(m_kart->getVelocityLC().getZ() < other_kart->getVelocityLC().getZ())
+                if(forward_speed < snapshot.getForwardSpeed(j))
                     continue;
-                Vec3 other_kart_xyz = other_kart->getXYZ()
-                                    + other_kart->getVelocity()*(i*dt);
+                Vec3 other_kart_xyz = snapshot.getXYZ(j)
+                                    + snapshot.getVelocity(j)*(i*dt);
                 float kart_distance = (step_coord - other_kart_xyz).length();
 
                 if( kart_distance < m_kart_length)
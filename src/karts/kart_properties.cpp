@@ -64,9 +64,10 @@ std::string KartProperties::getPerPlayerDifficultyAsString(PerPlayerDifficulty d
  *  Otherwise the defaults are taken from STKConfig (and since they are all
  *  defined, it is guaranteed that each kart has well defined physics values).
  */
-KartProperties::KartProperties(const std::string &filename)
+KartProperties::KartProperties(const std::string &filename, bool load_model)
 {
     m_is_addon = false;
+    m_kart_model_loaded = false;
     m_icon_material = NULL;
     m_minimap_icon  = NULL;
     m_name          = "NONAME";
@@ -97,7 +98,7 @@ KartProperties::KartProperties(const std::string &filename)
     // The default constructor for stk_config uses filename=""
     if (filename != "")
     {
-        load(filename, "kart");
+        load(filename, "kart", load_model);
     }
     else
     {
@@ -136,6 +137,8 @@ KartProperties::~KartProperties()
 void KartProperties::copyForPlayer(const KartProperties *source,
                                    PerPlayerDifficulty d)
 {
+    // The copy needs the values computed from the model
+    source->ensureKartModelLoaded();
     *this = *source;
 
     // After the memcpy any pointers will be shared.
@@ -178,8 +181,10 @@ void KartProperties::copyFrom(const KartProperties *source)
 /** Loads the kart properties from a file.
  *  \param filename Filename to load.
  *  \param node Name of the xml node to load the data from
+ *  \param load_model If false, the kart model is only loaded on first use.
  */
-void KartProperties::load(const std::string &filename, const std::string &node)
+void KartProperties::load(const std::string &filename, const std::string &node,
+                          bool load_model)
 {
     // Get the default values from STKConfig. This will also allocate any
     // pointers used in KartProperties
@@ -250,12 +255,6 @@ void KartProperties::load(const std::string &filename, const std::string &node)
     std::string unique_id = StringUtils::insertValues("karts/%s", m_ident.c_str());
     file_manager->pushModelSearchPath(m_root);
     file_manager->pushTextureSearchPath(m_root, unique_id);
-#ifndef SERVER_ONLY
-    if (CVS->isGLSL())
-    {
-        SP::SPShaderManager::get()->loadSPShaders(m_root);
-    }
-#endif
 
     STKTexManager::getInstance()
         ->setTextureErrorMessage("Error while loading kart '%s':", m_name);
@@ -281,6 +280,33 @@ void KartProperties::load(const std::string &filename, const std::string &node)
     else
         m_minimap_icon = NULL;
 
+    STKTexManager::getInstance()->unsetTextureErrorMessage();
+    file_manager->popTextureSearchPath();
+    file_manager->popModelSearchPath();
+
+    if (load_model)
+        loadKartModel();
+}   // load
+
+// ----------------------------------------------------------------------------
+/** Loads the meshes of the kart model, and sets the values that depend on
+ *  the size of the model.
+ *  \throw std::runtime_error if the model can't be loaded.
+ */
+void KartProperties::loadKartModel()
+{
+    std::string unique_id = StringUtils::insertValues("karts/%s", m_ident.c_str());
+    file_manager->pushModelSearchPath(m_root);
+    file_manager->pushTextureSearchPath(m_root, unique_id);
+#ifndef SERVER_ONLY
+    if (CVS->isGLSL())
+    {
+        SP::SPShaderManager::get()->loadSPShaders(m_root);
+    }
+#endif
+    STKTexManager::getInstance()
+        ->setTextureErrorMessage("Error while loading kart '%s':", m_name);
+
     // Only load the model if the .kart file has the appropriate version,
     // otherwise warnings are printed.
     if (m_version >= 1)
@@ -288,6 +314,7 @@ void KartProperties::load(const std::string &filename, const std::string &node)
         const bool success = m_kart_model->loadModels(*this);
         if (!success)
         {
+            STKTexManager::getInstance()->unsetTextureErrorMessage();
             file_manager->popTextureSearchPath();
             file_manager->popModelSearchPath();
             throw std::runtime_error("Cannot load kart models");
@@ -321,8 +348,30 @@ void KartProperties::load(const std::string &filename, const std::string &node)
     STKTexManager::getInstance()->unsetTextureErrorMessage();
     file_manager->popTextureSearchPath();
     file_manager->popModelSearchPath();
+    m_kart_model_loaded = true;
+}   // loadKartModel
 
-}   // load
+// ----------------------------------------------------------------------------
+/** Loads the kart model if this wasn't done when the kart properties were
+ *  loaded. The kart properties manager only skips loading the model of karts
+ *  that were successfully loaded in a previous run, so a failure here is
+ *  fatal.
+ */
+void KartProperties::ensureKartModelLoaded() const
+{
+    // The default kart properties in stk_config don't have a model
+    if (m_kart_model_loaded || !m_kart_model)
+        return;
+    try
+    {
+        const_cast<KartProperties*>(this)->loadKartModel();
+    }
+    catch (std::runtime_error& e)
+    {
+        Log::fatal("KartProperties", "Cannot load kart '%s': %s",
+                   m_ident.c_str(), e.what());
+    }
+}   // ensureKartModelLoaded
 
 // ----------------------------------------------------------------------------
 /** Returns a pointer to the KartModel object.
@@ -331,6 +380,7 @@ void KartProperties::load(const std::string &filename, const std::string &node)
  */
 KartModel* KartProperties::getKartModelCopy(std::shared_ptr<RenderInfo> ri) const
 {
+    ensureKartModelLoaded();
     return m_kart_model->makeCopy(ri);
 }  // getKartModelCopy
 
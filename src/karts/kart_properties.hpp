@@ -84,6 +84,10 @@ private:
      *  the kart_properties object is const. */
     mutable std::shared_ptr<KartModel> m_kart_model;
 
+    /** False if the meshes of the kart model are not loaded yet, they are
+     *  then loaded on first use (see ensureKartModelLoaded). */
+    bool m_kart_model_loaded;
+
     /** List of all groups the kart belongs to. */
     std::vector<std::string> m_groups;
 
@@ -207,14 +211,16 @@ private:
     InterpolationArray m_restitution;
 
     void  load              (const std::string &filename,
-                             const std::string &node);
+                             const std::string &node, bool load_model);
+    void  loadKartModel     ();
     void combineCharacteristics(PerPlayerDifficulty d);
 
 public:
     /** Returns the string representation of a per-player difficulty. */
     static std::string      getPerPlayerDifficultyAsString(PerPlayerDifficulty d);
 
-          KartProperties    (const std::string &filename="");
+          KartProperties    (const std::string &filename="",
+                             bool load_model=true);
          ~KartProperties    ();
     void  copyForPlayer     (const KartProperties *source,
                              PerPlayerDifficulty d = PLAYER_DIFFICULTY_NORMAL);
@@ -247,7 +253,13 @@ public:
     // ------------------------------------------------------------------------
     /** Returns a pointer to the main KartModel object. This copy
      *  should not be modified, not attachModel be called on it. */
-    const KartModel& getMasterKartModel() const {return *m_kart_model;        }
+    const KartModel& getMasterKartModel() const
+    {
+        ensureKartModelLoaded();
+        return *m_kart_model;
+    }
+    // ------------------------------------------------------------------------
+    void ensureKartModelLoaded() const;
     // ------------------------------------------------------------------------
     void setHatMeshName(const std::string &hat_name);
     // ------------------------------------------------------------------------
@@ -27,6 +27,7 @@
 #include "graphics/irr_driver.hpp"
 #include "guiengine/engine.hpp"
 #include "io/file_manager.hpp"
+#include "io/utf_writer.hpp"
 #include "karts/kart_properties.hpp"
 #include "karts/xml_characteristic.hpp"
 #include "utils/log.hpp"
@@ -42,6 +43,9 @@ KartPropertiesManager *kart_properties_manager=0;
 
 std::vector<std::string> KartPropertiesManager::m_kart_search_path;
 
+/** Increase if the content of the kart index changes. */
+static const int KART_INDEX_VERSION = 1;
+
 /** Constructor, only clears internal data structures. */
 KartPropertiesManager::KartPropertiesManager()
 {
@@ -143,17 +147,66 @@ void KartPropertiesManager::removeKart(const std::string &ident)
 }   // removeKart
 
 //-----------------------------------------------------------------------------
-/** Loads all kart properties and models.
+/** Loads all kart properties and models. The models of karts that were
+ *  loaded successfully in a previous run and did not change since then
+ *  (according to the kart index) are only loaded on first use.
  */
 void KartPropertiesManager::loadAllKarts(bool loading_icon)
 {
     m_all_kart_dirs.clear();
+
+    // Read the kart index of the last run
+    std::map<std::string, std::pair<int64_t, int64_t> > index_entries;
+    const std::string index_file = getKartIndexFile();
+    XMLNode *index = NULL;
+    if (!index_file.empty() && file_manager->fileExists(index_file))
+        index = file_manager->createXMLTree(index_file);
+    int version = 0;
+    if (index && index->getName() == "kart-index" &&
+        index->get("version", &version) && version == KART_INDEX_VERSION)
+    {
+        for (unsigned int i = 0; i < index->getNumNodes(); i++)
+        {
+            const XMLNode *entry = index->getNode(i);
+            std::string dir;
+            int64_t dir_mtime = 0, xml_mtime = 0;
+            if (entry->getName() != "kart" || !entry->get("dir", &dir))
+                continue;
+            entry->get("dir-mtime", &dir_mtime);
+            entry->get("xml-mtime", &xml_mtime);
+            dir = StringUtils::wideToUtf8(StringUtils::xmlDecode(dir));
+            index_entries[dir] = std::make_pair(dir_mtime, xml_mtime);
+        }
+    }
+    delete index;
+
+    // Modification times of all kart directories and kart.xml files
+    std::map<std::string, std::pair<uint64_t, uint64_t> > mtimes;
+    bool index_outdated = false;
+    auto load_kart = [&](const std::string &dir)
+    {
+        std::string config_filename = dir + "/kart.xml";
+        if (!file_manager->fileExists(config_filename))
+            return false;
+        std::pair<uint64_t, uint64_t> mtime(
+            file_manager->getModificationTime(dir),
+            file_manager->getModificationTime(config_filename));
+        mtimes[dir] = mtime;
+        auto it = index_entries.find(dir);
+        const bool unchanged = it != index_entries.end() &&
+            (uint64_t)it->second.first == mtime.first &&
+            (uint64_t)it->second.second == mtime.second;
+        if (!unchanged)
+            index_outdated = true;
+        return loadKart(dir, /*load_model*/!unchanged);
+    };   // load_kart
+
     std::vector<std::string>::const_iterator dir;
     for(dir = m_kart_search_path.begin(); dir!=m_kart_search_path.end(); dir++)
     {
         // First check if there is a kart in the current directory
         // -------------------------------------------------------
-        if(loadKart(*dir)) continue;
+        if(load_kart(*dir)) continue;
 
         // If not, check each subdir of this directory.
         // --------------------------------------------
@@ -162,7 +215,7 @@ void KartPropertiesManager::loadAllKarts(bool loading_icon)
         for(std::set<std::string>::const_iterator subdir=result.begin();
             subdir!=result.end(); subdir++)
         {
-            const bool loaded = loadKart(*dir+*subdir);
+            const bool loaded = load_kart(*dir+*subdir);
 
             if (loaded && loading_icon)
             {
@@ -173,8 +226,59 @@ void KartPropertiesManager::loadAllKarts(bool loading_icon)
             }
         }   // for all files in the currently handled directory
     }   // for i
+
+    // Also rewrite the index if karts were removed
+    if (index_outdated || index_entries.size() != m_all_kart_dirs.size())
+        saveKartIndex(mtimes);
 }   // loadAllKarts
 
+//-----------------------------------------------------------------------------
+/** Returns the name of the file which lists all karts that were successfully
+ *  loaded, or "" if there is no cache directory. */
+std::string KartPropertiesManager::getKartIndexFile() const
+{
+    if (file_manager->getCachedXMLDir().empty())
+        return "";
+    return file_manager->getCachedXMLDir() + "kart_index.xml";
+}   // getKartIndexFile
+
+//-----------------------------------------------------------------------------
+/** Saves the list of all loaded karts, together with the modification time
+ *  of the kart directory and kart.xml. The next run only loads the models of
+ *  these karts when they are needed.
+ *  \param mtimes Modification times taken before each kart was loaded.
+ */
+void KartPropertiesManager::saveKartIndex(const std::map<std::string,
+                                std::pair<uint64_t, uint64_t> >& mtimes) const
+{
+    const std::string filename = getKartIndexFile();
+    if (filename.empty())
+        return;
+    try
+    {
+        UTFWriter index(filename.c_str(), false);
+        index << "<?xml version=\"1.0\"?>\n";
+        index << "<kart-index version=\"" << KART_INDEX_VERSION << "\">\n";
+        for (const std::string &dir : m_all_kart_dirs)
+        {
+            auto it = mtimes.find(dir);
+            if (it == mtimes.end())
+                continue;
+            index << "    <kart dir=\""
+                  << StringUtils::xmlEncode(StringUtils::utf8ToWide(dir))
+                  << "\" dir-mtime=\"" << it->second.first
+                  << "\" xml-mtime=\"" << it->second.second << "\"/>\n";
+        }
+        index << "</kart-index>\n";
+        index.close();
+    }
+    catch (std::runtime_error& e)
+    {
+        Log::warn("KartPropertiesManager", "Failed to write kart index "
+                  "'%s': %s", filename.c_str(), e.what());
+    }
+}   // saveKartIndex
+
 //-----------------------------------------------------------------------------
 /** Loads the characteristics from the characteristics config file.
  *  \param root The xml node where the characteristics are stored.
@@ -235,8 +339,9 @@ void KartPropertiesManager::loadCharacteristics(const XMLNode *root)
 //-----------------------------------------------------------------------------
 /** Loads a single kart and (if not disabled) the corresponding 3d model.
  *  \param filename Full path to the kart config file.
+ *  \param load_model If false, the 3d model is loaded on first use.
  */
-bool KartPropertiesManager::loadKart(const std::string &dir)
+bool KartPropertiesManager::loadKart(const std::string &dir, bool load_model)
 {
     std::string config_filename = dir + "/kart.xml";
     if(!file_manager->fileExists(config_filename))
@@ -245,7 +350,7 @@ bool KartPropertiesManager::loadKart(const std::string &dir)
     KartProperties* kart_properties;
     try
     {
-        kart_properties = new KartProperties(config_filename);
+        kart_properties = new KartProperties(config_filename, load_model);
     }
     catch (std::runtime_error& err)
     {
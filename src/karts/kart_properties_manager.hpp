@@ -21,6 +21,7 @@
 #define HEADER_KART_PROPERTIES_MANAGER_HPP
 
 #include "utils/ptr_vector.hpp"
+#include <cstdint>
 #include <map>
 #include <memory>
 
@@ -69,6 +70,10 @@ private:
     std::map<std::string, std::unique_ptr<AbstractCharacteristic> > m_kart_type_characteristics;
     std::map<std::string, std::unique_ptr<AbstractCharacteristic> > m_player_characteristics;
 
+    std::string getKartIndexFile() const;
+    void        saveKartIndex(const std::map<std::string,
+                              std::pair<uint64_t, uint64_t> >& mtimes) const;
+
 protected:
 
     typedef PtrVector<KartProperties> KartPropertiesVector;
@@ -86,7 +91,8 @@ public:
                                            int i) const;
 
     void                     loadCharacteristics    (const XMLNode *root);
-    bool                     loadKart               (const std::string &dir);
+    bool                     loadKart               (const std::string &dir,
+                                                     bool load_model = true);
     void                     loadAllKarts           (bool loading_icon = true);
     void                     unloadAllKarts         ();
     void                     removeKart(const std::string &id);
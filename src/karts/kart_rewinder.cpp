@@ -440,6 +440,59 @@ void KartRewinder::update(int ticks)
     Kart::update(ticks);
 }   // update
 
+// ----------------------------------------------------------------------------
+/** Saves the state of this kart together with the values which are only
+ *  kept locally in a networked game (see getLocalStateRestoreFunction()), so
+ *  that restoreFullState() can restore the kart without any further state.
+ *  This is used by the history checkpoints, which also work in local races.
+ *  \return The state, or NULL if the kart is eliminated. The caller must
+ *          free it.
+ */
+BareNetworkString* KartRewinder::saveFullState()
+{
+    std::vector<std::string> ru;
+    BareNetworkString* buffer = saveState(&ru);
+    if (!buffer)
+        return NULL;
+
+    PlayerController* pc = dynamic_cast<PlayerController*>(m_controller);
+    const MaxSpeed::SpeedDecrease& terrain =
+        m_max_speed->m_speed_decrease[MaxSpeed::MS_DECREASE_TERRAIN];
+    buffer->addUInt32(m_brake_ticks).addUInt8(m_min_nitro_ticks)
+        .addUInt32(pc ? pc->m_steer_val_l : 0)
+        .addUInt32(pc ? pc->m_steer_val_r : 0)
+        .addFloat(terrain.m_current_fraction)
+        .addUInt16(terrain.m_max_speed_fraction)
+        .addFloat(m_skidding->m_remaining_jump_time);
+    return buffer;
+}   // saveFullState
+
+// ----------------------------------------------------------------------------
+/** Restores a state saved by saveFullState(). The world time must already
+ *  be set to the time the state was saved at.
+ *  \param buffer The state.
+ */
+void KartRewinder::restoreFullState(BareNetworkString* buffer)
+{
+    restoreState(buffer, buffer->size());
+
+    m_brake_ticks = buffer->getUInt32();
+    m_min_nitro_ticks = buffer->getUInt8();
+    const int steer_val_l = buffer->getUInt32();
+    const int steer_val_r = buffer->getUInt32();
+    PlayerController* pc = dynamic_cast<PlayerController*>(m_controller);
+    if (pc)
+    {
+        pc->m_steer_val_l = steer_val_l;
+        pc->m_steer_val_r = steer_val_r;
+    }
+    MaxSpeed::SpeedDecrease& terrain =
+        m_max_speed->m_speed_decrease[MaxSpeed::MS_DECREASE_TERRAIN];
+    terrain.m_current_fraction = buffer->getFloat();
+    terrain.m_max_speed_fraction = buffer->getUInt16();
+    m_skidding->m_remaining_jump_time = buffer->getFloat();
+}   // restoreFullState
+
 // ----------------------------------------------------------------------------
 std::function<void()> KartRewinder::getLocalStateRestoreFunction()
 {
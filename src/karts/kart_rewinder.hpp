@@ -46,6 +46,8 @@ public:
     virtual void restoreState(BareNetworkString *p, int count) OVERRIDE;
     virtual void rewindToEvent(BareNetworkString *p) OVERRIDE {}
     virtual void update(int ticks) OVERRIDE;
+    BareNetworkString* saveFullState();
+    void restoreFullState(BareNetworkString* buffer);
     // -------------------------------------------------------------------------
     virtual float getSteerPercent() const OVERRIDE
     {
@@ -73,7 +75,12 @@ public:
     virtual void undoEvent(BareNetworkString *p) OVERRIDE {}
     // ------------------------------------------------------------------------
     virtual std::function<void()> getLocalStateRestoreFunction() OVERRIDE;
-
+    // ------------------------------------------------------------------------
+    virtual bool getRelevancePosition(Vec3* xyz) const OVERRIDE
+    {
+        *xyz = getXYZ();
+        return true;
+    }
 
 };   // Rewinder
 #endif
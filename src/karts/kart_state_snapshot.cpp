@@ -0,0 +1,78 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "karts/kart_state_snapshot.hpp"
+
+#include "karts/abstract_kart.hpp"
+#include "modes/world.hpp"
+
+// ----------------------------------------------------------------------------
+/** Returns the flags of kart i of the world. */
+uint8_t KartStateSnapshot::computeFlags(const World* world, unsigned i) const
+{
+    const AbstractKart* kart = world->getKart(i);
+    uint8_t flags = 0;
+    if (kart->isEliminated())
+        flags |= KF_ELIMINATED;
+    if (kart->hasFinishedRace())
+        flags |= KF_FINISHED;
+    if (kart->getKartAnimation())
+        flags |= KF_ANIMATION;
+    if (kart->isGhostKart())
+        flags |= KF_GHOST;
+    return flags;
+}   // computeFlags
+
+// ----------------------------------------------------------------------------
+/** Copies the values of all karts of the world.
+ */
+void KartStateSnapshot::update(const World* world)
+{
+    const unsigned num_karts = world->getNumKarts();
+    m_xyz.resize(num_karts);
+    m_front_xyz.resize(num_karts);
+    m_velocity.resize(num_karts);
+    m_forward_speed.resize(num_karts);
+    m_flags.resize(num_karts);
+
+    for (unsigned i = 0; i < num_karts; i++)
+    {
+        const AbstractKart* kart = world->getKart(i);
+        m_xyz[i]           = kart->getXYZ();
+        m_front_xyz[i]     = kart->getFrontXYZ();
+        m_velocity[i]      = kart->getVelocity();
+        m_forward_speed[i] = kart->getVelocityLC().getZ();
+        m_flags[i]         = computeFlags(world, i);
+    }
+}   // update
+
+// ----------------------------------------------------------------------------
+/** Only updates the flags, used when karts might have finished the race or
+ *  been eliminated after the snapshot was taken (e.g. by a checkline in the
+ *  same tick).
+ */
+void KartStateSnapshot::updateFlags(const World* world)
+{
+    if (m_flags.size() != world->getNumKarts())
+    {
+        update(world);
+        return;
+    }
+    for (unsigned i = 0; i < m_flags.size(); i++)
+        m_flags[i] = computeFlags(world, i);
+}   // updateFlags
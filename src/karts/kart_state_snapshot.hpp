@@ -0,0 +1,84 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_KART_STATE_SNAPSHOT_HPP
+#define HEADER_KART_STATE_SNAPSHOT_HPP
+
+#include "utils/types.hpp"
+#include "utils/vec3.hpp"
+
+#include <vector>
+
+class World;
+
+/** A copy of the kart values which are read most often by loops over all
+ *  karts (checklines, race positions, crash detection of the AI), stored as
+ *  one contiguous array per value instead of behind the pointers of each
+ *  kart. It is refreshed once per tick by World::update after the physics
+ *  update, so all karts are seen at the same time independent of the order
+ *  in which they are updated, and it can be read from several threads.
+ *  \ingroup karts
+ */
+class KartStateSnapshot
+{
+public:
+    enum KartFlag : uint8_t
+    {
+        KF_ELIMINATED   = 1,
+        KF_FINISHED     = 2,
+        KF_ANIMATION    = 4,
+        KF_GHOST        = 8
+    };
+
+private:
+    std::vector<Vec3>    m_xyz;
+    std::vector<Vec3>    m_front_xyz;
+    std::vector<Vec3>    m_velocity;
+    /** Speed in the direction of the kart (z of the local velocity). */
+    std::vector<float>   m_forward_speed;
+    std::vector<uint8_t> m_flags;
+
+    // ------------------------------------------------------------------------
+    uint8_t computeFlags(const World* world, unsigned i) const;
+
+public:
+    // ------------------------------------------------------------------------
+    void update(const World* world);
+    // ------------------------------------------------------------------------
+    void updateFlags(const World* world);
+    // ------------------------------------------------------------------------
+    unsigned getNumKarts() const              { return (unsigned)m_xyz.size(); }
+    // ------------------------------------------------------------------------
+    const Vec3& getXYZ(unsigned i) const                  { return m_xyz[i]; }
+    // ------------------------------------------------------------------------
+    const Vec3& getFrontXYZ(unsigned i) const       { return m_front_xyz[i]; }
+    // ------------------------------------------------------------------------
+    const Vec3& getVelocity(unsigned i) const        { return m_velocity[i]; }
+    // ------------------------------------------------------------------------
+    float getForwardSpeed(unsigned i) const     { return m_forward_speed[i]; }
+    // ------------------------------------------------------------------------
+    bool hasFlag(unsigned i, KartFlag f) const
+                                            { return (m_flags[i] & f) != 0; }
+    // ------------------------------------------------------------------------
+    /** Returns true if the kart is neither eliminated nor finished. */
+    bool isRacing(unsigned i) const
+                     { return (m_flags[i] & (KF_ELIMINATED | KF_FINISHED)) == 0; }
+
+};   // KartStateSnapshot
+
+#endif // HEADER_KART_STATE_SNAPSHOT_HPP
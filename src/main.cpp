@@ -183,6 +183,7 @@
 #include "config/stk_config.hpp"
 #include "config/user_config.hpp"
 #include "font/font_manager.hpp"
+#include "font/text_layout_cache.hpp"
 #include "graphics/camera.hpp"
 #include "graphics/camera_debug.hpp"
 #include "graphics/central_settings.hpp"
@@ -192,7 +193,9 @@
 #include "graphics/particle_kind_manager.hpp"
 #include "graphics/referee.hpp"
 #include "graphics/sp/sp_base.hpp"
+#include "graphics/sp/sp_culling.hpp"
 #include "graphics/sp/sp_shader.hpp"
+#include "graphics/sp/sp_texture_manager.hpp"
 #include "guiengine/engine.hpp"
 #include "guiengine/event_handler.hpp"
 #include "guiengine/dialog_queue.hpp"
@@ -217,17 +220,25 @@
 #include "network/protocols/connect_to_server.hpp"
 #include "network/protocols/client_lobby.hpp"
 #include "network/protocols/server_lobby.hpp"
+#include "network/load_tester.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
+#include "network/parallel_packet_sender.hpp"
 #include "network/rewind_manager.hpp"
 #include "network/rewind_queue.hpp"
 #include "network/server.hpp"
 #include "network/server_config.hpp"
+#include "network/server_messages.hpp"
+#include "network/server_plugins.hpp"
 #include "network/servers_manager.hpp"
+#include "network/spectator_relay.hpp"
+#include "network/state_scheduler.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "online/profile_manager.hpp"
 #include "online/request_manager.hpp"
+#include "physics/parallel_island_solver.hpp"
+#include "physics/triangle_mesh.hpp"
 #include "race/grand_prix_manager.hpp"
 #include "race/highscore_manager.hpp"
 #include "race/history.hpp"
@@ -247,16 +258,20 @@
 #include "utils/command_line.hpp"
 #include "utils/constants.hpp"
 #include "utils/crash_reporting.hpp"
+#include "utils/histogram.hpp"
 #include "utils/leak_check.hpp"
 #include "utils/log.hpp"
 #include "utils/mini_glm.hpp"
 #include "utils/profiler.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/trace_recorder.hpp"
 #include "utils/translation.hpp"
+#include "utils/worker_pool.hpp"
 
 static void cleanSuperTuxKart();
 static void cleanUserConfig();
 void runUnitTests();
+void prepareTextureCache();
 
 // ============================================================================
 //                        gamepad visualisation screen
@@ -560,6 +575,8 @@ void cmdLineHelp()
     "       --stk-config=FILE  use ./data/FILE instead of "
                               "./data/stk_config.xml\n"
     "  -k,  --numkarts=NUM     Set number of karts on the racetrack.\n"
+    "       --physics-threads=N Solve independent groups of physics objects\n"
+    "                          with N threads (0 disables it).\n"
     "       --kart=NAME        Use kart NAME.\n"
     "       --ai=a,b,...       Use the karts a, b, ... for the AI, and additional player kart.\n"
     "       --aiNP=a,b,...     Use the karts a, b, ... for the AI, no additional player kart.\n"
@@ -596,6 +613,10 @@ void cmdLineHelp()
     "       --demo-laps=n      Number of laps to use in a demo.\n"
     "       --demo-karts=n     Number of karts to use in a demo.\n"
     // "       --history          Replay history file 'history.dat'.\n"
+    "       --record-history=file Write the history of each race to file while\n"
+    "                          racing, with checkpoints for --history-seek.\n"
+    // "       --history-check    Compare each checkpoint of a replayed history\n"
+    // "                          with the state of the replay.\n"
     // "       --test-ai=n        Use the test-ai for every n-th AI kart.\n"
     // "                          (so n=1 means all Ais will be the test ai)\n"
     // "
@@ -613,6 +634,18 @@ void cmdLineHelp()
     "                          (in format x.x.x.x:xxx(port)), the port should be its\n"
     "                          public port.\n"
     "       --server-id=n      Server id in stk addons for --connect-now.\n"
+    "       --relay=ip         Relay the games of the server at ip (x.x.x.x:xxx) to\n"
+    "                          spectators, which connect to --port of the relay.\n"
+    "       --relay-delay=s    Delay in seconds of the relayed games (default 0).\n"
+    "       --relay-spectators=n Maximum number of spectators of the relay\n"
+    "                          (default 256).\n"
+    "       --load-test=ip     Connect simulated clients to the server at ip\n"
+    "                          (x.x.x.x:xxx) and log statistics of its game states.\n"
+    "       --load-test-clients=n Number of simulated clients (default 8).\n"
+    "       --load-test-duration=s Seconds to run the load test (default until\n"
+    "                          terminated).\n"
+    "       --load-test-actions=n Average actions per second of each simulated\n"
+    "                          player (default 10).\n"
     "       --network-ai=n     Numbers of AI for connecting to linear race server, used\n"
     "                          together with --connect-now.\n"
     "       --login=s          Automatically log in (set the login).\n"
@@ -669,6 +702,8 @@ void cmdLineHelp()
     "       --disable-mlaa     Disable anti-aliasing.\n"
     "       --enable-texture-compression Enable texture compression.\n"
     "       --disable-texture-compression Disable texture compression.\n"
+    "       --prepare-texture-cache Compress the textures of all karts and\n"
+    "                          tracks into the texture cache, then exit.\n"
     "       --enable-ssao      Enable screen space ambient occlusion.\n"
     "       --disable-ssao     Disable screen space ambient occlusion.\n"
     "       --enable-ibl       Enable image based lighting.\n"
@@ -1520,6 +1555,9 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
                      (int)UserConfigParams::m_default_num_karts);
     }   // --numkarts
 
+    if(CommandLine::has("--physics-threads", &n))
+        UserConfigParams::m_physics_threads = std::max(n, 0);
+
     if(CommandLine::has( "--no-start-screen") ||
         CommandLine::has("-N")                   )
         UserConfigParams::m_no_start_screen = true;
@@ -1578,7 +1616,19 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         race_manager->setNumLaps(999999); // profile end depends on time
     }   // --profile-time
 
-    if(CommandLine::has("--history"))
+    if(CommandLine::has("--record-history", &s))
+        history->setStreamFilename(s);
+    if(CommandLine::has("--history-seek", &n))
+        history->setSeekTicks(stk_config->time2Ticks((float)n));
+    if(CommandLine::has("--history-check"))
+        history->setCheckCheckpoints(true);
+    bool replay_history = CommandLine::has("--history");
+    if(CommandLine::has("--history", &s))
+    {
+        history->setFilename(s);
+        replay_history = true;
+    }
+    if(replay_history)
     {
         history->setReplayHistory(true);
         // Force the no-start screen flag, since this initialises
@@ -1852,6 +1902,8 @@ void main_abort()
     {
         main_loop->requestAbort();
     }
+    SpectatorRelay::requestAbort();
+    LoadTester::requestAbort();
 }
 #ifdef ANDROID
 }
@@ -1863,6 +1915,7 @@ int main(int argc, char *argv[] )
     CommandLine::init(argc, argv);
 
     CrashReporting::installHandlers();
+    TraceRecorder::installSignalHandler();
 #ifndef WIN32
     signal(SIGTERM, [](int signum)
         {
@@ -1955,6 +2008,12 @@ int main(int argc, char *argv[] )
             ServerConfig::m_wan_server = false;
             ServerConfig::m_validating_player = false;
         }
+        else if (CommandLine::has("--relay") ||
+            CommandLine::has("--load-test"))
+        {
+            ProfileWorld::disableGraphics();
+            UserConfigParams::m_enable_sound = false;
+        }
 
         if (!ProfileWorld::isNoGraphics())
             profiler.init();
@@ -2071,6 +2130,49 @@ int main(int argc, char *argv[] )
             exit(0);
         }
 
+        if (CommandLine::has("--relay", &s))
+        {
+            float delay = 0.0f;
+            int spectators = 256;
+            CommandLine::has("--relay-delay", &delay);
+            CommandLine::has("--relay-spectators", &spectators);
+            const uint16_t port = ServerConfig::m_server_port != 0 ?
+                (uint16_t)ServerConfig::m_server_port :
+                (uint16_t)stk_config->m_server_port;
+            {
+                SpectatorRelay relay(TransportAddress(s), port,
+                    (unsigned)std::max(spectators, 1), delay);
+                relay.run();
+            }
+            Log::flushBuffers();
+            exit(0);
+        }
+
+        if (CommandLine::has("--load-test", &s))
+        {
+            int clients = 8;
+            float duration = 0.0f, actions = 10.0f;
+            CommandLine::has("--load-test-clients", &clients);
+            CommandLine::has("--load-test-duration", &duration);
+            CommandLine::has("--load-test-actions", &actions);
+            {
+                LoadTester tester(TransportAddress(s),
+                    (unsigned)std::max(clients, 1), duration, actions);
+                tester.run();
+            }
+            Log::flushBuffers();
+            exit(0);
+        }
+
+#ifndef SERVER_ONLY
+        if (!ProfileWorld::isNoGraphics() &&
+            CommandLine::has("--prepare-texture-cache"))
+        {
+            prepareTextureCache();
+            exit(0);
+        }
+#endif
+
 #ifndef SERVER_ONLY
         if (!ProfileWorld::isNoGraphics())
         {
@@ -2442,6 +2544,22 @@ void runUnitTests()
     NetworkString::unitTesting();
     Log::info("UnitTest", "TransportAddress");
     TransportAddress::unitTesting();
+    Log::info("UnitTest", "RequestManager lanes");
+    Online::RequestManager::unitTesting();
+    Log::info("UnitTest", "WorkerPool");
+    WorkerPool::unitTesting();
+    Log::info("UnitTest", "ParallelPacketSender");
+    ParallelPacketSender::unitTesting();
+    Log::info("UnitTest", "Histogram");
+    Histogram::unitTesting();
+    Log::info("UnitTest", "TraceRecorder");
+    TraceRecorder::unitTesting();
+    Log::info("UnitTest", "StateScheduler");
+    StateScheduler::unitTesting();
+    Log::info("UnitTest", "ServerPlugins");
+    ServerPlugins::unitTesting();
+    Log::info("UnitTest", "ServerMessages");
+    ServerMessages::unitTesting();
     Log::info("UnitTest", "StringUtils::versionToInt");
     StringUtils::unitTesting();
 
@@ -2482,16 +2600,62 @@ void runUnitTests()
     Log::info("UnitTest", "Kart characteristics");
     CombinedCharacteristic::unitTesting();
 
+    Log::info("UnitTest", "TriangleMesh ray packets");
+    TriangleMesh::unitTesting();
+
+    Log::info("UnitTest", "Parallel physics islands");
+    ParallelIslandSolver::unitTesting();
+
     Log::info("UnitTest", "Arena Graph");
     ArenaGraph::unitTesting();
 
     Log::info("UnitTest", "Fonts for translation");
     font_manager->unitTesting();
 
+    Log::info("UnitTest", "Glyph table and text layout cache");
+    TextLayoutCache::unitTesting();
+
     Log::info("UnitTest", "RewindQueue");
     RewindQueue::unitTesting();
 
+    Log::info("UnitTest", "Replay frame encoding");
+    ReplayBase::unitTesting();
+
+    Log::info("UnitTest", "SPCulling");
+    SP::SPCulling::unitTesting();
+
     Log::info("UnitTest", "=====================");
     Log::info("UnitTest", "Testing successful   ");
     Log::info("UnitTest", "=====================");
 }   // runUnitTests
+
+//=============================================================================
+/** Fills the texture cache for all installed karts and tracks, so that later
+ *  starts (and kiosk machines sharing the cache) don't compress at runtime.
+ */
+void prepareTextureCache()
+{
+#ifndef SERVER_ONLY
+    if (!CVS->isTextureCompressionEnabled())
+    {
+        Log::error("main", "Texture compression is disabled or not supported,"
+            " no texture cache to prepare.");
+        return;
+    }
+    for (unsigned i = 0; i < kart_properties_manager->getNumberOfKarts(); i++)
+    {
+        const KartProperties* kp = kart_properties_manager->getKartById(i);
+        SP::SPTextureManager::get()->prepareTextureCache(kp->getKartDir(),
+            "karts/" + kp->getIdent());
+    }
+    for (unsigned i = 0; i < track_manager->getNumberOfTracks(); i++)
+    {
+        const Track* track = track_manager->getTrack(i);
+        SP::SPTextureManager::get()->prepareTextureCache(
+            StringUtils::getPath(track->getFilename()) + "/",
+            "tracks/" + track->getIdent());
+    }
+    Log::info("main", "Texture cache prepared in %s.",
+        file_manager->getCachedTexturesDir().c_str());
+#endif
+}   // prepareTextureCache
@@ -38,6 +38,7 @@
 #include "network/protocol_manager.hpp"
 #include "network/race_event_manager.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/server_metrics.hpp"
 #include "network/stk_host.hpp"
 #include "online/request_manager.hpp"
 #include "race/history.hpp"
@@ -509,7 +510,10 @@ void MainLoop::run()
                 PROFILER_PUSH_CPU_MARKER("Update race", 0, 255, 255);
                 if (World::getWorld())
                 {
+                    const uint64_t start_time = StkTime::getMonoTimeUs();
                     updateRace(1, fast_forward);
+                    ServerMetrics::add(ServerMetrics::SM_WORLD_UPDATE_TIME,
+                        StkTime::getMonoTimeUs() - start_time);
                 }
                 PROFILER_POP_CPU_MARKER();
 
@@ -570,6 +574,8 @@ void MainLoop::run()
         }
         PROFILER_POP_CPU_MARKER();   // MainLoop pop
         PROFILER_SYNC_FRAME();
+        TraceRecorder::update();
+        ServerMetrics::update();
     }  // while !m_abort
 
 #ifdef WIN32
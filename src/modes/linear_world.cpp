@@ -818,6 +818,8 @@ void LinearWorld::updateRacePosition()
     // Mostly for debugging:
     beginSetKartPositions();
     const unsigned int kart_amount = (unsigned int) m_karts.size();
+    // Karts can finish or be eliminated after the snapshot of this tick
+    m_kart_snapshot.updateFlags(this);
 
 #ifdef DEBUG
     bool rank_changed = false;
@@ -853,7 +855,8 @@ void LinearWorld::updateRacePosition()
         for (unsigned int j = 0 ; j < kart_amount ; j++)
         {
             // don't compare a kart with itself and ignore eliminated karts
-            if(j == my_id || m_karts[j]->isEliminated())
+            if(j == my_id ||
+               m_kart_snapshot.hasFlag(j, KartStateSnapshot::KF_ELIMINATED))
                 continue;
 
             // If the other kart has:
@@ -861,7 +864,8 @@ void LinearWorld::updateRacePosition()
             // - or is ahead
             // - or has the same distance (very unlikely) but started earlier
             // it is ahead --> increase position
-            if((!kart->hasFinishedRace() && m_karts[j]->hasFinishedRace()) ||
+            if((!kart->hasFinishedRace() &&
+                m_kart_snapshot.hasFlag(j, KartStateSnapshot::KF_FINISHED)) ||
                 m_kart_info[j].m_overall_distance > my_distance            ||
                (m_kart_info[j].m_overall_distance == my_distance &&
                 m_karts[j]->getInitialPosition()<kart->getInitialPosition() ) )
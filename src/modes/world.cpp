@@ -398,6 +398,7 @@ void World::reset(bool restart)
     // Reset all data structures that depend on number of karts.
     irr_driver->reset();
     m_unfair_team = false;
+    m_kart_snapshot.update(this);
 }   // reset
 
 //-----------------------------------------------------------------------------
@@ -439,7 +440,9 @@ std::shared_ptr<AbstractKart> World::createKart
     int position           = index+1;
     btTransform init_pos   = getStartTransform(index - gk);
     std::shared_ptr<AbstractKart> new_kart;
-    if (RewindManager::get()->isEnabled())
+    // History checkpoints save the karts with the rewinder functions, which
+    // also work if the rewind manager is not used (local races)
+    if (RewindManager::get()->isEnabled() || history->usesCheckpoints())
     {
         auto kr = std::make_shared<KartRewinder>(kart_ident, index, position,
             init_pos, difficulty, ri);
@@ -559,6 +562,7 @@ Controller* World::loadAIController(AbstractKart* kart)
 World::~World()
 {
     material_manager->unloadAllTextures();
+    history->stopRecording();
     RewindManager::destroy();
 
     irr_driver->onUnloadWorld();
@@ -1092,6 +1096,7 @@ void World::update(int ticks)
     PROFILER_PUSH_CPU_MARKER("World::update (RewindManager)", 0x20, 0x7F, 0x40);
     RewindManager::get()->update(ticks);
     PROFILER_POP_CPU_MARKER();
+    history->update(getTicksSinceStart());
 
     PROFILER_PUSH_CPU_MARKER("World::update (Track object manager)", 0x20, 0x7F, 0x40);
     Track::getCurrentTrack()->getTrackObjectManager()->update(stk_config->ticks2Time(ticks));
@@ -1124,6 +1129,8 @@ void World::update(int ticks)
     Physics::getInstance()->update(ticks);
     PROFILER_POP_CPU_MARKER();
 
+    m_kart_snapshot.update(this);
+
     PROFILER_POP_CPU_MARKER();
 
 #ifdef DEBUG
@@ -1479,7 +1486,9 @@ std::shared_ptr<AbstractKart> World::createKartWithTeam
         std::make_shared<RenderInfo>(1.0f));
 
     std::shared_ptr<AbstractKart> new_kart;
-    if (RewindManager::get()->isEnabled())
+    // History checkpoints save the karts with the rewinder functions, which
+    // also work if the rewind manager is not used (local races)
+    if (RewindManager::get()->isEnabled() || history->usesCheckpoints())
     {
         auto kr = std::make_shared<KartRewinder>(kart_ident, index, position,
             init_pos, difficulty, ri);
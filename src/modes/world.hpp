@@ -32,6 +32,7 @@
 #include <stdexcept>
 
 #include "graphics/weather.hpp"
+#include "karts/kart_state_snapshot.hpp"
 #include "modes/world_status.hpp"
 #include "race/highscores.hpp"
 #include "states_screens/race_gui_base.hpp"
@@ -112,6 +113,10 @@ protected:
     KartList                  m_karts;
     RandomGenerator           m_random;
 
+    /** Copy of the hot values of all karts, refreshed after each physics
+     *  update. */
+    KartStateSnapshot         m_kart_snapshot;
+
     AbstractKart* m_fastest_kart;
     /** Number of eliminated karts. */
     int         m_eliminated_karts;
@@ -319,6 +324,9 @@ public:
     /** Returns all karts. */
     const KartList & getKarts() const { return m_karts; }
     // ------------------------------------------------------------------------
+    /** Returns the values of all karts at the end of the last tick. */
+    const KartStateSnapshot& getKartSnapshot() const { return m_kart_snapshot; }
+    // ------------------------------------------------------------------------
     /** Returns the number of currently active (i.e.non-elikminated) karts. */
     unsigned int    getCurrentNumKarts() const { return (int)m_karts.size() -
                                                          m_eliminated_karts; }
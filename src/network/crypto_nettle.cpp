@@ -21,6 +21,7 @@
 #include "network/crypto_nettle.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
+#include "network/packet_buffer_pool.hpp"
 
 #include <nettle/base64.h>
 #include <nettle/version.h>
@@ -101,7 +102,7 @@ bool Crypto::decryptConnectionRequest(BareNetworkString& ns)
 ENetPacket* Crypto::encryptSend(BareNetworkString& ns, bool reliable)
 {
     // 4 bytes counter and 4 bytes tag
-    ENetPacket* p = enet_packet_create(NULL, ns.m_buffer.size() + 8,
+    ENetPacket* p = PacketBufferPool::createPacket(ns.m_buffer.size() + 8,
         (reliable ? ENET_PACKET_FLAG_RELIABLE :
         (ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT))
         );
@@ -146,7 +147,10 @@ ENetPacket* Crypto::encryptSend(BareNetworkString& ns, bool reliable)
 NetworkString* Crypto::decryptRecieve(ENetPacket* p)
 {
     int clen = (int)(p->dataLength - 8);
-    auto ns = std::unique_ptr<NetworkString>(new NetworkString(p->data, clen));
+    // The whole buffer is overwritten by the decrypted message
+    std::unique_ptr<NetworkString, void(*)(NetworkString*)> ns(
+        NetworkString::createReceived(NULL, clen),
+        NetworkString::releaseReceived);
 
     std::array<uint8_t, 12> iv = {};
     if (NetworkConfig::get()->isClient())
@@ -24,6 +24,7 @@
 #include "utils/log.hpp"
 #include "utils/time.hpp"
 
+#include <assert.h>
 #include <string.h>
 
 /** \brief Constructor
@@ -41,9 +42,11 @@ constexpr bool isConnectionRequestPacket(unsigned char* data, size_t length)
 // ============================================================================
 Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
 {
-    m_arrival_time = StkTime::getMonoTimeMs();
+    m_arrival_time_us = StkTime::getMonoTimeUs();
+    m_arrival_time = m_arrival_time_us / 1000;
     m_pdi = PDI_TIMEOUT;
     m_peer = peer;
+    m_data = NULL;
 
     switch (event->type)
     {
@@ -82,9 +85,27 @@ Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
         }
         else
         {
-            m_data = new NetworkString(event->packet->data, 
+            m_data = NetworkString::createReceived(event->packet->data,
                 (int)event->packet->dataLength);
         }
+        if (m_data && m_data->getTotalSize() > 0 && m_data->isCompressed())
+        {
+            try
+            {
+                if (!m_peer->acceptsCompressed())
+                {
+                    throw std::runtime_error("Compressed message from a peer "
+                        "which did not negotiate compression.");
+                }
+                m_data->decompress();
+            }
+            catch (std::exception&)
+            {
+                NetworkString::releaseReceived(m_data);
+                m_data = NULL;
+                throw;
+            }
+        }
     }
     else
         m_data = NULL;
@@ -102,6 +123,54 @@ Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
  */
 Event::~Event()
 {
-    delete m_data;
+    NetworkString::releaseReceived(m_data);
 }   // ~Event
 
+// ----------------------------------------------------------------------------
+std::vector<void*> Event::m_free_events;
+std::mutex Event::m_free_events_mutex;
+// ----------------------------------------------------------------------------
+/** Events are created for each received packet in the listening thread and
+ *  deleted after dispatch in other threads, so their memory is kept in a
+ *  free list instead of going through the allocator each time.
+ */
+void* Event::operator new(size_t size)
+{
+    assert(size == sizeof(Event));
+    std::unique_lock<std::mutex> ul(m_free_events_mutex);
+    if (!m_free_events.empty())
+    {
+        void* p = m_free_events.back();
+        m_free_events.pop_back();
+        return p;
+    }
+    ul.unlock();
+    return ::operator new(size);
+}   // operator new
+
+// ----------------------------------------------------------------------------
+void Event::operator delete(void* p)
+{
+    const size_t MAX_FREE_EVENTS = 1024;
+    if (!p)
+        return;
+    std::unique_lock<std::mutex> ul(m_free_events_mutex);
+    if (m_free_events.size() < MAX_FREE_EVENTS)
+    {
+        m_free_events.push_back(p);
+        return;
+    }
+    ul.unlock();
+    ::operator delete(p);
+}   // operator delete
+
+// ----------------------------------------------------------------------------
+/** Frees the memory of all pooled events. */
+void Event::clearPool()
+{
+    std::lock_guard<std::mutex> lock(m_free_events_mutex);
+    for (void* p : m_free_events)
+        ::operator delete(p);
+    m_free_events.clear();
+}   // clearPool
+
@@ -31,6 +31,8 @@
 #include "enet/enet.h"
 
 #include <memory>
+#include <mutex>
+#include <vector>
 
 class STKPeer;
 
@@ -86,13 +88,28 @@ private:
     /** Arrivial time of the event, for timeouts. */
     uint64_t m_arrival_time;
 
+    /** Arrival time in microseconds, for latency statistics. */
+    uint64_t m_arrival_time_us;
+
     /** For disconnection event, a bit more info is provided. */
     PeerDisconnectInfo m_pdi;
 
+    /** Memory of deleted events, reused by operator new. */
+    static std::vector<void*> m_free_events;
+
+    static std::mutex m_free_events_mutex;
+
 public:
          Event(ENetEvent* event, std::shared_ptr<STKPeer> peer);
         ~Event();
 
+    // ------------------------------------------------------------------------
+    static void* operator new(size_t size);
+    // ------------------------------------------------------------------------
+    static void operator delete(void* p);
+    // ------------------------------------------------------------------------
+    static void clearPool();
+
     // ------------------------------------------------------------------------
     /** Returns the type of this event. */
     EVENT_TYPE getType() const { return m_type; }
@@ -121,6 +138,9 @@ public:
     /** Returns the arrival time of this event. */
     uint64_t getArrivalTime() const { return m_arrival_time; }
     // ------------------------------------------------------------------------
+    /** Returns the arrival time of this event in microseconds. */
+    uint64_t getArrivalTimeUs() const { return m_arrival_time_us; }
+    // ------------------------------------------------------------------------
     PeerDisconnectInfo getPeerDisconnectInfo() const { return m_pdi; }
     // ------------------------------------------------------------------------
 
@@ -0,0 +1,535 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/load_tester.hpp"
+
+#include "config/stk_config.hpp"
+#include "input/input.hpp"
+#include "karts/kart_properties_manager.hpp"
+#include "network/event.hpp"
+#include "network/network.hpp"
+#include "network/network_string.hpp"
+#include "network/peer_vote.hpp"
+#include "network/protocols/game_protocol.hpp"
+#include "network/protocols/lobby_protocol.hpp"
+#include "network/remote_kart_info.hpp"
+#include "network/server_config.hpp"
+#include "network/server_messages.hpp"
+#include "network/stk_peer.hpp"
+#include "tracks/track_manager.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/time.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+std::atomic_bool LoadTester::m_abort(false);
+
+namespace
+{
+    /** Buttons which are pressed and released by the simulated players. */
+    const PlayerAction g_buttons[3] = { PA_NITRO, PA_DRIFT, PA_FIRE };
+}   // anonymous namespace
+
+// ----------------------------------------------------------------------------
+/** Creates the sockets of all simulated clients.
+ *  \param server Address of the server to test.
+ *  \param clients Number of simulated clients, each with one player.
+ *  \param duration Time in seconds to run the test, 0 to run until aborted.
+ *  \param action_rate Average number of actions per second of a player.
+ */
+LoadTester::LoadTester(const TransportAddress& server, unsigned clients,
+                       float duration, float action_rate)
+          : m_server_address(server), m_random(std::random_device()())
+{
+    m_duration = (uint64_t)(std::max(duration, 0.0f) * 1000.0f);
+    m_action_rate = std::max(action_rate, 0.1f);
+    m_state_frequency = 10;
+    m_state_count = m_state_bytes = m_action_count = m_game_count = 0;
+    m_reported_states = m_reported_bytes = m_reported_actions = 0;
+    m_start_time = m_next_report_time = m_last_report_time = 0;
+    m_last_game_start = 0;
+
+    if (enet_initialize() != 0)
+        Log::error("LoadTester", "Could not initialize enet.");
+    m_clients.resize(std::max(clients, 1u));
+    for (Client& client : m_clients)
+    {
+        ENetAddress addr;
+        addr.host = ENET_HOST_ANY;
+        addr.port = ENET_PORT_ANY;
+        client.m_network = new Network(/*peer_count*/1,
+            /*channel_limit*/EVENT_CHANNEL_COUNT, /*max_in_bandwidth*/0,
+            /*max_out_bandwidth*/0, &addr);
+        client.m_peer = NULL;
+        client.m_state = CS_DISCONNECTED;
+        client.m_host_id = 0;
+        client.m_timer_offset = 0;
+        client.m_timer_synchronised = false;
+        client.m_start_time = 0;
+        client.m_next_action_time = 0;
+        client.m_result_ack_time = 0;
+        client.m_last_state_ticks = 0;
+        client.m_last_state_time = 0;
+        client.m_steer = 0;
+        client.m_pressed = 0;
+    }
+}   // LoadTester
+
+// ----------------------------------------------------------------------------
+LoadTester::~LoadTester()
+{
+    for (Client& client : m_clients)
+        delete client.m_network;
+    enet_deinitialize();
+}   // ~LoadTester
+
+// ----------------------------------------------------------------------------
+/** Connects all clients and runs them until the test time is over, all
+ *  clients are disconnected or requestAbort is called.
+ */
+void LoadTester::run()
+{
+    m_start_time = StkTime::getMonoTimeMs();
+    for (Client& client : m_clients)
+    {
+        if (!client.m_network->getENetHost())
+        {
+            Log::error("LoadTester", "Can't create a socket, try less "
+                "clients or a higher limit of open files.");
+            return;
+        }
+        client.m_peer = client.m_network->connectTo(m_server_address);
+        if (client.m_peer)
+            client.m_state = CS_CONNECTING;
+    }
+    Log::info("LoadTester", "Connecting %d clients to %s.",
+        (int)m_clients.size(), m_server_address.toString().c_str());
+    m_last_report_time = m_start_time;
+    m_next_report_time = m_start_time + 5000;
+
+    while (!m_abort)
+    {
+        const uint64_t now = StkTime::getMonoTimeMs();
+        if (m_duration != 0 && now > m_start_time + m_duration)
+            break;
+        bool any_connected = false;
+        for (Client& client : m_clients)
+        {
+            if (client.m_state == CS_DISCONNECTED)
+                continue;
+            any_connected = true;
+            ENetEvent event;
+            while (client.m_state != CS_DISCONNECTED &&
+                enet_host_service(client.m_network->getENetHost(), &event,
+                0) > 0)
+                handleEvent(client, event);
+
+            if (client.m_state == CS_RACING && now >= client.m_start_time &&
+                now >= client.m_next_action_time)
+                sendRandomAction(client, now);
+            else if (client.m_state == CS_RESULT &&
+                now >= client.m_result_ack_time)
+            {
+                sendLobbyMessage(client, LobbyProtocol::LE_RACE_FINISHED_ACK,
+                    /*synchronous*/true);
+                client.m_result_ack_time =
+                    std::numeric_limits<uint64_t>::max();
+            }
+            enet_host_flush(client.m_network->getENetHost());
+        }
+        if (!any_connected)
+        {
+            Log::error("LoadTester", "All clients are disconnected.");
+            break;
+        }
+        if (now >= m_next_report_time)
+        {
+            report(/*final_report*/false);
+            m_next_report_time = now + 5000;
+        }
+        StkTime::sleep(1);
+    }
+
+    for (Client& client : m_clients)
+    {
+        if (client.m_state == CS_DISCONNECTED)
+            continue;
+        enet_peer_disconnect(client.m_peer, PDI_NORMAL);
+        enet_host_flush(client.m_network->getENetHost());
+    }
+    report(/*final_report*/true);
+}   // run
+
+// ----------------------------------------------------------------------------
+void LoadTester::handleEvent(Client& client, ENetEvent& event)
+{
+    const uint64_t now = StkTime::getMonoTimeMs();
+    if (event.type == ENET_EVENT_TYPE_CONNECT)
+    {
+        m_connect_time.add(now - m_start_time);
+        sendConnectionRequest(client, (unsigned)(&client - &m_clients[0]));
+        client.m_state = CS_REQUESTING;
+        return;
+    }
+    if (event.type == ENET_EVENT_TYPE_DISCONNECT)
+    {
+        Log::warn("LoadTester", "Client %d disconnected.", client.m_host_id);
+        client.m_state = CS_DISCONNECTED;
+        return;
+    }
+    if (event.type != ENET_EVENT_TYPE_RECEIVE)
+        return;
+
+    const uint8_t* data = event.packet->data;
+    const size_t length = event.packet->dataLength;
+    if (ServerMessages::PingPacket::isPingPacket(data, length))
+    {
+        handlePing(client, data, length);
+        enet_packet_destroy(event.packet);
+        return;
+    }
+    if (length < 2)
+    {
+        enet_packet_destroy(event.packet);
+        return;
+    }
+    NetworkString ns(data, (int)length);
+    enet_packet_destroy(event.packet);
+    try
+    {
+        if (ns.isCompressed())
+            ns.decompress();
+        if (ns.getProtocolType() == PROTOCOL_LOBBY_ROOM)
+            handleLobbyMessage(client, ns);
+        else if (ns.getProtocolType() == PROTOCOL_CONTROLLER_EVENTS &&
+            ns.getUInt8() == GameProtocol::GP_STATE)
+            handleState(client, ns, length);
+    }
+    catch (std::exception& e)
+    {
+        Log::warn("LoadTester", "Invalid message for client %d: %s",
+            client.m_host_id, e.what());
+    }
+}   // handleEvent
+
+// ----------------------------------------------------------------------------
+/** Takes the network timer of the server from a ping packet, which is needed
+ *  for the ticks of the controller actions.
+ */
+void LoadTester::handlePing(Client& client, const uint8_t* data,
+                            size_t length)
+{
+    try
+    {
+        const ServerMessages::PingPacket ping(data, length);
+        const uint32_t rtt = client.m_peer->roundTripTime;
+        client.m_timer_offset = (int64_t)(ping.m_server_time + rtt / 2) -
+            (int64_t)StkTime::getMonoTimeMs();
+        client.m_timer_synchronised = true;
+        m_rtt.add(rtt);
+    }
+    catch (std::exception& e)
+    {
+        Log::debug("LoadTester", "Invalid ping packet: %s", e.what());
+    }
+}   // handlePing
+
+// ----------------------------------------------------------------------------
+/** Answers the lobby messages like a client with one player which is always
+ *  ready, loads a world instantly and doesn't look at the results.
+ */
+void LoadTester::handleLobbyMessage(Client& client, NetworkString& data)
+{
+    const uint64_t now = StkTime::getMonoTimeMs();
+    switch (data.getUInt8())
+    {
+    case LobbyProtocol::LE_CONNECTION_REFUSED:
+        Log::error("LoadTester", "Connection refused (reason %d).",
+            data.getUInt8());
+        enet_peer_disconnect(client.m_peer, PDI_NORMAL);
+        client.m_state = CS_DISCONNECTED;
+        break;
+    case LobbyProtocol::LE_CONNECTION_ACCEPTED:
+    {
+        const ServerMessages::ConnectionAccepted accepted(data);
+        client.m_host_id = accepted.m_host_id;
+        m_state_frequency = accepted.m_state_frequency;
+        client.m_state = CS_LOBBY;
+        // Ready for the next game (or start it if this is the owner)
+        sendLobbyMessage(client, LobbyProtocol::LE_REQUEST_BEGIN,
+            /*synchronous*/false);
+        break;
+    }
+    case LobbyProtocol::LE_LOAD_WORLD:
+    {
+        data.getUInt32();
+        PeerVote winner_vote(data);
+        // Only a live join for another client
+        if (data.getUInt8() == 1)
+            break;
+        client.m_kart_ids.clear();
+        const std::vector<ServerMessages::PlayerEntry> players =
+            ServerMessages::decodePlayerEntries(data);
+        for (unsigned i = 0; i < players.size(); i++)
+        {
+            if (players[i].m_host_id == client.m_host_id)
+                client.m_kart_ids.push_back((uint8_t)i);
+        }
+        client.m_state = CS_LOADING;
+        sendLobbyMessage(client, LobbyProtocol::LE_CLIENT_LOADED_WORLD,
+            /*synchronous*/false);
+        break;
+    }
+    case LobbyProtocol::LE_START_RACE:
+    {
+        if (client.m_state != CS_LOADING)
+            break;
+        const uint64_t start_time = data.getUInt64();
+        if (start_time != m_last_game_start)
+        {
+            m_last_game_start = start_time;
+            m_game_count++;
+        }
+        client.m_state = CS_RACING;
+        client.m_start_time = (uint64_t)std::max<int64_t>(0,
+            (int64_t)start_time - client.m_timer_offset);
+        client.m_next_action_time = 0;
+        client.m_last_state_ticks = 0;
+        client.m_last_state_time = 0;
+        client.m_steer = 0;
+        client.m_pressed = 0;
+        break;
+    }
+    case LobbyProtocol::LE_RACE_FINISHED:
+        if (client.m_state != CS_RACING)
+            break;
+        client.m_state = CS_RESULT;
+        // Look at the results for a moment like a player
+        client.m_result_ack_time = now + 1000 + m_random() % 4000;
+        break;
+    case LobbyProtocol::LE_BACK_LOBBY:
+        client.m_state = CS_LOBBY;
+        sendLobbyMessage(client, LobbyProtocol::LE_REQUEST_BEGIN,
+            /*synchronous*/false);
+        break;
+    default:
+        break;
+    }
+}   // handleLobbyMessage
+
+// ----------------------------------------------------------------------------
+/** Measures a state packet and confirms the item events in it.
+ *  \param size Size of the packet as received.
+ */
+void LoadTester::handleState(Client& client, NetworkString& data,
+                             size_t size)
+{
+    const uint32_t ticks = data.getUInt32();
+    const uint64_t now_us = StkTime::getMonoTimeUs();
+    m_state_count++;
+    m_state_bytes += size;
+    m_state_size.add(size);
+    if (client.m_last_state_time != 0 && ticks > client.m_last_state_ticks)
+    {
+        const uint64_t interval = now_us - client.m_last_state_time;
+        m_state_interval.add(interval / 1000);
+        // Difference between the time between the states on the server
+        // and the time between their arrival
+        const int64_t expected = (int64_t)(1000000.0f *
+            stk_config->ticks2Time(ticks - client.m_last_state_ticks));
+        m_tick_jitter.add((uint64_t)std::abs((int64_t)interval - expected));
+    }
+    if (ticks > client.m_last_state_ticks)
+    {
+        client.m_last_state_ticks = ticks;
+        client.m_last_state_time = now_us;
+        NetworkString confirmation(PROTOCOL_CONTROLLER_EVENTS);
+        confirmation.addUInt8(GameProtocol::GP_ITEM_CONFIRMATION)
+            .addUInt32(ticks);
+        send(client, confirmation, /*reliable*/false);
+    }
+}   // handleState
+
+// ----------------------------------------------------------------------------
+/** Sends the same connection request as ClientLobby, for one player without
+ *  online account.
+ */
+void LoadTester::sendConnectionRequest(Client& client, unsigned index)
+{
+    NetworkString ns(PROTOCOL_LOBBY_ROOM);
+    ns.addUInt8(LobbyProtocol::LE_CONNECTION_REQUESTED)
+        .addUInt32(ServerConfig::m_server_version)
+        .encodeString(StringUtils::getUserAgentString())
+        .addUInt16((uint16_t)stk_config->m_network_capabilities.size());
+    for (const std::string& cap : stk_config->m_network_capabilities)
+        ns.encodeString(cap);
+
+    auto all_k = kart_properties_manager->getAllAvailableKarts();
+    auto all_t = track_manager->getAllTrackIdentifiers();
+    if (all_k.size() >= 65536)
+        all_k.resize(65535);
+    if (all_t.size() >= 65536)
+        all_t.resize(65535);
+    ns.addUInt16((uint16_t)all_k.size()).addUInt16((uint16_t)all_t.size());
+    for (const std::string& kart : all_k)
+        ns.encodeString(kart);
+    for (const std::string& track : all_t)
+        ns.encodeString(track);
+
+    const std::string& password = ServerConfig::m_private_server_password;
+    const core::stringw name =
+        StringUtils::utf8ToWide("LoadTest" + StringUtils::toString(index));
+    // One player, no online id and no encrypted part
+    ns.addUInt8(1).addUInt32(0).addUInt32(0).encodeString(password)
+        .addUInt8(1).encodeString(name).addFloat(0.0f)
+        .addUInt8(PLAYER_DIFFICULTY_NORMAL);
+    send(client, ns, /*reliable*/true);
+}   // sendConnectionRequest
+
+// ----------------------------------------------------------------------------
+void LoadTester::sendLobbyMessage(Client& client, uint8_t type,
+                                  bool synchronous)
+{
+    NetworkString ns(PROTOCOL_LOBBY_ROOM);
+    ns.setSynchronous(synchronous);
+    ns.addUInt8(type);
+    send(client, ns, /*reliable*/true);
+}   // sendLobbyMessage
+
+// ----------------------------------------------------------------------------
+/** Sends a random action of a player: mostly steering changes, sometimes
+ *  pressing or releasing nitro, drift or fire. It is sent with the ticks of
+ *  a client which is half a round trip ahead of the server, in the same
+ *  format as GameProtocol::sendActions.
+ */
+void LoadTester::sendRandomAction(Client& client, uint64_t now)
+{
+    client.m_next_action_time = now + getNextActionDelay();
+    if (client.m_kart_ids.empty())
+        return;
+
+    PlayerAction action = PA_ACCEL;
+    int value = Input::MAX_VALUE;
+    if ((client.m_pressed & (1 << 3)) == 0)
+    {
+        // Accelerate first, and never release it
+        client.m_pressed |= 1 << 3;
+    }
+    else if (m_random() % 4 != 0)
+    {
+        client.m_steer = (int)(m_random() % 3) - 1;
+        action = client.m_steer < 0 ? PA_STEER_LEFT : PA_STEER_RIGHT;
+        value = client.m_steer == 0 ? 0 : Input::MAX_VALUE;
+    }
+    else
+    {
+        const unsigned button = m_random() % 3;
+        action = g_buttons[button];
+        client.m_pressed ^= 1 << button;
+        value = (client.m_pressed & (1 << button)) != 0 ?
+            Input::MAX_VALUE : 0;
+    }
+    const int value_l = client.m_steer < 0 ? Input::MAX_VALUE : 0;
+    const int value_r = client.m_steer > 0 ? Input::MAX_VALUE : 0;
+
+    const int64_t race_time = (int64_t)now - (int64_t)client.m_start_time +
+        client.m_peer->roundTripTime / 2;
+    const uint32_t ticks = (uint32_t)std::max(0,
+        stk_config->time2Ticks(race_time / 1000.0f));
+
+    NetworkString ns(PROTOCOL_CONTROLLER_EVENTS);
+    ns.addUInt8(GameProtocol::GP_CONTROLLER_ACTION)
+        .addUInt8((uint8_t)client.m_kart_ids.size());
+    for (uint8_t kart_id : client.m_kart_ids)
+    {
+        // Same as GameProtocol::compressAction
+        const uint8_t w = (uint8_t)(action & 63) | (value_l > 0 ? 64 : 0) |
+            (value_r > 0 ? 128 : 0);
+        ns.addUInt32(ticks).addUInt8(kart_id).addUInt8(w)
+            .addUInt16((uint16_t)value).addUInt16((uint16_t)value_l)
+            .addUInt16((uint16_t)value_r);
+    }
+    send(client, ns, /*reliable*/true);
+    m_action_count++;
+}   // sendRandomAction
+
+// ----------------------------------------------------------------------------
+void LoadTester::send(Client& client, const NetworkString& data,
+                      bool reliable)
+{
+    ENetPacket* packet = enet_packet_create(data.getData(),
+        data.getTotalSize(), reliable ? ENET_PACKET_FLAG_RELIABLE :
+        (ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT));
+    if (packet &&
+        enet_peer_send(client.m_peer, EVENT_CHANNEL_NORMAL, packet) < 0)
+        enet_packet_destroy(packet);
+}   // send
+
+// ----------------------------------------------------------------------------
+/** Returns the time in ms until the next action of a player, exponentially
+ *  distributed so that actions come in bursts like from real players.
+ */
+uint64_t LoadTester::getNextActionDelay()
+{
+    std::exponential_distribution<float> dist(m_action_rate);
+    return (uint64_t)(std::min(dist(m_random), 10.0f) * 1000.0f);
+}   // getNextActionDelay
+
+// ----------------------------------------------------------------------------
+/** Logs the rates since the last report and the histograms since the start.
+ */
+void LoadTester::report(bool final_report)
+{
+    const uint64_t now = StkTime::getMonoTimeMs();
+    const float seconds = std::max(now - m_last_report_time, (uint64_t)1) /
+        1000.0f;
+    unsigned connected = 0, racing = 0;
+    for (const Client& client : m_clients)
+    {
+        if (client.m_state >= CS_LOBBY && client.m_state != CS_DISCONNECTED)
+            connected++;
+        if (client.m_state == CS_RACING)
+            racing++;
+    }
+    Log::info("LoadTester", "%d/%d clients connected, %d racing, %d games. "
+        "%.1f states/s (%d/s expected per racing client), %.0f bytes/s, "
+        "%.1f actions/s.", connected, (int)m_clients.size(), racing,
+        (int)m_game_count, (m_state_count - m_reported_states) / seconds,
+        m_state_frequency, (m_state_bytes - m_reported_bytes) / seconds,
+        (m_action_count - m_reported_actions) / seconds);
+    m_reported_states = m_state_count;
+    m_reported_bytes = m_state_bytes;
+    m_reported_actions = m_action_count;
+    m_last_report_time = now;
+    if (!final_report)
+        return;
+
+    Log::info("LoadTester", "Connect time: %s",
+        m_connect_time.getSummary("ms").c_str());
+    Log::info("LoadTester", "Round trip time: %s",
+        m_rtt.getSummary("ms").c_str());
+    Log::info("LoadTester", "State size: %s",
+        m_state_size.getSummary(" bytes").c_str());
+    Log::info("LoadTester", "State interval: %s",
+        m_state_interval.getSummary("ms").c_str());
+    Log::info("LoadTester", "Tick jitter: %s",
+        m_tick_jitter.getSummary("us").c_str());
+}   // report
@@ -0,0 +1,157 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_LOAD_TESTER_HPP
+#define HEADER_LOAD_TESTER_HPP
+
+#include "network/transport_address.hpp"
+#include "utils/histogram.hpp"
+#include "utils/no_copy.hpp"
+#include "utils/types.hpp"
+
+#include <atomic>
+#include <random>
+#include <vector>
+
+class Network;
+class NetworkString;
+typedef struct _ENetEvent ENetEvent;
+typedef struct _ENetPeer ENetPeer;
+
+/** Simulates many clients in one process to measure the capacity of a
+ *  server, without running a world for each of them like --network-ai.
+ *  Each simulated client has its own enet socket and player, does the
+ *  lobby handshake, is ready for every game, acknowledges loading and the
+ *  race results immediately, and sends random controller actions (steering,
+ *  nitro, drifting and firing) at a given average rate while racing.
+ *  The state packets received by all clients are measured (rate, size,
+ *  and the jitter of their arrival against the ticks of the server), as
+ *  well as the round trip times, and reported periodically to the log.
+ *  The clients don't simulate the world, so a race only ends when the
+ *  server ends it (e.g. with a time limit or by kicking idle players).
+ *  \ingroup network
+ */
+class LoadTester : public NoCopy
+{
+private:
+    enum ClientState : uint8_t
+    {
+        CS_CONNECTING,
+        CS_REQUESTING,
+        CS_LOBBY,
+        CS_LOADING,
+        CS_RACING,
+        CS_RESULT,
+        CS_DISCONNECTED
+    };
+
+    struct Client
+    {
+        Network* m_network;
+        ENetPeer* m_peer;
+        ClientState m_state;
+        uint32_t m_host_id;
+
+        /** Kart ids of the player of this client in the current game. */
+        std::vector<uint8_t> m_kart_ids;
+
+        /** Network timer of the server minus the local time, from its ping
+         *  packets. */
+        int64_t m_timer_offset;
+        bool m_timer_synchronised;
+
+        /** Local time when the current race starts. */
+        uint64_t m_start_time;
+        uint64_t m_next_action_time;
+        uint64_t m_result_ack_time;
+
+        /** Ticks of the last state received, and when it was received
+         *  (local time in us). */
+        uint32_t m_last_state_ticks;
+        uint64_t m_last_state_time;
+
+        /** Steering of the player, -1 (left), 0 or 1 (right). */
+        int m_steer;
+        /** Bit mask of the pressed buttons (nitro, drift, fire and
+         *  accelerate). */
+        unsigned m_pressed;
+    };
+
+    static std::atomic_bool m_abort;
+
+    TransportAddress m_server_address;
+
+    /** Time in ms to run the test, 0 runs until aborted. */
+    uint64_t m_duration;
+
+    /** Average number of actions sent by each client per second. */
+    float m_action_rate;
+
+    uint32_t m_state_frequency;
+
+    std::vector<Client> m_clients;
+
+    std::mt19937 m_random;
+
+    Histogram m_state_size, m_state_interval, m_tick_jitter, m_rtt,
+              m_connect_time;
+
+    /** Totals since the start, and at the last report to compute rates. */
+    uint64_t m_state_count, m_state_bytes, m_action_count, m_game_count;
+    uint64_t m_reported_states, m_reported_bytes, m_reported_actions;
+
+    uint64_t m_start_time, m_next_report_time, m_last_report_time;
+
+    /** Start time of the last game sent by the server, to count games. */
+    uint64_t m_last_game_start;
+
+    // ------------------------------------------------------------------------
+    void handleEvent(Client& client, ENetEvent& event);
+    // ------------------------------------------------------------------------
+    void handlePing(Client& client, const uint8_t* data, size_t length);
+    // ------------------------------------------------------------------------
+    void handleLobbyMessage(Client& client, NetworkString& data);
+    // ------------------------------------------------------------------------
+    void handleState(Client& client, NetworkString& data, size_t size);
+    // ------------------------------------------------------------------------
+    void sendConnectionRequest(Client& client, unsigned index);
+    // ------------------------------------------------------------------------
+    void sendLobbyMessage(Client& client, uint8_t type, bool synchronous);
+    // ------------------------------------------------------------------------
+    void sendRandomAction(Client& client, uint64_t now);
+    // ------------------------------------------------------------------------
+    void send(Client& client, const NetworkString& data, bool reliable);
+    // ------------------------------------------------------------------------
+    uint64_t getNextActionDelay();
+    // ------------------------------------------------------------------------
+    void report(bool final_report);
+
+public:
+    // ------------------------------------------------------------------------
+             LoadTester(const TransportAddress& server, unsigned clients,
+                        float duration, float action_rate);
+    // ------------------------------------------------------------------------
+            ~LoadTester();
+    // ------------------------------------------------------------------------
+    void run();
+    // ------------------------------------------------------------------------
+    static void requestAbort()                           { m_abort = true; }
+
+};   // LoadTester
+
+#endif // HEADER_LOAD_TESTER_HPP
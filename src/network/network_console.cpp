@@ -18,11 +18,14 @@
 
 #include "network/network_config.hpp"
 #include "network/network_player_profile.hpp"
+#include "network/protocol_manager.hpp"
 #include "network/server_config.hpp"
+#include "network/server_metrics.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "network/protocols/server_lobby.hpp"
 #include "utils/time.hpp"
+#include "utils/trace_recorder.hpp"
 #include "utils/vs.hpp"
 #include "main_loop.hpp"
 
@@ -43,6 +46,12 @@ void showHelp()
     std::cout << "listpeers, List all peers with host ID and IP." << std::endl;
     std::cout << "listban, List IP ban list of server." << std::endl;
     std::cout << "speedstats, Show upload and download speed." << std::endl;
+    std::cout << "eventstats, Show event queue depth and latency." <<
+        std::endl;
+    std::cout << "metrics, Show tick times, state sizes and ping statistics, "
+        "metrics 0 resets them." << std::endl;
+    std::cout << "trace, Write the recorded profiler markers to a Chrome "
+        "trace file, trace 0 / trace 1 stop / start recording." << std::endl;
 }   // showHelp
 
 // ----------------------------------------------------------------------------
@@ -122,6 +131,26 @@ void mainLoop(STKHost* host)
                 "   Download speed (KBps): " <<
                 (float)host->getDownloadSpeed() / 1024.0f  << std::endl;
         }
+        else if (str == "eventstats")
+        {
+            auto pm = ProtocolManager::lock();
+            if (pm)
+                std::cout << pm->getStatistics();
+        }
+        else if (str == "metrics")
+        {
+            if (number == 0)
+                ServerMetrics::reset();
+            else
+                std::cout << ServerMetrics::toString();
+        }
+        else if (str == "trace")
+        {
+            if (number == -1)
+                TraceRecorder::exportChromeTrace();
+            else
+                TraceRecorder::setEnabled(number != 0);
+        }
         else
         {
             std::cout << "Unknown command: " << str << std::endl;
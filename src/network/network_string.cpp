@@ -22,6 +22,7 @@
 #include <algorithm>   // for std::min
 #include <iomanip>
 #include <ostream>
+#include <zlib.h>
 
 // ============================================================================
 /** Unit testing function.
@@ -57,8 +58,230 @@ void NetworkString::unitTesting()
     std::string log = slog.getLogMessage();
     assert(log=="0x000 | 00 01 02 03 04 05 06 07  08 09 0a 0b 0c 0d 0e 0f   | ................\n"
                 "0x010 | 10 11 12 13 14 15 16 17  18 19 1a 1b               | ............\n");
+
+    // Reference values of xxHash32, the hash does not depend on the read
+    // position
+    assert(BareNetworkString().getHash() == 0x02cc5d05);
+    assert(BareNetworkString("abc", 3).getHash() == 0x32d153ff);
+    const char* text = "Nobody inspects the spammish repetition";
+    BareNetworkString shash(text, (int)strlen(text));
+    assert(shash.getHash() == 0xe2293b2f);
+    shash.getUInt32();
+    assert(shash.getHash() == 0xe2293b2f);
+    BareNetworkString slong(100);
+    for (unsigned int i = 0; i < 100; i++)
+        slong.addUInt8(i);
+    assert(slong.getHash() == 0x7f89ba44);
+
+    // Released strings are reused with the new content
+    const uint8_t received[] = { PROTOCOL_LOBBY_ROOM, 1, 2, 3 };
+    NetworkString* r1 = createReceived(received, 4);
+    assert(r1->getProtocolType() == PROTOCOL_LOBBY_ROOM);
+    assert(r1->size() == 3 && r1->getUInt8() == 1);
+    releaseReceived(r1);
+    NetworkString* r2 = createReceived(received, 2);
+    assert(r2 == r1);
+    assert(r2->getTotalSize() == 2 && r2->size() == 1);
+    assert(r2->getUInt8() == 1);
+    releaseReceived(r2);
+    clearPool();
+
+    // Compressed messages keep their type and flags, small or incompressible
+    // ones are not compressed
+    NetworkString big(PROTOCOL_LOBBY_ROOM);
+    big.setSynchronous(true);
+    for (unsigned i = 0; i < 1000; i++)
+        big.addUInt32(i % 10);
+    assert(!big.compress(100000));
+    std::unique_ptr<NetworkString> c = big.compress(100);
+    assert(c && c->isCompressed() && c->isSynchronous());
+    assert(c->getProtocolType() == PROTOCOL_LOBBY_ROOM);
+    assert(c->getTotalSize() < big.getTotalSize());
+    NetworkString* d = createReceived((const uint8_t*)c->getData(),
+        c->getTotalSize());
+    d->decompress();
+    assert(!d->isCompressed() && d->isSynchronous());
+    assert(d->getProtocolType() == PROTOCOL_LOBBY_ROOM);
+    assert(d->getTotalSize() == big.getTotalSize());
+    assert(memcmp(d->getData(), big.getData(), big.getTotalSize()) == 0);
+    assert(d->getUInt32() == 0 && d->getUInt32() == 1);
+    releaseReceived(d);
+    NetworkString random(PROTOCOL_LOBBY_ROOM);
+    for (unsigned i = 0; i < 1000; i++)
+        random.addUInt32(i * 2654435761u);
+    assert(!random.compress(100));
+
+    // Corrupted or truncated data is rejected
+    NetworkString* bad = createReceived((const uint8_t*)c->getData(),
+        c->getTotalSize() / 2);
+    bool thrown = false;
+    try
+    {
+        bad->decompress();
+    }
+    catch (std::exception&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    releaseReceived(bad);
+
+    // Messages which would be too large to decompress are not compressed,
+    // and a received size above the limit is rejected
+    NetworkString huge(PROTOCOL_LOBBY_ROOM);
+    huge.getBuffer().resize(MAX_UNCOMPRESSED_SIZE + 2);
+    assert(!huge.compress(100));
+    BareNetworkString header(5);
+    header.addUInt8(PROTOCOL_LOBBY_ROOM | PROTOCOL_COMPRESSED)
+        .addUInt32(MAX_UNCOMPRESSED_SIZE + 1);
+    NetworkString* too_large = createReceived(
+        (const uint8_t*)header.getData(), header.getTotalSize());
+    thrown = false;
+    try
+    {
+        too_large->decompress();
+    }
+    catch (std::exception&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    (void)thrown;
+    releaseReceived(too_large);
+    clearPool();
 }   // unitTesting
 
+// ============================================================================
+std::vector<NetworkString*> NetworkString::m_pool;
+std::mutex NetworkString::m_pool_mutex;
+// ----------------------------------------------------------------------------
+/** Returns a string for a received message, reusing a released one if
+ *  possible. Like the constructor for received messages the protocol type
+ *  byte is skipped.
+ *  \param data The message, or NULL to only set the size (e.g. for
+ *         decrypting into the buffer).
+ *  \param len Size of the message.
+ */
+NetworkString* NetworkString::createReceived(const uint8_t *data, int len)
+{
+    NetworkString* ns = NULL;
+    std::unique_lock<std::mutex> ul(m_pool_mutex);
+    if (!m_pool.empty())
+    {
+        ns = m_pool.back();
+        m_pool.pop_back();
+    }
+    ul.unlock();
+
+    if (!ns)
+    {
+        if (data)
+            return new NetworkString(data, len);
+        ns = new NetworkString(PROTOCOL_NONE, len);
+    }
+    if (data)
+        ns->m_buffer.assign(data, data + len);
+    else
+        ns->m_buffer.resize(len);
+    ns->m_current_offset = 1;
+    return ns;
+}   // createReceived
+
+// ----------------------------------------------------------------------------
+/** Puts a string created with \ref createReceived back into the pool. Very
+ *  large buffers (e.g. a replay transfer) are freed, so that one such
+ *  message does not keep its memory forever.
+ */
+void NetworkString::releaseReceived(NetworkString* ns)
+{
+    const size_t MAX_POOL_SIZE = 1024;
+    const size_t MAX_POOLED_CAPACITY = 4096;
+    if (!ns)
+        return;
+    if (ns->m_buffer.capacity() <= MAX_POOLED_CAPACITY)
+    {
+        std::lock_guard<std::mutex> lock(m_pool_mutex);
+        if (m_pool.size() < MAX_POOL_SIZE)
+        {
+            m_pool.push_back(ns);
+            return;
+        }
+    }
+    delete ns;
+}   // releaseReceived
+
+// ----------------------------------------------------------------------------
+/** Frees all pooled strings, called when the network is shut down. */
+void NetworkString::clearPool()
+{
+    std::lock_guard<std::mutex> lock(m_pool_mutex);
+    for (NetworkString* ns : m_pool)
+        delete ns;
+    m_pool.clear();
+}   // clearPool
+
+// ----------------------------------------------------------------------------
+std::atomic<uint64_t> NetworkString::m_compressed_count(0);
+std::atomic<uint64_t> NetworkString::m_uncompressed_bytes(0);
+std::atomic<uint64_t> NetworkString::m_compressed_bytes(0);
+// ----------------------------------------------------------------------------
+/** Returns a copy of this message with a zlib compressed payload, or NULL if
+ *  the message is smaller than the threshold, does not get smaller or is
+ *  too large to be decompressed by the receiver. The
+ *  type byte stays uncompressed (with PROTOCOL_COMPRESSED set), followed by
+ *  the uncompressed payload size.
+ *  \param threshold Minimum payload size in bytes, 0 to never compress.
+ */
+std::unique_ptr<NetworkString> NetworkString::compress(unsigned threshold) const
+{
+    const unsigned payload = (unsigned)m_buffer.size() - 1;
+    if (threshold == 0 || payload < threshold || isCompressed() ||
+        payload > MAX_UNCOMPRESSED_SIZE)
+        return nullptr;
+
+    uLongf compressed_size = compressBound(payload);
+    std::unique_ptr<NetworkString> ns(new NetworkString(PROTOCOL_NONE,
+        (int)compressed_size + 4));
+    ns->m_buffer[0] = m_buffer[0] | PROTOCOL_COMPRESSED;
+    ns->addUInt32(payload);
+    ns->m_buffer.resize(5 + compressed_size);
+    if (compress2(ns->m_buffer.data() + 5, &compressed_size,
+        m_buffer.data() + 1, payload, Z_DEFAULT_COMPRESSION) != Z_OK ||
+        compressed_size + 4 >= payload)
+        return nullptr;
+    ns->m_buffer.resize(5 + compressed_size);
+
+    m_compressed_count.fetch_add(1, std::memory_order_relaxed);
+    m_uncompressed_bytes.fetch_add(payload + 1, std::memory_order_relaxed);
+    m_compressed_bytes.fetch_add(ns->m_buffer.size(),
+        std::memory_order_relaxed);
+    return ns;
+}   // compress
+
+// ----------------------------------------------------------------------------
+/** Decompresses a received message created by \ref compress in place, and
+ *  rewinds it to the beginning of the payload. Throws an exception if the
+ *  data is invalid or larger than MAX_UNCOMPRESSED_SIZE.
+ */
+void NetworkString::decompress()
+{
+    if (m_buffer.size() < 5)
+        throw std::runtime_error("Compressed message too short.");
+    m_current_offset = 1;
+    const uint32_t payload = getUInt32();
+    if (payload > MAX_UNCOMPRESSED_SIZE)
+        throw std::runtime_error("Compressed message too large.");
+
+    std::vector<uint8_t> buffer(payload + 1);
+    buffer[0] = m_buffer[0] & ~PROTOCOL_COMPRESSED;
+    uLongf size = payload;
+    if (uncompress(buffer.data() + 1, &size, m_buffer.data() + 5,
+        (uLong)m_buffer.size() - 5) != Z_OK || size != payload)
+        throw std::runtime_error("Invalid compressed message.");
+    m_buffer.swap(buffer);
+    m_current_offset = 1;
+}   // decompress
+
 // ============================================================================
 
 // ----------------------------------------------------------------------------
@@ -161,3 +384,58 @@ std::string BareNetworkString::getLogMessage(const std::string &indent) const
     return oss.str();
 }   // getLogMessage
 
+// ----------------------------------------------------------------------------
+/** Returns the xxHash32 (with seed 0) of the whole buffer, independent of
+ *  the read position. It is fast enough to hash every state of a server,
+ *  and is used by clients to detect a state which differs from the state
+ *  on the server (see RewindManager::checkStateHashes).
+ */
+uint32_t BareNetworkString::getHash() const
+{
+    const uint32_t PRIME1 = 2654435761u, PRIME2 = 2246822519u,
+                   PRIME3 = 3266489917u, PRIME4 = 668265263u,
+                   PRIME5 = 374761393u;
+    auto rotl = [](uint32_t x, int r) { return (x << r) | (x >> (32 - r)); };
+    auto read32 = [](const uint8_t* p)
+        {
+            return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        };
+    auto round = [&rotl](uint32_t acc, uint32_t input)
+        {
+            return rotl(acc + input * PRIME2, 13) * PRIME1;
+        };
+
+    const uint8_t* p = m_buffer.data();
+    const size_t len = m_buffer.size();
+    const uint8_t* end = p + len;
+    uint32_t h;
+    if (len >= 16)
+    {
+        uint32_t v1 = PRIME1 + PRIME2, v2 = PRIME2, v3 = 0, v4 = 0u - PRIME1;
+        const uint8_t* limit = end - 16;
+        do
+        {
+            v1 = round(v1, read32(p));
+            v2 = round(v2, read32(p + 4));
+            v3 = round(v3, read32(p + 8));
+            v4 = round(v4, read32(p + 12));
+            p += 16;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    }
+    else
+        h = PRIME5;
+    h += (uint32_t)len;
+    for (; p + 4 <= end; p += 4)
+        h = rotl(h + read32(p) * PRIME3, 17) * PRIME4;
+    for (; p < end; p++)
+        h = rotl(h + (*p) * PRIME5, 11) * PRIME1;
+    h ^= h >> 15;
+    h *= PRIME2;
+    h ^= h >> 13;
+    h *= PRIME3;
+    h ^= h >> 16;
+    return h;
+}   // getHash
+
@@ -33,6 +33,9 @@
 #include "irrString.h"
 
 #include <assert.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <stdarg.h>
 #include <stdexcept>
 #include <string>
@@ -178,6 +181,7 @@ public:
     int decodeString(std::string *out) const;
     int decodeStringW(irr::core::stringw *out) const;
     std::string getLogMessage(const std::string &indent="") const;
+    uint32_t getHash() const;
     // ------------------------------------------------------------------------
     /** Returns the internal buffer of the network string. */
     std::vector<uint8_t>& getBuffer() { return m_buffer; }
@@ -441,8 +445,40 @@ public:
  */
 class NetworkString : public BareNetworkString
 {
+private:
+    /** Received strings which were released, kept with their buffers so
+     *  that receiving a message does not need any allocation. */
+    static std::vector<NetworkString*> m_pool;
+
+    static std::mutex m_pool_mutex;
+
+    /** Number of messages sent compressed, and their total size before and
+     *  after compression. */
+    static std::atomic<uint64_t> m_compressed_count, m_uncompressed_bytes,
+                                 m_compressed_bytes;
+
 public:
+    /** Largest payload a compressed message may have, so that a small packet
+     *  can't make the receiver allocate and inflate a lot of memory. */
+    static const uint32_t MAX_UNCOMPRESSED_SIZE = 256 * 1024;
+    // ------------------------------------------------------------------------
     static void unitTesting();
+    // ------------------------------------------------------------------------
+    static NetworkString* createReceived(const uint8_t *data, int len);
+    // ------------------------------------------------------------------------
+    static void releaseReceived(NetworkString* ns);
+    // ------------------------------------------------------------------------
+    static void clearPool();
+    // ------------------------------------------------------------------------
+    static uint64_t getCompressedCount()      { return m_compressed_count;   }
+    // ------------------------------------------------------------------------
+    static uint64_t getUncompressedBytes()    { return m_uncompressed_bytes; }
+    // ------------------------------------------------------------------------
+    static uint64_t getCompressedBytes()      { return m_compressed_bytes;   }
+    // ------------------------------------------------------------------------
+    std::unique_ptr<NetworkString> compress(unsigned threshold) const;
+    // ------------------------------------------------------------------------
+    void decompress();
         
     /** Constructor for a message to be sent. It sets the 
      *  protocol type of this message. It adds 1 byte to the capacity:
@@ -474,7 +510,8 @@ public:
     /** Returns the protocol type of this message. */
     ProtocolType getProtocolType() const
     {
-        return (ProtocolType)(m_buffer.at(0) & ~PROTOCOL_SYNCHRONOUS);
+        return (ProtocolType)(m_buffer.at(0) &
+            ~(PROTOCOL_SYNCHRONOUS | PROTOCOL_COMPRESSED));
     }   // getProtocolType
 
     // ------------------------------------------------------------------------
@@ -492,6 +529,13 @@ public:
     {
         return (m_buffer[0] & PROTOCOL_SYNCHRONOUS) == PROTOCOL_SYNCHRONOUS;
     }   // isSynchronous
+    // ------------------------------------------------------------------------
+    /** Returns if the payload of this message is compressed, received
+     *  messages are decompressed before they are handled. */
+    bool isCompressed() const
+    {
+        return (m_buffer[0] & PROTOCOL_COMPRESSED) == PROTOCOL_COMPRESSED;
+    }   // isCompressed
 
 };   // class NetworkString
 
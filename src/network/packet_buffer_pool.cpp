@@ -0,0 +1,87 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/packet_buffer_pool.hpp"
+
+std::mutex PacketBufferPool::m_mutex;
+std::vector<uint8_t*>
+    PacketBufferPool::m_free_buffers[PacketBufferPool::SIZE_CLASSES];
+
+// ----------------------------------------------------------------------------
+/** Creates an ENet packet with uninitialised data of the given size.
+ *  \param size Size of the packet data.
+ *  \param flags ENet packet flags.
+ */
+ENetPacket* PacketBufferPool::createPacket(size_t size, uint32_t flags)
+{
+    unsigned size_class = 0;
+    while (size_class < SIZE_CLASSES && size > (size_t(64) << size_class))
+        size_class++;
+    if (size_class == SIZE_CLASSES)
+        return enet_packet_create(NULL, size, flags);
+
+    uint8_t* buffer = NULL;
+    std::unique_lock<std::mutex> ul(m_mutex);
+    if (!m_free_buffers[size_class].empty())
+    {
+        buffer = m_free_buffers[size_class].back();
+        m_free_buffers[size_class].pop_back();
+    }
+    ul.unlock();
+    if (buffer == NULL)
+        buffer = new uint8_t[size_t(64) << size_class];
+
+    ENetPacket* packet = enet_packet_create(buffer, size,
+        flags | ENET_PACKET_FLAG_NO_ALLOCATE);
+    if (packet == NULL)
+    {
+        delete [] buffer;
+        return NULL;
+    }
+    packet->freeCallback = freePacket;
+    packet->userData = (void*)(uintptr_t)size_class;
+    return packet;
+}   // createPacket
+
+// ----------------------------------------------------------------------------
+/** Called by enet_packet_destroy, usually from the listening thread. */
+void PacketBufferPool::freePacket(ENetPacket* packet)
+{
+    const unsigned size_class = (unsigned)(uintptr_t)packet->userData;
+    std::unique_lock<std::mutex> ul(m_mutex);
+    if (m_free_buffers[size_class].size() < MAX_FREE_BUFFERS)
+    {
+        m_free_buffers[size_class].push_back(packet->data);
+        return;
+    }
+    ul.unlock();
+    delete [] packet->data;
+}   // freePacket
+
+// ----------------------------------------------------------------------------
+/** Frees all buffers in the pool, called when the STKHost is destroyed. */
+void PacketBufferPool::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (unsigned i = 0; i < SIZE_CLASSES; i++)
+    {
+        for (uint8_t* buffer : m_free_buffers[i])
+            delete [] buffer;
+        m_free_buffers[i].clear();
+    }
+}   // clear
@@ -0,0 +1,60 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_PACKET_BUFFER_POOL_HPP
+#define HEADER_PACKET_BUFFER_POOL_HPP
+
+#include "utils/types.hpp"
+
+#include <enet/enet.h>
+
+#include <mutex>
+#include <vector>
+
+/** A pool of pre-sized data buffers for ENet packets. The server creates
+ *  one packet per peer for each broadcast (e.g. every state update), ENet
+ *  destroys it in the listening thread after it was sent. Packets created
+ *  here use ENET_PACKET_FLAG_NO_ALLOCATE with a free callback which returns
+ *  the buffer to the pool instead of freeing it. Packets larger than the
+ *  biggest size class are allocated by ENet as usual.
+ */
+class PacketBufferPool
+{
+private:
+    /** Size classes are powers of two from 64 to 4096 bytes. */
+    static const unsigned SIZE_CLASSES = 7;
+
+    /** Limits the memory kept in the pool after a burst of packets. */
+    static const unsigned MAX_FREE_BUFFERS = 256;
+
+    static std::mutex m_mutex;
+
+    static std::vector<uint8_t*> m_free_buffers[SIZE_CLASSES];
+
+    // ------------------------------------------------------------------------
+    static void freePacket(ENetPacket* packet);
+
+public:
+    // ------------------------------------------------------------------------
+    static ENetPacket* createPacket(size_t size, uint32_t flags);
+    // ------------------------------------------------------------------------
+    static void clear();
+
+};   // PacketBufferPool
+
+#endif // HEADER_PACKET_BUFFER_POOL_HPP
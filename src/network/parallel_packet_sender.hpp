@@ -0,0 +1,64 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_PARALLEL_PACKET_SENDER_HPP
+#define HEADER_PARALLEL_PACKET_SENDER_HPP
+
+#include "utils/no_copy.hpp"
+#include "utils/types.hpp"
+#include "utils/worker_pool.hpp"
+
+#include <functional>
+#include <vector>
+
+class NetworkString;
+class STKPeer;
+
+/** Sends a broadcast packet to a list of peers, using a small pool of
+ *  worker threads so that the per-peer encryption (see
+ *  Crypto::encryptSend) of different peers runs in parallel. Each peer
+ *  still gets its packets in the order of the broadcasts, because
+ *  \ref send only returns once all peers are done.
+ */
+class ParallelPacketSender : public NoCopy
+{
+private:
+    /** Below this number of peers the packets are sent from the calling
+     *  thread, waking up the workers would cost more than it saves. */
+    static const unsigned MIN_PARALLEL_PEERS = 4;
+
+    WorkerPool m_pool;
+
+public:
+    // ------------------------------------------------------------------------
+    ParallelPacketSender(unsigned worker_count);
+    // ------------------------------------------------------------------------
+    void send(const std::vector<STKPeer*>& peers, NetworkString* data,
+              bool reliable, bool compress);
+    // ------------------------------------------------------------------------
+    void parallelFor(unsigned count, const std::function<void(unsigned)>& job);
+    // ------------------------------------------------------------------------
+    unsigned getWorkerCount() const       { return m_pool.getWorkerCount(); }
+    // ------------------------------------------------------------------------
+    static unsigned getDefaultWorkerCount();
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // ParallelPacketSender
+
+#endif // HEADER_PARALLEL_PACKET_SENDER_HPP
@@ -48,6 +48,7 @@ enum ProtocolType
     PROTOCOL_CONTROLLER_EVENTS = 0x04,  //!< Protocol to transfer controller modifications
     PROTOCOL_SILENT            = 0x05,  //!< Used for protocols that do not subscribe to any network event.
     PROTOCOL_MAX                     ,  //!< Maximum number of different protocol types
+    PROTOCOL_COMPRESSED        = 0x40,  //!< Flag, indicates a zlib compressed payload
     PROTOCOL_SYNCHRONOUS       = 0x80,  //!< Flag, indicates synchronous delivery
 };   // ProtocolType
 
@@ -116,6 +117,13 @@ public:
      *  Must be re-defined. */
     virtual void asynchronousUpdate() = 0;
 
+    /** \brief Returns the monotonic time (in ms) at which the protocol
+     *  manager thread must call asynchronousUpdate() again even if no event
+     *  or request arrives in between. The default 0 means the protocol polls
+     *  some state, so it is updated at the shortest interval, protocols
+     *  with an empty asynchronousUpdate() can return the maximum value. */
+    virtual uint64_t getNextAsyncUpdateTime() const { return 0; }
+
     /// functions to check incoming data easily
     NetworkString* getNetworkString(size_t capacity = 16) const;
     bool checkDataSize(Event* event, unsigned int minimum_size);
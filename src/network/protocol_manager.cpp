@@ -33,6 +33,7 @@
 #include <cstdlib>
 #include <errno.h>
 #include <functional>
+#include <limits>
 #include <typeinfo>
 
 // ============================================================================
@@ -54,7 +55,7 @@ std::shared_ptr<ProtocolManager> ProtocolManager::createInstance()
             {
                 pm->asynchronousUpdate();
                 PROFILER_PUSH_CPU_MARKER("sleep", 0, 255, 255);
-                StkTime::sleep(2);
+                pm->waitForAsynchronousWork();
                 PROFILER_POP_CPU_MARKER();
             }
         });
@@ -101,6 +102,7 @@ std::shared_ptr<ProtocolManager> ProtocolManager::createInstance()
 ProtocolManager::ProtocolManager()
 {
     m_exit.store(false);
+    m_async_wakeup = false;
 }   // ProtocolManager
 
 // ----------------------------------------------------------------------------
@@ -149,6 +151,7 @@ void ProtocolManager::OneProtocolType::abort()
 void ProtocolManager::abort()
 {
     m_exit.store(true);
+    wakeUpAsynchronousUpdate();
     if (NetworkConfig::get()->isServer())
     {
         std::unique_lock<std::mutex> ul(m_game_protocol_mutex);
@@ -159,8 +162,98 @@ void ProtocolManager::abort()
     }
     // wait the thread to finish
     m_asynchronous_update_thread.join();
+    Log::info("ProtocolManager", "%s", getStatistics().c_str());
 }   // abort
 
+// ----------------------------------------------------------------------------
+/** Wakes up the asynchronous update thread, called when there are new
+ *  events or requests. Protocols can call this too if something they poll
+ *  in asynchronousUpdate() was changed by another thread.
+ */
+void ProtocolManager::wakeUpAsynchronousUpdate()
+{
+    std::lock_guard<std::mutex> lock(m_async_wakeup_mutex);
+    m_async_wakeup = true;
+    m_async_wakeup_cv.notify_one();
+}   // wakeUpAsynchronousUpdate
+
+// ----------------------------------------------------------------------------
+/** Returns the earliest time (in ms) at which any running protocol needs its
+ *  asynchronousUpdate() to be called, see Protocol::getNextAsyncUpdateTime.
+ *  \param poll_time Time used for protocols which poll.
+ */
+uint64_t ProtocolManager::OneProtocolType::getNextAsyncUpdateTime(
+                                                     uint64_t poll_time) const
+{
+    uint64_t next = std::numeric_limits<uint64_t>::max();
+    for (unsigned int i = 0; i < m_protocols.size(); i++)
+    {
+        uint64_t t = m_protocols[i]->getNextAsyncUpdateTime();
+        next = std::min(next, t == 0 ? poll_time : t);
+    }
+    return next;
+}   // OneProtocolType::getNextAsyncUpdateTime
+
+// ----------------------------------------------------------------------------
+/** Returns the time (in ms) at which the asynchronous update thread has to
+ *  wake up even without new events or requests. Only called from the
+ *  asynchronous update thread, which is the only one changing the protocols,
+ *  so no lock is needed.
+ */
+uint64_t ProtocolManager::getNextAsyncUpdateTime()
+{
+    // The shortest interval, used for protocols which poll some state and
+    // for events which could not be delivered yet
+    const uint64_t POLL_INTERVAL = 2;
+    // Upper limit in case some protocol misses a wake up
+    const uint64_t MAX_WAIT_TIME = 1000;
+
+    const uint64_t now = StkTime::getMonoTimeMs();
+    uint64_t next = now + MAX_WAIT_TIME;
+
+    m_async_events_to_process.lock();
+    if (!m_async_events_to_process.getData().empty())
+        next = now + POLL_INTERVAL;
+    m_async_events_to_process.unlock();
+
+    for (unsigned int i = 0; i < m_all_protocols.size(); i++)
+    {
+        next = std::min(next,
+            m_all_protocols[i].getNextAsyncUpdateTime(now + POLL_INTERVAL));
+    }
+    return next;
+}   // getNextAsyncUpdateTime
+
+// ----------------------------------------------------------------------------
+/** Blocks the asynchronous update thread until there is a new event or
+ *  request, the manager is exiting, or the nearest protocol deadline is
+ *  reached.
+ */
+void ProtocolManager::waitForAsynchronousWork()
+{
+    const uint64_t next = getNextAsyncUpdateTime();
+    std::unique_lock<std::mutex> ul(m_async_wakeup_mutex);
+    const uint64_t now = StkTime::getMonoTimeMs();
+    if (!m_async_wakeup && next > now)
+    {
+        m_async_wakeup_cv.wait_for(ul, std::chrono::milliseconds(next - now),
+            [this]() { return m_async_wakeup || m_exit.load(); });
+    }
+    m_async_wakeup = false;
+}   // waitForAsynchronousWork
+
+// ----------------------------------------------------------------------------
+/** Returns the event queue depth and latency histograms of the asynchronous
+ *  update thread.
+ */
+std::string ProtocolManager::getStatistics() const
+{
+    return "Asynchronous event queue depth: " +
+        m_async_queue_depth.toString("") +
+        "Asynchronous event latency: " +
+        m_async_event_latency.toString("us");
+}   // getStatistics
+
 // ----------------------------------------------------------------------------
 /** \brief Function that processes incoming events.
  *  This function is called by the network manager each time there is an
@@ -189,6 +282,7 @@ void ProtocolManager::propagateEvent(Event* event)
         m_async_events_to_process.lock();
         m_async_events_to_process.getData().push_back(event);
         m_async_events_to_process.unlock();
+        wakeUpAsynchronousUpdate();
     }
 }   // propagateEvent
 
@@ -207,6 +301,7 @@ void ProtocolManager::requestStart(std::shared_ptr<Protocol> protocol)
     m_requests.lock();
     m_requests.getData().push_back(req);
     m_requests.unlock();
+    wakeUpAsynchronousUpdate();
 }   // requestStart
 
 // ----------------------------------------------------------------------------
@@ -234,6 +329,7 @@ void ProtocolManager::requestTerminate(std::shared_ptr<Protocol> protocol)
     }
     m_requests.getData().push_back(req);
     m_requests.unlock();
+    wakeUpAsynchronousUpdate();
 }   // requestTerminate
 
 // ----------------------------------------------------------------------------
@@ -485,6 +581,7 @@ void ProtocolManager::asynchronousUpdate()
     // First deliver asynchronous messages for all protocols
     // =====================================================
     m_async_events_to_process.lock();
+    m_async_queue_depth.add(m_async_events_to_process.getData().size());
     EventList::iterator i = m_async_events_to_process.getData().begin();
     while (i != m_async_events_to_process.getData().end())
     {
@@ -507,6 +604,8 @@ void ProtocolManager::asynchronousUpdate()
         m_async_events_to_process.lock();
         if (result)
         {
+            m_async_event_latency.add(StkTime::getMonoTimeUs() -
+                (*i)->getArrivalTimeUs());
             delete *i;
             i = m_async_events_to_process.getData().erase(i);
         }
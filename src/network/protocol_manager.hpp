@@ -25,6 +25,7 @@
 
 #include "network/network_string.hpp"
 #include "network/protocol.hpp"
+#include "utils/histogram.hpp"
 #include "utils/no_copy.hpp"
 #include "utils/singleton.hpp"
 #include "utils/synchronised.hpp"
@@ -150,6 +151,7 @@ private:
         bool notifyEvent(Event *event);
         void update(int ticks, bool async);
         void abort();
+        uint64_t getNextAsyncUpdateTime(uint64_t poll_time) const;
         // --------------------------------------------------------------------
         /** Returns the first protocol of a given type. It is assumed that
          *  there is a protocol of that type. */
@@ -207,6 +209,24 @@ private:
     /*! Asynchronous update thread.*/
     std::thread m_asynchronous_update_thread;
 
+    /** Used to wake up the asynchronous update thread when there are new
+     *  events or requests, or the manager is exiting. */
+    std::condition_variable m_async_wakeup_cv;
+
+    std::mutex m_async_wakeup_mutex;
+
+    /** Set when there is new work for the asynchronous update thread, so
+     *  that a wake up between two waits is not lost. */
+    bool m_async_wakeup;
+
+    /** Number of events in the asynchronous event queue each time the
+     *  asynchronous update thread wakes up. */
+    Histogram m_async_queue_depth;
+
+    /** Time in microseconds between the arrival of an asynchronous event
+     *  and its delivery to the protocols. */
+    Histogram m_async_event_latency;
+
     /** Asynchronous game protocol thread to handle controller action as fast
      *  as possible. */
     std::thread m_game_protocol_thread;
@@ -226,6 +246,8 @@ private:
     virtual void startProtocol(std::shared_ptr<Protocol> protocol);
     virtual void terminateProtocol(std::shared_ptr<Protocol> protocol);
     virtual void asynchronousUpdate();
+    uint64_t getNextAsyncUpdateTime();
+    void waitForAsynchronousWork();
 
 public:
     // ===========================================
@@ -239,6 +261,13 @@ public:
     void      requestTerminate(std::shared_ptr<Protocol> protocol);
     void      findAndTerminate(ProtocolType type);
     void      update(int ticks);
+    void      wakeUpAsynchronousUpdate();
+    std::string getStatistics() const;
+    // ------------------------------------------------------------------------
+    const Histogram& getAsyncQueueDepth() const { return m_async_queue_depth; }
+    // ------------------------------------------------------------------------
+    const Histogram& getAsyncEventLatency() const
+                                              { return m_async_event_latency; }
     // ------------------------------------------------------------------------
     bool isExiting() const                            { return m_exit.load(); }
     // ------------------------------------------------------------------------
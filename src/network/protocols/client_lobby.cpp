@@ -47,6 +47,7 @@
 #include "network/race_event_manager.hpp"
 #include "network/server.hpp"
 #include "network/server_config.hpp"
+#include "network/server_messages.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "states_screens/online/networking_lobby.hpp"
@@ -317,26 +318,18 @@ std::vector<std::shared_ptr<NetworkPlayerProfile> >
                              bool* is_specator) const
 {
     std::vector<std::shared_ptr<NetworkPlayerProfile> > players;
-    unsigned player_count = data.getUInt8();
-    for (unsigned i = 0; i < player_count; i++)
+    for (const ServerMessages::PlayerEntry& entry :
+         ServerMessages::decodePlayerEntries(data))
     {
-        core::stringw player_name;
-        data.decodeStringW(&player_name);
-        uint32_t host_id = data.getUInt32();
-        float kart_color = data.getFloat();
-        uint32_t online_id = data.getUInt32();
-        PerPlayerDifficulty ppd = (PerPlayerDifficulty)data.getUInt8();
-        uint8_t local_id = data.getUInt8();
-        KartTeam team = (KartTeam)data.getUInt8();
-        std::string country_code;
-        data.decodeString(&country_code);
-        if (is_specator && host_id == STKHost::get()->getMyHostId())
+        if (is_specator && entry.m_host_id == STKHost::get()->getMyHostId())
             *is_specator = false;
-        auto player = std::make_shared<NetworkPlayerProfile>(peer, player_name,
-            host_id, kart_color, online_id, ppd, local_id, team, country_code);
-        std::string kart_name;
-        data.decodeString(&kart_name);
-        player->setKartName(kart_name);
+        auto player = std::make_shared<NetworkPlayerProfile>(peer,
+            entry.m_name, entry.m_host_id, entry.m_kart_color,
+            entry.m_online_id,
+            (PerPlayerDifficulty)entry.m_per_player_difficulty,
+            entry.m_local_player_id, (KartTeam)entry.m_team,
+            entry.m_country_code);
+        player->setKartName(entry.m_kart_name);
         players.push_back(player);
     }
     return players;
@@ -598,33 +591,25 @@ void ClientLobby::connectionAccepted(Event* event)
         MessageQueue::add(MessageQueue::MT_GENERIC, msg);
     }
 
-    STKHost::get()->setMyHostId(data.getUInt32());
+    ServerMessages::ConnectionAccepted accepted(data);
+    STKHost::get()->setMyHostId(accepted.m_host_id);
     assert(!NetworkConfig::get()->isAddingNetworkPlayers());
-    uint32_t server_version = data.getUInt32();
-    NetworkConfig::get()->setJoinedServerVersion(server_version);
-    assert(server_version != 0);
+    NetworkConfig::get()->setJoinedServerVersion(accepted.m_server_version);
+    assert(accepted.m_server_version != 0);
     m_auto_started = false;
     m_state.store(CONNECTED);
 
-    unsigned list_caps = data.getUInt16();
-    std::set<std::string> caps;
-    for (unsigned i = 0; i < list_caps; i++)
+    NetworkConfig::get()->setStateFrequency(accepted.m_state_frequency);
+    if (accepted.m_auto_start_timer != std::numeric_limits<float>::max())
     {
-        std::string cap;
-        data.decodeString(&cap);
-        caps.insert(cap);
+        NetworkingLobby::getInstance()
+            ->setStartingTimerTo(accepted.m_auto_start_timer);
     }
-    NetworkConfig::get()->setServerCapabilities(caps);
-
-    float auto_start_timer = data.getFloat();
-    int state_frequency_in_server = data.getUInt32();
-    NetworkConfig::get()->setStateFrequency(state_frequency_in_server);
-    if (auto_start_timer != std::numeric_limits<float>::max())
-        NetworkingLobby::getInstance()->setStartingTimerTo(auto_start_timer);
-    m_server_enabled_chat = data.getUInt8() == 1;
-    if (NetworkConfig::get()->getServerCapabilities().find("report_player") !=
-        NetworkConfig::get()->getServerCapabilities().end())
-        m_server_enabled_report_player = data.getUInt8() == 1;
+    m_server_enabled_chat = accepted.m_chat;
+    if (accepted.m_capabilities.find("report_player") !=
+        accepted.m_capabilities.end())
+        m_server_enabled_report_player = accepted.m_report_player;
+    NetworkConfig::get()->setServerCapabilities(accepted.m_capabilities);
 }   // connectionAccepted
 
 //-----------------------------------------------------------------------------
@@ -733,7 +718,8 @@ void ClientLobby::updatePlayerList(Event* event)
 {
     if (!checkDataSize(event, 1)) return;
     NetworkString& data = event->data();
-    bool waiting = data.getUInt8() == 1;
+    const ServerMessages::PlayerListHeader header(data);
+    bool waiting = header.m_game_started;
     if (m_waiting_for_game && !waiting)
     {
         // The waiting game finished
@@ -741,7 +727,7 @@ void ClientLobby::updatePlayerList(Event* event)
     }
 
     m_waiting_for_game = waiting;
-    unsigned player_count = data.getUInt8();
+    unsigned player_count = header.m_player_count;
     core::stringw total_players;
     m_lobby_players.clear();
     bool client_server_owner = false;
@@ -25,6 +25,7 @@
 #include "utils/cpp2011.hpp"
 
 #include <atomic>
+#include <limits>
 #include <map>
 #include <memory>
 #include <set>
@@ -153,6 +154,10 @@ public:
     virtual void setup() OVERRIDE;
     virtual void update(int ticks) OVERRIDE;
     virtual void asynchronousUpdate() OVERRIDE {}
+    virtual uint64_t getNextAsyncUpdateTime() const OVERRIDE
+    {
+        return std::numeric_limits<uint64_t>::max();
+    }
     virtual bool allPlayersReady() const OVERRIDE
                                            { return m_state.load() >= RACING; }
     bool waitingForServerRespond() const
@@ -4,6 +4,8 @@
 #include "network/protocol.hpp"
 #include "utils/cpp2011.hpp"
 
+#include <limits>
+
 class AbstractKart;
 
 class GameEventsProtocol : public Protocol
@@ -36,6 +38,11 @@ public:
     virtual void update(int ticks) OVERRIDE {}
     virtual void asynchronousUpdate() OVERRIDE {}
     // ------------------------------------------------------------------------
+    virtual uint64_t getNextAsyncUpdateTime() const OVERRIDE
+    {
+        return std::numeric_limits<uint64_t>::max();
+    }
+    // ------------------------------------------------------------------------
     virtual bool notifyEventAsynchronous(Event* event) OVERRIDE
     {
         return false;
@@ -30,8 +30,10 @@
 #include "network/protocol_manager.hpp"
 #include "network/rewind_info.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/server_metrics.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
+#include "race/history.hpp"
 #include "utils/log.hpp"
 #include "utils/time.hpp"
 #include "main_loop.hpp"
@@ -298,6 +300,19 @@ void GameProtocol::addState(BareNetworkString *buffer)
     (*m_data_to_send) += *buffer;
 }   // addState
 
+// ----------------------------------------------------------------------------
+/** Called by a server after all states were added to append the hash of
+ *  each of them, which is ignored by clients not comparing state hashes
+ *  (see RewindInfoState::restore).
+ *  \param hashes The hash of each state added, 0 if not hashed.
+ */
+void GameProtocol::addStateHashes(const std::vector<uint32_t>& hashes)
+{
+    assert(NetworkConfig::get()->isServer());
+    for (uint32_t hash : hashes)
+        m_data_to_send->addUInt32(hash);
+}   // addStateHashes
+
 // ----------------------------------------------------------------------------
 /** Called by a server to finalize the current state, which add updated
  *  names of rewinder using to the beginning of state buffer
@@ -325,11 +340,33 @@ void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
 // ----------------------------------------------------------------------------
 /** Called when the last state information has been added and the message
  *  can be sent to the clients.
+ *  \param predicate If set, the state is only sent to the peers for which
+ *         it returns true.
+ */
+void GameProtocol::sendState(std::function<bool(STKPeer*)> predicate)
+{
+    assert(NetworkConfig::get()->isServer());
+    ServerMetrics::add(ServerMetrics::SM_STATE_SIZE,
+        m_data_to_send->getTotalSize());
+    if (predicate)
+    {
+        STKHost::get()->sendPacketToAllPeersWith(predicate, m_data_to_send,
+            /*reliable*/false);
+    }
+    else
+        sendMessageToPeers(m_data_to_send, /*reliable*/false);
+}   // sendState
+
+// ----------------------------------------------------------------------------
+/** Sends the current state to a single peer only, used when the state was
+ *  filtered for that peer (see RewindManager::sendState).
  */
-void GameProtocol::sendState()
+void GameProtocol::sendState(STKPeer* peer)
 {
     assert(NetworkConfig::get()->isServer());
-    sendMessageToPeers(m_data_to_send, /*reliable*/false);
+    ServerMetrics::add(ServerMetrics::SM_STATE_SIZE,
+        m_data_to_send->getTotalSize());
+    peer->sendPacket(m_data_to_send, /*reliable*/false);
 }   // sendState
 
 // ----------------------------------------------------------------------------
@@ -387,5 +424,8 @@ void GameProtocol::rewind(BareNetworkString *buffer)
     {
         pc->actionFromNetwork(std::get<0>(a), std::get<1>(a), std::get<2>(a),
             std::get<3>(a));
+        // Record the inputs of remote players in the history of a server
+        if (NetworkConfig::get()->isServer() && !history->replayHistory())
+            history->addEvent(kart_id, std::get<0>(a), std::get<1>(a));
     }
 }   // rewind
@@ -27,6 +27,8 @@
 #include "utils/singleton.hpp"
 
 #include <cstdlib>
+#include <functional>
+#include <limits>
 #include <mutex>
 #include <vector>
 #include <tuple>
@@ -38,11 +40,7 @@ class STKPeer;
 class GameProtocol : public Protocol
                    , public EventRewinder
 {
-private:
-    /* Used to check if deleting world is doing at the same the for
-     * asynchronous event update. */
-    mutable std::mutex m_world_deleting_mutex;
-
+public:
     /** The type of game events to be forwarded to the server. */
     enum { GP_CONTROLLER_ACTION,
            GP_STATE,
@@ -51,6 +49,11 @@ private:
            GP_ADJUST_TIME
     };
 
+private:
+    /* Used to check if deleting world is doing at the same the for
+     * asynchronous event update. */
+    mutable std::mutex m_world_deleting_mutex;
+
     /** A network string that collects all information from the server to be sent
      *  next. */
     NetworkString *m_data_to_send;
@@ -111,7 +114,9 @@ public:
                           int value, int val_l, int val_r);
     void startNewState();
     void addState(BareNetworkString *buffer);
-    void sendState();
+    void addStateHashes(const std::vector<uint32_t>& hashes);
+    void sendState(std::function<bool(STKPeer*)> predicate = nullptr);
+    void sendState(STKPeer* peer);
     void finalizeState(std::vector<std::string>& cur_rewinder);
     void sendItemEventConfirmation(int ticks);
 
@@ -122,6 +127,11 @@ public:
     // ------------------------------------------------------------------------
     virtual void asynchronousUpdate() OVERRIDE {}
     // ------------------------------------------------------------------------
+    virtual uint64_t getNextAsyncUpdateTime() const OVERRIDE
+    {
+        return std::numeric_limits<uint64_t>::max();
+    }
+    // ------------------------------------------------------------------------
     static std::shared_ptr<GameProtocol> createInstance();
     // ------------------------------------------------------------------------
     static bool emptyInstance()
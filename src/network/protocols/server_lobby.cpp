@@ -39,11 +39,14 @@
 #include "network/protocols/game_events_protocol.hpp"
 #include "network/race_event_manager.hpp"
 #include "network/server_config.hpp"
+#include "network/server_messages.hpp"
+#include "network/server_plugins.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "online/online_profile.hpp"
 #include "online/request_manager.hpp"
 #include "race/race_manager.hpp"
+#include "scriptengine/script_engine.hpp"
 #include "states_screens/online/networking_lobby.hpp"
 #include "states_screens/race_result_gui.hpp"
 #include "tracks/check_manager.hpp"
@@ -140,6 +143,7 @@ ServerLobby::ServerLobby() : LobbyProtocol()
     m_result_ns = getNetworkString();
     m_result_ns->setSynchronous(true);
     m_items_complete_state = new BareNetworkString();
+    createPlugins();
     m_server_id_online.store(0);
     m_difficulty.store(ServerConfig::m_server_difficulty);
     m_game_mode.store(ServerConfig::m_server_mode);
@@ -153,6 +157,8 @@ ServerLobby::ServerLobby() : LobbyProtocol()
  */
 ServerLobby::~ServerLobby()
 {
+    // Stop the plugin thread first, as hooks may refer to the lobby
+    delete m_plugins;
     if (NetworkConfig::get()->isNetworking() &&
         NetworkConfig::get()->isWAN())
     {
@@ -595,28 +601,92 @@ void ServerLobby::handleChat(Event* event)
     const bool sender_in_game = event->getPeer()->isWaitingForGame();
     core::stringw message;
     event->data().decodeString16(&message);
-    if (message.size() > 0)
-    {
-        NetworkString* chat = getNetworkString();
-        chat->setSynchronous(true);
-        chat->addUInt8(LE_CHAT).encodeString16(message);
-        const bool game_started = m_state.load() != WAITING_FOR_START_GAME;
-        STKHost::get()->sendPacketToAllPeersWith(
-            [game_started, sender_in_game](STKPeer* p)
+    if (message.size() == 0)
+        return;
+
+    if (m_plugins && m_plugins->hasHook(ServerPlugins::HOOK_CHAT))
+    {
+        // Sent once the plugin allowed it, see asynchronousUpdate
+        m_plugins->onChat(event->getPeer()->getHostId(),
+            StringUtils::wideToUtf8(message),
+            [this, message, sender_in_game](bool allowed)
             {
-                if (game_started)
-                {
-                    if (p->isWaitingForGame() && !sender_in_game)
-                        return false;
-                    if (!p->isWaitingForGame() && sender_in_game)
-                        return false;
-                }
-                return true;
-            }, chat);
-        delete chat;
+                if (allowed)
+                    broadcastChat(message, sender_in_game);
+            });
+        return;
     }
+    broadcastChat(message, sender_in_game);
 }   // handleChat
 
+//-----------------------------------------------------------------------------
+/** Sends a chat message to the peers which are in the same state (in game or
+ *  waiting for the game) as the sender.
+ */
+void ServerLobby::broadcastChat(const core::stringw& message,
+                                bool sender_in_game)
+{
+    NetworkString* chat = getNetworkString();
+    chat->setSynchronous(true);
+    chat->addUInt8(LE_CHAT).encodeString16(message);
+    const bool game_started = m_state.load() != WAITING_FOR_START_GAME;
+    STKHost::get()->sendPacketToAllPeersWith(
+        [game_started, sender_in_game](STKPeer* p)
+        {
+            if (game_started)
+            {
+                if (p->isWaitingForGame() && !sender_in_game)
+                    return false;
+                if (!p->isWaitingForGame() && sender_in_game)
+                    return false;
+            }
+            return true;
+        }, chat);
+    delete chat;
+}   // broadcastChat
+
+//-----------------------------------------------------------------------------
+/** Loads the plugin-script if set. Its hooks run in a thread of their own,
+ *  the actions they request are applied in asynchronousUpdate.
+ */
+void ServerLobby::createPlugins()
+{
+    m_plugins = NULL;
+    const std::string& path = ServerConfig::m_plugin_script;
+    if (path.empty())
+        return;
+    std::string script = Scripting::getScript(path);
+    if (script.empty())
+    {
+        Log::error("ServerLobby", "Cannot load plugin script %s.",
+            path.c_str());
+        return;
+    }
+    m_plugins = new ServerPlugins(script,
+        std::max((int)ServerConfig::m_plugin_time_budget, 1),
+        []()
+        {
+            if (auto pm = ProtocolManager::lock())
+                pm->wakeUpAsynchronousUpdate();
+        },
+        [this](const std::string& message)
+        {
+            NetworkString* chat = getNetworkString();
+            chat->setSynchronous(true);
+            chat->addUInt8(LE_CHAT)
+                .encodeString16(StringUtils::utf8ToWide(message));
+            STKHost::get()->sendPacketToAllPeers(chat, true/*reliable*/);
+            delete chat;
+        },
+        [](uint32_t host_id)
+        {
+            std::shared_ptr<STKPeer> peer =
+                STKHost::get()->findPeerByHostId(host_id);
+            if (peer)
+                peer->kick();
+        });
+}   // createPlugins
+
 //-----------------------------------------------------------------------------
 void ServerLobby::changeTeam(Event* event)
 {
@@ -978,6 +1048,9 @@ void ServerLobby::writePlayerReport(Event* event)
 /** Find out the public IP server or poll STK server asynchronously. */
 void ServerLobby::asynchronousUpdate()
 {
+    if (m_plugins)
+        m_plugins->handleResults();
+
     if (m_rs_state.load() == RS_ASYNC_RESET)
     {
         resetVotingTime();
@@ -1155,6 +1228,12 @@ void ServerLobby::asynchronousUpdate()
         if (go_on_race)
         {
             *m_default_vote = winner_vote;
+            if (m_plugins)
+            {
+                m_plugins->onVotesResolved(winner_vote.m_track_name,
+                    winner_vote.m_num_laps, winner_vote.m_reverse,
+                    StringUtils::wideToUtf8(winner_vote.m_player_name));
+            }
             m_item_seed = (uint32_t)StkTime::getTimeSinceEpoch();
             ItemManager::updateRandomSeed(m_item_seed);
             m_game_setup->setRace(winner_vote);
@@ -1219,25 +1298,60 @@ void ServerLobby::asynchronousUpdate()
 
 }   // asynchronousUpdate
 
+//-----------------------------------------------------------------------------
+/** In most states the asynchronous update only handles coarse timers
+ *  (database cleanup, polling the STK server, auto start countdown),
+ *  incoming events wake up the protocol manager anyway. Only the states
+ *  which wait for something set by the main thread still poll.
+ */
+uint64_t ServerLobby::getNextAsyncUpdateTime() const
+{
+    const uint64_t COARSE_UPDATE_INTERVAL = 50;
+    const uint64_t now = StkTime::getMonoTimeMs();
+    switch (m_state.load())
+    {
+    case WAITING_FOR_START_GAME:
+    {
+        uint64_t next = now + COARSE_UPDATE_INTERVAL;
+        const int64_t timeout = m_timeout.load();
+        if (ServerConfig::m_owner_less && timeout >= 0 &&
+            (uint64_t)timeout < next)
+            next = std::max((uint64_t)timeout, now);
+        return next;
+    }
+    case LOAD_WORLD:
+    case WAIT_FOR_RACE_STARTED:
+    case RACING:
+    case WAIT_FOR_RACE_STOPPED:
+    case RESULT_DISPLAY:
+    case EXITING:
+        return now + COARSE_UPDATE_INTERVAL;
+    default:
+        return 0;
+    }
+}   // getNextAsyncUpdateTime
+
 //-----------------------------------------------------------------------------
 void ServerLobby::encodePlayers(BareNetworkString* bns,
         std::vector<std::shared_ptr<NetworkPlayerProfile> >& players) const
 {
-    bns->addUInt8((uint8_t)players.size());
+    std::vector<ServerMessages::PlayerEntry> entries(players.size());
     for (unsigned i = 0; i < players.size(); i++)
     {
         std::shared_ptr<NetworkPlayerProfile>& player = players[i];
-        bns->encodeString(player->getName())
-            .addUInt32(player->getHostId())
-            .addFloat(player->getDefaultKartColor())
-            .addUInt32(player->getOnlineId())
-            .addUInt8(player->getPerPlayerDifficulty())
-            .addUInt8(player->getLocalPlayerId())
-            .addUInt8(
-            race_manager->teamEnabled() ? player->getTeam() : KART_TEAM_NONE)
-            .encodeString(player->getCountryCode());
-        bns->encodeString(player->getKartName());
-    }
+        ServerMessages::PlayerEntry& entry = entries[i];
+        entry.m_name = player->getName();
+        entry.m_host_id = player->getHostId();
+        entry.m_kart_color = player->getDefaultKartColor();
+        entry.m_online_id = player->getOnlineId();
+        entry.m_per_player_difficulty = player->getPerPlayerDifficulty();
+        entry.m_local_player_id = player->getLocalPlayerId();
+        entry.m_team = (uint8_t)(race_manager->teamEnabled() ?
+            player->getTeam() : KART_TEAM_NONE);
+        entry.m_country_code = player->getCountryCode();
+        entry.m_kart_name = player->getKartName();
+    }
+    ServerMessages::encodePlayerEntries(bns, entries);
 }   // encodePlayers
 
 //-----------------------------------------------------------------------------
@@ -2208,6 +2322,9 @@ void ServerLobby::checkIncomingConnectionRequests()
                 }
             }
             sl->replaceKeys(keys);
+            // Handle the new keys in handlePendingConnection now
+            if (auto pm = ProtocolManager::lock())
+                pm->wakeUpAsynchronousUpdate();
         }
     public:
         PollServerRequest(std::shared_ptr<ServerLobby> sl)
@@ -2306,6 +2423,31 @@ void ServerLobby::checkRaceFinished()
         computeNewRankings();
         submitRankingsToAddons();
     }
+    if (m_plugins)
+    {
+        // Players in finishing order
+        World* w = World::getWorld();
+        std::vector<unsigned> order;
+        for (unsigned i = 0; i < race_manager->getNumPlayers(); i++)
+            order.push_back(i);
+        std::sort(order.begin(), order.end(), [w](unsigned a, unsigned b)
+            {
+                return w->getKart(a)->getPosition() <
+                    w->getKart(b)->getPosition();
+            });
+        std::vector<std::string> names;
+        std::vector<uint32_t> online_ids;
+        std::vector<float> times;
+        for (unsigned i : order)
+        {
+            const RemoteKartInfo& rki = race_manager->getKartInfo(i);
+            names.push_back(StringUtils::wideToUtf8(rki.getPlayerName()));
+            online_ids.push_back(rki.getOnlineId());
+            times.push_back(w->getKart(i)->hasFinishedRace() ?
+                w->getKart(i)->getFinishTime() : -1.0f);
+        }
+        m_plugins->onRaceEnd(names, online_ids, times);
+    }
     m_state.store(WAIT_FOR_RACE_STOPPED);
 }   // checkRaceFinished
 
@@ -2806,7 +2948,9 @@ void ServerLobby::connectionRequested(Event* event)
 
     // Reject non-valiated player joinning if WAN server and not disabled
     // encforement of validation, unless it's player from localhost or lan
-    // And no duplicated online id or split screen players in ranked server
+    // And no duplicated online id or split screen players in ranked server.
+    // This refuses a SpectatorRelay too (it connects without players), so
+    // ranked servers can't be relayed
     std::set<uint32_t> all_online_ids =
         STKHost::get()->getAllPlayerOnlineIds();
     bool duplicated_ranked_player =
@@ -2970,18 +3114,18 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
         auto_start_timer =
             (m_timeout.load() - (int64_t)StkTime::getMonoTimeMs()) / 1000.0f;
     }
-    message_ack->addUInt8(LE_CONNECTION_ACCEPTED).addUInt32(peer->getHostId())
-        .addUInt32(ServerConfig::m_server_version);
-
-    message_ack->addUInt16(
-        (uint16_t)stk_config->m_network_capabilities.size());
-    for (const std::string& cap : stk_config->m_network_capabilities)
-        message_ack->encodeString(cap);
-
-    message_ack->addFloat(auto_start_timer)
-        .addUInt32(ServerConfig::m_state_frequency)
-        .addUInt8(ServerConfig::m_chat ? 1 : 0)
-        .addUInt8(m_player_reports_table_exists ? 1 : 0);
+    ServerMessages::ConnectionAccepted accepted;
+    accepted.m_host_id = peer->getHostId();
+    accepted.m_server_version = ServerConfig::m_server_version;
+    accepted.m_capabilities.insert(
+        stk_config->m_network_capabilities.begin(),
+        stk_config->m_network_capabilities.end());
+    accepted.m_auto_start_timer = auto_start_timer;
+    accepted.m_state_frequency = ServerConfig::m_state_frequency;
+    accepted.m_chat = ServerConfig::m_chat;
+    accepted.m_report_player = m_player_reports_table_exists;
+    message_ack->addUInt8(LE_CONNECTION_ACCEPTED);
+    accepted.encode(message_ack);
 
     peer->setSpectator(false);
     if (game_started)
@@ -3016,6 +3160,16 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
             getRankingForPlayer(peer->getPlayerProfiles()[0]);
         }
     }
+    if (m_plugins)
+    {
+        for (std::shared_ptr<NetworkPlayerProfile>& npp :
+            peer->getPlayerProfiles())
+        {
+            m_plugins->onConnect(peer->getHostId(),
+                StringUtils::wideToUtf8(npp->getName()), npp->getOnlineId(),
+                country_code);
+        }
+    }
 #ifdef ENABLE_SQLITE3
     if (m_server_stats_table.empty())
         return;
@@ -3085,9 +3239,9 @@ void ServerLobby::updatePlayerList(bool update_when_reset_server)
     auto all_profiles = STKHost::get()->getAllPlayerProfiles();
     NetworkString* pl = getNetworkString();
     pl->setSynchronous(true);
-    pl->addUInt8(LE_UPDATE_PLAYER_LIST)
-        .addUInt8((uint8_t)(game_started ? 1 : 0))
-        .addUInt8((uint8_t)all_profiles.size());
+    pl->addUInt8(LE_UPDATE_PLAYER_LIST);
+    ServerMessages::PlayerListHeader(game_started,
+        (uint8_t)all_profiles.size()).encode(pl);
     for (auto profile : all_profiles)
     {
         pl->addUInt32(profile->getHostId()).addUInt32(profile->getOnlineId())
@@ -3150,7 +3304,7 @@ void ServerLobby::updateServerOwner()
     for (auto peer: peers)
     {
         // Only 127.0.0.1 can be server owner in case of graphics-client-server
-        if (peer->isValidated() &&
+        if (peer->isValidated() && !peer->isRelay() &&
             (NetworkConfig::get()->getServerIdFile().empty() ||
             peer->getAddress().getIP() == 0x7f000001))
         {
@@ -3508,6 +3662,8 @@ void ServerLobby::finishedLoadingWorld()
             peer->updateLastActivity();
     }
     m_server_has_loaded_world.store(true);
+    if (auto pm = ProtocolManager::lock())
+        pm->wakeUpAsynchronousUpdate();
 }   // finishedLoadingWorld;
 
 //-----------------------------------------------------------------------------
@@ -3768,6 +3924,23 @@ void ServerLobby::configPeersStartTime()
         });
 }   // configPeersStartTime
 
+//-----------------------------------------------------------------------------
+/** Returns true if all peers are ready, spectator relays are never waited
+ *  for as they don't load the world nor display the results.
+ */
+bool ServerLobby::checkPeersReady() const
+{
+    for (auto p : m_peers_ready)
+    {
+        auto peer = p.first.lock();
+        if (!peer || peer->isRelay())
+            continue;
+        if (!p.second)
+            return false;
+    }
+    return true;
+}   // checkPeersReady
+
 //-----------------------------------------------------------------------------
 bool ServerLobby::allowJoinedPlayersWaiting() const
 {
@@ -3808,6 +3981,14 @@ void ServerLobby::addWaitingPlayersToGame()
             getRankingForPlayer(peer->getPlayerProfiles()[0]);
         }
     }
+    // Spectator relays have no players but spectate every game
+    for (auto& peer : STKHost::get()->getPeers())
+    {
+        if (!peer->isValidated() || !peer->isRelay())
+            continue;
+        peer->setWaitingForGame(false);
+        peer->setSpectator(true);
+    }
 }   // addWaitingPlayersToGame
 
 //-----------------------------------------------------------------------------
@@ -41,6 +41,7 @@
 class BareNetworkString;
 class NetworkString;
 class NetworkPlayerProfile;
+class ServerPlugins;
 class STKPeer;
 
 class ServerLobby : public LobbyProtocol
@@ -207,6 +208,9 @@ private:
 
     uint64_t m_client_starting_time;
 
+    /** Runs the hooks of the plugin-script, NULL if none is set. */
+    ServerPlugins* m_plugins;
+
     // connection management
     void clientDisconnected(Event* event);
     void connectionRequested(Event* event);
@@ -221,25 +225,16 @@ private:
     void kickHost(Event* event);
     void changeTeam(Event* event);
     void handleChat(Event* event);
+    void broadcastChat(const irr::core::stringw& message,
+                       bool sender_in_game);
+    void createPlugins();
     void unregisterServer(bool now);
     void createServerIdFile();
     void updatePlayerList(bool update_when_reset_server = false);
     void updateServerOwner();
     void handleServerConfiguration(Event* event);
     void updateTracksForMode();
-    bool checkPeersReady() const
-    {
-        bool all_ready = true;
-        for (auto p : m_peers_ready)
-        {
-            if (p.first.expired())
-                continue;
-            all_ready = all_ready && p.second;
-            if (!all_ready)
-                return false;
-        }
-        return true;
-    }
+    bool checkPeersReady() const;
     void resetPeersReady()
     {
         for (auto it = m_peers_ready.begin(); it != m_peers_ready.end();)
@@ -342,6 +337,7 @@ public:
     virtual void setup() OVERRIDE;
     virtual void update(int ticks) OVERRIDE;
     virtual void asynchronousUpdate() OVERRIDE;
+    virtual uint64_t getNextAsyncUpdateTime() const OVERRIDE;
 
     void startSelection(const Event *event=NULL);
     void checkIncomingConnectionRequests();
@@ -71,10 +71,13 @@ RewindInfoState::RewindInfoState(int ticks, BareNetworkString* buffer,
 // ------------------------------------------------------------------------
 /** Rewinds to this state. This is called while going forwards in time
  *  again to reach current time. It will call rewindToState().
- *  if the state is a confirmed state.
+ *  if the state is a confirmed state. If the server appended the hashes of
+ *  the states (state-hash server option), they are compared with the states
+ *  of this client first.
  */
 void RewindInfoState::restore()
 {
+    checkHashes();
     m_buffer->reset();
     m_buffer->skip(m_start_offset);
     for (const std::string& name : m_rewinder_using)
@@ -84,6 +87,18 @@ void RewindInfoState::restore()
         std::shared_ptr<Rewinder> r =
             RewindManager::get()->getRewinder(name);
 
+        // An empty state is sent by the server for a distant object, which
+        // keeps the state predicted by this client
+        Vec3 xyz;
+        if (data_size == 0 && (!r || r->getRelevancePosition(&xyz)))
+        {
+            if (r)
+            {
+                RewindManager::get()->restorePredictedState(r.get(),
+                    getTicks());
+            }
+            continue;
+        }
         if (!r)
         {
             // For now we only need to get missing rewinder from
@@ -120,6 +135,34 @@ void RewindInfoState::restore()
     }   // for all rewinder
 }   // restore
 
+// ------------------------------------------------------------------------
+/** Reads the hashes appended by the server after the data of all rewinders,
+ *  if any, and passes them to RewindManager::checkStateHashes.
+ */
+void RewindInfoState::checkHashes()
+{
+    m_buffer->reset();
+    m_buffer->skip(m_start_offset);
+    for (unsigned i = 0; i < m_rewinder_using.size(); i++)
+    {
+        if (m_buffer->size() < 2)
+            return;
+        const uint16_t data_size = m_buffer->getUInt16();
+        if (m_buffer->size() < data_size)
+            return;
+        m_buffer->skip(data_size);
+    }
+    if (m_rewinder_using.empty() ||
+        m_buffer->size() != m_rewinder_using.size() * 4)
+        return;
+
+    std::vector<uint32_t> hashes;
+    for (unsigned i = 0; i < m_rewinder_using.size(); i++)
+        hashes.push_back(m_buffer->getUInt32());
+    RewindManager::get()->checkStateHashes(getTicks(), m_rewinder_using,
+        hashes);
+}   // checkHashes
+
 // ============================================================================
 RewindInfoEvent::RewindInfoEvent(int ticks, EventRewinder *event_rewinder,
                                  BareNetworkString *buffer, bool is_confirmed)
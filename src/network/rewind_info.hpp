@@ -99,6 +99,8 @@ private:
     /** Pointer to the buffer which stores all states. */
     BareNetworkString *m_buffer;
 
+    void checkHashes();
+
 public:
     // ------------------------------------------------------------------------
     RewindInfoState(int ticks, int start_offset,
@@ -19,13 +19,17 @@
 #include "network/rewind_manager.hpp"
 
 #include "graphics/irr_driver.hpp"
+#include "karts/abstract_kart.hpp"
 #include "modes/world.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
 #include "network/protocols/game_protocol.hpp"
 #include "network/rewinder.hpp"
 #include "network/rewind_info.hpp"
+#include "network/server_config.hpp"
 #include "network/smooth_network_body.hpp"
+#include "network/stk_host.hpp"
+#include "network/stk_peer.hpp"
 #include "physics/physics.hpp"
 #include "race/history.hpp"
 #include "tracks/check_manager.hpp"
@@ -61,6 +65,8 @@ void RewindManager::destroy()
  */
 RewindManager::RewindManager()
 {
+    m_compared_states = 0;
+    m_desynced_states = 0;
     reset();
 }   // RewindManager
 
@@ -85,6 +91,24 @@ void RewindManager::reset()
     m_overall_state_size = 0;
     m_state_frequency = stk_config->getPhysicsFPS() /
         NetworkConfig::get()->getStateFrequency();
+    m_saved_states.clear();
+    m_last_sent_ticks.clear();
+    m_predicted_states.clear();
+    m_save_predicted_states = false;
+    if (m_compared_states > 0)
+    {
+        Log::info("RewindManager", "%u of %u states compared with the "
+            "server hashes differed.", m_desynced_states, m_compared_states);
+    }
+    m_state_hashes.clear();
+    m_compare_state_hashes = false;
+    m_desynced = false;
+    m_compared_states = 0;
+    m_desynced_states = 0;
+    m_state_scheduler.reset(m_state_frequency,
+        std::max(NetworkConfig::get()->getStateFrequency() /
+        std::max((int)ServerConfig::m_min_state_frequency, 1), 1),
+        stk_config->getPhysicsFPS());
 
     if (!m_enable_rewind_manager) return;
 
@@ -144,37 +168,360 @@ void RewindManager::addNetworkState(BareNetworkString *buffer, int ticks)
 }   // addNetworkState
 
 // ----------------------------------------------------------------------------
-/** Saves a state using the GameProtocol function to combine several
- *  independent rewinders to write one state.
+/** Saves the state of all rewinders on the server, which is then sent to
+ *  the clients by sendState.
  */
 void RewindManager::saveState()
 {
     PROFILER_PUSH_CPU_MARKER("RewindManager - save state", 0x20, 0x7F, 0x20);
+    m_overall_state_size = 0;
+    m_saved_states.clear();
+    std::vector<std::string> rewinder_using;
+
+    for (auto& p : m_all_rewinder)
+    {
+        std::shared_ptr<Rewinder> r = p.second.lock();
+        if (!r)
+            continue;
+        BareNetworkString* buffer = r->saveState(&rewinder_using);
+        if (buffer == NULL)
+            continue;
+        m_overall_state_size += buffer->size();
+        SavedState state;
+        state.m_name = p.first;
+        state.m_buffer.reset(buffer);
+        state.m_has_position = r->getRelevancePosition(&state.m_position);
+        // Only rewinders with a position are compared by clients, see
+        // savePredictedState
+        state.m_hash = ServerConfig::m_state_hash && state.m_has_position ?
+            buffer->getHash() : 0;
+        m_saved_states.push_back(std::move(state));
+    }
+    PROFILER_POP_CPU_MARKER();
+}   // saveState
+
+// ----------------------------------------------------------------------------
+/** Sends the saved state to all peers. If the state-relevance-distance
+ *  server option is set, peers supporting it get a state of their own: the
+ *  state of rewinders (karts and flyables) far away from all karts of the
+ *  peer is only sent every distant-state-interval states, otherwise only
+ *  its name with an empty state is sent, for which the client uses its own
+ *  predicted state (see restorePredictedState).
+ *  Spectators and peers without support get the full state. If the
+ *  adaptive-state-frequency server option is set, the StateScheduler
+ *  decides which peers get a state at all.
+ *  If the state-hash server option is set, the hashes of the states are
+ *  appended, see checkStateHashes.
+ */
+void RewindManager::sendState()
+{
     auto gp = GameProtocol::lock();
     if (!gp)
         return;
-    gp->startNewState();
 
-    m_overall_state_size = 0;
+    const bool state_hash = ServerConfig::m_state_hash;
     std::vector<std::string> rewinder_using;
+    std::vector<uint32_t> hashes;
+    auto add_full_state = [this, &gp, &rewinder_using, &hashes, state_hash]()
+        {
+            rewinder_using.clear();
+            hashes.clear();
+            gp->startNewState();
+            for (SavedState& state : m_saved_states)
+            {
+                rewinder_using.push_back(state.m_name);
+                hashes.push_back(state.m_hash);
+                gp->addState(state.m_buffer.get());
+            }
+            if (state_hash)
+                gp->addStateHashes(hashes);
+            gp->finalizeState(rewinder_using);
+        };
+
+    const bool adaptive = ServerConfig::m_adaptive_state_frequency;
+    const float distance = ServerConfig::m_state_relevance_distance;
+    if (!adaptive && distance <= 0.0f)
+    {
+        add_full_state();
+        gp->sendState();
+        m_last_sent_ticks.clear();
+        return;
+    }
+
+    World* world = World::getWorld();
+    const int ticks = world->getTicksSinceStart();
+    if (adaptive)
+        m_state_scheduler.update();
 
+    std::vector<std::shared_ptr<STKPeer> > full_peers, partial_peers;
+    std::vector<uint32_t> host_ids;
+    for (auto& peer : STKHost::get()->getPeers())
+    {
+        if (!peer->isValidated() || peer->isWaitingForGame())
+            continue;
+        host_ids.push_back(peer->getHostId());
+        if (adaptive && !m_state_scheduler.isDue(peer.get(), ticks))
+            continue;
+        if (distance > 0.0f && peer->supportsPartialState() &&
+            !peer->getAvailableKartIDs().empty())
+            partial_peers.push_back(peer);
+        else
+            full_peers.push_back(peer);
+    }
+    if (adaptive)
+        m_state_scheduler.removeMissingPeers(host_ids);
+
+    if (!full_peers.empty())
+    {
+        add_full_state();
+        const unsigned size = m_overall_state_size;
+        gp->sendState([&full_peers](STKPeer* peer)
+            {
+                for (auto& p : full_peers)
+                {
+                    if (p.get() == peer)
+                        return true;
+                }
+                return false;
+            });
+        for (auto& peer : full_peers)
+        {
+            if (adaptive)
+                m_state_scheduler.onStateSent(peer.get(), ticks, size);
+        }
+    }
+
+    // Only keep the last sent ticks of peers which still exist
+    for (auto it = m_last_sent_ticks.begin(); it != m_last_sent_ticks.end();)
+    {
+        if (distance <= 0.0f || std::find(host_ids.begin(), host_ids.end(),
+            it->first) == host_ids.end())
+            it = m_last_sent_ticks.erase(it);
+        else
+            it++;
+    }
+
+    const int interval = m_state_frequency *
+        std::max((int)ServerConfig::m_distant_state_interval, 1);
+    const float distance2 = distance * distance;
+    BareNetworkString empty_state;
+    std::vector<Vec3> kart_positions;
+    for (auto& peer : partial_peers)
+    {
+        kart_positions.clear();
+        for (unsigned id : peer->getAvailableKartIDs())
+        {
+            if (id < world->getNumKarts())
+                kart_positions.push_back(world->getKart(id)->getXYZ());
+        }
+        const std::map<std::string, int>& old_sent =
+            m_last_sent_ticks[peer->getHostId()];
+        // Rebuilt from the current rewinders only
+        std::map<std::string, int> sent;
+        unsigned size = 0;
+
+        rewinder_using.clear();
+        hashes.clear();
+        gp->startNewState();
+        for (SavedState& state : m_saved_states)
+        {
+            bool relevant = !state.m_has_position;
+            for (unsigned i = 0; i < kart_positions.size() && !relevant; i++)
+            {
+                relevant =
+                    (kart_positions[i] - state.m_position).length2() <
+                    distance2;
+            }
+            auto it = old_sent.find(state.m_name);
+            if (!relevant && it != old_sent.end() &&
+                ticks - it->second < interval)
+            {
+                sent[state.m_name] = it->second;
+                rewinder_using.push_back(state.m_name);
+                hashes.push_back(0);
+                gp->addState(&empty_state);
+                continue;
+            }
+            sent[state.m_name] = ticks;
+            size += state.m_buffer->size();
+            rewinder_using.push_back(state.m_name);
+            hashes.push_back(state.m_hash);
+            gp->addState(state.m_buffer.get());
+        }
+        if (state_hash)
+            gp->addStateHashes(hashes);
+        gp->finalizeState(rewinder_using);
+        gp->sendState(peer.get());
+        m_last_sent_ticks[peer->getHostId()] = std::move(sent);
+        if (adaptive)
+            m_state_scheduler.onStateSent(peer.get(), ticks, size);
+    }
+}   // sendState
+
+// ----------------------------------------------------------------------------
+/** Saves on a client the state of all rewinders which the server might leave
+ *  out of its state at the given ticks, and / or the hashes of these states
+ *  if the server sends state hashes. Other rewinders are not hashed, since
+ *  their saveState differs between client and server.
+ */
+void RewindManager::savePredictedState(int ticks)
+{
+    // Keep at most a few seconds in case no state is received
+    const int max_age = stk_config->time2Ticks(5.0f);
+    while (!m_predicted_states.empty() &&
+        m_predicted_states.begin()->first < ticks - max_age)
+        m_predicted_states.erase(m_predicted_states.begin());
+    while (!m_state_hashes.empty() &&
+        m_state_hashes.begin()->first < ticks - max_age)
+        m_state_hashes.erase(m_state_hashes.begin());
+
+    std::map<std::string, std::unique_ptr<BareNetworkString> >* states =
+        NULL;
+    if (m_save_predicted_states)
+    {
+        states = &m_predicted_states[ticks];
+        states->clear();
+    }
+    std::map<std::string, uint32_t>* hashes = NULL;
+    if (m_compare_state_hashes)
+    {
+        hashes = &m_state_hashes[ticks];
+        hashes->clear();
+    }
+    std::vector<std::string> rewinder_using;
+    Vec3 xyz;
     for (auto& p : m_all_rewinder)
     {
-        // TODO: check if it's worth passing in a sufficiently large buffer from
-        // GameProtocol - this would save the copy operation.
-        BareNetworkString* buffer = NULL;
-        if (auto r = p.second.lock())
-            buffer = r->saveState(&rewinder_using);
-        if (buffer != NULL)
+        std::shared_ptr<Rewinder> r = p.second.lock();
+        if (!r || !r->getRelevancePosition(&xyz))
+            continue;
+        BareNetworkString* buffer = r->saveState(&rewinder_using);
+        if (!buffer)
+            continue;
+        if (hashes)
+            (*hashes)[p.first] = buffer->getHash();
+        if (states)
+            (*states)[p.first].reset(buffer);
+        else
+            delete buffer;
+    }
+}   // savePredictedState
+
+// ----------------------------------------------------------------------------
+/** Called on a client for a rewinder which the server left out of the state
+ *  at the given ticks, as it is far away from the karts of this client. The
+ *  state predicted by this client is restored instead, or if there is none
+ *  (e.g. right after the server started to leave out states) the current
+ *  state is kept, so the rewinder is still known to be in game.
+ */
+void RewindManager::restorePredictedState(Rewinder* r, int ticks)
+{
+    m_save_predicted_states = true;
+    BareNetworkString* state = NULL;
+    std::unique_ptr<BareNetworkString> current_state;
+    auto it = m_predicted_states.find(ticks);
+    if (it != m_predicted_states.end())
+    {
+        auto s = it->second.find(r->getUniqueIdentity());
+        if (s != it->second.end())
+            state = s->second.get();
+    }
+    if (!state)
+    {
+        std::vector<std::string> rewinder_using;
+        current_state.reset(r->saveState(&rewinder_using));
+        state = current_state.get();
+        if (!state)
+            return;
+    }
+    state->reset();
+    r->restoreState(state, state->size());
+}   // restorePredictedState
+
+// ----------------------------------------------------------------------------
+/** Called on a client with the hashes of a state sent by the server, before
+ *  the state is restored. They are compared with the hashes of the states
+ *  this client had at the same ticks, and the first rewinder which differs
+ *  is logged when the client goes out of sync (and once it is in sync
+ *  again), so that desyncs can be found in the log.
+ *  \param ticks The ticks of the state.
+ *  \param rewinder_using Names of the rewinders in the state.
+ *  \param hashes The hash of the state of each rewinder, 0 if it has not
+ *         been hashed by the server.
+ */
+void RewindManager::checkStateHashes(int ticks,
+                                     const std::vector<std::string>&
+                                     rewinder_using,
+                                     const std::vector<uint32_t>& hashes)
+{
+    // Start saving hashes, which can only be compared for later states
+    m_compare_state_hashes = true;
+    auto it = m_state_hashes.find(ticks);
+    if (it == m_state_hashes.end())
+        return;
+
+    const std::string* first_desync = NULL;
+    uint32_t server_hash = 0, client_hash = 0;
+    bool compared = false;
+    for (unsigned i = 0; i < rewinder_using.size() && i < hashes.size(); i++)
+    {
+        if (hashes[i] == 0)
+            continue;
+        auto h = it->second.find(rewinder_using[i]);
+        if (h == it->second.end())
+            continue;
+        compared = true;
+        if (h->second != hashes[i])
         {
-            m_overall_state_size += buffer->size();
-            gp->addState(buffer);
+            first_desync = &rewinder_using[i];
+            server_hash = hashes[i];
+            client_hash = h->second;
+            break;
         }
-        delete buffer;    // buffer can be freed
     }
-    gp->finalizeState(rewinder_using);
-    PROFILER_POP_CPU_MARKER();
-}   // saveState
+    m_state_hashes.erase(m_state_hashes.begin(), ++it);
+    if (!compared)
+        return;
+
+    m_compared_states++;
+    if (first_desync)
+    {
+        m_desynced_states++;
+        if (!m_desynced)
+        {
+            // Names of rewinders are binary, so log them as hex
+            std::string name;
+            for (unsigned i = 0; i < first_desync->size(); i++)
+            {
+                char hex[3];
+                snprintf(hex, sizeof(hex), "%02x",
+                    (unsigned)(uint8_t)(*first_desync)[i]);
+                name += hex;
+            }
+            Log::warn("RewindManager", "Desync at ticks %d: state of "
+                "rewinder %s has hash %08x, server has %08x.", ticks,
+                name.c_str(), client_hash, server_hash);
+        }
+    }
+    else if (m_desynced)
+    {
+        Log::info("RewindManager", "State at ticks %d matches the server "
+            "again.", ticks);
+    }
+    m_desynced = first_desync != NULL;
+}   // checkStateHashes
+
+// ----------------------------------------------------------------------------
+/** Called on a client when events of other players are received for ticks
+ *  which this client has already simulated. The hashes saved since then
+ *  did not include these events, so they are not compared.
+ *  \param ticks The ticks of the earliest of these events.
+ */
+void RewindManager::discardStateHashes(int ticks)
+{
+    m_state_hashes.erase(m_state_hashes.lower_bound(ticks),
+        m_state_hashes.end());
+}   // discardStateHashes
 
 // ----------------------------------------------------------------------------
 /** Determines if a new state snapshot should be taken, and if so calls all
@@ -185,10 +532,17 @@ void RewindManager::update(int ticks_not_used)
 {
     // FIXME: rename ticks_not_used
     if (!m_enable_rewind_manager ||
-        m_all_rewinder.size() == 0 ||
-        m_is_rewinding)  return;
+        m_all_rewinder.size() == 0)  return;
 
     int ticks = World::getWorld()->getTicksSinceStart();
+    if (m_is_rewinding)
+    {
+        // Replace the predicted states (and hashes) with the corrected ones
+        if ((m_save_predicted_states || m_compare_state_hashes) &&
+            shouldSaveState(ticks))
+            savePredictedState(ticks);
+        return;
+    }
 
     m_not_rewound_ticks.store(ticks, std::memory_order_relaxed);
 
@@ -205,13 +559,14 @@ void RewindManager::update(int ticks_not_used)
             if (auto r = p.second.lock())
                 ret.push_back(r->getLocalStateRestoreFunction());
         }
+        if (m_save_predicted_states || m_compare_state_hashes)
+            savePredictedState(ticks);
     }
     else
     {
         saveState();
         PROFILER_PUSH_CPU_MARKER("RewindManager - send state", 0x20, 0x7F, 0x40);
-        if (auto gp = GameProtocol::lock())
-            gp->sendState();
+        sendState();
     }
     PROFILER_POP_CPU_MARKER();
 }   // update
@@ -235,7 +590,11 @@ void RewindManager::playEventsTill(int world_ticks, bool fast_forward)
     // time step.
     // merge and that have happened before the current time (which will
     // be getTime()+dt - world time has not been updated yet).
-    m_rewind_queue.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
+    int late_event_ticks = -1;
+    m_rewind_queue.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks,
+        &late_event_ticks);
+    if (late_event_ticks >= 0)
+        discardStateHashes(late_event_ticks);
 
     if (needs_rewind)
     {
@@ -356,6 +715,9 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
         m_rewind_queue.next();
         current = m_rewind_queue.getCurrent();
     }
+    // Older predicted states are not needed anymore
+    m_predicted_states.erase(m_predicted_states.begin(),
+        m_predicted_states.lower_bound(exact_rewind_ticks));
 
     // Update check line, so the cannon animation can be replayed correctly
     CheckManager::get()->resetAfterRewind();
@@ -20,8 +20,11 @@
 #define HEADER_REWIND_MANAGER_HPP
 
 #include "network/rewind_queue.hpp"
+#include "network/state_scheduler.hpp"
 #include "utils/ptr_vector.hpp"
 #include "utils/synchronised.hpp"
+#include "utils/types.hpp"
+#include "utils/vec3.hpp"
 
 #include <assert.h>
 #include <atomic>
@@ -32,6 +35,7 @@
 #include <string>
 #include <vector>
 
+class BareNetworkString;
 class Rewinder;
 class RewindInfo;
 class RewindInfoEventFunction;
@@ -116,6 +120,51 @@ private:
 
     std::vector<RewindInfoEventFunction*> m_pending_rief;
 
+    /** The state of one rewinder saved by the server for the current state
+     *  message(s). */
+    struct SavedState
+    {
+        std::string m_name;
+        std::unique_ptr<BareNetworkString> m_buffer;
+        /** False if the state is relevant for all peers. */
+        bool m_has_position;
+        Vec3 m_position;
+        /** Hash of the state if state-hash is enabled, 0 otherwise. */
+        uint32_t m_hash;
+    };
+    std::vector<SavedState> m_saved_states;
+
+    /** On a server, for each peer (by host id) receiving partial states the
+     *  ticks at which the state of each rewinder was last sent to it. */
+    std::map<uint32_t, std::map<std::string, int> > m_last_sent_ticks;
+
+    /** On a client, the states of rewinders with a relevance position saved
+     *  at the state ticks, which are restored when the server leaves them
+     *  out of its state. */
+    std::map<int, std::map<std::string, std::unique_ptr<BareNetworkString> > >
+        m_predicted_states;
+
+    /** Set on a client once the server left a rewinder out of a state. */
+    bool m_save_predicted_states;
+
+    /** On a client, the hashes of the states of rewinders with a relevance
+     *  position at the state ticks, compared with the hashes sent by the
+     *  server to detect desyncs. */
+    std::map<int, std::map<std::string, uint32_t> > m_state_hashes;
+
+    /** Set on a client once a state with hashes was received. */
+    bool m_compare_state_hashes;
+
+    /** True while the last compared state differed from the server. */
+    bool m_desynced;
+
+    /** Number of states compared and found different, logged on reset. */
+    unsigned m_compared_states, m_desynced_states;
+
+    /** Decides which peers get a state if adaptive-state-frequency is
+     *  enabled on the server. */
+    StateScheduler m_state_scheduler;
+
     RewindManager();
    ~RewindManager();
     // ------------------------------------------------------------------------
@@ -133,6 +182,12 @@ private:
     }
     // ------------------------------------------------------------------------
     void mergeRewindInfoEventFunction();
+    // ------------------------------------------------------------------------
+    void sendState();
+    // ------------------------------------------------------------------------
+    void savePredictedState(int ticks);
+    // ------------------------------------------------------------------------
+    void discardStateHashes(int ticks);
 
 public:
     // First static functions to manage rewinding.
@@ -166,6 +221,10 @@ public:
                          BareNetworkString *buffer, int ticks);
     void addNetworkState(BareNetworkString *buffer, int ticks);
     void saveState();
+    void restorePredictedState(Rewinder* r, int ticks);
+    void checkStateHashes(int ticks,
+                          const std::vector<std::string>& rewinder_using,
+                          const std::vector<uint32_t>& hashes);
     // ------------------------------------------------------------------------
     std::shared_ptr<Rewinder> getRewinder(const std::string& name)
     {
@@ -197,9 +197,11 @@ void RewindQueue::addNetworkState(BareNetworkString *buffer, int ticks)
  *         performed.
  *  \param rewind_time[out] If needs_rewind is true, the time to which a rewind
  *         must be performed (at least). Otherwise undefined.
+ *  \param late_event_ticks[out] If set, on a client the time of the earliest
+ *         event merged which is before world_ticks, unchanged if none.
  */
 void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
-                                   int *rewind_ticks)
+                                   int *rewind_ticks, int *late_event_ticks)
 {
     *needs_rewind = false;
     m_network_events.lock();
@@ -283,6 +285,13 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
                 *rewind_ticks = (*i)->getTicks();
         }   // if client and ticks < world_ticks
 
+        if (late_event_ticks && NetworkConfig::get()->isClient() &&
+            (*i)->isEvent() && (*i)->getTicks() < world_ticks &&
+            (*late_event_ticks < 0 || (*i)->getTicks() < *late_event_ticks))
+        {
+            *late_event_ticks = (*i)->getTicks();
+        }
+
         if ((*i)->isState() && (*i)->getTicks() > latest_confirmed_state &&
             (*i)->isConfirmed())
         {
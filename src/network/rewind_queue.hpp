@@ -77,7 +77,7 @@ public:
         m_network_events.unlock();
     }
     void mergeNetworkData(int world_ticks,  bool *needs_rewind, 
-                          int *rewind_ticks);
+                          int *rewind_ticks, int *late_event_ticks = NULL);
     void replayAllEvents(int ticks);
     bool isEmpty() const;
     bool hasMoreRewindInfo() const;
@@ -26,6 +26,7 @@
 #include <vector>
 
 class BareNetworkString;
+class Vec3;
 
 enum RewinderName : char
 {
@@ -106,6 +107,12 @@ public:
     virtual std::function<void()> getLocalStateRestoreFunction()
                                                              { return nullptr; }
     // -------------------------------------------------------------------------
+    /** Returns false if the state of this object is relevant for all peers.
+     *  Otherwise sets the position of this object, so that the server can
+     *  send its state less often to peers whose karts are far away from it
+     *  (see RewindManager::sendState). */
+    virtual bool getRelevancePosition(Vec3* xyz) const        { return false; }
+    // -------------------------------------------------------------------------
     const std::string& getUniqueIdentity() const
     {
         assert(!m_unique_identity.empty() && m_unique_identity.size() < 255);
@@ -40,6 +40,7 @@ static std::vector<UserConfigParam*> g_server_params;
 #include "race/race_manager.hpp"
 #include "utils/string_utils.hpp"
 
+#include <algorithm>
 #include <fstream>
 
 namespace ServerConfig
@@ -310,6 +311,9 @@ void loadServerLobbyFromConfig()
         m_state_frequency.revertToDefaults();
     }
     NetworkConfig::get()->setStateFrequency(m_state_frequency);
+    if (m_min_state_frequency <= 0 ||
+        m_min_state_frequency > m_state_frequency)
+        m_min_state_frequency = std::min((int)m_state_frequency, 3);
 
     if (m_player_reports_expired_days < 0.0f)
         m_player_reports_expired_days.revertToDefaults();
@@ -319,6 +319,69 @@ namespace ServerConfig
         "more rewind, which clients with slow device may have problem playing "
         "this server, use the default value is recommended."));
 
+    SERVER_CFG_PREFIX BoolServerConfigParam m_adaptive_state_frequency
+        SERVER_CFG_DEFAULT(BoolServerConfigParam(false,
+        "adaptive-state-frequency",
+        "If true, state-frequency is the highest number of states per second, "
+        "which is only used for clients whose karts are close to other karts "
+        "or colliding. Clients whose karts are far away from others or have "
+        "finished get less states, and the states are limited by "
+        "state-bandwidth-budget and the congestion detected by enet."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_min_state_frequency
+        SERVER_CFG_DEFAULT(IntServerConfigParam(3,
+        "min-state-frequency",
+        "The lowest number of states per second sent to each client if "
+        "adaptive-state-frequency is enabled."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_state_bandwidth_budget
+        SERVER_CFG_DEFAULT(IntServerConfigParam(0,
+        "state-bandwidth-budget",
+        "Bytes per second of states to each client if "
+        "adaptive-state-frequency is enabled, 0 to only use the bandwidth "
+        "reported by the client. The number of states per second never goes "
+        "below min-state-frequency."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_compression_threshold
+        SERVER_CFG_DEFAULT(IntServerConfigParam(1024,
+        "compression-threshold",
+        "Lobby messages (like the game state for live join, player list and "
+        "server info) larger than this number of bytes are sent compressed "
+        "to clients supporting it, 0 to disable compression."));
+
+    SERVER_CFG_PREFIX FloatServerConfigParam m_state_relevance_distance
+        SERVER_CFG_DEFAULT(FloatServerConfigParam(0.0f,
+        "state-relevance-distance",
+        "Karts and items thrown further away than this distance from all "
+        "karts of a client have their state sent to that client less often, "
+        "which reduces the upload bandwidth of servers with many players. "
+        "Clients predict these objects in between. 0 to always send the "
+        "full state."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_distant_state_interval
+        SERVER_CFG_DEFAULT(IntServerConfigParam(4,
+        "distant-state-interval",
+        "If state-relevance-distance is set, the state of distant objects is "
+        "sent only every this number of states."));
+
+    SERVER_CFG_PREFIX BoolServerConfigParam m_state_hash
+        SERVER_CFG_DEFAULT(BoolServerConfigParam(false,
+        "state-hash",
+        "Send a hash of the state of each kart and item thrown with the "
+        "states (4 bytes each), so that clients can detect and log when "
+        "their physics differs from the server (a desync)."));
+
+    SERVER_CFG_PREFIX StringServerConfigParam m_plugin_script
+        SERVER_CFG_DEFAULT(StringServerConfigParam("",
+        "plugin-script",
+        "AngelScript file with server plugin hooks, which run on a thread of "
+        "their own, see NETWORKING.md for details, empty to disable."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_plugin_time_budget
+        SERVER_CFG_DEFAULT(IntServerConfigParam(50,
+        "plugin-time-budget",
+        "Time in milliseconds a plugin hook can run before it is aborted."));
+
     SERVER_CFG_PREFIX BoolServerConfigParam m_sql_management
         SERVER_CFG_DEFAULT(BoolServerConfigParam(false,
         "sql-management",
@@ -370,6 +433,17 @@ namespace ServerConfig
         "empty to disable. "
         "This table can be shared for all servers if you use the same name."));
 
+    SERVER_CFG_PREFIX StringServerConfigParam m_metrics_file
+        SERVER_CFG_DEFAULT(StringServerConfigParam("", "metrics-file",
+        "If not empty, the server writes statistics about its health (tick "
+        "times, state sizes, ping of players ...) to this file in the "
+        "Prometheus text format, so that it can be scraped by a monitoring "
+        "system."));
+
+    SERVER_CFG_PREFIX FloatServerConfigParam m_metrics_interval
+        SERVER_CFG_DEFAULT(FloatServerConfigParam(10.0f, "metrics-interval",
+        "Time in seconds between writes of the metrics-file."));
+
     // ========================================================================
     /** Server version, will be advanced if there are protocol changes. */
     static const uint32_t m_server_version = 6;
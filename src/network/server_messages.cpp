@@ -0,0 +1,360 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/server_messages.hpp"
+
+#include "network/network_string.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace ServerMessages
+{
+    namespace
+    {
+        const uint8_t g_ping_header[5] = { 255, 'p', 'i', 'n', 'g' };
+    }   // anonymous namespace
+
+    // ------------------------------------------------------------------------
+    ConnectionAccepted::ConnectionAccepted()
+    {
+        m_host_id = 0;
+        m_server_version = 0;
+        m_auto_start_timer = std::numeric_limits<float>::max();
+        m_state_frequency = 10;
+        m_chat = false;
+        m_report_player = false;
+    }   // ConnectionAccepted
+
+    // ------------------------------------------------------------------------
+    ConnectionAccepted::ConnectionAccepted(const BareNetworkString& ns)
+    {
+        m_host_id = ns.getUInt32();
+        m_server_version = ns.getUInt32();
+        const unsigned list_caps = ns.getUInt16();
+        for (unsigned i = 0; i < list_caps; i++)
+        {
+            std::string cap;
+            ns.decodeString(&cap);
+            m_capabilities.insert(cap);
+        }
+        m_auto_start_timer = ns.getFloat();
+        m_state_frequency = ns.getUInt32();
+        m_chat = ns.getUInt8() == 1;
+        m_report_player = false;
+        if (m_capabilities.find("report_player") != m_capabilities.end())
+            m_report_player = ns.getUInt8() == 1;
+    }   // ConnectionAccepted(BareNetworkString&)
+
+    // ------------------------------------------------------------------------
+    void ConnectionAccepted::encode(BareNetworkString* ns) const
+    {
+        ns->addUInt32(m_host_id).addUInt32(m_server_version)
+            .addUInt16((uint16_t)m_capabilities.size());
+        for (const std::string& cap : m_capabilities)
+            ns->encodeString(cap);
+        ns->addFloat(m_auto_start_timer).addUInt32(m_state_frequency)
+            .addUInt8(m_chat ? 1 : 0).addUInt8(m_report_player ? 1 : 0);
+    }   // encode
+
+    // ========================================================================
+    PlayerListHeader::PlayerListHeader(const BareNetworkString& ns)
+    {
+        m_game_started = ns.getUInt8() == 1;
+        m_player_count = ns.getUInt8();
+    }   // PlayerListHeader(BareNetworkString&)
+
+    // ------------------------------------------------------------------------
+    void PlayerListHeader::encode(BareNetworkString* ns) const
+    {
+        ns->addUInt8(m_game_started ? 1 : 0).addUInt8(m_player_count);
+    }   // encode
+
+    // ========================================================================
+    PlayerEntry::PlayerEntry()
+    {
+        m_host_id = 0;
+        m_kart_color = 0.0f;
+        m_online_id = 0;
+        m_per_player_difficulty = 0;
+        m_local_player_id = 0;
+        m_team = 0;
+    }   // PlayerEntry
+
+    // ------------------------------------------------------------------------
+    PlayerEntry::PlayerEntry(const BareNetworkString& ns)
+    {
+        ns.decodeStringW(&m_name);
+        m_host_id = ns.getUInt32();
+        m_kart_color = ns.getFloat();
+        m_online_id = ns.getUInt32();
+        m_per_player_difficulty = ns.getUInt8();
+        m_local_player_id = ns.getUInt8();
+        m_team = ns.getUInt8();
+        ns.decodeString(&m_country_code);
+        ns.decodeString(&m_kart_name);
+    }   // PlayerEntry(BareNetworkString&)
+
+    // ------------------------------------------------------------------------
+    void PlayerEntry::encode(BareNetworkString* ns) const
+    {
+        ns->encodeString(m_name).addUInt32(m_host_id).addFloat(m_kart_color)
+            .addUInt32(m_online_id).addUInt8(m_per_player_difficulty)
+            .addUInt8(m_local_player_id).addUInt8(m_team)
+            .encodeString(m_country_code).encodeString(m_kart_name);
+    }   // encode
+
+    // ------------------------------------------------------------------------
+    /** Appends the number of players and their entries to \p ns. */
+    void encodePlayerEntries(BareNetworkString* ns,
+                             const std::vector<PlayerEntry>& players)
+    {
+        assert(players.size() <= 255);
+        ns->addUInt8((uint8_t)players.size());
+        for (const PlayerEntry& player : players)
+            player.encode(ns);
+    }   // encodePlayerEntries
+
+    // ------------------------------------------------------------------------
+    std::vector<PlayerEntry> decodePlayerEntries(const BareNetworkString& ns)
+    {
+        std::vector<PlayerEntry> players;
+        const unsigned player_count = ns.getUInt8();
+        for (unsigned i = 0; i < player_count; i++)
+            players.emplace_back(ns);
+        return players;
+    }   // decodePlayerEntries
+
+    // ========================================================================
+    PingPacket::PingPacket()
+    {
+        m_server_time = 0;
+        m_remaining_time = std::numeric_limits<uint32_t>::max();
+        m_progress = std::numeric_limits<uint32_t>::max();
+    }   // PingPacket
+
+    // ------------------------------------------------------------------------
+    /** Decodes a ping packet, the data must start with the header (see
+     *  isPingPacket). */
+    PingPacket::PingPacket(const uint8_t* data, size_t length)
+    {
+        m_server_time = 0;
+        m_remaining_time = std::numeric_limits<uint32_t>::max();
+        m_progress = std::numeric_limits<uint32_t>::max();
+        decode(data, length);
+    }   // PingPacket(const uint8_t*, size_t)
+
+    // ------------------------------------------------------------------------
+    /** Decodes a ping packet into this object, which should be default
+     *  constructed. If the data is too short, the fields decoded so far keep
+     *  their values, the others their defaults (the list of pings is either
+     *  complete or empty), before the exception is thrown.
+     */
+    void PingPacket::decode(const uint8_t* data, size_t length)
+    {
+        BareNetworkString ping((const char*)data, (int)length);
+        ping.skip((int)sizeof(g_ping_header));
+        m_server_time = ping.getUInt64();
+        std::map<uint32_t, uint32_t> pings;
+        const unsigned peer_size = ping.getUInt8();
+        for (unsigned i = 0; i < peer_size; i++)
+        {
+            const uint32_t host_id = ping.getUInt32();
+            pings[host_id] = ping.getUInt32();
+        }
+        std::swap(m_pings, pings);
+        if (ping.size() == 0)
+            return;
+        m_remaining_time = ping.getUInt32();
+        m_progress = ping.getUInt32();
+        std::string track;
+        ping.decodeString(&track);
+        std::swap(m_current_track, track);
+    }   // decode
+
+    // ------------------------------------------------------------------------
+    bool PingPacket::isPingPacket(const uint8_t* data, size_t length)
+    {
+        return length > sizeof(g_ping_header) &&
+            memcmp(data, g_ping_header, sizeof(g_ping_header)) == 0;
+    }   // isPingPacket
+
+    // ------------------------------------------------------------------------
+    /** Appends the whole packet including the header to \p ns. Only the
+     *  first 255 pings are sent. */
+    void PingPacket::encode(BareNetworkString* ns) const
+    {
+        for (uint8_t c : g_ping_header)
+            ns->addUInt8(c);
+        const size_t count = std::min<size_t>(m_pings.size(), 255);
+        ns->addUInt64(m_server_time).addUInt8((uint8_t)count);
+        auto it = m_pings.begin();
+        for (size_t i = 0; i < count; i++, it++)
+            ns->addUInt32(it->first).addUInt32(it->second);
+        ns->addUInt32(m_remaining_time).addUInt32(m_progress)
+            .encodeString(m_current_track);
+    }   // encode
+
+    // ------------------------------------------------------------------------
+    /** Checks the encoded bytes of all messages against fixed values, so that
+     *  a change of the format (which breaks older clients and relays) can't
+     *  go unnoticed, and that they decode to the same values.
+     */
+    void unitTesting()
+    {
+        auto same_bytes = [](const BareNetworkString& ns,
+                             const std::vector<uint8_t>& bytes)
+            {
+                return ns.getTotalSize() == bytes.size() &&
+                    memcmp(ns.getData(), bytes.data(), bytes.size()) == 0;
+            };
+
+        ConnectionAccepted accepted;
+        accepted.m_host_id = 1;
+        accepted.m_server_version = 2;
+        accepted.m_capabilities.insert("report_player");
+        accepted.m_state_frequency = 3;
+        accepted.m_chat = true;
+        accepted.m_report_player = true;
+        BareNetworkString ns;
+        accepted.encode(&ns);
+        std::vector<uint8_t> bytes = { 0, 0, 0, 1, 0, 0, 0, 2, 0, 1, 13 };
+        for (char c : std::string("report_player"))
+            bytes.push_back((uint8_t)c);
+        for (uint8_t b : { 0x7f, 0x7f, 0xff, 0xff, 0, 0, 0, 3, 1, 1 })
+            bytes.push_back(b);
+        assert(same_bytes(ns, bytes));
+        ConnectionAccepted accepted_decoded(ns);
+        assert(accepted_decoded.m_host_id == 1);
+        assert(accepted_decoded.m_server_version == 2);
+        assert(accepted_decoded.m_capabilities == accepted.m_capabilities);
+        assert(accepted_decoded.m_auto_start_timer ==
+            std::numeric_limits<float>::max());
+        assert(accepted_decoded.m_state_frequency == 3);
+        assert(accepted_decoded.m_chat && accepted_decoded.m_report_player);
+        assert(ns.size() == 0);
+
+        BareNetworkString list;
+        PlayerListHeader(true, 4).encode(&list);
+        assert(same_bytes(list, { 1, 4 }));
+        PlayerListHeader list_decoded(list);
+        assert(list_decoded.m_game_started);
+        assert(list_decoded.m_player_count == 4);
+
+        PlayerEntry player;
+        player.m_name = L"a";
+        player.m_host_id = 2;
+        player.m_kart_color = 0.5f;
+        player.m_online_id = 3;
+        player.m_per_player_difficulty = 1;
+        player.m_local_player_id = 0;
+        player.m_team = 1;
+        player.m_country_code = "de";
+        player.m_kart_name = "k";
+        BareNetworkString players;
+        encodePlayerEntries(&players, { player });
+        assert(same_bytes(players,
+            { 1, 1, 'a', 0, 0, 0, 2, 0x3f, 0, 0, 0, 0, 0, 0, 3, 1, 0, 1,
+              2, 'd', 'e', 1, 'k' }));
+        std::vector<PlayerEntry> players_decoded =
+            decodePlayerEntries(players);
+        assert(players_decoded.size() == 1);
+        assert(players_decoded[0].m_name == L"a");
+        assert(players_decoded[0].m_host_id == 2);
+        assert(players_decoded[0].m_kart_color == 0.5f);
+        assert(players_decoded[0].m_online_id == 3);
+        assert(players_decoded[0].m_per_player_difficulty == 1);
+        assert(players_decoded[0].m_team == 1);
+        assert(players_decoded[0].m_country_code == "de");
+        assert(players_decoded[0].m_kart_name == "k");
+        assert(players.size() == 0);
+
+        PingPacket ping;
+        ping.m_server_time = 0x0102030405060708ULL;
+        ping.m_pings[7] = 20;
+        ping.m_remaining_time = 5;
+        ping.m_progress = 6;
+        ping.m_current_track = "t";
+        BareNetworkString ping_ns;
+        ping.encode(&ping_ns);
+        const std::vector<uint8_t> ping_bytes =
+            { 255, 'p', 'i', 'n', 'g', 1, 2, 3, 4, 5, 6, 7, 8, 1,
+              0, 0, 0, 7, 0, 0, 0, 20, 0, 0, 0, 5, 0, 0, 0, 6, 1, 't' };
+        assert(same_bytes(ping_ns, ping_bytes));
+        assert(PingPacket::isPingPacket(ping_bytes.data(),
+            ping_bytes.size()));
+        assert(!PingPacket::isPingPacket(ping_bytes.data(), 5));
+        PingPacket ping_decoded(ping_bytes.data(), ping_bytes.size());
+        assert(ping_decoded.m_server_time == ping.m_server_time);
+        assert(ping_decoded.getPing(7) == 20 && ping_decoded.getPing(8) == 0);
+        assert(ping_decoded.m_remaining_time == 5);
+        assert(ping_decoded.m_progress == 6);
+        assert(ping_decoded.m_current_track == "t");
+
+        // Old servers send no game progress
+        PingPacket old_ping(ping_bytes.data(), 22);
+        assert(old_ping.getPing(7) == 20);
+        assert(old_ping.m_remaining_time ==
+            std::numeric_limits<uint32_t>::max());
+        assert(old_ping.m_current_track.empty());
+
+        bool thrown = false;
+        try
+        {
+            PingPacket truncated(ping_bytes.data(), 20);
+        }
+        catch (std::exception&)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+
+        // The fields before the missing data are still decoded
+        PingPacket partial;
+        thrown = false;
+        try
+        {
+            partial.decode(ping_bytes.data(), 24);
+        }
+        catch (std::exception&)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+        assert(partial.m_server_time == ping.m_server_time);
+        assert(partial.getPing(7) == 20);
+        assert(partial.m_remaining_time ==
+            std::numeric_limits<uint32_t>::max());
+        PingPacket no_pings;
+        try
+        {
+            no_pings.decode(ping_bytes.data(), 20);
+        }
+        catch (std::exception&)
+        {
+        }
+        assert(no_pings.m_server_time == ping.m_server_time);
+        assert(no_pings.m_pings.empty());
+        (void)thrown;
+        (void)same_bytes;
+    }   // unitTesting
+
+}   // namespace ServerMessages
@@ -0,0 +1,162 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SERVER_MESSAGES_HPP
+#define HEADER_SERVER_MESSAGES_HPP
+
+#include "utils/types.hpp"
+
+#include "irrString.h"
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class BareNetworkString;
+
+/** Messages of the server which are read by more than one class (the client
+ *  lobby, the spectator relay and the load tester), so that all of them
+ *  share one encoding. Decoding throws an exception if the data is too
+ *  short, like BareNetworkString.
+ *  \ingroup network
+ */
+namespace ServerMessages
+{
+    /** The content of LE_CONNECTION_ACCEPTED after its type. */
+    class ConnectionAccepted
+    {
+    public:
+        uint32_t m_host_id;
+        uint32_t m_server_version;
+        std::set<std::string> m_capabilities;
+        /** Seconds until the game starts automatically, the largest float
+         *  if it doesn't. */
+        float m_auto_start_timer;
+        uint32_t m_state_frequency;
+        bool m_chat;
+        /** Only sent to clients with the "report_player" capability. */
+        bool m_report_player;
+
+        // --------------------------------------------------------------------
+        ConnectionAccepted();
+        // --------------------------------------------------------------------
+        ConnectionAccepted(const BareNetworkString& ns);
+        // --------------------------------------------------------------------
+        void encode(BareNetworkString* ns) const;
+    };   // class ConnectionAccepted
+
+    // ========================================================================
+    /** The start of LE_UPDATE_PLAYER_LIST after its type, followed by
+     *  m_player_count players. */
+    class PlayerListHeader
+    {
+    public:
+        /** If a game is running, players in the list are waiting for it. */
+        bool m_game_started;
+        uint8_t m_player_count;
+
+        // --------------------------------------------------------------------
+        PlayerListHeader(bool game_started, uint8_t player_count)
+            : m_game_started(game_started), m_player_count(player_count)
+        {
+        }   // PlayerListHeader
+        // --------------------------------------------------------------------
+        PlayerListHeader(const BareNetworkString& ns);
+        // --------------------------------------------------------------------
+        void encode(BareNetworkString* ns) const;
+    };   // class PlayerListHeader
+
+    // ========================================================================
+    /** One player of the list in LE_LOAD_WORLD and in the live join state of
+     *  a game (see ServerLobby::encodePlayers). The list is sent as the
+     *  number of players followed by the entries, see encodePlayerEntries.
+     */
+    class PlayerEntry
+    {
+    public:
+        irr::core::stringw m_name;
+        uint32_t m_host_id;
+        float m_kart_color;
+        uint32_t m_online_id;
+        /** A PerPlayerDifficulty. */
+        uint8_t m_per_player_difficulty;
+        uint8_t m_local_player_id;
+        /** A KartTeam, KART_TEAM_NONE if teams are not used. */
+        uint8_t m_team;
+        std::string m_country_code;
+        std::string m_kart_name;
+
+        // --------------------------------------------------------------------
+        PlayerEntry();
+        // --------------------------------------------------------------------
+        PlayerEntry(const BareNetworkString& ns);
+        // --------------------------------------------------------------------
+        void encode(BareNetworkString* ns) const;
+    };   // class PlayerEntry
+
+    // ------------------------------------------------------------------------
+    void encodePlayerEntries(BareNetworkString* ns,
+                             const std::vector<PlayerEntry>& players);
+    // ------------------------------------------------------------------------
+    std::vector<PlayerEntry> decodePlayerEntries(const BareNetworkString& ns);
+
+    // ========================================================================
+    /** The ping packet, which the server sends 10 times per second to each
+     *  client in the lobby (see STKHost::mainLoop). It starts with 255, so
+     *  that ProtocolManager won't handle it, and "ping", followed by:
+     *  1. Network timer of the server (for synchronization)
+     *  2. Host id with ping of each connected peer
+     *  3. Remaining time and progress in percent of the running game
+     *  4. Track identity of the running game
+     *  Old servers send only 1 and 2.
+     */
+    class PingPacket
+    {
+    public:
+        uint64_t m_server_time;
+        std::map<uint32_t, uint32_t> m_pings;
+        uint32_t m_remaining_time;
+        uint32_t m_progress;
+        std::string m_current_track;
+
+        // --------------------------------------------------------------------
+        PingPacket();
+        // --------------------------------------------------------------------
+        PingPacket(const uint8_t* data, size_t length);
+        // --------------------------------------------------------------------
+        void decode(const uint8_t* data, size_t length);
+        // --------------------------------------------------------------------
+        static bool isPingPacket(const uint8_t* data, size_t length);
+        // --------------------------------------------------------------------
+        void encode(BareNetworkString* ns) const;
+        // --------------------------------------------------------------------
+        uint32_t getPing(uint32_t host_id) const
+        {
+            auto it = m_pings.find(host_id);
+            return it == m_pings.end() ? 0 : it->second;
+        }   // getPing
+    };   // class PingPacket
+
+    // ------------------------------------------------------------------------
+    void unitTesting();
+
+}   // namespace ServerMessages
+
+#endif // HEADER_SERVER_MESSAGES_HPP
@@ -0,0 +1,268 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/server_metrics.hpp"
+
+#include "network/network_config.hpp"
+#include "network/network_string.hpp"
+#include "network/protocol_manager.hpp"
+#include "network/server_config.hpp"
+#include "network/stk_host.hpp"
+#include "network/stk_peer.hpp"
+#include "utils/log.hpp"
+#include "utils/time.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+
+Histogram ServerMetrics::m_histograms[ServerMetrics::SM_COUNT];
+std::map<std::string, Histogram> ServerMetrics::m_scraped;
+uint64_t ServerMetrics::m_next_write_time = 0;
+
+// ----------------------------------------------------------------------------
+const char* ServerMetrics::getName(MetricType type)
+{
+    switch (type)
+    {
+    case SM_WORLD_UPDATE_TIME: return "stk_world_update_us";
+    case SM_PHYSICS_TIME:      return "stk_physics_update_us";
+    case SM_STATE_SIZE:        return "stk_state_packet_bytes";
+    case SM_PEER_RTT:          return "stk_peer_rtt_ms";
+    case SM_PEER_JITTER:       return "stk_peer_jitter_ms";
+    case SM_STATE_INTERVAL:    return "stk_state_interval_ms";
+    default:                   break;
+    }
+    return "stk_unknown";
+}   // getName
+
+// ----------------------------------------------------------------------------
+const char* ServerMetrics::getUnit(MetricType type)
+{
+    switch (type)
+    {
+    case SM_WORLD_UPDATE_TIME:
+    case SM_PHYSICS_TIME:      return "us";
+    case SM_STATE_SIZE:        return " bytes";
+    case SM_PEER_RTT:
+    case SM_PEER_JITTER:
+    case SM_STATE_INTERVAL:    return "ms";
+    default:                   break;
+    }
+    return "";
+}   // getUnit
+
+// ----------------------------------------------------------------------------
+/** Clears all metrics, used by the "metrics 0" console command. Can be
+ *  called from any thread: m_scraped is not touched, a histogram which has
+ *  fewer values than at the previous scrape is detected by Histogram. */
+void ServerMetrics::reset()
+{
+    for (unsigned i = 0; i < SM_COUNT; i++)
+        m_histograms[i].reset();
+}   // reset
+
+// ----------------------------------------------------------------------------
+/** Called once per frame from the main loop, writes the metrics file if one
+ *  is configured. The file is written to a temporary file first, so that a
+ *  scraper never reads a partially written file.
+ */
+void ServerMetrics::update()
+{
+    const std::string& file = ServerConfig::m_metrics_file;
+    if (file.empty() || !STKHost::existHost() ||
+        !NetworkConfig::get()->isServer())
+        return;
+    const uint64_t now = StkTime::getMonoTimeMs();
+    if (now < m_next_write_time)
+        return;
+    m_next_write_time = now + (uint64_t)(std::max(
+        (float)ServerConfig::m_metrics_interval, 1.0f) * 1000.0f);
+
+    const std::string text = getScrapeText();
+    const std::string tmp_file = file + ".tmp";
+    FILE* fp = fopen(tmp_file.c_str(), "wb");
+    if (!fp)
+    {
+        Log::warn("ServerMetrics", "Can't write metrics file '%s'.",
+            tmp_file.c_str());
+        return;
+    }
+    const bool written = fwrite(text.data(), 1, text.size(), fp) ==
+        text.size();
+    fclose(fp);
+    if (written)
+    {
+#ifdef WIN32
+        // Windows doesn't allow renaming to an existing file
+        remove(file.c_str());
+#endif
+        if (rename(tmp_file.c_str(), file.c_str()) == 0)
+            return;
+    }
+    remove(tmp_file.c_str());
+}   // update
+
+// ----------------------------------------------------------------------------
+/** Returns a human readable summary of all metrics, used by the network
+ *  console. */
+std::string ServerMetrics::toString()
+{
+    std::ostringstream oss;
+    for (unsigned i = 0; i < SM_COUNT; i++)
+    {
+        MetricType type = (MetricType)i;
+        oss << getName(type) << ": "
+            << m_histograms[i].getSummary(getUnit(type)) << "\n";
+    }
+    if (STKHost::existHost())
+    {
+        STKHost* host = STKHost::get();
+        oss << "Upload " << host->getUploadSpeed() << " bytes/s, download "
+            << host->getDownloadSpeed() << " bytes/s, "
+            << host->getPeerCount() << " peers.\n";
+        oss << NetworkString::getCompressedCount()
+            << " messages compressed from "
+            << NetworkString::getUncompressedBytes() << " to "
+            << NetworkString::getCompressedBytes() << " bytes.\n";
+        for (auto& peer : host->getPeers())
+        {
+            oss << "  " << peer->getHostId() << ": "
+                << peer->getAddress().toString() << " average ping "
+                << peer->getAveragePing() << "ms, jitter "
+                << peer->getJitter() << "ms\n";
+        }
+    }
+    if (auto pm = ProtocolManager::lock())
+        oss << pm->getStatistics();
+    return oss.str();
+}   // toString
+
+// ----------------------------------------------------------------------------
+/** Returns all metrics in the Prometheus text exposition format. Histograms
+ *  are exported as summaries: as Prometheus expects, _sum and _count are
+ *  totals, while the quantiles only cover the values added since the
+ *  previous call (the quantile 1 is the largest of them, accurate to the
+ *  bucket size). Only called from the main thread.
+ */
+std::string ServerMetrics::getScrapeText()
+{
+    std::ostringstream oss;
+    const float quantiles[] = { 50.0f, 90.0f, 99.0f, 99.9f, 100.0f };
+    auto add_summary = [&oss, &quantiles](const char* name,
+                                          const Histogram& h)
+        {
+            Histogram& scraped = m_scraped[name];
+            oss << "# TYPE " << name << " summary\n";
+            for (float q : quantiles)
+            {
+                oss << name << "{quantile=\"" << q / 100.0f << "\"} "
+                    << h.getPercentileSince(scraped, q) << "\n";
+            }
+            oss << name << "_sum " << h.getSum() << "\n";
+            oss << name << "_count " << h.getCount() << "\n";
+            scraped.copyFrom(h);
+        };
+    auto add_value = [&oss](const std::string& name, const char* type,
+                            uint64_t value)
+        {
+            oss << "# TYPE " << name << " " << type << "\n";
+            oss << name << " " << value << "\n";
+        };
+    auto add_gauge = [&add_value](const std::string& name, uint64_t value)
+        {
+            add_value(name, "gauge", value);
+        };
+    // Counters only increase, a scraper computes rates from them
+    auto add_counter = [&add_value](const std::string& name, uint64_t value)
+        {
+            add_value(name, "counter", value);
+        };
+
+    for (unsigned i = 0; i < SM_COUNT; i++)
+        add_summary(getName((MetricType)i), m_histograms[i]);
+
+    if (auto pm = ProtocolManager::lock())
+    {
+        add_summary("stk_async_event_queue_depth",
+            pm->getAsyncQueueDepth());
+        add_summary("stk_async_event_latency_us",
+            pm->getAsyncEventLatency());
+    }
+
+    if (STKHost::existHost())
+    {
+        STKHost* host = STKHost::get();
+        add_gauge("stk_upload_bytes_per_second", host->getUploadSpeed());
+        add_gauge("stk_download_bytes_per_second", host->getDownloadSpeed());
+        add_gauge("stk_peers", host->getPeerCount());
+        add_counter("stk_compressed_messages_total",
+            NetworkString::getCompressedCount());
+        add_counter("stk_compression_input_bytes_total",
+            NetworkString::getUncompressedBytes());
+        add_counter("stk_compression_output_bytes_total",
+            NetworkString::getCompressedBytes());
+
+        // One gauge per peer, labelled with its host id. The type is only
+        // written once for each of them.
+        const std::map<uint32_t, uint32_t> pings = host->getPeerPings();
+        const auto peers = host->getPeers();
+        auto add_peer_gauge = [&oss, &peers](const char* name,
+            std::function<bool(const STKPeer&, uint64_t*)> get_value)
+            {
+                oss << "# TYPE " << name << " gauge\n";
+                for (auto& peer : peers)
+                {
+                    uint64_t value;
+                    if (!get_value(*peer, &value))
+                        continue;
+                    oss << name << "{host_id=\"" << peer->getHostId()
+                        << "\"} " << value << "\n";
+                }
+            };
+        add_peer_gauge("stk_peer_ping_ms",
+            [&pings](const STKPeer& peer, uint64_t* value)
+            {
+                auto it = pings.find(peer.getHostId());
+                if (it == pings.end())
+                    return false;
+                *value = it->second;
+                return true;
+            });
+        add_peer_gauge("stk_peer_average_ping_ms",
+            [](const STKPeer& peer, uint64_t* value)
+            {
+                *value = peer.getAveragePing();
+                return true;
+            });
+        add_peer_gauge("stk_peer_current_jitter_ms",
+            [](const STKPeer& peer, uint64_t* value)
+            {
+                *value = peer.getJitter();
+                return true;
+            });
+        add_peer_gauge("stk_peer_packet_throttle",
+            [](const STKPeer& peer, uint64_t* value)
+            {
+                *value = peer.getPacketThrottle();
+                return true;
+            });
+    }
+    return oss.str();
+}   // getScrapeText
@@ -0,0 +1,82 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SERVER_METRICS_HPP
+#define HEADER_SERVER_METRICS_HPP
+
+#include "utils/histogram.hpp"
+#include "utils/types.hpp"
+
+#include <map>
+#include <string>
+
+/** Collects statistics about the health of a server (tick times, state
+ *  sizes, peer latencies ...) in histograms. They can be shown with
+ *  the "metrics" network console command, and are written periodically to
+ *  the text file set by the metrics-file server config option, in the plain
+ *  text format of Prometheus so that it can be scraped by a monitoring
+ *  system. Recording a value is lock free and can be done from any thread.
+ */
+class ServerMetrics
+{
+public:
+    enum MetricType : unsigned
+    {
+        SM_WORLD_UPDATE_TIME,   //!< Time of one world update (us).
+        SM_PHYSICS_TIME,        //!< Time of one physics update (us).
+        SM_STATE_SIZE,          //!< Size of a state packet (bytes).
+        SM_PEER_RTT,            //!< Round trip time of a peer (ms).
+        SM_PEER_JITTER,         //!< Jitter of the round trip time (ms).
+        SM_STATE_INTERVAL,      //!< Time between states sent to a peer (ms).
+        SM_COUNT
+    };
+
+private:
+    static Histogram m_histograms[SM_COUNT];
+
+    /** State of each exported histogram at the previous write of the metrics
+     *  file, so that the quantiles only cover the values since then. */
+    static std::map<std::string, Histogram> m_scraped;
+
+    /** Time when the metrics file will be written next. */
+    static uint64_t m_next_write_time;
+
+    // ------------------------------------------------------------------------
+    static const char* getName(MetricType type);
+    // ------------------------------------------------------------------------
+    static const char* getUnit(MetricType type);
+
+public:
+    // ------------------------------------------------------------------------
+    static void add(MetricType type, uint64_t value)
+                                           { m_histograms[type].add(value); }
+    // ------------------------------------------------------------------------
+    static const Histogram& get(MetricType type)
+                                                { return m_histograms[type]; }
+    // ------------------------------------------------------------------------
+    static void reset();
+    // ------------------------------------------------------------------------
+    static void update();
+    // ------------------------------------------------------------------------
+    static std::string toString();
+    // ------------------------------------------------------------------------
+    static std::string getScrapeText();
+
+};   // ServerMetrics
+
+#endif // HEADER_SERVER_METRICS_HPP
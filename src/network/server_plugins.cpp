@@ -0,0 +1,529 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/server_plugins.hpp"
+
+#include "scriptengine/script_engine.hpp"
+#include "scriptengine/scriptarray.hpp"
+#include "scriptengine/scriptstdstring.hpp"
+#include "utils/log.hpp"
+#include "utils/time.hpp"
+#include "utils/vs.hpp"
+
+#include <angelscript.h>
+#include <cassert>
+
+// ----------------------------------------------------------------------------
+/** Starts the plugin thread, which compiles the script.
+ *  \param script The source code of the plugin script.
+ *  \param time_budget Time in ms after which a hook is aborted.
+ *  \param wake_up Called from the plugin thread when results are available
+ *         for \ref handleResults.
+ *  \param send_chat Sends a chat message to all players.
+ *  \param kick Kicks the peer with the given host id.
+ */
+ServerPlugins::ServerPlugins(const std::string& script, unsigned time_budget,
+                             std::function<void()> wake_up,
+                             std::function<void(const std::string&)>
+                             send_chat,
+                             std::function<void(uint32_t)> kick)
+             : m_script(script), m_time_budget(time_budget)
+{
+    m_wake_up = wake_up;
+    m_send_chat = send_chat;
+    m_kick = kick;
+    m_engine = NULL;
+    m_context = NULL;
+    m_deadline = 0;
+    m_exit = false;
+    for (unsigned i = 0; i < HOOK_COUNT; i++)
+    {
+        m_hooks[i] = NULL;
+        m_has_hook[i].store(false);
+    }
+    asPrepareMultithread();
+    m_thread = std::thread([this]()
+        {
+            VS::setThreadName("ServerPlugins");
+            threadLoop();
+        });
+}   // ServerPlugins
+
+// ----------------------------------------------------------------------------
+/** Stops the plugin thread, aborting the running hook. Queued hooks and
+ *  results which were not handled yet are discarded.
+ */
+ServerPlugins::~ServerPlugins()
+{
+    std::unique_lock<std::mutex> ul(m_jobs_mutex);
+    m_exit = true;
+    if (m_context)
+        m_context->Abort();
+    m_jobs_cv.notify_one();
+    ul.unlock();
+    m_thread.join();
+    asUnprepareMultithread();
+}   // ~ServerPlugins
+
+// ----------------------------------------------------------------------------
+void ServerPlugins::threadLoop()
+{
+    if (loadScript())
+    {
+        while (true)
+        {
+            std::unique_lock<std::mutex> ul(m_jobs_mutex);
+            m_jobs_cv.wait(ul, [this]() { return m_exit || !m_jobs.empty(); });
+            if (m_exit)
+                break;
+            Job job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            ul.unlock();
+            runJob(job);
+        }
+    }
+
+    std::unique_lock<std::mutex> ul(m_jobs_mutex);
+    asIScriptContext* ctx = m_context;
+    m_context = NULL;
+    ul.unlock();
+    if (ctx)
+        ctx->Release();
+    if (m_engine)
+        m_engine->ShutDownAndRelease();
+    m_engine = NULL;
+    asThreadCleanup();
+}   // threadLoop
+
+// ----------------------------------------------------------------------------
+/** Creates the script engine with the server API and compiles the script,
+ *  called in the plugin thread.
+ *  \return False if the script can't be used.
+ */
+bool ServerPlugins::loadScript()
+{
+    m_engine = asCreateScriptEngine(ANGELSCRIPT_VERSION);
+    if (m_engine == NULL)
+    {
+        Log::error("ServerPlugins", "Failed to create script engine.");
+        return false;
+    }
+    m_engine->SetMessageCallback(
+        asFUNCTION(Scripting::AngelScript_ErrorCallback), 0, asCALL_CDECL);
+    RegisterStdString(m_engine);
+    RegisterScriptArray(m_engine, true);
+
+    // Generic calling convention, which works with AS_MAX_PORTABILITY too
+    struct Function
+    {
+        const char* m_declaration;
+        asSFuncPtr m_function;
+    };
+    const Function functions[] =
+    {
+        { "void sendChat(const string &in)",   asFUNCTION(scriptSendChat)   },
+        { "void kick(uint)",                   asFUNCTION(scriptKick)       },
+        { "void logInfo(const string &in)",    asFUNCTION(scriptLogInfo)    },
+        { "void logWarning(const string &in)", asFUNCTION(scriptLogWarning) }
+    };
+    m_engine->SetDefaultNamespace("Server");
+    for (const Function& f : functions)
+    {
+        if (m_engine->RegisterGlobalFunction(f.m_declaration, f.m_function,
+            asCALL_GENERIC, this) < 0)
+        {
+            Log::error("ServerPlugins", "Failed to register '%s'.",
+                f.m_declaration);
+            return false;
+        }
+    }
+    m_engine->SetDefaultNamespace("");
+
+    asIScriptModule* mod = m_engine->GetModule("server_plugins",
+        asGM_ALWAYS_CREATE);
+    if (mod->AddScriptSection("plugin", m_script.c_str(),
+        m_script.size()) < 0 || mod->Build() < 0)
+    {
+        Log::error("ServerPlugins", "Failed to compile the plugin script.");
+        return false;
+    }
+
+    asIScriptContext* ctx = m_engine->CreateContext();
+    if (ctx == NULL)
+    {
+        Log::error("ServerPlugins", "Failed to create the context.");
+        return false;
+    }
+    if (ctx->SetLineCallback(asFUNCTION(lineCallback), this,
+        asCALL_CDECL) < 0)
+    {
+        Log::warn("ServerPlugins", "The time budget of plugin hooks is not "
+            "supported by this build of AngelScript.");
+    }
+    std::unique_lock<std::mutex> ul(m_jobs_mutex);
+    m_context = ctx;
+    ul.unlock();
+
+    const char* declarations[HOOK_COUNT] =
+    {
+        "void onConnect(uint, const string &in, uint, const string &in)",
+        "bool onChat(uint, const string &in)",
+        "void onVotesResolved(const string &in, int, bool, const string &in)",
+        "void onRaceEnd(const array<string>@, const array<uint>@, "
+            "const array<float>@)"
+    };
+    unsigned hook_count = 0;
+    for (unsigned i = 0; i < HOOK_COUNT; i++)
+    {
+        m_hooks[i] = mod->GetFunctionByDecl(declarations[i]);
+        if (m_hooks[i])
+            hook_count++;
+        m_has_hook[i].store(m_hooks[i] != NULL);
+    }
+    Log::info("ServerPlugins", "Plugin script loaded with %u hooks.",
+        hook_count);
+    return true;
+}   // loadScript
+
+// ----------------------------------------------------------------------------
+/** Aborts the running hook once its time budget is used up. */
+void ServerPlugins::lineCallback(asIScriptContext* ctx, ServerPlugins* sp)
+{
+    if (StkTime::getMonoTimeMs() > sp->m_deadline)
+        ctx->Abort();
+}   // lineCallback
+
+// ----------------------------------------------------------------------------
+/** Runs a hook in the plugin thread and queues its actions and result. */
+void ServerPlugins::runJob(Job& job)
+{
+    const char* names[HOOK_COUNT] =
+        { "onConnect", "onChat", "onVotesResolved", "onRaceEnd" };
+    asIScriptContext* ctx = m_context;
+    m_actions.clear();
+    bool finished = false;
+    bool ret = false;
+    if (ctx->Prepare(m_hooks[job.m_hook]) < 0)
+    {
+        Log::error("ServerPlugins", "Failed to prepare the context.");
+    }
+    else
+    {
+        job.m_set_args(ctx);
+        m_deadline = StkTime::getMonoTimeMs() + m_time_budget;
+        int r = ctx->Execute();
+        if (r == asEXECUTION_FINISHED)
+        {
+            finished = true;
+            if (job.m_hook == HOOK_CHAT)
+                ret = ctx->GetReturnByte() != 0;
+        }
+        else if (r == asEXECUTION_ABORTED)
+        {
+            Log::warn("ServerPlugins", "%s took longer than %u ms and was "
+                "aborted.", names[job.m_hook], (unsigned)m_time_budget);
+        }
+        else if (r == asEXECUTION_EXCEPTION)
+        {
+            Log::warn("ServerPlugins", "%s ended with an exception: "
+                "(line %d) %s", names[job.m_hook],
+                ctx->GetExceptionLineNumber(), ctx->GetExceptionString());
+        }
+        else
+        {
+            Log::warn("ServerPlugins", "%s ended for some unforeseen reason "
+                "(%d)", names[job.m_hook], r);
+        }
+        // Free the arguments now
+        ctx->Unprepare();
+    }
+
+    std::vector<std::function<void()> > actions;
+    if (finished)
+        std::swap(actions, m_actions);
+    m_actions.clear();
+    if (actions.empty() && !job.m_done)
+        return;
+    std::function<void(bool, bool)> done = job.m_done;
+    addResult([actions, done, finished, ret]()
+        {
+            for (auto& action : actions)
+                action();
+            if (done)
+                done(finished, ret);
+        });
+}   // runJob
+
+// ----------------------------------------------------------------------------
+/** Queues a hook for the plugin thread, or if the script doesn't define it
+ *  or too many hooks are queued, reports it as not finished. */
+void ServerPlugins::addJob(Job job)
+{
+    std::unique_lock<std::mutex> ul(m_jobs_mutex);
+    const bool has_hook = hasHook(job.m_hook);
+    if (has_hook && m_jobs.size() < MAX_QUEUED_HOOKS)
+    {
+        m_jobs.push_back(std::move(job));
+        m_jobs_cv.notify_one();
+        return;
+    }
+    ul.unlock();
+
+    if (has_hook)
+    {
+        Log::warn("ServerPlugins", "Too many plugin hooks queued, one is "
+            "dropped.");
+    }
+    std::function<void(bool, bool)> done = job.m_done;
+    if (done)
+        addResult([done]() { done(false, false); });
+}   // addJob
+
+// ----------------------------------------------------------------------------
+void ServerPlugins::addResult(const std::function<void()>& result)
+{
+    std::unique_lock<std::mutex> ul(m_results_mutex);
+    m_results.push_back(result);
+    ul.unlock();
+    if (m_wake_up)
+        m_wake_up();
+}   // addResult
+
+// ----------------------------------------------------------------------------
+/** Applies the actions and results of the hooks finished since the last
+ *  call, in the order the hooks were called. Called by the lobby.
+ */
+void ServerPlugins::handleResults()
+{
+    std::vector<std::function<void()> > results;
+    std::unique_lock<std::mutex> ul(m_results_mutex);
+    std::swap(results, m_results);
+    ul.unlock();
+    for (auto& result : results)
+        result();
+}   // handleResults
+
+// ----------------------------------------------------------------------------
+/** Called when a player joined the server. */
+void ServerPlugins::onConnect(uint32_t host_id, const std::string& name,
+                              uint32_t online_id, const std::string& country)
+{
+    Job job;
+    job.m_hook = HOOK_CONNECT;
+    job.m_set_args = [host_id, name, online_id, country]
+        (asIScriptContext* ctx)
+        {
+            ctx->SetArgDWord(0, host_id);
+            ctx->SetArgObject(1, (void*)&name);
+            ctx->SetArgDWord(2, online_id);
+            ctx->SetArgObject(3, (void*)&country);
+        };
+    addJob(std::move(job));
+}   // onConnect
+
+// ----------------------------------------------------------------------------
+/** Called for a chat message, which the lobby only sends once done was
+ *  called with true.
+ *  \param done Called by \ref handleResults with false if the hook returned
+ *         false, or true if it returned true or didn't finish.
+ */
+void ServerPlugins::onChat(uint32_t host_id, const std::string& message,
+                           std::function<void(bool)> done)
+{
+    Job job;
+    job.m_hook = HOOK_CHAT;
+    job.m_set_args = [host_id, message](asIScriptContext* ctx)
+        {
+            ctx->SetArgDWord(0, host_id);
+            ctx->SetArgObject(1, (void*)&message);
+        };
+    job.m_done = [done](bool finished, bool allowed)
+        {
+            done(!finished || allowed);
+        };
+    addJob(std::move(job));
+}   // onChat
+
+// ----------------------------------------------------------------------------
+/** Called when the votes decided the next track. */
+void ServerPlugins::onVotesResolved(const std::string& track, int laps,
+                                    bool reverse, const std::string& winner)
+{
+    Job job;
+    job.m_hook = HOOK_VOTES_RESOLVED;
+    job.m_set_args = [track, laps, reverse, winner](asIScriptContext* ctx)
+        {
+            ctx->SetArgObject(0, (void*)&track);
+            ctx->SetArgDWord(1, (asDWORD)laps);
+            ctx->SetArgByte(2, reverse ? 1 : 0);
+            ctx->SetArgObject(3, (void*)&winner);
+        };
+    addJob(std::move(job));
+}   // onVotesResolved
+
+// ----------------------------------------------------------------------------
+/** Called when a race ended, with the players in finishing order.
+ *  \param times The finishing time of each player, -1 if not finished.
+ */
+void ServerPlugins::onRaceEnd(const std::vector<std::string>& names,
+                              const std::vector<uint32_t>& online_ids,
+                              const std::vector<float>& times)
+{
+    Job job;
+    job.m_hook = HOOK_RACE_END;
+    job.m_set_args = [this, names, online_ids, times](asIScriptContext* ctx)
+        {
+            // The context keeps a reference to the arguments
+            CScriptArray* a = CScriptArray::Create(
+                m_engine->GetTypeInfoByDecl("array<string>"),
+                (asUINT)names.size());
+            for (unsigned i = 0; i < names.size(); i++)
+                *(std::string*)a->At(i) = names[i];
+            ctx->SetArgObject(0, a);
+            a->Release();
+            a = CScriptArray::Create(
+                m_engine->GetTypeInfoByDecl("array<uint>"),
+                (asUINT)online_ids.size());
+            for (unsigned i = 0; i < online_ids.size(); i++)
+                *(uint32_t*)a->At(i) = online_ids[i];
+            ctx->SetArgObject(1, a);
+            a->Release();
+            a = CScriptArray::Create(
+                m_engine->GetTypeInfoByDecl("array<float>"),
+                (asUINT)times.size());
+            for (unsigned i = 0; i < times.size(); i++)
+                *(float*)a->At(i) = times[i];
+            ctx->SetArgObject(2, a);
+            a->Release();
+        };
+    addJob(std::move(job));
+}   // onRaceEnd
+
+// ----------------------------------------------------------------------------
+void ServerPlugins::scriptSendChat(asIScriptGeneric* gen)
+{
+    ServerPlugins* sp = (ServerPlugins*)gen->GetAuxiliary();
+    const std::string message = *(std::string*)gen->GetArgAddress(0);
+    sp->m_actions.push_back([sp, message]()
+        {
+            if (sp->m_send_chat)
+                sp->m_send_chat(message);
+        });
+}   // scriptSendChat
+
+// ----------------------------------------------------------------------------
+void ServerPlugins::scriptKick(asIScriptGeneric* gen)
+{
+    ServerPlugins* sp = (ServerPlugins*)gen->GetAuxiliary();
+    const uint32_t host_id = gen->GetArgDWord(0);
+    sp->m_actions.push_back([sp, host_id]()
+        {
+            if (sp->m_kick)
+                sp->m_kick(host_id);
+        });
+}   // scriptKick
+
+// ----------------------------------------------------------------------------
+void ServerPlugins::scriptLogInfo(asIScriptGeneric* gen)
+{
+    Log::info("ServerPlugins", "%s",
+        ((std::string*)gen->GetArgAddress(0))->c_str());
+}   // scriptLogInfo
+
+// ----------------------------------------------------------------------------
+void ServerPlugins::scriptLogWarning(asIScriptGeneric* gen)
+{
+    Log::warn("ServerPlugins", "%s",
+        ((std::string*)gen->GetArgAddress(0))->c_str());
+}   // scriptLogWarning
+
+// ----------------------------------------------------------------------------
+void ServerPlugins::unitTesting()
+{
+    const std::string script =
+        "void onConnect(uint host_id, const string &in name, uint online_id,"
+        "               const string &in country)\n"
+        "{\n"
+        "    Server::sendChat('Welcome ' + name + ' from ' + country);\n"
+        "    if (online_id == 0)\n"
+        "        Server::kick(host_id);\n"
+        "}\n"
+        "bool onChat(uint host_id, const string &in message)\n"
+        "{\n"
+        "    if (message == 'slow')\n"
+        "    {\n"
+        "        Server::sendChat('never sent');\n"
+        "        while (true) {}\n"
+        "    }\n"
+        "    return message.findFirst('bad') < 0;\n"
+        "}\n"
+        "void onRaceEnd(const array<string>@ names,\n"
+        "               const array<uint>@ online_ids,\n"
+        "               const array<float>@ times)\n"
+        "{\n"
+        "    Server::sendChat(names[0] + ' ' + online_ids[0] + ' ' +\n"
+        "        times[1]);\n"
+        "}\n";
+
+    std::vector<std::string> chat;
+    std::vector<uint32_t> kicked;
+    std::vector<std::string> allowed_chat;
+    ServerPlugins sp(script, 20, nullptr,
+        [&chat](const std::string& message) { chat.push_back(message); },
+        [&kicked](uint32_t host_id) { kicked.push_back(host_id); });
+
+    uint64_t timeout = StkTime::getMonoTimeMs() + 10000;
+    while (!sp.hasHook(HOOK_RACE_END) && StkTime::getMonoTimeMs() < timeout)
+        StkTime::sleep(1);
+    assert(sp.hasHook(HOOK_CONNECT));
+    assert(sp.hasHook(HOOK_CHAT));
+    assert(!sp.hasHook(HOOK_VOTES_RESOLVED));
+    assert(sp.hasHook(HOOK_RACE_END));
+
+    sp.onConnect(1, "alice", 42, "de");
+    sp.onConnect(2, "bob", 0, "");
+    for (const std::string message : { "hi", "bad word", "slow", "bye" })
+    {
+        sp.onChat(1, message, [&allowed_chat, message](bool allowed)
+            {
+                if (allowed)
+                    allowed_chat.push_back(message);
+            });
+    }
+    // Not defined by the script, nothing happens
+    sp.onVotesResolved("lighthouse", 3, false, "alice");
+    sp.onRaceEnd({ "alice", "bob" }, { 42, 0 }, { 60.5f, -1.0f });
+
+    // The calls above only queue the hooks
+    timeout = StkTime::getMonoTimeMs() + 10000;
+    while (chat.size() < 3 && StkTime::getMonoTimeMs() < timeout)
+    {
+        sp.handleResults();
+        StkTime::sleep(1);
+    }
+    assert(chat.size() == 3);
+    assert(chat[0] == "Welcome alice from de");
+    assert(chat[1] == "Welcome bob from ");
+    assert(chat[2] == "alice 42 -1");
+    assert(kicked.size() == 1 && kicked[0] == 2);
+    // The aborted hook is treated as allowing the message
+    assert(allowed_chat.size() == 3);
+    assert(allowed_chat[0] == "hi");
+    assert(allowed_chat[1] == "slow");
+    assert(allowed_chat[2] == "bye");
+}   // unitTesting
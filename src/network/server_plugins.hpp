@@ -0,0 +1,173 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SERVER_PLUGINS_HPP
+#define HEADER_SERVER_PLUGINS_HPP
+
+#include "utils/no_copy.hpp"
+#include "utils/types.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class asIScriptContext;
+class asIScriptEngine;
+class asIScriptFunction;
+class asIScriptGeneric;
+
+/** Runs the hooks of a server plugin script (see plugin-script in
+ *  NETWORKING.md) on a thread of its own, so that a slow plugin never
+ *  stalls the lobby or network threads. The script gets its own AngelScript
+ *  engine, as the one of ScriptEngine runs the track scripts in the main
+ *  thread and exposes the world to them.
+ *  Calling a hook only queues it, its result and the actions the script
+ *  requested (e.g. Server::kick) are collected and applied by
+ *  \ref handleResults in the thread of the lobby. A hook running longer
+ *  than the time budget is aborted and its actions are discarded.
+ *  \ingroup network
+ */
+class ServerPlugins : public NoCopy
+{
+public:
+    enum Hook : unsigned
+    {
+        HOOK_CONNECT,
+        HOOK_CHAT,
+        HOOK_VOTES_RESOLVED,
+        HOOK_RACE_END,
+        HOOK_COUNT
+    };
+
+private:
+    /** At most this number of hooks are queued, further hooks are dropped
+     *  (a chat message is then sent unfiltered). */
+    static const unsigned MAX_QUEUED_HOOKS = 256;
+
+    struct Job
+    {
+        Hook m_hook;
+        /** Sets the arguments of the hook, called in the plugin thread. */
+        std::function<void(asIScriptContext*)> m_set_args;
+        /** Called in the thread of the lobby with true if the hook
+         *  returned in time (and with its return value), can be empty. */
+        std::function<void(bool, bool)> m_done;
+    };
+
+    const std::string m_script;
+
+    const uint64_t m_time_budget;
+
+    /** Called from the plugin thread when there are new results. */
+    std::function<void()> m_wake_up;
+
+    std::function<void(const std::string&)> m_send_chat;
+
+    std::function<void(uint32_t)> m_kick;
+
+    /** Only used in the plugin thread. */
+    asIScriptEngine* m_engine;
+
+    asIScriptFunction* m_hooks[HOOK_COUNT];
+
+    /** Actions requested by the running hook. */
+    std::vector<std::function<void()> > m_actions;
+
+    /** Time at which the running hook is aborted. */
+    uint64_t m_deadline;
+
+    /** Set by the plugin thread once the script is compiled. */
+    std::atomic_bool m_has_hook[HOOK_COUNT];
+
+    std::thread m_thread;
+
+    std::mutex m_jobs_mutex;
+
+    std::condition_variable m_jobs_cv;
+
+    std::deque<Job> m_jobs;
+
+    /** Context of the running hook, protected by m_jobs_mutex so it can be
+     *  aborted when exiting. */
+    asIScriptContext* m_context;
+
+    bool m_exit;
+
+    std::mutex m_results_mutex;
+
+    std::vector<std::function<void()> > m_results;
+
+    // ------------------------------------------------------------------------
+    void threadLoop();
+    // ------------------------------------------------------------------------
+    bool loadScript();
+    // ------------------------------------------------------------------------
+    void runJob(Job& job);
+    // ------------------------------------------------------------------------
+    void addJob(Job job);
+    // ------------------------------------------------------------------------
+    void addResult(const std::function<void()>& result);
+    // ------------------------------------------------------------------------
+    static void lineCallback(asIScriptContext* ctx, ServerPlugins* sp);
+    // ------------------------------------------------------------------------
+    static void scriptSendChat(asIScriptGeneric* gen);
+    // ------------------------------------------------------------------------
+    static void scriptKick(asIScriptGeneric* gen);
+    // ------------------------------------------------------------------------
+    static void scriptLogInfo(asIScriptGeneric* gen);
+    // ------------------------------------------------------------------------
+    static void scriptLogWarning(asIScriptGeneric* gen);
+
+public:
+    // ------------------------------------------------------------------------
+    ServerPlugins(const std::string& script, unsigned time_budget,
+                  std::function<void()> wake_up,
+                  std::function<void(const std::string&)> send_chat,
+                  std::function<void(uint32_t)> kick);
+    // ------------------------------------------------------------------------
+    ~ServerPlugins();
+    // ------------------------------------------------------------------------
+    void onConnect(uint32_t host_id, const std::string& name,
+                   uint32_t online_id, const std::string& country);
+    // ------------------------------------------------------------------------
+    void onChat(uint32_t host_id, const std::string& message,
+                std::function<void(bool)> done);
+    // ------------------------------------------------------------------------
+    void onVotesResolved(const std::string& track, int laps, bool reverse,
+                         const std::string& winner);
+    // ------------------------------------------------------------------------
+    void onRaceEnd(const std::vector<std::string>& names,
+                   const std::vector<uint32_t>& online_ids,
+                   const std::vector<float>& times);
+    // ------------------------------------------------------------------------
+    void handleResults();
+    // ------------------------------------------------------------------------
+    /** Returns if the script defines the hook, false until the script is
+     *  compiled. */
+    bool hasHook(Hook hook) const           { return m_has_hook[hook].load(); }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // ServerPlugins
+
+#endif // HEADER_SERVER_PLUGINS_HPP
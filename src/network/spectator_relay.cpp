@@ -0,0 +1,968 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/spectator_relay.hpp"
+
+#include "config/stk_config.hpp"
+#include "karts/kart_properties_manager.hpp"
+#include "network/event.hpp"
+#include "network/network.hpp"
+#include "network/network_string.hpp"
+#include "network/peer_vote.hpp"
+#include "network/protocols/game_protocol.hpp"
+#include "network/protocols/lobby_protocol.hpp"
+#include "network/server_config.hpp"
+#include "network/server_messages.hpp"
+#include "network/stk_peer.hpp"
+#include "tracks/track_manager.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/time.hpp"
+
+#include <algorithm>
+#include <limits>
+
+std::atomic_bool SpectatorRelay::m_abort(false);
+
+// ----------------------------------------------------------------------------
+/** Creates the sockets of the relay.
+ *  \param server Address of the game server.
+ *  \param port Port for the spectators to connect to.
+ *  \param max_spectators Maximum number of connected spectators.
+ *  \param delay Time in seconds the game is delayed for spectators.
+ */
+SpectatorRelay::SpectatorRelay(const TransportAddress& server, uint16_t port,
+                               unsigned max_spectators, float delay)
+              : m_server_address(server), m_port(port)
+{
+    // Maximum number of peers of an enet host
+    m_max_spectators = std::min(std::max(max_spectators, 1u), 4095u);
+    m_delay = (uint64_t)(std::max(delay, 0.0f) * 1000.0f);
+    m_server_peer = NULL;
+    m_host_id = 0;
+    m_next_host_id = 0x40000000;
+    m_accepted = m_game_started = m_in_game = m_self_joining = false;
+    m_live_join_requested = m_snapshot_requested = false;
+    m_skip_server_info = false;
+    m_timer_offset = 0;
+    m_timer_ping = std::numeric_limits<uint32_t>::max();
+    m_timer_sample_time = 0;
+    m_timer_synchronised = false;
+    m_remaining_time = m_progress = std::numeric_limits<uint32_t>::max();
+    m_game_id = m_released_game_id = 0;
+    m_last_state_ticks = m_released_state_ticks = m_sent_confirmation = 0;
+    m_next_ping_time = m_next_self_join_time = 0;
+
+    if (enet_initialize() != 0)
+        Log::error("SpectatorRelay", "Could not initialize enet.");
+    ENetAddress addr;
+    addr.host = ENET_HOST_ANY;
+    addr.port = ENET_PORT_ANY;
+    m_upstream = new Network(/*peer_count*/1,
+        /*channel_limit*/EVENT_CHANNEL_COUNT, /*max_in_bandwidth*/0,
+        /*max_out_bandwidth*/0, &addr);
+    addr.port = m_port;
+    m_downstream = new Network(m_max_spectators,
+        /*channel_limit*/EVENT_CHANNEL_COUNT, /*max_in_bandwidth*/0,
+        /*max_out_bandwidth*/0, &addr);
+}   // SpectatorRelay
+
+// ----------------------------------------------------------------------------
+SpectatorRelay::~SpectatorRelay()
+{
+    delete m_upstream;
+    delete m_downstream;
+    enet_deinitialize();
+}   // ~SpectatorRelay
+
+// ----------------------------------------------------------------------------
+/** Connects to the server and relays its games until the connection is
+ *  closed or requestAbort is called.
+ */
+void SpectatorRelay::run()
+{
+    if (!m_upstream->getENetHost() || !m_downstream->getENetHost())
+    {
+        Log::error("SpectatorRelay", "Can't create the sockets, is port %d "
+            "in use?", m_port);
+        return;
+    }
+    if (!connectToServer())
+        return;
+    Log::info("SpectatorRelay", "Relaying %s on port %d for at most %d "
+        "spectators with a delay of %d ms.",
+        m_server_address.toString().c_str(), m_port, m_max_spectators,
+        (int)m_delay);
+
+    ENetEvent event;
+    while (!m_abort && m_server_peer)
+    {
+        while (m_server_peer &&
+            enet_host_service(m_upstream->getENetHost(), &event, 0) > 0)
+            handleServerEvent(event);
+        while (enet_host_service(m_downstream->getENetHost(), &event, 0) > 0)
+            handleSpectatorEvent(event);
+
+        releaseMessages();
+        sendPings();
+        // Join a running game by itself, so that spectators joining later
+        // only need a snapshot
+        if (m_accepted && m_game_started && !m_in_game && !m_self_joining &&
+            StkTime::getMonoTimeMs() >= m_next_self_join_time)
+        {
+            m_self_joining = true;
+            requestLiveJoin();
+        }
+        enet_host_flush(m_upstream->getENetHost());
+        enet_host_flush(m_downstream->getENetHost());
+        StkTime::sleep(1);
+    }
+
+    for (auto& s : m_spectators)
+        enet_peer_disconnect(s.first, PDI_NORMAL);
+    if (m_server_peer)
+        enet_peer_disconnect(m_server_peer, PDI_NORMAL);
+    enet_host_flush(m_upstream->getENetHost());
+    enet_host_flush(m_downstream->getENetHost());
+    Log::info("SpectatorRelay", "Relay stopped.");
+}   // run
+
+// ----------------------------------------------------------------------------
+/** Connects to the server and sends the connection request of a client
+ *  without players and with the "relay" capability.
+ */
+bool SpectatorRelay::connectToServer()
+{
+    for (unsigned i = 0; i < 5 && !m_abort; i++)
+    {
+        m_server_peer = m_upstream->connectTo(m_server_address);
+        if (!m_server_peer)
+            break;
+        const uint64_t timeout = StkTime::getMonoTimeMs() + 2000;
+        ENetEvent event;
+        while (StkTime::getMonoTimeMs() < timeout && !m_abort)
+        {
+            if (enet_host_service(m_upstream->getENetHost(), &event, 10) <= 0)
+                continue;
+            if (event.type == ENET_EVENT_TYPE_RECEIVE)
+                enet_packet_destroy(event.packet);
+            if (event.type != ENET_EVENT_TYPE_CONNECT)
+                continue;
+
+            NetworkString ns(PROTOCOL_LOBBY_ROOM);
+            ns.addUInt8(LobbyProtocol::LE_CONNECTION_REQUESTED)
+                .addUInt32(ServerConfig::m_server_version)
+                .encodeString(StringUtils::getUserAgentString())
+                .addUInt16(
+                (uint16_t)stk_config->m_network_capabilities.size() + 1);
+            for (const std::string& cap : stk_config->m_network_capabilities)
+                ns.encodeString(cap);
+            ns.encodeString(std::string("relay"));
+
+            auto all_k = kart_properties_manager->getAllAvailableKarts();
+            auto all_t = track_manager->getAllTrackIdentifiers();
+            if (all_k.size() >= 65536)
+                all_k.resize(65535);
+            if (all_t.size() >= 65536)
+                all_t.resize(65535);
+            m_karts = std::set<std::string>(all_k.begin(), all_k.end());
+            m_tracks = std::set<std::string>(all_t.begin(), all_t.end());
+            ns.addUInt16((uint16_t)all_k.size())
+                .addUInt16((uint16_t)all_t.size());
+            for (const std::string& kart : all_k)
+                ns.encodeString(kart);
+            for (const std::string& track : all_t)
+                ns.encodeString(track);
+            // No players, no online id and no encrypted part
+            const std::string& password =
+                ServerConfig::m_private_server_password;
+            ns.addUInt8(0).addUInt32(0).addUInt32(0).encodeString(password)
+                .addUInt8(0);
+            sendToServer(ns, /*reliable*/true);
+            return true;
+        }
+        enet_peer_reset(m_server_peer);
+    }
+    Log::error("SpectatorRelay", "Can't connect to %s.",
+        m_server_address.toString().c_str());
+    m_server_peer = NULL;
+    return false;
+}   // connectToServer
+
+// ----------------------------------------------------------------------------
+void SpectatorRelay::handleServerEvent(ENetEvent& event)
+{
+    if (event.type == ENET_EVENT_TYPE_DISCONNECT)
+    {
+        Log::error("SpectatorRelay", "Disconnected from the server.");
+        m_server_peer = NULL;
+        return;
+    }
+    if (event.type != ENET_EVENT_TYPE_RECEIVE)
+        return;
+
+    if (ServerMessages::PingPacket::isPingPacket(event.packet->data,
+        event.packet->dataLength))
+    {
+        handleServerPing(event.packet->data, event.packet->dataLength);
+        enet_packet_destroy(event.packet);
+        return;
+    }
+    if (event.packet->dataLength < 2)
+    {
+        enet_packet_destroy(event.packet);
+        return;
+    }
+    auto data = std::make_shared<NetworkString>(event.packet->data,
+        (int)event.packet->dataLength);
+    const bool reliable =
+        (event.packet->flags & ENET_PACKET_FLAG_RELIABLE) != 0;
+    enet_packet_destroy(event.packet);
+
+    Route route = ROUTE_NONE;
+    uint32_t state_ticks = 0;
+    try
+    {
+        if (data->isCompressed())
+            data->decompress();
+        switch (data->getProtocolType())
+        {
+        case PROTOCOL_LOBBY_ROOM:
+            route = handleServerLobbyMessage(data);
+            break;
+        case PROTOCOL_CONTROLLER_EVENTS:
+        {
+            const uint8_t type = data->getUInt8();
+            if (type == GameProtocol::GP_STATE)
+            {
+                state_ticks = m_last_state_ticks = data->getUInt32();
+                updateItemConfirmation();
+            }
+            // Time adjustments are for the relay, spectators don't send
+            // any kart actions
+            route = type == GameProtocol::GP_ADJUST_TIME ?
+                ROUTE_NONE : ROUTE_GAME;
+            break;
+        }
+        case PROTOCOL_GAME_EVENTS:
+            route = ROUTE_GAME;
+            break;
+        default:
+            break;
+        }
+    }
+    catch (std::exception& e)
+    {
+        Log::warn("SpectatorRelay", "Invalid message from server: %s",
+            e.what());
+        return;
+    }
+    if (route == ROUTE_NONE)
+        return;
+
+    QueuedMessage message;
+    message.m_release_time = StkTime::getMonoTimeMs() + m_delay;
+    message.m_route = route;
+    message.m_reliable = reliable;
+    message.m_game_id = m_game_id;
+    message.m_state_ticks = state_ticks;
+    message.m_data = data;
+    m_queue.push_back(message);
+}   // handleServerEvent
+
+// ----------------------------------------------------------------------------
+/** Updates the relay with a lobby message of the server, and returns which
+ *  spectators receive it.
+ */
+SpectatorRelay::Route SpectatorRelay::handleServerLobbyMessage(
+                                 const std::shared_ptr<NetworkString>& data)
+{
+    const uint64_t now = StkTime::getMonoTimeMs();
+    switch (data->getUInt8())
+    {
+    case LobbyProtocol::LE_CONNECTION_REFUSED:
+    {
+        const uint8_t reason = data->getUInt8();
+        if (reason == LobbyProtocol::RR_INVALID_PLAYER)
+        {
+            Log::error("SpectatorRelay", "The server refused the connection "
+                "without players, ranked servers and WAN servers validating "
+                "players can't be relayed.");
+        }
+        else
+        {
+            Log::error("SpectatorRelay", "The server refused the connection "
+                "(reason %d).", reason);
+        }
+        requestAbort();
+        return ROUTE_NONE;
+    }
+    case LobbyProtocol::LE_CONNECTION_ACCEPTED:
+    {
+        m_server_accepted = ServerMessages::ConnectionAccepted(*data);
+        m_host_id = m_server_accepted.m_host_id;
+        m_accepted = true;
+        Log::info("SpectatorRelay", "Connected to the server with host id "
+            "%d.", m_host_id);
+        return ROUTE_NONE;
+    }
+    case LobbyProtocol::LE_SERVER_INFO:
+        m_server_info = data;
+        if (m_skip_server_info)
+        {
+            m_skip_server_info = false;
+            return ROUTE_NONE;
+        }
+        return ROUTE_LOBBY;
+    case LobbyProtocol::LE_UPDATE_PLAYER_LIST:
+        m_game_started =
+            ServerMessages::PlayerListHeader(*data).m_game_started;
+        m_player_list = data;
+        return ROUTE_ALL;
+    case LobbyProtocol::LE_LOAD_WORLD:
+    {
+        data->getUInt32();
+        PeerVote winner_vote(*data);
+        if (data->getUInt8() == 0)
+        {
+            startGame();
+            return ROUTE_NEW_GAME;
+        }
+        if (!m_requests.empty() && m_requests.front() == RT_LIVE_JOIN)
+            m_requests.pop_front();
+        // The relay needs the snapshot too if it isn't in the game yet
+        if (!m_in_game)
+            requestSnapshot();
+        return ROUTE_LIVE_JOIN;
+    }
+    case LobbyProtocol::LE_LIVE_JOIN_ACK:
+        if (!m_requests.empty() && m_requests.front() == RT_SNAPSHOT)
+            m_requests.pop_front();
+        if (!m_in_game)
+            startGame();
+        // The server confirms no item event of the relay after a snapshot
+        m_sent_confirmation = 0;
+        return ROUTE_SNAPSHOT;
+    case LobbyProtocol::LE_BACK_LOBBY:
+    {
+        const uint8_t reason = data->getUInt8();
+        if ((reason == LobbyProtocol::BLR_NO_GAME_FOR_LIVE_JOIN ||
+            reason == LobbyProtocol::BLR_NO_PLACE_FOR_LIVE_JOIN) &&
+            !m_requests.empty())
+        {
+            const RequestType rt = m_requests.front();
+            m_requests.pop_front();
+            m_skip_server_info = true;
+            if (!m_in_game)
+            {
+                m_self_joining = false;
+                m_next_self_join_time = now + 5000;
+            }
+            return rt == RT_LIVE_JOIN ? ROUTE_LIVE_JOIN_REJECTED :
+                ROUTE_SNAPSHOT_REJECTED;
+        }
+        m_in_game = false;
+        return ROUTE_BACK_LOBBY;
+    }
+    case LobbyProtocol::LE_START_RACE:
+    case LobbyProtocol::LE_RACE_FINISHED:
+    case LobbyProtocol::LE_KART_INFO:
+        return ROUTE_GAME;
+    case LobbyProtocol::LE_CHAT:
+    case LobbyProtocol::LE_PLAYER_DISCONNECTED:
+        return ROUTE_ALL;
+    // Spectators of the relay don't vote nor own the server
+    case LobbyProtocol::LE_START_SELECTION:
+    case LobbyProtocol::LE_VOTE:
+    case LobbyProtocol::LE_SERVER_OWNERSHIP:
+    case LobbyProtocol::LE_BAD_TEAM:
+    case LobbyProtocol::LE_BAD_CONNECTION:
+    case LobbyProtocol::LE_REPORT_PLAYER:
+        return ROUTE_NONE;
+    default:
+        break;
+    }
+    return ROUTE_LOBBY;
+}   // handleServerLobbyMessage
+
+// ----------------------------------------------------------------------------
+/** Called when the relay starts receiving the state of a new game. */
+void SpectatorRelay::startGame()
+{
+    m_in_game = true;
+    m_self_joining = false;
+    m_game_id++;
+    m_last_state_ticks = 0;
+    m_sent_confirmation = 0;
+}   // startGame
+
+// ----------------------------------------------------------------------------
+/** Takes the network timer of the server from its ping packets, and the
+ *  pings and game progress to forward to the spectators.
+ */
+void SpectatorRelay::handleServerPing(const uint8_t* data, size_t length)
+{
+    uint32_t relay_ping = 0;
+    uint64_t server_time = 0;
+    try
+    {
+        ServerMessages::PingPacket ping(data, length);
+        server_time = ping.m_server_time;
+        relay_ping = ping.getPing(m_host_id);
+        ping.m_pings.erase(m_host_id);
+        std::swap(m_server_pings, ping.m_pings);
+        m_remaining_time = ping.m_remaining_time;
+        m_progress = ping.m_progress;
+        std::swap(m_current_track, ping.m_current_track);
+    }
+    catch (std::exception& e)
+    {
+        Log::debug("SpectatorRelay", "Invalid ping packet: %s", e.what());
+    }
+    if (relay_ping == 0)
+        return;
+
+    // The sample with the lowest round trip is the most accurate, but
+    // allow a new one from time to time in case the clocks drift
+    const uint64_t now = StkTime::getMonoTimeMs();
+    if (!m_timer_synchronised || relay_ping <= m_timer_ping ||
+        now > m_timer_sample_time + 60000)
+    {
+        m_timer_offset = (int64_t)(server_time + relay_ping / 2) -
+            (int64_t)now;
+        m_timer_ping = relay_ping;
+        m_timer_sample_time = now;
+        m_timer_synchronised = true;
+    }
+}   // handleServerPing
+
+// ----------------------------------------------------------------------------
+uint64_t SpectatorRelay::getNetworkTimer() const
+{
+    return (uint64_t)((int64_t)StkTime::getMonoTimeMs() + m_timer_offset);
+}   // getNetworkTimer
+
+// ----------------------------------------------------------------------------
+void SpectatorRelay::handleSpectatorEvent(ENetEvent& event)
+{
+    const TransportAddress addr(event.peer->address);
+    if (event.type == ENET_EVENT_TYPE_CONNECT)
+    {
+        Spectator& s = m_spectators[event.peer];
+        s.m_host_id = m_next_host_id++;
+        s.m_state = SS_CONNECTING;
+        s.m_compression = false;
+        s.m_confirmed_ticks = 0;
+        s.m_connected_time = StkTime::getMonoTimeMs();
+        Log::info("SpectatorRelay", "%s has just connected. There are now "
+            "%d spectators.", addr.toString().c_str(),
+            (int)m_spectators.size());
+        return;
+    }
+    if (event.type == ENET_EVENT_TYPE_DISCONNECT)
+    {
+        m_spectators.erase(event.peer);
+        Log::info("SpectatorRelay", "%s has just disconnected. There are "
+            "now %d spectators.", addr.toString().c_str(),
+            (int)m_spectators.size());
+        updateItemConfirmation();
+        return;
+    }
+    if (event.type != ENET_EVENT_TYPE_RECEIVE)
+        return;
+
+    auto it = m_spectators.find(event.peer);
+    if (it == m_spectators.end() || event.packet->dataLength < 2)
+    {
+        enet_packet_destroy(event.packet);
+        return;
+    }
+    NetworkString data(event.packet->data, (int)event.packet->dataLength);
+    enet_packet_destroy(event.packet);
+    try
+    {
+        if (data.isCompressed())
+            data.decompress();
+        handleSpectatorMessage(event.peer, it->second, data);
+    }
+    catch (std::exception& e)
+    {
+        Log::warn("SpectatorRelay", "Invalid message from %s: %s",
+            addr.toString().c_str(), e.what());
+        enet_peer_disconnect(event.peer, PDI_KICK);
+    }
+}   // handleSpectatorEvent
+
+// ----------------------------------------------------------------------------
+/** Handles a message of a spectator. The relay answers connection, live join
+ *  and back to lobby requests itself, everything a player would send (chat,
+ *  votes, kart actions ...) is ignored.
+ */
+void SpectatorRelay::handleSpectatorMessage(ENetPeer* peer,
+                                            Spectator& spectator,
+                                            NetworkString& data)
+{
+    const ProtocolType type = data.getProtocolType();
+    if (spectator.m_state == SS_CONNECTING)
+    {
+        if (type == PROTOCOL_LOBBY_ROOM &&
+            data.getUInt8() == LobbyProtocol::LE_CONNECTION_REQUESTED)
+            handleConnectionRequest(peer, spectator, data);
+        return;
+    }
+    if (type == PROTOCOL_CONTROLLER_EVENTS)
+    {
+        if (spectator.m_state == SS_IN_GAME &&
+            data.getUInt8() == GameProtocol::GP_ITEM_CONFIRMATION)
+        {
+            spectator.m_confirmed_ticks = data.getUInt32();
+            updateItemConfirmation();
+        }
+        return;
+    }
+    if (type != PROTOCOL_LOBBY_ROOM)
+        return;
+
+    switch (data.getUInt8())
+    {
+    case LobbyProtocol::LE_LIVE_JOIN:
+        if (spectator.m_state != SS_LOBBY)
+            break;
+        if (data.getUInt8() != 1)
+        {
+            // Only spectating is possible
+            sendBackLobby(peer, spectator,
+                LobbyProtocol::BLR_NO_PLACE_FOR_LIVE_JOIN);
+        }
+        else if (!m_game_started)
+        {
+            sendBackLobby(peer, spectator,
+                LobbyProtocol::BLR_NO_GAME_FOR_LIVE_JOIN);
+        }
+        else
+        {
+            spectator.m_state = SS_LIVE_JOIN_REQUESTED;
+            requestLiveJoin();
+        }
+        break;
+    case LobbyProtocol::LE_CLIENT_LOADED_WORLD:
+        // Only the live join loading is answered, the start of a game is
+        // decided by the server
+        if (spectator.m_state == SS_LIVE_LOADING && data.isSynchronous())
+        {
+            spectator.m_state = SS_WAITING_SNAPSHOT;
+            requestSnapshot();
+        }
+        break;
+    case LobbyProtocol::LE_CLIENT_BACK_LOBBY:
+        sendBackLobby(peer, spectator, LobbyProtocol::BLR_NONE);
+        break;
+    case LobbyProtocol::LE_KART_INFO:
+        if (spectator.m_state == SS_IN_GAME && m_in_game)
+            sendToServer(data, /*reliable*/true);
+        break;
+    default:
+        break;
+    }
+}   // handleSpectatorMessage
+
+// ----------------------------------------------------------------------------
+/** Checks the connection request of a spectator like the server would, and
+ *  answers it with the latest server info and player list. A spectator
+ *  needs all karts and tracks of the relay, as the server can pick any of
+ *  them.
+ */
+void SpectatorRelay::handleConnectionRequest(ENetPeer* peer,
+                                             Spectator& spectator,
+                                             NetworkString& data)
+{
+    const uint32_t version = data.getUInt32();
+    if (version < (uint32_t)stk_config->m_min_server_version ||
+        version > (uint32_t)stk_config->m_max_server_version)
+    {
+        refuseConnection(peer, LobbyProtocol::RR_INCOMPATIBLE_DATA);
+        return;
+    }
+    if (!m_accepted || !m_server_info || !m_player_list)
+    {
+        refuseConnection(peer, LobbyProtocol::RR_BUSY);
+        return;
+    }
+
+    std::string user_version;
+    data.decodeString(&user_version);
+    const unsigned list_caps = data.getUInt16();
+    for (unsigned i = 0; i < list_caps; i++)
+    {
+        std::string cap;
+        data.decodeString(&cap);
+        if (cap == "compression")
+            spectator.m_compression = true;
+    }
+
+    std::set<std::string> client_karts, client_tracks;
+    const unsigned kart_num = data.getUInt16();
+    const unsigned track_num = data.getUInt16();
+    for (unsigned i = 0; i < kart_num; i++)
+    {
+        std::string kart;
+        data.decodeString(&kart);
+        client_karts.insert(kart);
+    }
+    for (unsigned i = 0; i < track_num; i++)
+    {
+        std::string track;
+        data.decodeString(&track);
+        client_tracks.insert(track);
+    }
+    if (!std::includes(client_karts.begin(), client_karts.end(),
+        m_karts.begin(), m_karts.end()) ||
+        !std::includes(client_tracks.begin(), client_tracks.end(),
+        m_tracks.begin(), m_tracks.end()))
+    {
+        refuseConnection(peer, LobbyProtocol::RR_INCOMPATIBLE_DATA);
+        return;
+    }
+
+    // Player count, spectators never play
+    data.getUInt8();
+    const uint32_t online_id = data.getUInt32();
+    const uint32_t encrypted_size = data.getUInt32();
+    // The relay doesn't validate players with the stk server
+    if (encrypted_size != 0)
+    {
+        refuseConnection(peer, LobbyProtocol::RR_INVALID_PLAYER);
+        return;
+    }
+    if (online_id != 0)
+    {
+        core::stringw online_name;
+        data.decodeStringW(&online_name);
+    }
+    std::string password;
+    data.decodeString(&password);
+    const std::string& server_password =
+        ServerConfig::m_private_server_password;
+    if (password != server_password)
+    {
+        refuseConnection(peer, LobbyProtocol::RR_INCORRECT_PASSWORD);
+        return;
+    }
+
+    spectator.m_state = SS_LOBBY;
+    sendToSpectator(peer, spectator, *m_server_info);
+    ServerMessages::ConnectionAccepted accepted = m_server_accepted;
+    accepted.m_host_id = spectator.m_host_id;
+    // No auto start timer, chat nor player reports for spectators
+    accepted.m_auto_start_timer = std::numeric_limits<float>::max();
+    accepted.m_chat = false;
+    accepted.m_report_player = false;
+    NetworkString accepted_message(PROTOCOL_LOBBY_ROOM);
+    accepted_message.setSynchronous(true);
+    accepted_message.addUInt8(LobbyProtocol::LE_CONNECTION_ACCEPTED);
+    accepted.encode(&accepted_message);
+    sendToSpectator(peer, spectator, accepted_message);
+    sendToSpectator(peer, spectator, *m_player_list);
+    Log::info("SpectatorRelay", "%s with %s is spectating with host id %d.",
+        TransportAddress(peer->address).toString().c_str(),
+        user_version.c_str(), spectator.m_host_id);
+}   // handleConnectionRequest
+
+// ----------------------------------------------------------------------------
+void SpectatorRelay::refuseConnection(ENetPeer* peer, uint8_t reason)
+{
+    NetworkString ns(PROTOCOL_LOBBY_ROOM);
+    ns.setSynchronous(true);
+    ns.addUInt8(LobbyProtocol::LE_CONNECTION_REFUSED).addUInt8(reason);
+    ENetPacket* packet = enet_packet_create(ns.getData(), ns.getTotalSize(),
+        ENET_PACKET_FLAG_RELIABLE);
+    if (packet &&
+        enet_peer_send(peer, EVENT_CHANNEL_UNENCRYPTED, packet) < 0)
+        enet_packet_destroy(packet);
+    enet_peer_disconnect_later(peer, PDI_NORMAL);
+    Log::verbose("SpectatorRelay", "Spectator refused with reason %d.",
+        reason);
+}   // refuseConnection
+
+// ----------------------------------------------------------------------------
+/** Sends a spectator back to the lobby, like ServerLobby::rejectLiveJoin. */
+void SpectatorRelay::sendBackLobby(ENetPeer* peer, Spectator& spectator,
+                                   uint8_t reason)
+{
+    NetworkString ns(PROTOCOL_LOBBY_ROOM);
+    ns.setSynchronous(true);
+    ns.addUInt8(LobbyProtocol::LE_BACK_LOBBY).addUInt8(reason);
+    sendToSpectator(peer, spectator, ns);
+    sendToSpectator(peer, spectator, *m_player_list);
+    sendToSpectator(peer, spectator, *m_server_info);
+    spectator.m_state = SS_LOBBY;
+}   // sendBackLobby
+
+// ----------------------------------------------------------------------------
+/** Sends a lobby message reliable to one spectator. */
+void SpectatorRelay::sendToSpectator(ENetPeer* peer,
+                                     const Spectator& spectator,
+                                     const NetworkString& data)
+{
+    std::unique_ptr<NetworkString> compressed;
+    if (spectator.m_compression && data.isSynchronous())
+        compressed = data.compress(ServerConfig::m_compression_threshold);
+    const NetworkString& ns = compressed ? *compressed : data;
+    ENetPacket* packet = enet_packet_create(ns.getData(), ns.getTotalSize(),
+        ENET_PACKET_FLAG_RELIABLE);
+    if (packet && enet_peer_send(peer, EVENT_CHANNEL_NORMAL, packet) < 0)
+        enet_packet_destroy(packet);
+}   // sendToSpectator
+
+// ----------------------------------------------------------------------------
+void SpectatorRelay::sendToServer(const NetworkString& data, bool reliable)
+{
+    if (!m_server_peer)
+        return;
+    ENetPacket* packet = enet_packet_create(data.getData(),
+        data.getTotalSize(), reliable ? ENET_PACKET_FLAG_RELIABLE :
+        (ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT));
+    if (packet &&
+        enet_peer_send(m_server_peer, EVENT_CHANNEL_NORMAL, packet) < 0)
+        enet_packet_destroy(packet);
+}   // sendToServer
+
+// ----------------------------------------------------------------------------
+/** Asks the server for a live join world, unless a request of another
+ *  spectator is still pending.
+ */
+void SpectatorRelay::requestLiveJoin()
+{
+    if (m_live_join_requested)
+        return;
+    NetworkString ns(PROTOCOL_LOBBY_ROOM);
+    ns.setSynchronous(true);
+    // Always as spectator
+    ns.addUInt8(LobbyProtocol::LE_LIVE_JOIN).addUInt8(1);
+    sendToServer(ns, /*reliable*/true);
+    m_requests.push_back(RT_LIVE_JOIN);
+    m_live_join_requested = true;
+}   // requestLiveJoin
+
+// ----------------------------------------------------------------------------
+/** Asks the server for a snapshot of the running game, which is answered
+ *  with a live join acknowledgement. All spectators which have loaded the
+ *  world when it is released use the same snapshot.
+ */
+void SpectatorRelay::requestSnapshot()
+{
+    if (m_snapshot_requested)
+        return;
+    NetworkString ns(PROTOCOL_LOBBY_ROOM);
+    ns.setSynchronous(true);
+    ns.addUInt8(LobbyProtocol::LE_CLIENT_LOADED_WORLD);
+    sendToServer(ns, /*reliable*/true);
+    m_requests.push_back(RT_SNAPSHOT);
+    m_snapshot_requested = true;
+}   // requestSnapshot
+
+// ----------------------------------------------------------------------------
+/** Confirms the item events to the server which all watching spectators
+ *  have confirmed. The confirmation is held back while a snapshot is on its
+ *  way to spectators, or while they still watch a previous game.
+ */
+void SpectatorRelay::updateItemConfirmation()
+{
+    if (!m_in_game || m_snapshot_requested)
+        return;
+    uint32_t ticks = m_last_state_ticks;
+    for (auto& s : m_spectators)
+    {
+        if (s.second.m_state != SS_IN_GAME)
+            continue;
+        if (m_released_game_id != m_game_id)
+            return;
+        ticks = std::min(ticks, s.second.m_confirmed_ticks);
+    }
+    if (ticks <= m_sent_confirmation)
+        return;
+    m_sent_confirmation = ticks;
+    NetworkString ns(PROTOCOL_CONTROLLER_EVENTS);
+    ns.addUInt8(GameProtocol::GP_ITEM_CONFIRMATION).addUInt32(ticks);
+    sendToServer(ns, /*reliable*/false);
+}   // updateItemConfirmation
+
+// ----------------------------------------------------------------------------
+/** Sends the messages of the server whose delay is over to the spectators,
+ *  and moves the spectators along the game. Each message is copied into
+ *  at most two enet packets (compressed or not), which are shared by all
+ *  spectators.
+ */
+void SpectatorRelay::releaseMessages()
+{
+    const uint64_t now = StkTime::getMonoTimeMs();
+    while (!m_queue.empty() && m_queue.front().m_release_time <= now)
+    {
+        QueuedMessage message = m_queue.front();
+        m_queue.pop_front();
+        const NetworkString& data = *message.m_data;
+        m_released_game_id = message.m_game_id;
+        if (message.m_route == ROUTE_NEW_GAME)
+            m_released_state_ticks = 0;
+        else if (message.m_state_ticks != 0)
+            m_released_state_ticks = message.m_state_ticks;
+
+        std::unique_ptr<NetworkString> compressed;
+        if (data.isSynchronous())
+            compressed = data.compress(ServerConfig::m_compression_threshold);
+        ENetPacket* packets[2] = { NULL, NULL };
+        const uint32_t flags = message.m_reliable ? ENET_PACKET_FLAG_RELIABLE
+            : (ENET_PACKET_FLAG_UNSEQUENCED |
+            ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT);
+
+        for (auto& s : m_spectators)
+        {
+            Spectator& spectator = s.second;
+            const SpectatorState state = spectator.m_state;
+            bool send = false;
+            switch (message.m_route)
+            {
+            case ROUTE_NONE:
+                break;
+            case ROUTE_ALL:
+                send = state != SS_CONNECTING;
+                break;
+            case ROUTE_LOBBY:
+                send = state != SS_CONNECTING && state != SS_IN_GAME;
+                break;
+            case ROUTE_GAME:
+                send = state == SS_IN_GAME;
+                break;
+            case ROUTE_NEW_GAME:
+                send = state == SS_LOBBY;
+                if (send)
+                {
+                    spectator.m_state = SS_IN_GAME;
+                    spectator.m_confirmed_ticks = 0;
+                }
+                break;
+            case ROUTE_BACK_LOBBY:
+                send = state != SS_CONNECTING;
+                if (send)
+                    spectator.m_state = SS_LOBBY;
+                break;
+            case ROUTE_LIVE_JOIN:
+                send = state == SS_LIVE_JOIN_REQUESTED;
+                if (send)
+                    spectator.m_state = SS_LIVE_LOADING;
+                break;
+            case ROUTE_LIVE_JOIN_REJECTED:
+                send = state == SS_LIVE_JOIN_REQUESTED;
+                break;
+            case ROUTE_SNAPSHOT:
+                send = state == SS_WAITING_SNAPSHOT;
+                if (send)
+                {
+                    spectator.m_state = SS_IN_GAME;
+                    spectator.m_confirmed_ticks = m_released_state_ticks;
+                }
+                break;
+            case ROUTE_SNAPSHOT_REJECTED:
+                send = state == SS_WAITING_SNAPSHOT;
+                break;
+            }
+            if (!send)
+                continue;
+
+            const bool use_compressed = compressed && spectator.m_compression;
+            const NetworkString& ns = use_compressed ? *compressed : data;
+            ENetPacket*& packet = packets[use_compressed ? 1 : 0];
+            if (!packet)
+            {
+                packet = enet_packet_create(ns.getData(), ns.getTotalSize(),
+                    flags);
+            }
+            if (packet)
+                enet_peer_send(s.first, EVENT_CHANNEL_NORMAL, packet);
+
+            if (message.m_route == ROUTE_LIVE_JOIN_REJECTED ||
+                message.m_route == ROUTE_SNAPSHOT_REJECTED)
+            {
+                // The server info of the rejection was not queued
+                sendToSpectator(s.first, spectator, *m_server_info);
+                spectator.m_state = SS_LOBBY;
+            }
+        }
+        for (ENetPacket* packet : packets)
+        {
+            if (packet && packet->referenceCount == 0)
+                enet_packet_destroy(packet);
+        }
+
+        if (message.m_route == ROUTE_LIVE_JOIN ||
+            message.m_route == ROUTE_LIVE_JOIN_REJECTED)
+            m_live_join_requested = false;
+        else if (message.m_route == ROUTE_SNAPSHOT ||
+            message.m_route == ROUTE_SNAPSHOT_REJECTED)
+        {
+            m_snapshot_requested = false;
+            updateItemConfirmation();
+        }
+    }
+}   // releaseMessages
+
+// ----------------------------------------------------------------------------
+/** Sends ping packets to the spectators which don't watch a game, with the
+ *  network timer of the server minus the delay, so that the times in the
+ *  delayed messages match the timer of the spectators.
+ */
+void SpectatorRelay::sendPings()
+{
+    const uint64_t now = StkTime::getMonoTimeMs();
+    if (!m_timer_synchronised || now < m_next_ping_time)
+        return;
+    // 10 packets per second like STKHost, for accurate pings by enet
+    m_next_ping_time = now + 100;
+    const uint64_t network_timer = getNetworkTimer() - m_delay;
+
+    for (auto& s : m_spectators)
+    {
+        const Spectator& spectator = s.second;
+        if (spectator.m_state == SS_CONNECTING ||
+            spectator.m_state == SS_IN_GAME)
+            continue;
+        // Enet needs some time for an accurate round trip, see
+        // STKPeer::getPing
+        const uint32_t ping_ms = now < spectator.m_connected_time + 3000 ?
+            0 : s.first->roundTripTime;
+        ServerMessages::PingPacket ping;
+        ping.m_server_time = network_timer;
+        // Only 255 pings can be sent, the one of the spectator comes last
+        // as its host id is larger than the ones of the server
+        auto it = m_server_pings.begin();
+        for (size_t i = 0; i < 254 && it != m_server_pings.end(); i++, it++)
+            ping.m_pings.insert(*it);
+        ping.m_pings[spectator.m_host_id] = ping_ms;
+        ping.m_remaining_time = m_remaining_time;
+        ping.m_progress = m_progress;
+        ping.m_current_track = m_current_track;
+        BareNetworkString ping_packet;
+        ping.encode(&ping_packet);
+
+        ENetPacket* packet = enet_packet_create(ping_packet.getData(),
+            ping_packet.getTotalSize(), ENET_PACKET_FLAG_RELIABLE);
+        if (packet &&
+            enet_peer_send(s.first, EVENT_CHANNEL_UNENCRYPTED, packet) < 0)
+            enet_packet_destroy(packet);
+    }
+}   // sendPings
@@ -0,0 +1,268 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SPECTATOR_RELAY_HPP
+#define HEADER_SPECTATOR_RELAY_HPP
+
+#include "network/server_messages.hpp"
+#include "network/transport_address.hpp"
+#include "utils/no_copy.hpp"
+#include "utils/types.hpp"
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+class Network;
+class NetworkString;
+typedef struct _ENetEvent ENetEvent;
+typedef struct _ENetPeer ENetPeer;
+
+/** A relay connects to a game server like a client without players, and
+ *  spectates every game there. The lobby messages and the game state it
+ *  receives are forwarded (optionally delayed) to any number of spectators
+ *  connected to the relay, so that a tournament can be watched by many
+ *  people without adding load to the game server. Spectators connect with
+ *  a normal client (e.g. with --connect-now), the relay answers their
+ *  connection and live join requests itself and only asks the server for a
+ *  world snapshot when spectators join a running game, once for all
+ *  spectators loading at the same time.
+ *  The server recognises the relay by its "relay" network capability (see
+ *  STKPeer::isRelay), so the relay never becomes server owner and the
+ *  server doesn't wait for it when loading or showing the results.
+ *  As the relay connects without players, it is refused (RR_INVALID_PLAYER,
+ *  see ServerLobby::connectionRequested) by ranked servers, which require
+ *  exactly one player with an online id per connection, and by WAN servers
+ *  validating players, unless the relay runs on the same machine or in the
+ *  LAN of the server.
+ *  The messages which the relay decodes are shared with the client (see
+ *  ServerMessages), so that both follow any change of their format.
+ *  \ingroup network
+ */
+class SpectatorRelay : public NoCopy
+{
+public:
+    /** Which spectators receive a message from the server, when it is
+     *  released from the delay queue. */
+    enum Route : uint8_t
+    {
+        ROUTE_NONE,              //!< Only handled by the relay.
+        ROUTE_ALL,               //!< All spectators.
+        ROUTE_LOBBY,             //!< Spectators not watching a game.
+        ROUTE_GAME,              //!< Spectators watching the game.
+        ROUTE_NEW_GAME,          //!< Spectators in lobby, start watching.
+        ROUTE_BACK_LOBBY,        //!< All spectators, go back to lobby.
+        ROUTE_LIVE_JOIN,         //!< Spectators which requested a live join.
+        ROUTE_LIVE_JOIN_REJECTED,//!< Same, but the server rejected it.
+        ROUTE_SNAPSHOT,          //!< Spectators which loaded the world.
+        ROUTE_SNAPSHOT_REJECTED  //!< Same, but the server rejected it.
+    };
+
+private:
+    enum SpectatorState : uint8_t
+    {
+        SS_CONNECTING,
+        SS_LOBBY,
+        SS_LIVE_JOIN_REQUESTED,
+        SS_LIVE_LOADING,
+        SS_WAITING_SNAPSHOT,
+        SS_IN_GAME
+    };
+
+    struct Spectator
+    {
+        uint32_t m_host_id;
+        SpectatorState m_state;
+        bool m_compression;
+        /** Last item event ticks confirmed by this spectator. */
+        uint32_t m_confirmed_ticks;
+        uint64_t m_connected_time;
+    };
+
+    /** A message from the server waiting for its release time. */
+    struct QueuedMessage
+    {
+        uint64_t m_release_time;
+        Route m_route;
+        bool m_reliable;
+        /** Game the message belongs to, see m_game_id. */
+        uint32_t m_game_id;
+        /** Ticks of a state, used for the item confirmation of spectators
+         *  which start watching. */
+        uint32_t m_state_ticks;
+        std::shared_ptr<NetworkString> m_data;
+    };
+
+    /** Requests sent to the server for spectators, the server answers them
+     *  in order. */
+    enum RequestType : uint8_t
+    {
+        RT_LIVE_JOIN,
+        RT_SNAPSHOT
+    };
+
+    static std::atomic_bool m_abort;
+
+    TransportAddress m_server_address;
+
+    uint16_t m_port;
+
+    unsigned m_max_spectators;
+
+    uint64_t m_delay;
+
+    Network* m_upstream;
+
+    Network* m_downstream;
+
+    ENetPeer* m_server_peer;
+
+    /** Host id given by the server to this relay. */
+    uint32_t m_host_id;
+
+    /** Host id given to the next spectator, spectators get ids from a range
+     *  which is not used by the server. */
+    uint32_t m_next_host_id;
+
+    bool m_accepted;
+
+    /** If a game is running on the server, according to the player list. */
+    bool m_game_started;
+
+    /** If the server sends the game state to the relay. */
+    bool m_in_game;
+
+    /** If the relay is live joining the running game by itself. */
+    bool m_self_joining;
+
+    /** True until the answer to the last live join or snapshot request is
+     *  released, so that spectators joining at the same time share one
+     *  request. */
+    bool m_live_join_requested, m_snapshot_requested;
+
+    /** If the server info following a rejected live join is not forwarded,
+     *  the relay sends it with the rejection itself. */
+    bool m_skip_server_info;
+
+    std::deque<RequestType> m_requests;
+
+    std::deque<QueuedMessage> m_queue;
+
+    std::map<ENetPeer*, Spectator> m_spectators;
+
+    /** Latest lobby messages of the server, sent to new spectators. */
+    std::shared_ptr<NetworkString> m_server_info, m_player_list;
+
+    /** Connection accepted message of the server, forwarded to spectators
+     *  with their own host id. */
+    ServerMessages::ConnectionAccepted m_server_accepted;
+
+    /** Karts and tracks announced to the server, spectators need all of
+     *  them as the server may pick any. */
+    std::set<std::string> m_karts, m_tracks;
+
+    /** The network timer of the server is the monotonic time plus this
+     *  offset, taken from the ping packet with the lowest round trip. */
+    int64_t m_timer_offset;
+
+    uint32_t m_timer_ping;
+
+    uint64_t m_timer_sample_time;
+
+    bool m_timer_synchronised;
+
+    /** Pings of the players and progress of the game from the last ping
+     *  packet of the server. */
+    std::map<uint32_t, uint32_t> m_server_pings;
+
+    uint32_t m_remaining_time, m_progress;
+
+    std::string m_current_track;
+
+    /** Counts the games the relay joined when received and when released,
+     *  the item events of a game can only be confirmed once all spectators
+     *  are watching it. */
+    uint32_t m_game_id, m_released_game_id;
+
+    /** Ticks of the last state received and released. */
+    uint32_t m_last_state_ticks, m_released_state_ticks;
+
+    /** Last item confirmation sent to the server. */
+    uint32_t m_sent_confirmation;
+
+    uint64_t m_next_ping_time, m_next_self_join_time;
+
+    // ------------------------------------------------------------------------
+    bool connectToServer();
+    // ------------------------------------------------------------------------
+    void handleServerEvent(ENetEvent& event);
+    // ------------------------------------------------------------------------
+    Route handleServerLobbyMessage(
+                               const std::shared_ptr<NetworkString>& data);
+    // ------------------------------------------------------------------------
+    void handleServerPing(const uint8_t* data, size_t length);
+    // ------------------------------------------------------------------------
+    void handleSpectatorEvent(ENetEvent& event);
+    // ------------------------------------------------------------------------
+    void handleSpectatorMessage(ENetPeer* peer, Spectator& spectator,
+                                NetworkString& data);
+    // ------------------------------------------------------------------------
+    void handleConnectionRequest(ENetPeer* peer, Spectator& spectator,
+                                 NetworkString& data);
+    // ------------------------------------------------------------------------
+    void releaseMessages();
+    // ------------------------------------------------------------------------
+    void sendToSpectator(ENetPeer* peer, const Spectator& spectator,
+                         const NetworkString& data);
+    // ------------------------------------------------------------------------
+    void sendToServer(const NetworkString& data, bool reliable);
+    // ------------------------------------------------------------------------
+    void sendBackLobby(ENetPeer* peer, Spectator& spectator, uint8_t reason);
+    // ------------------------------------------------------------------------
+    void refuseConnection(ENetPeer* peer, uint8_t reason);
+    // ------------------------------------------------------------------------
+    void sendPings();
+    // ------------------------------------------------------------------------
+    void requestLiveJoin();
+    // ------------------------------------------------------------------------
+    void requestSnapshot();
+    // ------------------------------------------------------------------------
+    void updateItemConfirmation();
+    // ------------------------------------------------------------------------
+    void startGame();
+    // ------------------------------------------------------------------------
+    uint64_t getNetworkTimer() const;
+
+public:
+    // ------------------------------------------------------------------------
+    SpectatorRelay(const TransportAddress& server, uint16_t port,
+                   unsigned max_spectators, float delay);
+    // ------------------------------------------------------------------------
+    ~SpectatorRelay();
+    // ------------------------------------------------------------------------
+    void run();
+    // ------------------------------------------------------------------------
+    /** Stops the relay, can be called from a signal handler. */
+    static void requestAbort()                            { m_abort = true; }
+
+};   // SpectatorRelay
+
+#endif // HEADER_SPECTATOR_RELAY_HPP
@@ -0,0 +1,276 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/state_scheduler.hpp"
+
+#include "karts/abstract_kart.hpp"
+#include "modes/world.hpp"
+#include "network/server_config.hpp"
+#include "network/server_metrics.hpp"
+#include "network/stk_peer.hpp"
+#include "physics/btKart.hpp"
+#include "race/race_manager.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+const float StateScheduler::CLOSE_DISTANCE = 20.0f;
+const float StateScheduler::FAR_DISTANCE   = 80.0f;
+
+// ----------------------------------------------------------------------------
+StateScheduler::StateScheduler()
+{
+    reset(1, 1, 1);
+}   // StateScheduler
+
+// ----------------------------------------------------------------------------
+/** Resets the scheduler for a new game.
+ *  \param state_ticks Number of ticks between two state ticks.
+ *  \param max_divider Highest number of state ticks between two states sent
+ *         to a peer.
+ *  \param ticks_per_second Physics ticks per second.
+ */
+void StateScheduler::reset(int state_ticks, int max_divider,
+                           int ticks_per_second)
+{
+    m_peers.clear();
+    m_kart_divider.clear();
+    m_state_ticks = std::max(state_ticks, 1);
+    m_max_divider = std::max(max_divider, 1);
+    m_spectator_divider = 1;
+    m_ticks_per_second = std::max(ticks_per_second, 1);
+}   // reset
+
+// ----------------------------------------------------------------------------
+/** Returns the number of state ticks between two states for a kart, which
+ *  is the distance to the closest other kart scaled between CLOSE_DISTANCE
+ *  and FAR_DISTANCE.
+ *  \param busy If the kart is colliding or in an animation (explosion,
+ *         rescue ...), which always uses the highest rate.
+ */
+int StateScheduler::getDivider(float distance, bool busy, int max_divider)
+{
+    if (busy || distance <= CLOSE_DISTANCE)
+        return 1;
+    if (distance >= FAR_DISTANCE)
+        return max_divider;
+    const float f = (distance - CLOSE_DISTANCE) /
+        (FAR_DISTANCE - CLOSE_DISTANCE);
+    return std::min(1 + (int)(f * (max_divider - 1) + 0.5f), max_divider);
+}   // getDivider
+
+// ----------------------------------------------------------------------------
+/** Computes the divider of each kart of the world, called once per state
+ *  tick before isDue. Only linear races use lower rates, battle and soccer
+ *  arenas are small enough that all karts interact all the time.
+ */
+void StateScheduler::update()
+{
+    World* world = World::getWorld();
+    const unsigned num_karts = world->getNumKarts();
+    m_kart_divider.assign(num_karts, m_max_divider);
+    m_spectator_divider = m_max_divider;
+    if (!race_manager->isLinearRaceMode())
+    {
+        m_kart_divider.assign(num_karts, 1);
+        m_spectator_divider = 1;
+        return;
+    }
+
+    for (unsigned i = 0; i < num_karts; i++)
+    {
+        const AbstractKart* kart = world->getKart(i);
+        if (kart->isEliminated() || kart->hasFinishedRace())
+            continue;
+        const btKart* vehicle = kart->getVehicle();
+        const bool busy = kart->getKartAnimation() != NULL ||
+            vehicle->getCentralImpulseTicks() > 0 ||
+            vehicle->getTimedRotationTicks() > 0;
+        float nearest2 = std::numeric_limits<float>::max();
+        for (unsigned j = 0; j < num_karts && !busy; j++)
+        {
+            const AbstractKart* other = world->getKart(j);
+            if (i == j || other->isEliminated() || other->hasFinishedRace())
+                continue;
+            nearest2 = std::min(nearest2,
+                (other->getXYZ() - kart->getXYZ()).length2());
+        }
+        m_kart_divider[i] = getDivider(busy ? 0.0f : sqrtf(nearest2), busy,
+            m_max_divider);
+        m_spectator_divider = std::min(m_spectator_divider,
+            m_kart_divider[i]);
+    }
+}   // update
+
+// ----------------------------------------------------------------------------
+/** Returns if a state should be sent to a peer at the given ticks.
+ *  \param divider Number of state ticks between two states for the peer.
+ *  \param throttle The packet throttle of ENet for the peer.
+ *  \param budget Bytes per second which can be sent, 0 if unlimited.
+ */
+bool StateScheduler::isDue(PeerSchedule* ps, int divider, uint32_t throttle,
+                           uint32_t budget, int ticks) const
+{
+    const int max_interval = m_state_ticks * m_max_divider;
+    int interval = m_state_ticks * divider;
+    // ENet lowers its throttle when the round trip time rises, which means
+    // that the connection is congested
+    if (throttle < ENET_PEER_PACKET_THROTTLE_SCALE)
+    {
+        interval = interval * ENET_PEER_PACKET_THROTTLE_SCALE /
+            std::max(throttle, 1u);
+    }
+    interval = std::min(interval, max_interval);
+
+    if (budget > 0)
+    {
+        ps->m_tokens = std::min(ps->m_tokens + (float)budget *
+            (float)(ticks - ps->m_refill_ticks) / (float)m_ticks_per_second,
+            (float)budget);
+        ps->m_refill_ticks = ticks;
+    }
+    const int elapsed = ticks - ps->m_last_sent_ticks;
+    // The lowest rate is always kept, even if over budget
+    if (elapsed >= max_interval)
+        return true;
+    if (elapsed < interval)
+        return false;
+    return budget == 0 || ps->m_tokens > 0.0f;
+}   // isDue
+
+// ----------------------------------------------------------------------------
+/** Returns the bandwidth budget of a peer in bytes per second, 0 if
+ *  unlimited. */
+static uint32_t getBudget(STKPeer* peer)
+{
+    const int config_budget = ServerConfig::m_state_bandwidth_budget;
+    uint32_t budget = config_budget > 0 ? (uint32_t)config_budget : 0;
+    const uint32_t reported = peer->getReportedBandwidth();
+    if (reported > 0 && (budget == 0 || reported < budget))
+        budget = reported;
+    return budget;
+}   // getBudget
+
+// ----------------------------------------------------------------------------
+bool StateScheduler::isDue(STKPeer* peer, int ticks)
+{
+    const uint32_t budget = getBudget(peer);
+    auto it = m_peers.find(peer->getHostId());
+    if (it == m_peers.end())
+    {
+        PeerSchedule ps;
+        ps.m_last_sent_ticks = ticks - m_state_ticks * m_max_divider;
+        ps.m_refill_ticks = ticks;
+        ps.m_tokens = (float)budget;
+        it = m_peers.insert(std::make_pair(peer->getHostId(), ps)).first;
+    }
+
+    int divider = m_spectator_divider;
+    const std::set<unsigned>& kart_ids = peer->getAvailableKartIDs();
+    if (!kart_ids.empty())
+    {
+        divider = m_max_divider;
+        for (unsigned id : kart_ids)
+        {
+            if (id < m_kart_divider.size())
+                divider = std::min(divider, m_kart_divider[id]);
+        }
+    }
+    return isDue(&it->second, divider, peer->getPacketThrottle(), budget,
+        ticks);
+}   // isDue
+
+// ----------------------------------------------------------------------------
+/** Called after a state of the given size was sent to a peer. */
+void StateScheduler::onStateSent(STKPeer* peer, int ticks, unsigned size)
+{
+    auto it = m_peers.find(peer->getHostId());
+    if (it == m_peers.end())
+        return;
+    PeerSchedule& ps = it->second;
+    ServerMetrics::add(ServerMetrics::SM_STATE_INTERVAL,
+        (ticks - ps.m_last_sent_ticks) * 1000 / m_ticks_per_second);
+    ps.m_last_sent_ticks = ticks;
+    ps.m_tokens -= (float)size;
+}   // onStateSent
+
+// ----------------------------------------------------------------------------
+/** Removes the schedule of peers which are not in the given list anymore. */
+void StateScheduler::removeMissingPeers(const std::vector<uint32_t>& host_ids)
+{
+    for (auto it = m_peers.begin(); it != m_peers.end();)
+    {
+        if (std::find(host_ids.begin(), host_ids.end(), it->first) ==
+            host_ids.end())
+            it = m_peers.erase(it);
+        else
+            it++;
+    }
+}   // removeMissingPeers
+
+// ----------------------------------------------------------------------------
+/** Checks the dividers for distances, the longer intervals on congestion and
+ *  that the bandwidth budget lowers the rate but never below the lowest.
+ */
+void StateScheduler::unitTesting()
+{
+    assert(getDivider(5.0f, false, 4) == 1);
+    assert(getDivider(CLOSE_DISTANCE, false, 4) == 1);
+    assert(getDivider(200.0f, false, 4) == 4);
+    assert(getDivider(200.0f, true, 4) == 1);
+    const int mid = getDivider((CLOSE_DISTANCE + FAR_DISTANCE) / 2.0f, false,
+        4);
+    assert(mid > 1 && mid < 4);
+    (void)mid;
+
+    // 120 ticks per second, at most 10 and at least 2.5 states per second
+    StateScheduler s;
+    s.reset(12, 4, 120);
+    const uint32_t full = ENET_PEER_PACKET_THROTTLE_SCALE;
+    PeerSchedule ps;
+    ps.m_last_sent_ticks = 0;
+    ps.m_refill_ticks = 0;
+    ps.m_tokens = 0.0f;
+    assert(!s.isDue(&ps, 1, full, 0, 11));
+    assert(s.isDue(&ps, 1, full, 0, 12));
+    assert(!s.isDue(&ps, 2, full, 0, 12));
+    assert(s.isDue(&ps, 2, full, 0, 24));
+    // Half throttle doubles the interval
+    assert(!s.isDue(&ps, 1, full / 2, 0, 12));
+    assert(s.isDue(&ps, 1, full / 2, 0, 24));
+    // Never longer than the lowest rate
+    assert(s.isDue(&ps, 4, 1, 0, 48));
+
+    // 500 bytes per second, after a state of 1000 bytes the bucket is
+    // empty for 2 seconds, but the lowest rate still sends every 48 ticks
+    ps.m_last_sent_ticks = 0;
+    ps.m_refill_ticks = 0;
+    ps.m_tokens = 500.0f - 1000.0f;
+    assert(!s.isDue(&ps, 1, full, 500, 12));
+    assert(!s.isDue(&ps, 1, full, 500, 36));
+    assert(s.isDue(&ps, 1, full, 500, 48));
+    ps.m_last_sent_ticks = 48;
+    assert(!s.isDue(&ps, 1, full, 500, 60));
+    // The bucket is filled with 500 bytes per second
+    assert(s.isDue(&ps, 1, full, 500, 84));
+    assert(ps.m_tokens > 0.0f && ps.m_tokens <= 500.0f);
+    (void)full;
+    (void)ps;
+}   // unitTesting
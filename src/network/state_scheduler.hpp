@@ -0,0 +1,99 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_STATE_SCHEDULER_HPP
+#define HEADER_STATE_SCHEDULER_HPP
+
+#include "utils/types.hpp"
+
+#include <map>
+#include <vector>
+
+class STKPeer;
+
+/** Decides on a server which peers get the state saved at a state tick if
+ *  the adaptive-state-frequency server option is enabled. The state tick
+ *  interval (from state-frequency) is the highest rate, which is used for
+ *  peers whose karts are close to other karts or colliding. Karts further
+ *  away or finished get less states, down to min-state-frequency. The rate
+ *  is lowered too when ENet detects congestion for a peer, and a token
+ *  bucket keeps the states within the bandwidth budget of each peer.
+ *  Clients keep saving their local state at every state tick, so they
+ *  don't need to know which states are left out.
+ *  \ingroup network
+ */
+class StateScheduler
+{
+public:
+    /** Karts closer than this to another kart get the highest rate. */
+    static const float CLOSE_DISTANCE;
+    /** Karts further away than this from all other karts get the lowest
+     *  rate. */
+    static const float FAR_DISTANCE;
+
+private:
+    struct PeerSchedule
+    {
+        int m_last_sent_ticks;
+        /** Ticks at which the bucket was last filled. */
+        int m_refill_ticks;
+        /** Bytes which can still be sent, can be negative after a large
+         *  state. */
+        float m_tokens;
+    };
+    std::map<uint32_t, PeerSchedule> m_peers;
+
+    /** For each kart the number of state ticks between two states for it,
+     *  1 being the highest rate. */
+    std::vector<int> m_kart_divider;
+
+    /** Divider used for peers without karts, e.g. spectators. */
+    int m_spectator_divider;
+
+    /** Divider of the lowest rate (min-state-frequency). */
+    int m_max_divider;
+
+    /** Number of ticks between two state ticks. */
+    int m_state_ticks;
+
+    int m_ticks_per_second;
+
+    // ------------------------------------------------------------------------
+    bool isDue(PeerSchedule* ps, int divider, uint32_t throttle,
+               uint32_t budget, int ticks) const;
+
+public:
+    StateScheduler();
+    // ------------------------------------------------------------------------
+    void reset(int state_ticks, int max_divider, int ticks_per_second);
+    // ------------------------------------------------------------------------
+    static int getDivider(float distance, bool busy, int max_divider);
+    // ------------------------------------------------------------------------
+    void update();
+    // ------------------------------------------------------------------------
+    bool isDue(STKPeer* peer, int ticks);
+    // ------------------------------------------------------------------------
+    void onStateSent(STKPeer* peer, int ticks, unsigned size);
+    // ------------------------------------------------------------------------
+    void removeMissingPeers(const std::vector<uint32_t>& host_ids);
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // StateScheduler
+
+#endif // HEADER_STATE_SCHEDULER_HPP
@@ -28,10 +28,14 @@
 #include "network/network_player_profile.hpp"
 #include "network/network_string.hpp"
 #include "network/network_timer_synchronizer.hpp"
+#include "network/packet_buffer_pool.hpp"
+#include "network/parallel_packet_sender.hpp"
 #include "network/protocols/connect_to_peer.hpp"
 #include "network/protocols/server_lobby.hpp"
 #include "network/protocol_manager.hpp"
 #include "network/server_config.hpp"
+#include "network/server_messages.hpp"
+#include "network/server_metrics.hpp"
 #include "network/stk_peer.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
@@ -226,26 +230,9 @@ std::shared_ptr<LobbyProtocol> STKHost::create(SeparateProcess* p)
  *  remote players). It will also start the RaceEventManager and then load the
  *  world.
  *
- *  Below you can see the definition of ping packet, it's a special packet that
- *  will be sent to each client waiting in lobby, the 1st byte is 255 so
- *  ProtocolManager won't handle it, after 5 bytes it comes with real data:
- *  1. Server time in uint64_t (for synchronization)
- *  2. Host id with ping to each client currently connected
- *  3. If game is currently started, 2 uint32_t which tell remaining time or
- *     progress in percent
- *  4. If game is currently started, the track internal identity
+ *  The ping packet, which is sent to each client waiting in lobby, is
+ *  described in ServerMessages::PingPacket.
  */
-// ============================================================================
-constexpr std::array<uint8_t, 5> g_ping_packet {{ 255, 'p', 'i', 'n', 'g' }};
-
-// ============================================================================
-constexpr bool isPingPacket(unsigned char* data, size_t length)
-{
-    return length > g_ping_packet.size() && data[0] == g_ping_packet[0] &&
-        data[1] == g_ping_packet[1] && data[2] == g_ping_packet[2] &&
-        data[3] == g_ping_packet[3] && data[4] == g_ping_packet[4];
-}   // isPingPacket
-
 // ============================================================================
 /** The constructor for a server or client.
  */
@@ -285,7 +272,11 @@ STKHost::STKHost(bool server)
     }
     setPrivatePort();
     if (server)
+    {
         Log::info("STKHost", "Server port is %d", m_private_port);
+        m_parallel_sender.reset(new ParallelPacketSender(
+            ParallelPacketSender::getDefaultWorkerCount()));
+    }
 }   // STKHost
 
 // ----------------------------------------------------------------------------
@@ -350,6 +341,9 @@ STKHost::~STKHost()
     }
     delete m_network;
     enet_deinitialize();
+    PacketBufferPool::clear();
+    NetworkString::clearPool();
+    Event::clearPool();
     delete m_separate_process;
 }   // ~STKHost
 
@@ -741,6 +735,12 @@ void STKHost::mainLoop()
                 getNetwork()->getENetHost()->totalReceivedData);
             getNetwork()->getENetHost()->totalSentData = 0;
             getNetwork()->getENetHost()->totalReceivedData = 0;
+            if (is_server)
+            {
+                std::lock_guard<std::mutex> lock(m_peers_mutex);
+                for (auto& p : m_peers)
+                    p.second->updateThrottle();
+            }
         }
 
         auto sl = LobbyProtocol::get<ServerLobby>();
@@ -778,8 +778,14 @@ void STKHost::mainLoop()
                 m_peer_pings.getData().clear();
                 for (auto& p : m_peers)
                 {
-                    m_peer_pings.getData()[p.second->getHostId()] =
-                        p.second->getPing();
+                    const uint32_t ping = p.second->getPing();
+                    m_peer_pings.getData()[p.second->getHostId()] = ping;
+                    if (ping != 0)
+                    {
+                        ServerMetrics::add(ServerMetrics::SM_PEER_RTT, ping);
+                        ServerMetrics::add(ServerMetrics::SM_PEER_JITTER,
+                            p.second->getJitter());
+                    }
                     const unsigned ap = p.second->getAveragePing();
                     const unsigned max_ping = ServerConfig::m_max_ping;
                     if (p.second->isValidated() &&
@@ -822,31 +828,19 @@ void STKHost::mainLoop()
                         }
                     }
                 }
-                uint64_t network_timer = getNetworkTimer();
-                ping_packet.addUInt64(network_timer);
-                ping_packet.addUInt8((uint8_t)m_peer_pings.getData().size());
-                for (auto& p : m_peer_pings.getData())
-                    ping_packet.addUInt32(p.first).addUInt32(p.second);
+                ServerMessages::PingPacket ping;
+                ping.m_server_time = getNetworkTimer();
+                ping.m_pings = m_peer_pings.getData();
                 if (sl)
                 {
                     auto progress = sl->getGameStartedProgress();
-                    ping_packet.addUInt32(progress.first)
-                        .addUInt32(progress.second);
-                    std::string current_track;
+                    ping.m_remaining_time = progress.first;
+                    ping.m_progress = progress.second;
                     Track* t = sl->getPlayingTrack();
                     if (t)
-                        current_track = t->getIdent();
-                    ping_packet.encodeString(current_track);
-                }
-                else
-                {
-                    ping_packet.addUInt32(std::numeric_limits<uint32_t>::max())
-                        .addUInt32(std::numeric_limits<uint32_t>::max())
-                        .addUInt8(0);
+                        ping.m_current_track = t->getIdent();
                 }
-                ping_packet.getBuffer().insert(
-                    ping_packet.getBuffer().begin(), g_ping_packet.begin(),
-                    g_ping_packet.end());
+                ping.encode(&ping_packet);
             }
 
             for (auto it = m_peers.begin(); it != m_peers.end();)
@@ -971,7 +965,8 @@ void STKHost::mainLoop()
             }   // ENET_EVENT_TYPE_CONNECT
             else if (event.type == ENET_EVENT_TYPE_DISCONNECT)
             {
-                Log::flushBuffers();
+                // Don't block the listening thread on the log writer
+                Log::flushBuffers(/*wait*/false);
 
                 // If used a timeout waiting disconnect, exit now
                 if (m_exit_timeout.load() !=
@@ -996,59 +991,44 @@ void STKHost::mainLoop()
             if (!stk_event && m_peers.find(event.peer) != m_peers.end())
             {
                 auto& peer = m_peers.at(event.peer);
-                if (isPingPacket(event.packet->data, event.packet->dataLength))
+                if (ServerMessages::PingPacket::isPingPacket(
+                    event.packet->data, event.packet->dataLength))
                 {
                     if (!is_server)
                     {
-                        BareNetworkString ping_packet((char*)event.packet->data,
-                            (int)event.packet->dataLength);
-                        std::map<uint32_t, uint32_t> peer_pings;
-                        ping_packet.skip((int)g_ping_packet.size());
-                        uint64_t server_time = ping_packet.getUInt64();
-                        unsigned peer_size = ping_packet.getUInt8();
-                        for (unsigned i = 0; i < peer_size; i++)
-                        {
-                            unsigned host_id = ping_packet.getUInt32();
-                            unsigned ping = ping_packet.getUInt32();
-                            peer_pings[host_id] = ping;
-                        }
-                        const uint32_t client_ping =
-                            peer_pings.find(m_host_id) != peer_pings.end() ?
-                            peer_pings.at(m_host_id) : 0;
-                        uint32_t remaining_time =
-                            std::numeric_limits<uint32_t>::max();
-                        uint32_t progress =
-                            std::numeric_limits<uint32_t>::max();
-                        std::string current_track;
+                        // Use what could be decoded of an invalid packet,
+                        // the fields after it keep their defaults
+                        ServerMessages::PingPacket ping;
                         try
                         {
-                            remaining_time = ping_packet.getUInt32();
-                            progress = ping_packet.getUInt32();
-                            ping_packet.decodeString(&current_track);
+                            ping.decode(event.packet->data,
+                                event.packet->dataLength);
                         }
                         catch (std::exception& e)
                         {
-                            // For old server
-                            Log::debug("STKHost", "%s", e.what());
+                            Log::debug("STKHost", "Invalid ping packet: %s",
+                                e.what());
                         }
+                        const uint32_t client_ping = ping.getPing(m_host_id);
                         if (client_ping > 0)
                         {
                             assert(m_nts);
-                            m_nts->addAndSetTime(client_ping, server_time);
+                            m_nts->addAndSetTime(client_ping,
+                                ping.m_server_time);
                         }
                         if (need_ping_update)
                         {
                             m_peer_pings.lock();
-                            std::swap(m_peer_pings.getData(), peer_pings);
+                            std::swap(m_peer_pings.getData(), ping.m_pings);
                             m_peer_pings.unlock();
                             m_client_ping.store(client_ping,
                                 std::memory_order_relaxed);
                             if (lp)
                             {
-                                lp->setGameStartedProgress(
-                                    std::make_pair(remaining_time, progress));
-                                int idx = track_manager
-                                    ->getTrackIndexByIdent(current_track);
+                                lp->setGameStartedProgress(std::make_pair(
+                                    ping.m_remaining_time, ping.m_progress));
+                                int idx = track_manager->getTrackIndexByIdent(
+                                    ping.m_current_track);
                                 lp->storePlayingTrack(idx);
                             }
                         }
@@ -1236,11 +1216,13 @@ bool STKHost::isConnectedTo(const TransportAddress& peer)
 void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    m_broadcast_peers.clear();
+    for (auto& p : m_peers)
     {
         if (p.second->isValidated())
-            p.second->sendPacket(data, reliable);
+            m_broadcast_peers.push_back(p.second.get());
     }
+    sendBroadcast(data, reliable);
 }   // sendPacketToAllPeersInServer
 
 //-----------------------------------------------------------------------------
@@ -1251,11 +1233,13 @@ void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 void STKHost::sendPacketToAllPeers(NetworkString *data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    m_broadcast_peers.clear();
+    for (auto& p : m_peers)
     {
         if (p.second->isValidated() && !p.second->isWaitingForGame())
-            p.second->sendPacket(data, reliable);
+            m_broadcast_peers.push_back(p.second.get());
     }
+    sendBroadcast(data, reliable);
 }   // sendPacketToAllPeers
 
 //-----------------------------------------------------------------------------
@@ -1268,15 +1252,17 @@ void STKHost::sendPacketExcept(STKPeer* peer, NetworkString *data,
                                bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    m_broadcast_peers.clear();
+    for (auto& p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isSamePeer(peer) && p.second->isValidated() &&
             !p.second->isWaitingForGame())
         {
-            stk_peer->sendPacket(data, reliable);
+            m_broadcast_peers.push_back(stk_peer);
         }
     }
+    sendBroadcast(data, reliable);
 }   // sendPacketExcept
 
 //-----------------------------------------------------------------------------
@@ -1289,16 +1275,60 @@ void STKHost::sendPacketToAllPeersWith(std::function<bool(STKPeer*)> predicate,
                                        NetworkString* data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    m_broadcast_peers.clear();
+    for (auto& p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isValidated())
             continue;
         if (predicate(stk_peer))
-            stk_peer->sendPacket(data, reliable);
+            m_broadcast_peers.push_back(stk_peer);
     }
+    sendBroadcast(data, reliable);
 }   // sendPacketToAllPeersWith
 
+//-----------------------------------------------------------------------------
+/** Sends data to all peers in \ref m_broadcast_peers, encrypting the packets
+ *  in parallel on the server. \ref m_peers_mutex must be locked.
+ */
+void STKHost::sendBroadcast(NetworkString* data, bool reliable)
+{
+    // Compress large lobby messages only once for all peers supporting it
+    std::unique_ptr<NetworkString> compressed;
+    if (data->isSynchronous())
+        compressed = data->compress(ServerConfig::m_compression_threshold);
+    m_compressed_broadcast_peers.clear();
+    if (compressed)
+    {
+        auto it = std::stable_partition(m_broadcast_peers.begin(),
+            m_broadcast_peers.end(),
+            [](STKPeer* p) { return !p->supportsCompression(); });
+        m_compressed_broadcast_peers.assign(it, m_broadcast_peers.end());
+        m_broadcast_peers.erase(it, m_broadcast_peers.end());
+    }
+
+    // Compression was already tried above, the peers must not repeat it
+    // (if it didn't make the message smaller)
+    if (m_parallel_sender)
+    {
+        m_parallel_sender->send(m_broadcast_peers, data, reliable,
+            /*compress*/false);
+        if (compressed)
+        {
+            m_parallel_sender->send(m_compressed_broadcast_peers,
+                compressed.get(), reliable, /*compress*/false);
+        }
+        return;
+    }
+    for (STKPeer* peer : m_broadcast_peers)
+        peer->sendPacket(data, reliable, /*encrypted*/true, /*compress*/false);
+    for (STKPeer* peer : m_compressed_broadcast_peers)
+    {
+        peer->sendPacket(compressed.get(), reliable, /*encrypted*/true,
+            /*compress*/false);
+    }
+}   // sendBroadcast
+
 //-----------------------------------------------------------------------------
 /** Sends a message from a client to the server. */
 void STKHost::sendToServer(NetworkString *data, bool reliable)
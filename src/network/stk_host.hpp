@@ -45,11 +45,13 @@
 #include <set>
 #include <thread>
 #include <tuple>
+#include <vector>
 
 class GameSetup;
 class LobbyProtocol;
 class NetworkPlayerProfile;
 class NetworkTimerSynchronizer;
+class ParallelPacketSender;
 class Server;
 class ServerLobby;
 class SeparateProcess;
@@ -155,6 +157,16 @@ private:
 
     std::unique_ptr<NetworkTimerSynchronizer> m_nts;
 
+    /** Encrypts and sends broadcasts of the server in parallel. */
+    std::unique_ptr<ParallelPacketSender> m_parallel_sender;
+
+    /** Peers of the current broadcast, only used with \ref m_peers_mutex
+     *  locked, it is kept to avoid an allocation per broadcast. */
+    std::vector<STKPeer*> m_broadcast_peers;
+
+    /** Peers of the current broadcast which receive it compressed. */
+    std::vector<STKPeer*> m_compressed_broadcast_peers;
+
     // ------------------------------------------------------------------------
     STKHost(bool server);
     // ------------------------------------------------------------------------
@@ -167,6 +179,8 @@ private:
                                    std::map<std::string, uint64_t>& ctp);
     // ------------------------------------------------------------------------
     void mainLoop();
+    // ------------------------------------------------------------------------
+    void sendBroadcast(NetworkString* data, bool reliable);
 
 public:
     /** If a network console should be started. */
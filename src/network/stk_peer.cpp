@@ -23,6 +23,8 @@
 #include "network/event.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
+#include "network/packet_buffer_pool.hpp"
+#include "network/server_config.hpp"
 #include "network/stk_host.hpp"
 #include "network/transport_address.hpp"
 #include "utils/log.hpp"
@@ -40,6 +42,9 @@ STKPeer::STKPeer(ENetPeer *enet_peer, STKHost* host, uint32_t host_id)
     m_connected_time      = StkTime::getMonoTimeMs();
     m_validated.store(false);
     m_average_ping.store(0);
+    m_jitter.store(0.0f);
+    m_packet_throttle.store(ENET_PEER_PACKET_THROTTLE_SCALE);
+    m_reported_bandwidth.store(0);
     m_waiting_for_game.store(true);
     m_spectator.store(false);
     m_disconnected.store(false);
@@ -100,8 +105,11 @@ void STKPeer::reset()
  *  \param data The data to send.
  *  \param reliable If the data is sent reliable or not.
  *  \param encrypted If the data is sent encrypted or not.
+ *  \param compress If a synchronous message may be compressed, false if
+ *         the caller already tried (see STKHost::sendBroadcast).
  */
-void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
+void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted,
+                         bool compress)
 {
     if (m_disconnected.load())
         return;
@@ -112,6 +120,15 @@ void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
         a != m_peer_address)
         return;
 
+    // Large lobby messages are compressed if the other side supports it
+    std::unique_ptr<NetworkString> compressed;
+    if (compress && data->isSynchronous() && supportsCompression())
+    {
+        compressed = data->compress(ServerConfig::m_compression_threshold);
+        if (compressed)
+            data = compressed.get();
+    }
+
     ENetPacket* packet = NULL;
     if (m_crypto && encrypted)
     {
@@ -119,11 +136,12 @@ void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
     }
     else
     {
-        packet = enet_packet_create(data->getData(),
-            data->getTotalSize(), (reliable ?
-            ENET_PACKET_FLAG_RELIABLE :
+        packet = PacketBufferPool::createPacket(data->getTotalSize(),
+            (reliable ? ENET_PACKET_FLAG_RELIABLE :
             (ENET_PACKET_FLAG_UNSEQUENCED |
             ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)));
+        if (packet)
+            memcpy(packet->data, data->getData(), data->getTotalSize());
     }
 
     if (packet)
@@ -140,6 +158,48 @@ void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
     }
 }   // sendPacket
 
+//-----------------------------------------------------------------------------
+/** Returns if this peer can receive compressed messages, negotiated with the
+ *  "compression" network capability.
+ */
+bool STKPeer::supportsCompression() const
+{
+    if (NetworkConfig::get()->isServer())
+    {
+        return m_client_capabilities.find("compression") !=
+            m_client_capabilities.end();
+    }
+    const std::set<std::string>& caps =
+        NetworkConfig::get()->getServerCapabilities();
+    return caps.find("compression") != caps.end();
+}   // supportsCompression
+
+//-----------------------------------------------------------------------------
+/** Returns if compressed messages received from this peer are decompressed.
+ *  A server only accepts them from validated clients which offered the
+ *  "compression" capability. A client offers it itself and trusts the
+ *  server, whose capabilities may not be known yet when the first
+ *  compressed message arrives.
+ */
+bool STKPeer::acceptsCompressed() const
+{
+    if (!isValidated())
+        return false;
+    if (NetworkConfig::get()->isServer())
+        return supportsCompression();
+    return true;
+}   // acceptsCompressed
+
+//-----------------------------------------------------------------------------
+/** Copies the throttle values of the ENet peer, must be called from the
+ *  network thread (see STKHost::mainLoop).
+ */
+void STKPeer::updateThrottle()
+{
+    m_packet_throttle.store(m_enet_peer->packetThrottle);
+    m_reported_bandwidth.store(m_enet_peer->incomingBandwidth);
+}   // updateThrottle
+
 //-----------------------------------------------------------------------------
 /** Returns if the peer is connected or not.
  */
@@ -181,7 +241,17 @@ uint32_t STKPeer::getPing()
         // Average ping in 5 seconds
         // Frequency is 10 packets per second as seen in STKHost
         const unsigned ap = 10 * 5;
-        m_previous_pings.push_back(m_enet_peer->roundTripTime);
+        const uint32_t rtt = m_enet_peer->roundTripTime;
+        if (!m_previous_pings.empty())
+        {
+            // Smoothed difference of consecutive pings, like the
+            // interarrival jitter of RFC 3550
+            const uint32_t last = m_previous_pings.back();
+            const float diff = (float)(rtt > last ? rtt - last : last - rtt);
+            const float jitter = m_jitter.load();
+            m_jitter.store(jitter + (diff - jitter) / 16.0f);
+        }
+        m_previous_pings.push_back(rtt);
         while (m_previous_pings.size() > ap)
         {
             m_previous_pings.pop_front();
@@ -96,6 +96,15 @@ protected:
 
     std::atomic<uint32_t> m_average_ping;
 
+    /** Estimated jitter of the ping in ms, see getPing. */
+    std::atomic<float> m_jitter;
+
+    /** The packet throttle of ENet for this peer (out of
+     *  ENET_PEER_PACKET_THROTTLE_SCALE), which is lowered by ENet when the
+     *  round trip time rises, and the downstream bandwidth reported by the
+     *  client (0 if unlimited). Updated by the network thread. */
+    std::atomic<uint32_t> m_packet_throttle, m_reported_bandwidth;
+
     std::set<unsigned> m_available_kart_ids;
 
     std::string m_user_version;
@@ -110,7 +119,7 @@ public:
     ~STKPeer();
     // ------------------------------------------------------------------------
     void sendPacket(NetworkString *data, bool reliable = true,
-                    bool encrypted = true);
+                    bool encrypted = true, bool compress = true);
     // ------------------------------------------------------------------------
     void disconnect();
     // ------------------------------------------------------------------------
@@ -192,6 +201,15 @@ public:
     // ------------------------------------------------------------------------
     uint32_t getAveragePing() const           { return m_average_ping.load(); }
     // ------------------------------------------------------------------------
+    uint32_t getJitter() const           { return (uint32_t)m_jitter.load(); }
+    // ------------------------------------------------------------------------
+    void updateThrottle();
+    // ------------------------------------------------------------------------
+    uint32_t getPacketThrottle() const     { return m_packet_throttle.load(); }
+    // ------------------------------------------------------------------------
+    uint32_t getReportedBandwidth() const
+                                        { return m_reported_bandwidth.load(); }
+    // ------------------------------------------------------------------------
     ENetPeer* getENetPeer() const                       { return m_enet_peer; }
     // ------------------------------------------------------------------------
     void setWaitingForGame(bool val)         { m_waiting_for_game.store(val); }
@@ -241,6 +259,26 @@ public:
     // ------------------------------------------------------------------------
     const std::set<std::string>& getClientCapabilities() const
                                               { return m_client_capabilities; }
+    // ------------------------------------------------------------------------
+    bool supportsCompression() const;
+    // ------------------------------------------------------------------------
+    bool acceptsCompressed() const;
+    // ------------------------------------------------------------------------
+    /** Returns if this client can handle states which leave out distant
+     *  objects (see RewindManager::sendState). */
+    bool supportsPartialState() const
+    {
+        return m_client_capabilities.find("partial_state") !=
+            m_client_capabilities.end();
+    }
+    // ------------------------------------------------------------------------
+    /** Returns if this peer is a spectator relay (see SpectatorRelay), which
+     *  has no players and spectates every game to forward it. */
+    bool isRelay() const
+    {
+        return m_client_capabilities.find("relay") !=
+            m_client_capabilities.end();
+    }
 };   // STKPeer
 
 #endif // STK_PEER_HPP
@@ -179,6 +179,7 @@ namespace Online
         curl_easy_setopt(m_curl_session, CURLOPT_LOW_SPEED_LIMIT, 10);
         curl_easy_setopt(m_curl_session, CURLOPT_LOW_SPEED_TIME, 20);
         curl_easy_setopt(m_curl_session, CURLOPT_NOSIGNAL, 1);
+        curl_easy_setopt(m_curl_session, CURLOPT_TCP_KEEPALIVE, 1L);
         //curl_easy_setopt(m_curl_session, CURLOPT_VERBOSE, 1L);
 
         // https, load certificate info
@@ -199,26 +200,24 @@ namespace Online
     }   // prepareOperation
 
     // ------------------------------------------------------------------------
-    /** The actual curl download happens here.
+    /** Sets up where the received data is stored and the POST parameters of
+     *  the prepared curl session. Returns false if the file to download
+     *  into can not be opened.
      */
-    void HTTPRequest::operation()
+    bool HTTPRequest::openTransfer()
     {
-        if (!m_curl_session)
-            return;
-
-        FILE *fout = NULL;
         if (m_filename.size() > 0)
         {
-            fout = fopen((m_filename+".part").c_str(), "wb");
+            m_file = fopen((m_filename+".part").c_str(), "wb");
 
-            if (!fout)
+            if (!m_file)
             {
                 Log::error("HTTPRequest",
                            "Can't open '%s' for writing, ignored.",
                            (m_filename+".part").c_str());
-                return;
+                return false;
             }
-            curl_easy_setopt(m_curl_session,  CURLOPT_WRITEDATA,     fout  );
+            curl_easy_setopt(m_curl_session,  CURLOPT_WRITEDATA,     m_file);
             curl_easy_setopt(m_curl_session,  CURLOPT_WRITEFUNCTION, fwrite);
         }
         else
@@ -273,12 +272,21 @@ namespace Online
         const std::string& uagent = StringUtils::getUserAgentString();
         curl_easy_setopt(m_curl_session, CURLOPT_USERAGENT, uagent.c_str());
 
-        m_curl_code = curl_easy_perform(m_curl_session);
-        Request::operation();
+        return true;
+    }   // openTransfer
 
-        if (fout)
+    // ------------------------------------------------------------------------
+    /** Stores the result of the transfer, and if the data was downloaded
+     *  into a file, moves the file to its final name on success.
+     *  \param code The result of the curl transfer.
+     */
+    void HTTPRequest::closeTransfer(CURLcode code)
+    {
+        m_curl_code = code;
+        if (m_file)
         {
-            fclose(fout);
+            fclose(m_file);
+            m_file = NULL;
             if (m_curl_code == CURLE_OK)
             {
                 if(UserConfigParams::logAddons())
@@ -304,9 +312,58 @@ namespace Online
                     m_curl_code = CURLE_WRITE_ERROR;
                 }
             }   // m_curl_code ==CURLE_OK
-        }   // if fout
+        }   // if m_file
+    }   // closeTransfer
+
+    // ------------------------------------------------------------------------
+    /** The actual curl download happens here. This is only used when the
+     *  request is executed directly, the RequestManager runs the transfer
+     *  with its curl multi handle instead (see startMultiTransfer).
+     */
+    void HTTPRequest::operation()
+    {
+        if (!m_curl_session || !openTransfer())
+            return;
+
+        closeTransfer(curl_easy_perform(m_curl_session));
+        Request::operation();
     }   // operation
 
+    // ------------------------------------------------------------------------
+    /** Prepares this request to be transferred by a curl multi handle, and
+     *  returns its easy handle. If the request does not use a curl transfer
+     *  (e.g. a request that overwrites operation() for LAN discovery), or it
+     *  could not be set up, the request is executed completely here and NULL
+     *  is returned.
+     */
+    CURL* HTTPRequest::startMultiTransfer()
+    {
+        assert(isBusy());
+        // Abort as early as possible if abort is requested
+        if (isAborted()) return NULL;
+        prepareOperation();
+        if (isAborted()) return NULL;
+        if (!m_curl_session)
+            operation();
+        else if (openTransfer())
+            return m_curl_session;
+        finishExecution();
+        return NULL;
+    }   // startMultiTransfer
+
+    // ------------------------------------------------------------------------
+    /** Called by the RequestManager once the transfer started with
+     *  startMultiTransfer is finished (the easy handle must have been removed
+     *  from the multi handle already).
+     *  \param code The result of the curl transfer.
+     */
+    void HTTPRequest::finishMultiTransfer(CURLcode code)
+    {
+        closeTransfer(code);
+        Request::operation();
+        finishExecution();
+    }   // finishMultiTransfer
+
     // ------------------------------------------------------------------------
     /** Cleanup once the download is finished. The value of progress is
      *  guaranteed to be >=0 and <1 while the download is in progress, and
@@ -65,6 +65,9 @@ namespace Online
         /** Pointer to the curl data structure for this request. */
         CURL *m_curl_session = NULL;
 
+        /** The file the data is written to while downloading into a file. */
+        FILE *m_file = NULL;
+
         /** curl return code. */
         CURLcode m_curl_code;
 
@@ -72,6 +75,9 @@ namespace Online
         std::string m_string_buffer;
 
         static struct curl_slist* m_http_header;
+
+        bool openTransfer();
+        void closeTransfer(CURLcode code);
     protected:
         bool m_disable_sending_log;
 
@@ -95,6 +101,11 @@ namespace Online
                     int priority = 1);
         virtual           ~HTTPRequest()
         {
+            if (m_file)
+            {
+                fclose(m_file);
+                m_file = NULL;
+            }
             if (m_curl_session)
             {
                 curl_easy_cleanup(m_curl_session);
@@ -102,6 +113,8 @@ namespace Online
             }
         }
         virtual bool       isAllowedToAdd() const OVERRIDE;
+        CURL*              startMultiTransfer();
+        void               finishMultiTransfer(CURLcode code);
         void               setApiURL(const std::string& url, const std::string &action);
         void               setAddonsURL(const std::string& path);
 
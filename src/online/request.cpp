@@ -61,15 +61,34 @@ namespace Online
     {
         assert(isBusy());
         // Abort as early as possible if abort is requested
-        if (RequestManager::get()->getAbort() && isAbortable()) return;
+        if (isAborted()) return;
         prepareOperation();
-        if (RequestManager::get()->getAbort() && isAbortable()) return;
+        if (isAborted()) return;
         operation();
-        if (RequestManager::get()->getAbort() && isAbortable()) return;
+        finishExecution();
+    }   // execute
+
+    // ------------------------------------------------------------------------
+    /** Marks the request as executed and calls afterOperation, unless STK is
+     *  quitting and this request can be aborted. This is separate from
+     *  execute(), since a http request executed by the curl multi handle of
+     *  the RequestManager finishes its operation asynchronously.
+     */
+    void Request::finishExecution()
+    {
+        if (isAborted()) return;
         setExecuted();
-        if (RequestManager::get()->getAbort() && isAbortable()) return;
+        if (isAborted()) return;
         afterOperation();
-    }   // execute
+    }   // finishExecution
+
+    // ------------------------------------------------------------------------
+    /** Returns true if STK is quitting and this request should be aborted.
+     */
+    bool Request::isAborted() const
+    {
+        return RequestManager::get()->getAbort() && isAbortable();
+    }   // isAborted
 
     // ------------------------------------------------------------------------
     /** Executes the request now, i.e. in the main thread and without involving
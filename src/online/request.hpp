@@ -127,6 +127,11 @@ namespace Online
         /** Virtual function to be called after an operation. */
         virtual void afterOperation()   {}
 
+        // --------------------------------------------------------------------
+        bool isAborted() const;
+        // --------------------------------------------------------------------
+        void finishExecution();
+
     public:
         enum RequestType
         {
@@ -22,13 +22,20 @@
 
 #include "config/player_manager.hpp"
 #include "config/user_config.hpp"
+#include "online/http_request.hpp"
 #include "states_screens/state_manager.hpp"
 #include "utils/vs.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <mutex>
 #include <stdio.h>
 #include <memory.h>
 #include <errno.h>
+#include <thread>
+#include <vector>
 
 #if defined(WIN32) && !defined(__CYGWIN__)
 #  define WIN32_LEAN_AND_MEAN
@@ -36,6 +43,11 @@
 #else
 #  include <sys/time.h>
 #  include <math.h>
+#  include <arpa/inet.h>
+#  include <netinet/in.h>
+#  include <poll.h>
+#  include <sys/socket.h>
+#  include <unistd.h>
 #endif
 
 using namespace Online;
@@ -73,6 +85,9 @@ namespace Online
         m_game_polling_interval = 60;  // same for game polling
         m_time_since_poll       = m_menu_polling_interval;
         curl_global_init(CURL_GLOBAL_DEFAULT);
+        m_multi = curl_multi_init();
+        for (unsigned i = 0; i < LANE_COUNT; i++)
+            m_active_transfers[i] = 0;
         pthread_cond_init(&m_cond_request, NULL);
         m_abort.setAtomic(false);
     }   // RequestManager
@@ -85,6 +100,7 @@ namespace Online
         delete m_thread_id.getData();
         m_thread_id.unlock();
         pthread_cond_destroy(&m_cond_request);
+        curl_multi_cleanup(m_multi);
         curl_global_cleanup();
     }   // ~RequestManager
 
@@ -177,9 +193,13 @@ namespace Online
         m_request_queue.lock();
         m_request_queue.getData().push(request);
 
-        // Wake up the network http thread
+        // Wake up the network http thread, either waiting for a request
+        // or for the running transfers
         pthread_cond_signal(&m_cond_request);
         m_request_queue.unlock();
+#if LIBCURL_VERSION_NUM >= 0x074400
+        curl_multi_wakeup(m_multi);
+#endif
     }   // addRequest
 
     // ------------------------------------------------------------------------
@@ -193,44 +213,60 @@ namespace Online
         VS::setThreadName("RequestManager");
         RequestManager *me = (RequestManager*) obj;
 
-        me->m_current_request = NULL;
+        const long max_transfers =
+            std::max((int)UserConfigParams::m_max_http_connections, 1);
+        curl_multi_setopt(me->m_multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                          max_transfers);
+        curl_multi_setopt(me->m_multi, CURLMOPT_PIPELINING,
+                          CURLPIPE_MULTIPLEX);
+
         me->m_request_queue.lock();
-        while (me->m_request_queue.getData().empty() ||
-               me->m_request_queue.getData().top()->getType() != Request::RT_QUIT)
+        while (true)
         {
-            bool empty = me->m_request_queue.getData().empty();
-
-            // Wait in cond_wait for a request to arrive. The 'while' is necessary
-            // since "spurious wakeups from the pthread_cond_wait ... may occur"
-            // (pthread_cond_wait man page)!
-            while (empty)
+            // Start as many requests as the lanes allow. The quit request
+            // is only handled once all transfers are finished (a running
+            // sign-out must still be completed, all abortable transfers
+            // are aborted by the progress callback).
+            bool quit = false;
+            while (!me->m_request_queue.getData().empty())
             {
-                pthread_cond_wait(&me->m_cond_request, me->m_request_queue.getMutex());
-                empty = me->m_request_queue.getData().empty();
-            }
-            me->m_current_request = me->m_request_queue.getData().top();
-            me->m_request_queue.getData().pop();
-
-            if (me->m_current_request->getType() == Request::RT_QUIT)
+                Online::Request *request = me->m_request_queue.getData().top();
+                if (request->getType() == Request::RT_QUIT)
+                {
+                    quit = true;
+                    break;
+                }
+                if (!canStart(getLane(request->getPriority()),
+                              me->m_active_transfers, max_transfers))
+                    break;
+                me->m_request_queue.getData().pop();
+                me->m_request_queue.unlock();
+                me->startRequest(request);
+                me->m_request_queue.lock();
+            }   // while requests can be started
+
+            if (me->getActiveTransfers() == 0)
             {
-                delete me->m_current_request;
-                break;
+                if (quit)
+                    break;
+                // Wait in cond_wait for a request to arrive. A spurious
+                // wakeup just means that the loop is executed again.
+                if (me->m_request_queue.getData().empty())
+                {
+                    pthread_cond_wait(&me->m_cond_request,
+                                      me->m_request_queue.getMutex());
+                }
+                continue;
             }
 
             me->m_request_queue.unlock();
-            me->m_current_request->execute();
-            // This test is necessary in case that execute() was aborted
-            // (otherwise the assert in addResult will be triggered).
-            if (!me->getAbort())
-                me->addResult(me->m_current_request);
-            else if (me->m_current_request->manageMemory())
-            {
-                delete me->m_current_request;
-                me->m_current_request = NULL;
-            }
+            me->updateTransfers();
             me->m_request_queue.lock();
         } // while handle all requests
 
+        delete me->m_request_queue.getData().top();
+        me->m_request_queue.getData().pop();
+
         // Signal that the request manager can now be deleted.
         // We signal this even before cleaning up memory, since there's no
         // need to keep the user waiting for STK to exit.
@@ -252,6 +288,115 @@ namespace Online
         return 0;
     }   // mainLoop
 
+    // ------------------------------------------------------------------------
+    /** Returns if a transfer can be started in the given lane.
+     *  \param lane The lane of the request to start.
+     *  \param active Number of running transfers in each lane.
+     *  \param max_transfers Maximum number of concurrent transfers.
+     */
+    bool RequestManager::canStart(Lane lane, const unsigned active[LANE_COUNT],
+                                  unsigned max_transfers)
+    {
+        max_transfers = std::max(max_transfers, 1u);
+        if (active[LANE_BULK] + active[LANE_INTERACTIVE] >= max_transfers)
+            return false;
+        if (lane == LANE_INTERACTIVE)
+            return true;
+        // Always allow at least one bulk transfer
+        const unsigned max_bulk =
+            max_transfers > RESERVED_INTERACTIVE_TRANSFERS ?
+            max_transfers - RESERVED_INTERACTIVE_TRANSFERS : 1;
+        return active[LANE_BULK] < max_bulk;
+    }   // canStart
+
+    // ------------------------------------------------------------------------
+    /** Starts a request taken from the request queue. A http request is added
+     *  to the multi handle, any other request is executed immediately.
+     *  \param request The request to start.
+     */
+    void RequestManager::startRequest(Online::Request *request)
+    {
+        HTTPRequest *http_request = dynamic_cast<HTTPRequest*>(request);
+        if (!http_request)
+        {
+            request->execute();
+            finishRequest(request);
+            return;
+        }
+
+        CURL *handle = http_request->startMultiTransfer();
+        if (!handle)
+        {
+            // Request was executed or aborted already
+            finishRequest(request);
+            return;
+        }
+        curl_easy_setopt(handle, CURLOPT_PRIVATE, http_request);
+        CURLMcode code = curl_multi_add_handle(m_multi, handle);
+        if (code != CURLM_OK)
+        {
+            Log::error("RequestManager", "Can't start transfer: %s",
+                       curl_multi_strerror(code));
+            http_request->finishMultiTransfer(CURLE_FAILED_INIT);
+            finishRequest(request);
+            return;
+        }
+        m_active_transfers[getLane(request->getPriority())]++;
+    }   // startRequest
+
+    // ------------------------------------------------------------------------
+    /** Hands an executed request over to the main thread, or deletes it if
+     *  it was aborted.
+     *  \param request The request that was executed.
+     */
+    void RequestManager::finishRequest(Online::Request *request)
+    {
+        // This test is necessary in case that execute() was aborted
+        // (otherwise the assert in addResult will be triggered).
+        if (!getAbort())
+            addResult(request);
+        else if (request->manageMemory())
+            delete request;
+    }   // finishRequest
+
+    // ------------------------------------------------------------------------
+    /** Runs the transfers of the multi handle, finishes the ones that are
+     *  done, and waits a bit for more data (or a new request) to arrive.
+     */
+    void RequestManager::updateTransfers()
+    {
+        int running = 0;
+        curl_multi_perform(m_multi, &running);
+
+        CURLMsg *msg;
+        int msgs_left = 0;
+        while ((msg = curl_multi_info_read(m_multi, &msgs_left)) != NULL)
+        {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            // The message is freed when the handle is removed
+            CURL *handle = msg->easy_handle;
+            const CURLcode result = msg->data.result;
+            char *p = NULL;
+            curl_easy_getinfo(handle, CURLINFO_PRIVATE, &p);
+            HTTPRequest *request = (HTTPRequest*)p;
+            curl_multi_remove_handle(m_multi, handle);
+            m_active_transfers[getLane(request->getPriority())]--;
+            request->finishMultiTransfer(result);
+            finishRequest(request);
+        }
+
+        if (running > 0)
+        {
+#if LIBCURL_VERSION_NUM >= 0x074400
+            // addRequest wakes this up if a new request is added
+            curl_multi_poll(m_multi, NULL, 0, 1000, NULL);
+#else
+            curl_multi_wait(m_multi, NULL, 0, 50, NULL);
+#endif
+        }
+    }   // updateTransfers
+
     // ------------------------------------------------------------------------
     /** Inserts a request into the queue of results.
      *  \param request The pointer to the request to insert.
@@ -320,4 +465,329 @@ namespace Online
         }
 
     }   // update
+
+    // ------------------------------------------------------------------------
+    /** Checks that bulk downloads always leave transfers free for other
+     *  requests, and that the concurrency limit is respected.
+     */
+    void RequestManager::unitTesting()
+    {
+        assert(getLane(HTTP_MAX_PRIORITY) == LANE_INTERACTIVE);
+        assert(getLane(1) == LANE_INTERACTIVE);
+        assert(getLane(HTTP_BULK_PRIORITY) == LANE_BULK);
+
+        unsigned active[LANE_COUNT] = { 0, 0 };
+        // Fill the bulk lane
+        while (canStart(LANE_BULK, active, 6))
+            active[LANE_BULK]++;
+        assert(active[LANE_BULK] == 6 - RESERVED_INTERACTIVE_TRANSFERS);
+        // Interactive requests can still be started, up to the limit
+        while (canStart(LANE_INTERACTIVE, active, 6))
+            active[LANE_INTERACTIVE]++;
+        assert(active[LANE_INTERACTIVE] == RESERVED_INTERACTIVE_TRANSFERS);
+        assert(!canStart(LANE_BULK, active, 6));
+
+        // A finished bulk transfer can be replaced by an interactive one,
+        // which can use all transfers
+        active[LANE_BULK]--;
+        assert(canStart(LANE_INTERACTIVE, active, 6));
+        active[LANE_BULK] = 0;
+        active[LANE_INTERACTIVE] = 0;
+        while (canStart(LANE_INTERACTIVE, active, 6))
+            active[LANE_INTERACTIVE]++;
+        assert(active[LANE_INTERACTIVE] == 6);
+        assert(!canStart(LANE_BULK, active, 6));
+
+        // With a very low limit at least one bulk transfer is possible
+        active[LANE_INTERACTIVE] = 0;
+        assert(canStart(LANE_BULK, active, 0));
+        active[LANE_BULK] = 1;
+        assert(!canStart(LANE_BULK, active, 1));
+        assert(!canStart(LANE_INTERACTIVE, active, 1));
+
+#if !defined(WIN32) || defined(__CYGWIN__)
+        testLoopbackTransfers();
+#endif
+    }   // unitTesting
+
+#if !defined(WIN32) || defined(__CYGWIN__)
+    // ------------------------------------------------------------------------
+    namespace
+    {
+        /** A minimal HTTP/1.1 server on 127.0.0.1 for the unit test. Each
+         *  connection is handled in its own thread, keep-alive is supported.
+         *  Requests for a path starting with "/bulk" are answered after
+         *  BULK_DELAY, all others after INTERACTIVE_DELAY. The body of the
+         *  answer is the requested path.
+         */
+        class LoopbackHttpServer
+        {
+        public:
+            /** Delays of the answers in ms. */
+            enum { BULK_DELAY = 300, INTERACTIVE_DELAY = 10 };
+
+            /** Highest number of requests handled at the same time. */
+            std::atomic<int> m_max_in_flight;
+            /** Highest number of bulk requests handled at the same time. */
+            std::atomic<int> m_max_bulk_in_flight;
+
+        private:
+            int m_socket;
+            uint16_t m_port;
+            std::atomic<bool> m_stop;
+            std::atomic<int> m_in_flight;
+            std::atomic<int> m_bulk_in_flight;
+            std::thread m_accept_thread;
+            std::mutex m_connections_mutex;
+            std::vector<std::thread> m_connections;
+
+            // ----------------------------------------------------------------
+            /** Waits until \p fd is readable or the server is stopped. */
+            bool waitReadable(int fd) const
+            {
+                while (!m_stop.load())
+                {
+                    pollfd pfd;
+                    pfd.fd = fd;
+                    pfd.events = POLLIN;
+                    pfd.revents = 0;
+                    if (poll(&pfd, 1, 50) > 0)
+                        return true;
+                }
+                return false;
+            }   // waitReadable
+            // ----------------------------------------------------------------
+            void acceptLoop()
+            {
+                while (waitReadable(m_socket))
+                {
+                    const int fd = accept(m_socket, NULL, NULL);
+                    if (fd < 0)
+                        continue;
+                    std::lock_guard<std::mutex> lock(m_connections_mutex);
+                    m_connections.emplace_back(&LoopbackHttpServer::serve,
+                                               this, fd);
+                }
+            }   // acceptLoop
+            // ----------------------------------------------------------------
+            void serve(int fd)
+            {
+                std::string data;
+                char buffer[1024];
+                while (true)
+                {
+                    size_t header_end = data.find("\r\n\r\n");
+                    size_t content_length = 0;
+                    if (header_end != std::string::npos)
+                    {
+                        const size_t cl = data.find("Content-Length:");
+                        if (cl != std::string::npos && cl < header_end)
+                            content_length = atoi(data.c_str() + cl + 15);
+                    }
+                    if (header_end == std::string::npos ||
+                        data.size() < header_end + 4 + content_length)
+                    {
+                        if (!waitReadable(fd))
+                            break;
+                        const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+                        if (n <= 0)
+                            break;
+                        data.append(buffer, n);
+                        continue;
+                    }
+                    const size_t path_start = data.find(' ') + 1;
+                    const std::string path =
+                        data.substr(path_start,
+                                    data.find(' ', path_start) - path_start);
+                    data.erase(0, header_end + 4 + content_length);
+                    respond(fd, path);
+                }
+                close(fd);
+            }   // serve
+            // ----------------------------------------------------------------
+            void respond(int fd, const std::string &path)
+            {
+                const bool bulk = path.compare(0, 5, "/bulk") == 0;
+                updateMax(&m_max_in_flight, ++m_in_flight);
+                if (bulk)
+                    updateMax(&m_max_bulk_in_flight, ++m_bulk_in_flight);
+                std::this_thread::sleep_for(std::chrono::milliseconds(
+                    bulk ? BULK_DELAY : INTERACTIVE_DELAY));
+                const std::string answer = "HTTP/1.1 200 OK\r\n"
+                    "Content-Type: text/plain\r\nContent-Length: " +
+                    std::to_string(path.size()) + "\r\n\r\n" + path;
+                // Decrease before sending, the client can start the next
+                // request as soon as it has the answer
+                if (bulk)
+                    m_bulk_in_flight--;
+                m_in_flight--;
+                send(fd, answer.c_str(), answer.size(), 0);
+            }   // respond
+            // ----------------------------------------------------------------
+            static void updateMax(std::atomic<int> *max, int value)
+            {
+                int old = max->load();
+                while (value > old && !max->compare_exchange_weak(old, value))
+                {
+                }
+            }   // updateMax
+
+        public:
+            // ----------------------------------------------------------------
+            LoopbackHttpServer()
+                : m_max_in_flight(0), m_max_bulk_in_flight(0), m_port(0),
+                  m_stop(false), m_in_flight(0), m_bulk_in_flight(0)
+            {
+                m_socket = socket(AF_INET, SOCK_STREAM, 0);
+                sockaddr_in addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sin_family = AF_INET;
+                addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                addr.sin_port = 0;
+                socklen_t len = sizeof(addr);
+                if (m_socket < 0 ||
+                    bind(m_socket, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+                    listen(m_socket, 16) != 0 ||
+                    getsockname(m_socket, (sockaddr*)&addr, &len) != 0)
+                {
+                    Log::error("RequestManager",
+                               "Can't open loopback socket, errno=%d.", errno);
+                    return;
+                }
+                m_port = ntohs(addr.sin_port);
+                m_accept_thread = std::thread(&LoopbackHttpServer::acceptLoop,
+                                              this);
+            }   // LoopbackHttpServer
+            // ----------------------------------------------------------------
+            ~LoopbackHttpServer()
+            {
+                m_stop.store(true);
+                if (m_accept_thread.joinable())
+                    m_accept_thread.join();
+                for (std::thread &t : m_connections)
+                    t.join();
+                if (m_socket >= 0)
+                    close(m_socket);
+            }   // ~LoopbackHttpServer
+            // ----------------------------------------------------------------
+            /** Returns the port, 0 if the server could not be started. */
+            uint16_t getPort() const { return m_port; }
+        };   // class LoopbackHttpServer
+    }   // anonymous namespace
+
+    // ------------------------------------------------------------------------
+    /** Runs bulk and interactive requests through a separate request manager
+     *  against a loopback server. Tests that all requests are completed,
+     *  that the connection limit and the reserved interactive transfers are
+     *  respected, and that interactive requests are not queued behind the
+     *  bulk ones.
+     */
+    void RequestManager::testLoopbackTransfers()
+    {
+        const int MAX_CONNECTIONS = 4;
+        const unsigned BULK_COUNT = 8;
+        const unsigned INTERACTIVE_COUNT = 4;
+
+        LoopbackHttpServer server;
+        assert(server.getPort() != 0);
+        if (server.getPort() == 0)
+            return;
+        const std::string url = "http://127.0.0.1:" +
+                                std::to_string(server.getPort());
+
+        const int old_connections = UserConfigParams::m_max_http_connections;
+        const int old_status = UserConfigParams::m_internet_status;
+        UserConfigParams::m_max_http_connections = MAX_CONNECTIONS;
+        UserConfigParams::m_internet_status = IPERM_ALLOWED;
+
+        // A manager of its own, the main one keeps running independently.
+        RequestManager *manager = new RequestManager();
+        manager->m_thread_id.setAtomic(new pthread_t());
+        int error = pthread_create(manager->m_thread_id.getData(), NULL,
+                                   &RequestManager::mainLoop, manager);
+        assert(error == 0);
+        (void)error;
+
+        std::vector<HTTPRequest*> bulk, interactive;
+        for (unsigned i = 0; i < BULK_COUNT; i++)
+        {
+            bulk.push_back(new HTTPRequest(/*manage memory*/false,
+                                           HTTP_BULK_PRIORITY));
+            bulk.back()->setURL(url + "/bulk" + std::to_string(i));
+            manager->addRequest(bulk.back());
+        }
+        // Give the manager the time to start the bulk transfers, so that
+        // the interactive requests have to get past them.
+        std::this_thread::sleep_for(std::chrono::milliseconds(
+            LoopbackHttpServer::BULK_DELAY / 3));
+        for (unsigned i = 0; i < INTERACTIVE_COUNT; i++)
+        {
+            interactive.push_back(new HTTPRequest(/*manage memory*/false, 1));
+            interactive.back()->setURL(url + "/interactive" +
+                                       std::to_string(i));
+            manager->addRequest(interactive.back());
+        }
+
+        auto count_done = [](const std::vector<HTTPRequest*> &requests)
+        {
+            unsigned n = 0;
+            for (HTTPRequest *r : requests)
+                n += r->isDone() ? 1 : 0;
+            return n;
+        };
+        unsigned bulk_done_after_interactive = 0;
+        const auto timeout = std::chrono::steady_clock::now() +
+                             std::chrono::seconds(20);
+        while (count_done(bulk) + count_done(interactive) <
+               BULK_COUNT + INTERACTIVE_COUNT &&
+               std::chrono::steady_clock::now() < timeout)
+        {
+            manager->handleResultQueue();
+            if (bulk_done_after_interactive == 0 &&
+                count_done(interactive) == INTERACTIVE_COUNT)
+                bulk_done_after_interactive = count_done(bulk) + 1;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        // All requests completed with the right content
+        assert(count_done(bulk) == BULK_COUNT);
+        assert(count_done(interactive) == INTERACTIVE_COUNT);
+        for (unsigned i = 0; i < BULK_COUNT; i++)
+        {
+            assert(!bulk[i]->hadDownloadError());
+            assert(bulk[i]->getData() == "/bulk" + std::to_string(i));
+        }
+        for (unsigned i = 0; i < INTERACTIVE_COUNT; i++)
+        {
+            assert(!interactive[i]->hadDownloadError());
+            assert(interactive[i]->getData() ==
+                   "/interactive" + std::to_string(i));
+        }
+        // The limits were respected, and the bulk requests did run in
+        // parallel
+        assert(server.m_max_in_flight <= MAX_CONNECTIONS);
+        assert(server.m_max_bulk_in_flight ==
+               MAX_CONNECTIONS - (int)RESERVED_INTERACTIVE_TRANSFERS);
+        // The interactive requests were done while the first bulk requests
+        // were still running (+1 is only a marker for 'set')
+        assert(bulk_done_after_interactive > 0 &&
+               bulk_done_after_interactive - 1 <
+               (unsigned)(MAX_CONNECTIONS - RESERVED_INTERACTIVE_TRANSFERS));
+        (void)bulk_done_after_interactive;
+
+        Request *quit = new Request(true, HTTP_MAX_PRIORITY, Request::RT_QUIT);
+        quit->setAbortable(false);
+        manager->addRequest(quit);
+        // The destructor waits for the thread to finish, which also closes
+        // all connections to the server
+        delete manager;
+        for (HTTPRequest *r : bulk)
+            delete r;
+        for (HTTPRequest *r : interactive)
+            delete r;
+
+        UserConfigParams::m_max_http_connections = old_connections;
+        UserConfigParams::m_internet_status = old_status;
+    }   // testLoopbackTransfers
+#endif
 } // namespace Online
@@ -41,6 +41,8 @@
 
 namespace Online
 {
+    class HTTPRequest;
+
     /** A class to execute requests in a separate thread. Typically the
      *  requests involve a http(s) requests to be sent to the stk server, and
      *  receive an answer (e.g. to sign in; or to download an addon). The
@@ -55,6 +57,15 @@ namespace Online
      *  any functions or data members in requests, since they will either
      *  be handled by the main thread, or RequestManager thread, never by
      *  both.
+     *  Http requests are transferred concurrently by a curl multi handle, so
+     *  that connections to the same server are kept alive and reused. The
+     *  number of concurrent transfers is limited (max_http_connections in
+     *  the config file), and requests are started in order of priority.
+     *  Bulk downloads (requests with a priority of at most
+     *  HTTP_BULK_PRIORITY, e.g. addon icons) run in their own lane which
+     *  always leaves some transfers free, so that e.g. a sign-in request
+     *  never has to wait for bulk downloads to finish. Requests which are
+     *  not http transfers are executed directly in the thread.
      *  On exit, if necessary a high priority sign-out or client-quit request
      *  is put into the queue, and a flag is set which causes libcurl to
      *  abort any ongoing download. Then an additional 'quit' event with
@@ -92,11 +103,28 @@ namespace Online
         };
         static bool m_disable_polling;
     private:
+            /** The lanes in which transfers are started. */
+            enum Lane
+            {
+                LANE_BULK,
+                LANE_INTERACTIVE,
+                LANE_COUNT
+            };
+
+            /** Number of transfers which are kept free for requests which are
+             *  not bulk downloads. */
+            static const unsigned RESERVED_INTERACTIVE_TRANSFERS = 2;
+
             /** Time passed since the last poll request. */
             float                     m_time_since_poll;
 
-            /** The current requested being worked on. */
-            Online::Request *         m_current_request;
+            /** The curl multi handle running all http transfers. It keeps
+             *  the connection cache, so connections are reused. */
+            CURLM *                   m_multi;
+
+            /** Number of transfers running in each lane. Only accessed by
+             *  the request manager thread. */
+            unsigned                  m_active_transfers[LANE_COUNT];
 
             /** A conditional variable to wake up the main loop. */
             pthread_cond_t            m_cond_request;
@@ -129,8 +157,30 @@ namespace Online
 
             void addResult(Online::Request *request);
             void handleResultQueue();
+            void startRequest(Online::Request *request);
+            void finishRequest(Online::Request *request);
+            void updateTransfers();
+            static bool canStart(Lane lane,
+                                 const unsigned active[LANE_COUNT],
+                                 unsigned max_transfers);
+
+            // ----------------------------------------------------------------
+            /** Returns the lane in which a request of the given priority is
+             *  transferred. */
+            static Lane getLane(int priority)
+            {
+                return priority <= HTTP_BULK_PRIORITY ? LANE_BULK
+                                                      : LANE_INTERACTIVE;
+            }   // getLane
+            // ----------------------------------------------------------------
+            unsigned getActiveTransfers() const
+            {
+                return m_active_transfers[LANE_BULK] +
+                       m_active_transfers[LANE_INTERACTIVE];
+            }   // getActiveTransfers
 
             static void *mainLoop(void *obj);
+            static void testLoopbackTransfers();
 
             RequestManager(); //const std::string &url
             ~RequestManager();
@@ -140,6 +190,9 @@ namespace Online
         public:
             static const int HTTP_MAX_PRIORITY = 9999;
 
+            /** Requests with this or a lower priority are bulk downloads. */
+            static const int HTTP_BULK_PRIORITY = 0;
+
             // ----------------------------------------------------------------
             /** Singleton access function. Creates the RequestManager if
              * necessary. */
@@ -155,6 +208,7 @@ namespace Online
 
             static void deallocate();
             static bool isRunning();
+            static void unitTesting();
 
             void addRequest(Online::Request *request);
             void startNetworkThread();
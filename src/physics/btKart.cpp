@@ -42,7 +42,7 @@ btRigidBody& btKart::getFixedBody()
 }
 
 // ============================================================================
-btKart::btKart(btRigidBody* chassis, btVehicleRaycaster* raycaster,
+btKart::btKart(btRigidBody* chassis, btKartRaycaster* raycaster,
                Kart *kart)
       : m_vehicleRaycaster(raycaster)
 {
@@ -230,26 +230,43 @@ void btKart::updateAllWheelTransformsWS()
 
     m_num_wheels_on_ground       = 0;
     m_visual_wheels_touch_ground = true;
-    for (int i=0;i<m_wheelInfo.size();i++)
+    // Cast the rays of all wheels together, so that the track is only
+    // traversed once for all of them
+    int indices[BT_MAX_RAY_PACKET_SIZE] = { 0 };
+    const int num_wheels = btMin(m_wheelInfo.size(),
+                                 (int)BT_MAX_RAY_PACKET_SIZE);
+    for (int i=0;i<num_wheels;i++)
+        indices[i] = i;
+    rayCastWheels(num_wheels, indices, 1.0f);
+
+    int num_missed = 0;
+    for (int i=0;i<num_wheels;i++)
     {
-        rayCast( i);
         if(m_wheelInfo[i].m_raycastInfo.m_isInContact)
             m_num_wheels_on_ground++;
         else
-        {
-            // If the original raycast did not hit the ground,
-            // try a little bit (5%) closer to the centre of the chassis.
-            // Some tracks have very minor gaps that would otherwise
-            // trigger odd physical behaviour.
-            rayCast(i, 0.95f);
-            if (m_wheelInfo[i].m_raycastInfo.m_isInContact)
-                m_num_wheels_on_ground++;
-        }
+            indices[num_missed++] = i;
+    }
+
+    // If the original raycast did not hit the ground,
+    // try a little bit (5%) closer to the centre of the chassis.
+    // Some tracks have very minor gaps that would otherwise
+    // trigger odd physical behaviour.
+    rayCastWheels(num_missed, indices, 0.95f);
+    for (int i=0;i<num_missed;i++)
+    {
+        if (m_wheelInfo[indices[i]].m_raycastInfo.m_isInContact)
+            m_num_wheels_on_ground++;
     }
 }   // updateAllWheelTransformsWS
 
 // ----------------------------------------------------------------------------
-/**
+/** Casts the suspension ray of one wheel and updates its contact
+ *  information.
+ *  \param index Index of the wheel.
+ *  \param fraction Moves the ray this fraction closer to the centre of the
+ *         chassis.
+ *  \return The depth of the contact, or -1 if there is no contact.
  */
 btScalar btKart::rayCast(unsigned int index, float fraction)
 {
@@ -267,29 +284,117 @@ btScalar btKart::rayCast(unsigned int index, float fraction)
         m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup = 0;
     }
 
+    btScalar raylen, max_susp_len;
+    prepareWheelRay(wheel, fraction, &raylen, &max_susp_len);
+
+    btVehicleRaycaster::btVehicleRaycasterResult rayResults;
+
+    btAssert(m_vehicleRaycaster);
+
+    void* object = m_vehicleRaycaster->castRay(
+        wheel.m_raycastInfo.m_hardPointWS,
+        wheel.m_raycastInfo.m_contactPointWS, rayResults);
+
+    btScalar depth = updateWheelContact(wheel, raylen, max_susp_len, object,
+                                        rayResults);
+
+    if(m_chassisBody->getBroadphaseHandle())
+    {
+        m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup
+            = old_group;
+    }
+
+    return depth;
+
+}   // rayCast
+
+// ----------------------------------------------------------------------------
+/** Same as calling rayCast for each of the given wheels, but the rays are
+ *  cast together, so that the track is only traversed once.
+ *  \param num_wheels Number of wheels in indices.
+ *  \param indices The indices of the wheels.
+ *  \param fraction Moves the rays this fraction closer to the centre of the
+ *         chassis.
+ */
+void btKart::rayCastWheels(int num_wheels, const int *indices, float fraction)
+{
+    if (num_wheels == 0)
+        return;
+    btAssert(num_wheels <= BT_MAX_RAY_PACKET_SIZE);
+
+    // See rayCast: avoid that the rays hit the chassis
+    short int old_group=0;
+    if(m_chassisBody->getBroadphaseHandle())
+    {
+        old_group = m_chassisBody->getBroadphaseHandle()
+                                 ->m_collisionFilterGroup;
+        m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup = 0;
+    }
+
+    btVector3 sources[BT_MAX_RAY_PACKET_SIZE];
+    btVector3 targets[BT_MAX_RAY_PACKET_SIZE];
+    btScalar raylen[BT_MAX_RAY_PACKET_SIZE];
+    btScalar max_susp_len[BT_MAX_RAY_PACKET_SIZE];
+    for (int i = 0; i < num_wheels; i++)
+    {
+        btWheelInfo &wheel = m_wheelInfo[indices[i]];
+        prepareWheelRay(wheel, fraction, &raylen[i], &max_susp_len[i]);
+        sources[i] = wheel.m_raycastInfo.m_hardPointWS;
+        targets[i] = wheel.m_raycastInfo.m_contactPointWS;
+    }
+
+    btVehicleRaycaster::btVehicleRaycasterResult results[BT_MAX_RAY_PACKET_SIZE];
+    void* objects[BT_MAX_RAY_PACKET_SIZE];
+    btAssert(m_vehicleRaycaster);
+    m_vehicleRaycaster->castRays(num_wheels, sources, targets, results,
+                                 objects);
+
+    for (int i = 0; i < num_wheels; i++)
+    {
+        updateWheelContact(m_wheelInfo[indices[i]], raylen[i],
+                           max_susp_len[i], objects[i], results[i]);
+    }
+
+    if(m_chassisBody->getBroadphaseHandle())
+    {
+        m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup
+            = old_group;
+    }
+}   // rayCastWheels
+
+// ----------------------------------------------------------------------------
+/** Updates the world space transform of a wheel and computes its suspension
+ *  ray, which goes from m_hardPointWS to m_contactPointWS.
+ */
+void btKart::prepareWheelRay(btWheelInfo& wheel, float fraction,
+                             btScalar *raylen, btScalar *max_susp_len)
+{
     updateWheelTransformsWS(wheel, getChassisWorldTransform(), false, fraction);
 
-    btScalar max_susp_len = wheel.getSuspensionRestLength()
-                          + wheel.m_maxSuspensionTravel;
+    *max_susp_len = wheel.getSuspensionRestLength()
+                  + wheel.m_maxSuspensionTravel;
 
     // Do a slightly longer raycast to see if the kart might soon hit the 
     // ground and some 'cushioning' is needed to avoid that the chassis
     // hits the ground.
-    btScalar raylen = max_susp_len + 0.5f;
+    *raylen = *max_susp_len + 0.5f;
 
-    btVector3 rayvector = wheel.m_raycastInfo.m_wheelDirectionWS * (raylen);
+    btVector3 rayvector = wheel.m_raycastInfo.m_wheelDirectionWS * (*raylen);
     const btVector3& source = wheel.m_raycastInfo.m_hardPointWS;
     wheel.m_raycastInfo.m_contactPointWS = source + rayvector;
-    const btVector3& target = wheel.m_raycastInfo.m_contactPointWS;
-
-    btVehicleRaycaster::btVehicleRaycasterResult rayResults;
-
-    btAssert(m_vehicleRaycaster);
-
-    void* object = m_vehicleRaycaster->castRay(source,target,rayResults);
+}   // prepareWheelRay
 
+// ----------------------------------------------------------------------------
+/** Updates the contact information of a wheel from the result of its
+ *  suspension ray.
+ *  \return The depth of the contact, or -1 if there is no contact.
+ */
+btScalar btKart::updateWheelContact(btWheelInfo& wheel, btScalar raylen,
+                                    btScalar max_susp_len, void *object,
+                                    const btVehicleRaycaster
+                                        ::btVehicleRaycasterResult &rayResults)
+{
     wheel.m_raycastInfo.m_groundObject = 0;
-
     btScalar depth =  raylen * rayResults.m_distFraction;
     if (object &&  depth < max_susp_len)
     {
@@ -354,15 +459,8 @@ btScalar btKart::rayCast(unsigned int index, float fraction)
         wheel.m_clippedInvContactDotSuspension = btScalar(1.0);
     }
 
-    if(m_chassisBody->getBroadphaseHandle())
-    {
-        m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup
-            = old_group;
-    }
-
     return depth;
-
-}   // rayCast
+}   // updateWheelContact
 
 // ----------------------------------------------------------------------------
 /** Returns the contact point of a visual wheel.
@@ -69,7 +69,7 @@ private:
     btScalar calcRollingFriction(btWheelContactPoint& contactPoint);
 
     btScalar            m_damping;
-    btVehicleRaycaster *m_vehicleRaycaster;
+    btKartRaycaster    *m_vehicleRaycaster;
 
     /** Sliding (skidding) will only be permited when this is true. Also check
      *  the friction parameter in the wheels since friction directly affects
@@ -123,6 +123,14 @@ private:
 
     void     defaultInit();
     btScalar rayCast(btWheelInfo& wheel, const btVector3& ray);
+    void     rayCastWheels(int num_wheels, const int *indices,
+                           float fraction);
+    void     prepareWheelRay(btWheelInfo& wheel, float fraction,
+                             btScalar *raylen, btScalar *max_susp_len);
+    btScalar updateWheelContact(btWheelInfo& wheel, btScalar raylen,
+                                btScalar max_susp_len, void *object,
+                                const btVehicleRaycaster
+                                      ::btVehicleRaycasterResult &rayResults);
     void     updateWheelTransformsWS(btWheelInfo& wheel,
                                      btTransform chassis_trans,
                                      bool interpolatedTransform=true,
@@ -137,7 +145,7 @@ public:
      *         (this is used to get access to the kart properties).
      */
                        btKart(btRigidBody* chassis,
-                              btVehicleRaycaster* raycaster,
+                              btKartRaycaster* raycaster,
                               Kart *kart);
      virtual          ~btKart();
     void               reset();
@@ -19,48 +19,104 @@
 #include "physics/triangle_mesh.hpp"
 #include "tracks/track.hpp"
 
+// ----------------------------------------------------------------------------
+/** Stores the index of the triangle hit. */
+btScalar btKartRaycaster::ClosestWithNormal::addSingleResult(
+                                   btCollisionWorld::LocalRayResult& rayResult,
+                                   bool normalInWorldSpace)
+{
+    // We don't always get a triangle index, sometimes (e.g. ray hits
+    // other kart) we get shapePart=-1, or no localShapeInfo at all
+    if(rayResult.m_localShapeInfo &&
+        rayResult.m_localShapeInfo->m_shapePart>-1)
+        m_triangle_index = rayResult.m_localShapeInfo->m_triangleIndex;
+    return
+        btCollisionWorld::ClosestRayResultCallback::addSingleResult(rayResult,
+        normalInWorldSpace);
+}   // addSingleResult
+
+// ----------------------------------------------------------------------------
 void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
                                btVehicleRaycasterResult& result)
 {
-    // ========================================================================
-    class ClosestWithNormal : public btCollisionWorld::ClosestRayResultCallback
-    {
-    private:
-        int m_triangle_index;
-    public:
-        /** Constructor, initialises the triangle index. */
-        ClosestWithNormal(const btVector3 &from,
-                          const btVector3 &to)
-                          : btCollisionWorld::ClosestRayResultCallback(from,to)
-        {
-            m_triangle_index = -1;
-        }   // CloestWithNormal
-        // --------------------------------------------------------------------
-        /** Stores the index of the triangle hit. */
-        virtual    btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
-                                         bool normalInWorldSpace)
-        {
-            // We don't always get a triangle index, sometimes (e.g. ray hits
-            // other kart) we get shapePart=-1, or no localShapeInfo at all
-            if(rayResult.m_localShapeInfo &&
-                rayResult.m_localShapeInfo->m_shapePart>-1)
-                m_triangle_index = rayResult.m_localShapeInfo->m_triangleIndex;
-            return
-                btCollisionWorld::ClosestRayResultCallback::addSingleResult(rayResult,
-                normalInWorldSpace);
-        }
-        // --------------------------------------------------------------------
-        /** Returns the index of the triangle which was hit, or -1 if
-         *  no triangle was hit. */
-        int getTriangleIndex() const { return m_triangle_index; }
+    ClosestWithNormal rayCallback;
+    rayCallback.init(from, to, NULL);
+
+    m_dynamicsWorld->rayTest(from, to, rayCallback);
+    return getResult(rayCallback, result);
+}   // castRay
 
-    };   // CloestWithNormal
-    // ========================================================================
+// ----------------------------------------------------------------------------
+/** Casts several rays at once (e.g. the rays of all wheels of a kart). The
+ *  bvh of the track is only traversed once for all rays, all other objects
+ *  are tested for each ray with the dynamics world as in castRay. The
+ *  results are the same as calling castRay for each ray: the track hit is
+ *  only used if it is closer than any other hit (an exact tie in the hit
+ *  fraction with another object picks the other object, castRay would pick
+ *  the one found first by the broadphase).
+ *  \param num_rays Number of rays.
+ *  \param from, to Start and end points of each ray.
+ *  \param results On return the result of each ray.
+ *  \param objects On return the object hit by each ray, or NULL.
+ */
+void btKartRaycaster::castRays(int num_rays, const btVector3* from,
+                               const btVector3* to,
+                               btVehicleRaycasterResult* results,
+                               void** objects)
+{
+    const TriangleMesh *tm = Track::getCurrentTrack() ?
+        Track::getCurrentTrack()->getPtrTriangleMesh() : NULL;
+    const btCollisionObject *track_body = tm ? tm->getBody() : NULL;
+    if (!track_body || !track_body->getBroadphaseHandle() ||
+        num_rays > BT_MAX_RAY_PACKET_SIZE)
+    {
+        for (int i = 0; i < num_rays; i++)
+            objects[i] = castRay(from[i], to[i], results[i]);
+        return;
+    }
 
-    ClosestWithNormal rayCallback(from,to);
+    ClosestWithNormal world_callbacks[BT_MAX_RAY_PACKET_SIZE];
+    ClosestWithNormal track_callbacks[BT_MAX_RAY_PACKET_SIZE];
+    btCollisionWorld::RayResultCallback* packet[BT_MAX_RAY_PACKET_SIZE];
+    btVector3 packet_from[BT_MAX_RAY_PACKET_SIZE];
+    btVector3 packet_to[BT_MAX_RAY_PACKET_SIZE];
+    btBroadphaseProxy *track_proxy =
+        const_cast<btBroadphaseProxy*>(track_body->getBroadphaseHandle());
+    int packet_size = 0;
+    for (int i = 0; i < num_rays; i++)
+    {
+        world_callbacks[i].init(from[i], to[i], track_body);
+        m_dynamicsWorld->rayTest(from[i], to[i], world_callbacks[i]);
+        track_callbacks[i].init(from[i], to[i], NULL);
+        if (!track_callbacks[i].needsCollision(track_proxy))
+            continue;
+        packet[packet_size]      = &track_callbacks[i];
+        packet_from[packet_size] = from[i];
+        packet_to[packet_size]   = to[i];
+        packet_size++;
+    }
+    if (packet_size > 0)
+        tm->castRays(packet_size, packet_from, packet_to, packet);
 
-    m_dynamicsWorld->rayTest(from, to, rayCallback);
+    for (int i = 0; i < num_rays; i++)
+    {
+        const ClosestWithNormal &world = world_callbacks[i];
+        const ClosestWithNormal &track = track_callbacks[i];
+        if (track.hasHit() && (!world.hasHit() ||
+            track.m_closestHitFraction < world.m_closestHitFraction))
+            objects[i] = getResult(track, results[i]);
+        else
+            objects[i] = getResult(world, results[i]);
+    }
+}   // castRays
 
+// ----------------------------------------------------------------------------
+/** Converts the result of a raycast into a vehicle raycaster result, and
+ *  returns the body hit (or NULL if no body with contact response was hit).
+ */
+void* btKartRaycaster::getResult(const ClosestWithNormal &rayCallback,
+                                 btVehicleRaycasterResult& result) const
+{
     if (rayCallback.hasHit())
     {
         btRigidBody* body = btRigidBody::upcast(rayCallback.m_collisionObject);
@@ -105,5 +161,4 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
         }
     }
     return 0;
-}
-
+}   // getResult
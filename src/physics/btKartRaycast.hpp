@@ -14,6 +14,7 @@
 #include "BulletDynamics/Dynamics/btRigidBody.h"
 #include "BulletDynamics/ConstraintSolver/btTypedConstraint.h"
 #include "BulletDynamics/Vehicle/btVehicleRaycaster.h"
+#include "BulletCollision/CollisionDispatch/btCollisionWorld.h"
 class btDynamicsWorld;
 #include "LinearMath/btAlignedObjectArray.h"
 #include "BulletDynamics/Vehicle/btWheelInfo.h"
@@ -23,10 +24,57 @@ class btDynamicsWorld;
 class btKartRaycaster : public btVehicleRaycaster
 {
 private:
+    // ========================================================================
+    /** A closest ray result callback which also stores the index of the
+     *  triangle hit, and which can skip one object (used to skip the track
+     *  when it is tested separately by castRays). */
+    class ClosestWithNormal : public btCollisionWorld::ClosestRayResultCallback
+    {
+    private:
+        int m_triangle_index;
+        /** An object that is not tested, or NULL. */
+        const btCollisionObject *m_skip_object;
+    public:
+        ClosestWithNormal()
+            : btCollisionWorld::ClosestRayResultCallback(btVector3(0, 0, 0),
+                                                         btVector3(0, 0, 0))
+        {
+            m_triangle_index = -1;
+            m_skip_object    = NULL;
+        }   // ClosestWithNormal
+        // --------------------------------------------------------------------
+        void init(const btVector3 &from, const btVector3 &to,
+                  const btCollisionObject *skip_object)
+        {
+            m_rayFromWorld = from;
+            m_rayToWorld   = to;
+            m_skip_object  = skip_object;
+        }   // init
+        // --------------------------------------------------------------------
+        virtual bool needsCollision(btBroadphaseProxy* proxy0) const
+        {
+            if (m_skip_object && proxy0->m_clientObject == m_skip_object)
+                return false;
+            return btCollisionWorld::ClosestRayResultCallback
+                ::needsCollision(proxy0);
+        }   // needsCollision
+        // --------------------------------------------------------------------
+        virtual btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
+                                         bool normalInWorldSpace);
+        // --------------------------------------------------------------------
+        /** Returns the index of the triangle which was hit, or -1 if
+         *  no triangle was hit. */
+        int getTriangleIndex() const { return m_triangle_index; }
+    };   // ClosestWithNormal
+    // ========================================================================
+
     btDynamicsWorld*    m_dynamicsWorld;
     /** True if the normals should be smoothed. Not all tracks support this,
     *  so this flag is set depending on track when constructing this object. */
     bool                m_smooth_normals;
+
+    void* getResult(const ClosestWithNormal &ray_callback,
+                    btVehicleRaycasterResult& result) const;
 public:
     btKartRaycaster(btDynamicsWorld* world, bool smooth_normals=false)
         :m_dynamicsWorld(world), m_smooth_normals(smooth_normals)
@@ -35,6 +83,8 @@ public:
 
     virtual void* castRay(const btVector3& from,const btVector3& to,
                           btVehicleRaycasterResult& result);
+    void castRays(int num_rays, const btVector3* from, const btVector3* to,
+                  btVehicleRaycasterResult* results, void** objects);
 
 };
 
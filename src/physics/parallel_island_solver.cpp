@@ -0,0 +1,337 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "physics/parallel_island_solver.hpp"
+
+#include "utils/log.hpp"
+#include "utils/worker_pool.hpp"
+
+#include <cassert>
+#include <cstring>
+
+// ----------------------------------------------------------------------------
+ParallelIslandSolver::ParallelIslandSolver()
+{
+    m_island_count = 0;
+    m_group_solved = false;
+    m_num_threads = 0;
+    m_pool = NULL;
+    m_dispatcher = NULL;
+}   // ParallelIslandSolver
+
+// ----------------------------------------------------------------------------
+ParallelIslandSolver::~ParallelIslandSolver()
+{
+    stopWorkers();
+}   // ~ParallelIslandSolver
+
+// ----------------------------------------------------------------------------
+void ParallelIslandSolver::stopWorkers()
+{
+    delete m_pool;
+    m_pool = NULL;
+    for (btSequentialImpulseConstraintSolver* solver : m_worker_solvers)
+        delete solver;
+    m_worker_solvers.clear();
+}   // stopWorkers
+
+// ----------------------------------------------------------------------------
+/** Sets the number of threads used to solve the islands: 0 lets bullet solve
+ *  them as usual, 1 solves each island separately on the calling thread,
+ *  more starts the additional worker threads. Must not be called while
+ *  the world is stepped.
+ */
+void ParallelIslandSolver::setNumThreads(unsigned num_threads)
+{
+    stopWorkers();
+    m_num_threads = num_threads;
+    for (unsigned i = 1; i < num_threads; i++)
+        m_worker_solvers.push_back(new btSequentialImpulseConstraintSolver());
+    if (num_threads > 1)
+        m_pool = new WorkerPool(num_threads - 1, "Physics");
+    if (num_threads > 0)
+    {
+        Log::info("ParallelIslandSolver",
+            "Solving physics islands with %d thread(s).", num_threads);
+    }
+}   // setNumThreads
+
+// ----------------------------------------------------------------------------
+/** Solves all islands recorded in this step on the worker threads and the
+ *  calling thread, and returns when all are done. Any thread can take any
+ *  island, the result does not depend on it. Each island only changes
+ *  its own bodies and manifolds: static bodies can be part of several
+ *  islands, but they have no mass, so no impulse is applied to them. The
+ *  fixed body which bullet uses for contacts with static objects is shared
+ *  by all solvers too, it was patched to be only initialised once (see
+ *  btSequentialImpulseConstraintSolver::getFixedBody), so that solvers only
+ *  read it.
+ */
+void ParallelIslandSolver::solveIslands(const btContactSolverInfo& info,
+                                        btIDebugDraw* debug_drawer,
+                                        btStackAlloc* stack_alloc)
+{
+    auto solve = [this, &info, debug_drawer, stack_alloc](unsigned n,
+                                                          unsigned thread)
+        {
+            btSequentialImpulseConstraintSolver* solver =
+                thread == 0 ? this : m_worker_solvers[thread - 1];
+            Island& island = m_islands[n];
+            // Qualified call, so that a subclass of this solver is not
+            // called again from a worker thread
+            solver->btSequentialImpulseConstraintSolver::solveGroup(
+                &island.m_bodies[0], island.m_bodies.size(),
+                island.m_manifolds.size() ? &island.m_manifolds[0] : NULL,
+                island.m_manifolds.size(),
+                island.m_constraints.size() ? &island.m_constraints[0] : NULL,
+                island.m_constraints.size(), info, debug_drawer,
+                stack_alloc, m_dispatcher);
+        };
+    if (m_pool && m_island_count > 1)
+    {
+        m_pool->parallelFor(m_island_count, solve);
+        return;
+    }
+    for (unsigned n = 0; n < m_island_count; n++)
+        solve(n, 0);
+}   // solveIslands
+
+// ----------------------------------------------------------------------------
+void ParallelIslandSolver::prepareSolve(int num_bodies, int num_manifolds)
+{
+    m_island_count = 0;
+    m_group_solved = false;
+    btSequentialImpulseConstraintSolver::prepareSolve(num_bodies,
+                                                      num_manifolds);
+}   // prepareSolve
+
+// ----------------------------------------------------------------------------
+/** Called by bullet for each island (or batch of islands). Without threads
+ *  the group is solved immediately, otherwise it is only recorded and
+ *  solved in \ref allSolved. If the solver randomizes the order of the
+ *  constraints the islands are solved immediately too: the random numbers
+ *  are taken from the solver, so they would depend on which solver (i.e.
+ *  thread) solves an island.
+ */
+btScalar ParallelIslandSolver::solveGroup(btCollisionObject** bodies,
+                                          int num_bodies,
+                                          btPersistentManifold** manifold,
+                                          int num_manifolds,
+                                          btTypedConstraint** constraints,
+                                          int num_constraints,
+                                          const btContactSolverInfo& info,
+                                          btIDebugDraw* debug_drawer,
+                                          btStackAlloc* stack_alloc,
+                                          btDispatcher* dispatcher)
+{
+    if (m_num_threads == 0)
+    {
+        btScalar result = btSequentialImpulseConstraintSolver::solveGroup(
+            bodies, num_bodies, manifold, num_manifolds, constraints,
+            num_constraints, info, debug_drawer, stack_alloc, dispatcher);
+        onGroupSolved();
+        return result;
+    }
+
+    if ((info.m_solverMode & SOLVER_RANDMIZE_ORDER) != 0)
+    {
+        m_group_solved = true;
+        return btSequentialImpulseConstraintSolver::solveGroup(
+            bodies, num_bodies, manifold, num_manifolds, constraints,
+            num_constraints, info, debug_drawer, stack_alloc, dispatcher);
+    }
+
+    if (m_island_count == m_islands.size())
+        m_islands.emplace_back();
+    Island& island = m_islands[m_island_count++];
+    island.m_bodies.resize(num_bodies);
+    for (int i = 0; i < num_bodies; i++)
+        island.m_bodies[i] = bodies[i];
+    island.m_manifolds.resize(num_manifolds);
+    for (int i = 0; i < num_manifolds; i++)
+        island.m_manifolds[i] = manifold[i];
+    island.m_constraints.resize(num_constraints);
+    for (int i = 0; i < num_constraints; i++)
+        island.m_constraints[i] = constraints[i];
+    m_dispatcher = dispatcher;
+    return 0.0f;
+}   // solveGroup
+
+// ----------------------------------------------------------------------------
+/** Called by bullet once all islands of a step were passed to
+ *  \ref solveGroup. */
+void ParallelIslandSolver::allSolved(const btContactSolverInfo& info,
+                                     btIDebugDraw* debug_drawer,
+                                     btStackAlloc* stack_alloc)
+{
+    if (m_island_count > 0)
+    {
+        solveIslands(info, debug_drawer, stack_alloc);
+        m_group_solved = true;
+    }
+    if (m_num_threads > 0 && m_group_solved)
+        onGroupSolved();
+    btSequentialImpulseConstraintSolver::allSolved(info, debug_drawer,
+                                                   stack_alloc);
+}   // allSolved
+
+// ----------------------------------------------------------------------------
+/** Steps a world with several separate stacks of boxes and a chain of boxes
+ *  hanging from a fixed point with different numbers of threads, and checks
+ *  that the positions and velocities of all bodies are bit-identical.
+ */
+void ParallelIslandSolver::unitTesting()
+{
+    auto simulate = [](unsigned num_threads, unsigned* max_islands)
+        {
+            btDefaultCollisionConfiguration config;
+            btCollisionDispatcher dispatcher(&config);
+            btDbvtBroadphase broadphase;
+            ParallelIslandSolver solver;
+            solver.setNumThreads(num_threads);
+            btDiscreteDynamicsWorld world(&dispatcher, &broadphase, &solver,
+                                          &config);
+            world.setGravity(btVector3(0.0f, -9.81f, 0.0f));
+            // Same settings as used in the game (see stk_config.xml)
+            btContactSolverInfo& info = world.getSolverInfo();
+            info.m_numIterations = 4;
+            info.m_splitImpulse = true;
+            info.m_splitImpulsePenetrationThreshold = -0.00001f;
+            if (solver.isParallel())
+                info.m_minimumSolverBatchSize = 1;
+
+            btBoxShape ground_shape(btVector3(50.0f, 1.0f, 50.0f));
+            btBoxShape box_shape(btVector3(0.5f, 0.5f, 0.5f));
+            btVector3 inertia;
+            box_shape.calculateLocalInertia(1.0f, inertia);
+            std::vector<btRigidBody*> bodies;
+            std::vector<btTypedConstraint*> constraints;
+            auto add_body = [&](float mass, btCollisionShape* shape,
+                                const btTransform& t)
+                {
+                    btRigidBody::btRigidBodyConstructionInfo
+                        body_info(mass, NULL, shape,
+                                  mass > 0 ? inertia : btVector3(0, 0, 0));
+                    body_info.m_startWorldTransform = t;
+                    btRigidBody* body = new btRigidBody(body_info);
+                    body->setActivationState(DISABLE_DEACTIVATION);
+                    world.addRigidBody(body);
+                    bodies.push_back(body);
+                    return body;
+                };
+
+            btTransform t;
+            t.setIdentity();
+            t.setOrigin(btVector3(0.0f, -1.0f, 0.0f));
+            add_body(0.0f, &ground_shape, t);
+            // Separate stacks, each one is an island. They are slightly
+            // rotated so that they fall over.
+            for (int stack = 0; stack < 8; stack++)
+            {
+                for (int level = 0; level < 4; level++)
+                {
+                    t.setIdentity();
+                    t.setRotation(btQuaternion(btVector3(0, 0, 1),
+                        0.05f * (float)(stack + level)));
+                    t.setOrigin(btVector3(6.0f * (float)stack - 21.0f,
+                        0.55f + 1.05f * (float)level,
+                        0.1f * (float)level));
+                    add_body(1.0f, &box_shape, t);
+                }
+            }
+            // A chain of boxes hanging from a fixed point, which also uses
+            // the fixed body of the solver
+            btRigidBody* previous = NULL;
+            for (int link = 0; link < 3; link++)
+            {
+                t.setIdentity();
+                t.setOrigin(btVector3(0.5f + 1.2f * (float)link, 8.0f,
+                                      20.0f));
+                btRigidBody* body = add_body(1.0f, &box_shape, t);
+                btTypedConstraint* c = previous ?
+                    new btPoint2PointConstraint(*previous, *body,
+                        btVector3(0.6f, 0, 0), btVector3(-0.6f, 0, 0)) :
+                    new btPoint2PointConstraint(*body,
+                        btVector3(-0.6f, 0, 0));
+                world.addConstraint(c, true);
+                constraints.push_back(c);
+                previous = body;
+            }
+
+            *max_islands = 0;
+            for (int i = 0; i < 240; i++)
+            {
+                world.stepSimulation(1.0f / 120.0f, 1, 1.0f / 120.0f);
+                if (solver.m_island_count > *max_islands)
+                    *max_islands = solver.m_island_count;
+            }
+
+            // FNV-1a hash of the state of all bodies
+            uint64_t hash = 14695981039346656037ull;
+            auto add = [&hash](const btVector3& v)
+                {
+                    for (int i = 0; i < 3; i++)
+                    {
+                        uint32_t bits;
+                        const float f = v[i];
+                        memcpy(&bits, &f, sizeof(bits));
+                        for (int b = 0; b < 4; b++)
+                        {
+                            hash ^= (bits >> (8 * b)) & 0xff;
+                            hash *= 1099511628211ull;
+                        }
+                    }
+                };
+            for (btRigidBody* body : bodies)
+            {
+                const btTransform& wt = body->getWorldTransform();
+                add(wt.getOrigin());
+                add(wt.getBasis()[0]);
+                add(wt.getBasis()[1]);
+                add(wt.getBasis()[2]);
+                add(body->getLinearVelocity());
+                add(body->getAngularVelocity());
+            }
+
+            for (btTypedConstraint* c : constraints)
+            {
+                world.removeConstraint(c);
+                delete c;
+            }
+            for (btRigidBody* body : bodies)
+            {
+                world.removeRigidBody(body);
+                delete body;
+            }
+            return hash;
+        };
+
+    unsigned islands = 0;
+    const uint64_t reference = simulate(0, &islands);
+    for (unsigned threads = 1; threads <= 4; threads++)
+    {
+        const uint64_t hash = simulate(threads, &islands);
+        // The ground does not join islands, so each stack and the chain
+        // is solved on its own
+        assert(islands >= 9);
+        assert(hash == reference);
+        (void)hash;
+    }
+    (void)islands;
+    (void)reference;
+}   // unitTesting
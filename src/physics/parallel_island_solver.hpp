@@ -0,0 +1,129 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_PARALLEL_ISLAND_SOLVER_HPP
+#define HEADER_PARALLEL_ISLAND_SOLVER_HPP
+
+#include "btBulletDynamicsCommon.h"
+
+#include "utils/no_copy.hpp"
+
+#include <vector>
+
+class WorkerPool;
+
+/** A constraint solver which can solve the simulation islands of a step on
+ *  several threads. Islands don't share any dynamic body, so each island
+ *  can be solved on its own, and the result of an island does not depend
+ *  on the thread or on the order in which the islands are solved. This
+ *  keeps the physics bit-identical for any number of threads, which is
+ *  needed for rewinds.
+ *  With 0 threads (the default) this is bullet's solver: bullet collects
+ *  the islands into batches which are solved as they come. Otherwise
+ *  bullet must pass each island separately (see \ref isParallel), the
+ *  islands are only recorded in \ref solveGroup and all solved at once in
+ *  \ref allSolved, the calling thread uses the solver of this object, and
+ *  each worker thread owns its own solver (the temporary pools of a solver
+ *  can't be shared).
+ *  \ingroup physics
+ */
+class ParallelIslandSolver : public btSequentialImpulseConstraintSolver,
+                             public NoCopy
+{
+private:
+    /** Copy of the bodies, manifolds and constraints of an island (bullet
+     *  reuses its arrays for the next island). */
+    struct Island
+    {
+        btAlignedObjectArray<btCollisionObject*>    m_bodies;
+        btAlignedObjectArray<btPersistentManifold*> m_manifolds;
+        btAlignedObjectArray<btTypedConstraint*>    m_constraints;
+    };
+
+    /** Islands of the current step, only the first m_island_count are
+     *  used (the others are kept to avoid allocations). */
+    std::vector<Island> m_islands;
+
+    unsigned m_island_count;
+
+    /** True if a group was solved in the current step. */
+    bool m_group_solved;
+
+    /** Number of threads, 0 if islands are solved by bullet directly. */
+    unsigned m_num_threads;
+
+    /** The worker threads, NULL with less than two threads. */
+    WorkerPool* m_pool;
+
+    /** The solver of each worker thread. */
+    std::vector<btSequentialImpulseConstraintSolver*> m_worker_solvers;
+
+    /** The dispatcher of the islands of the current step. */
+    btDispatcher* m_dispatcher;
+
+    // ------------------------------------------------------------------------
+    void stopWorkers();
+    // ------------------------------------------------------------------------
+    void solveIslands(const btContactSolverInfo& info,
+                      btIDebugDraw* debug_drawer, btStackAlloc* stack_alloc);
+
+protected:
+    // ------------------------------------------------------------------------
+    /** Called on the main thread after the constraints of a step are solved
+     *  (once per group if bullet's batches are used, once for all islands
+     *  otherwise), and only if there was anything to solve. */
+    virtual void onGroupSolved() {}
+
+public:
+    // ------------------------------------------------------------------------
+    ParallelIslandSolver();
+    // ------------------------------------------------------------------------
+    virtual ~ParallelIslandSolver();
+    // ------------------------------------------------------------------------
+    void setNumThreads(unsigned num_threads);
+    // ------------------------------------------------------------------------
+    /** Returns the number of threads used to solve islands, 0 if bullet
+     *  solves them. */
+    unsigned getNumThreads() const                  { return m_num_threads; }
+    // ------------------------------------------------------------------------
+    /** Returns true if the islands are solved by this object. In this case
+     *  the m_minimumSolverBatchSize of the solver info of the world must be
+     *  1, so that bullet passes each island separately. */
+    bool isParallel() const                      { return m_num_threads > 0; }
+    // ------------------------------------------------------------------------
+    virtual void prepareSolve(int num_bodies, int num_manifolds);
+    // ------------------------------------------------------------------------
+    virtual btScalar solveGroup(btCollisionObject** bodies, int num_bodies,
+                                btPersistentManifold** manifold,
+                                int num_manifolds,
+                                btTypedConstraint** constraints,
+                                int num_constraints,
+                                const btContactSolverInfo& info,
+                                btIDebugDraw* debug_drawer,
+                                btStackAlloc* stack_alloc,
+                                btDispatcher* dispatcher);
+    // ------------------------------------------------------------------------
+    virtual void allSolved(const btContactSolverInfo& info,
+                           btIDebugDraw* debug_drawer,
+                           btStackAlloc* stack_alloc);
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // ParallelIslandSolver
+
+#endif
@@ -672,6 +672,15 @@ bool PhysicalObject::castRay(const btVector3 &from, const btVector3 &to,
         Log::warn("PhysicalObject", "Can only raycast against 'exact' meshes.");
         return false;
     }
+    // Most rays (e.g. the terrain rays of all karts) are far away from a
+    // driveable object, so test its bounding box first
+    if (!m_triangle_mesh->rayOverlapsAabb(from, to))
+    {
+        *material = NULL;
+        if (normal)
+            normal->setValue(0, 1, 0);
+        return false;
+    }
     bool result = m_triangle_mesh->castRay(from, to, hit_point, 
                                            material, normal, 
                                            interpolate_normal);
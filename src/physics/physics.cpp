@@ -32,6 +32,7 @@
 #include "modes/soccer_world.hpp"
 #include "modes/world.hpp"
 #include "network/network_config.hpp"
+#include "network/server_metrics.hpp"
 #include "karts/explosion_animation.hpp"
 #include "physics/btKart.hpp"
 #include "physics/irr_debug_drawer.hpp"
@@ -43,12 +44,13 @@
 #include "tracks/track.hpp"
 #include "tracks/track_object.hpp"
 #include "utils/profiler.hpp"
+#include "utils/time.hpp"
 
 // ----------------------------------------------------------------------------
 /** Initialise physics.
  *  Create the bullet dynamics world.
  */
-Physics::Physics() : btSequentialImpulseConstraintSolver()
+Physics::Physics() : ParallelIslandSolver()
 {
     m_collision_conf      = new btDefaultCollisionConfiguration();
     m_dispatcher          = new btCollisionDispatcher(m_collision_conf);
@@ -85,6 +87,12 @@ void Physics::init(const Vec3 &world_min, const Vec3 &world_max)
     // Modify the mode according to the bits of the solver mode:
     info.m_solverMode = (info.m_solverMode & (~stk_config->m_solver_reset_flags))
                       | stk_config->m_solver_set_flags;
+
+    // The islands are solved separately (and possibly in parallel), which
+    // gives exactly the same result as bullet's batches of islands
+    setNumThreads(std::max(0, (int)UserConfigParams::m_physics_threads));
+    if (isParallel())
+        info.m_minimumSolverBatchSize = 1;
 }   // init
 
 //-----------------------------------------------------------------------------
@@ -152,6 +160,7 @@ void Physics::removeKart(const AbstractKart *kart)
 void Physics::update(int ticks)
 {
     PROFILER_PUSH_CPU_MARKER("Physics", 0, 0, 0);
+    const uint64_t start_time = StkTime::getMonoTimeUs();
 
     m_physics_loop_active = true;
     // Bullet can report the same collision more than once (up to 4
@@ -387,6 +396,8 @@ void Physics::update(int ticks)
         removeKart(m_karts_to_delete[i]);
     m_karts_to_delete.clear();
 
+    ServerMetrics::add(ServerMetrics::SM_PHYSICS_TIME,
+        StkTime::getMonoTimeUs() - start_time);
     PROFILER_POP_CPU_MARKER();
 }   // update
 
@@ -526,34 +537,18 @@ void Physics::KartKartCollision(AbstractKart *kart_a,
 }   // KartKartCollision
 
 //-----------------------------------------------------------------------------
-/** This function is called at each internal bullet timestep. It is used
- *  here to do the collision handling: using the contact manifolds after a
- *  physics time step might miss some collisions (when more than one internal
- *  time step was done, and the collision is added and removed). So this
- *  function stores all collisions in a list, which is then handled after the
- *  actual physics timestep. This list only stores a collision if it's not
- *  already in the list, so a collisions which is reported more than once is
+/** This function is called at each internal bullet timestep once the
+ *  constraints are solved (see ParallelIslandSolver). It is used here to do
+ *  the collision handling: using the contact manifolds after a physics time
+ *  step might miss some collisions (when more than one internal time step
+ *  was done, and the collision is added and removed). So this function
+ *  stores all collisions in a list, which is then handled after the actual
+ *  physics timestep. This list only stores a collision if it's not already
+ *  in the list, so a collisions which is reported more than once is
  *  nevertheless only handled once.
- *  The list of collision
- *  Parameters: see bullet documentation for details.
  */
-btScalar Physics::solveGroup(btCollisionObject** bodies, int numBodies,
-                             btPersistentManifold** manifold,int numManifolds,
-                             btTypedConstraint** constraints,
-                             int numConstraints,
-                             const btContactSolverInfo& info,
-                             btIDebugDraw* debugDrawer,
-                             btStackAlloc* stackAlloc,
-                             btDispatcher* dispatcher)
+void Physics::onGroupSolved()
 {
-    btScalar returnValue=
-        btSequentialImpulseConstraintSolver::solveGroup(bodies, numBodies,
-                                                        manifold, numManifolds,
-                                                        constraints,
-                                                        numConstraints, info,
-                                                        debugDrawer,
-                                                        stackAlloc,
-                                                        dispatcher);
     int currentNumManifolds = m_dispatcher->getNumManifolds();
     // We can't explode a rocket in a loop, since a rocket might collide with
     // more than one object, and/or more than once with each object (if there
@@ -725,9 +720,7 @@ btScalar Physics::solveGroup(btCollisionObject** bodies, int numBodies,
         else
             assert("Unknown user pointer");           // 4) Should never happen
     }   // for i<numManifolds
-
-    return returnValue;
-}   // solveGroup
+}   // onGroupSolved
 
 // ----------------------------------------------------------------------------
 /** A debug draw function to show the track and all karts.
@@ -30,6 +30,7 @@
 #include "btBulletDynamicsCommon.h"
 
 #include "physics/irr_debug_drawer.hpp"
+#include "physics/parallel_island_solver.hpp"
 #include "physics/stk_dynamics_world.hpp"
 #include "physics/user_pointer.hpp"
 #include "utils/singleton.hpp"
@@ -41,7 +42,7 @@ class Vec3;
 /**
   * \ingroup physics
   */
-class Physics : public btSequentialImpulseConstraintSolver
+class Physics : public ParallelIslandSolver
               , public AbstractSingleton<Physics>
 {
 private:
@@ -177,12 +178,7 @@ public:
     /** Returns true if the debug drawer is enabled. */
     bool  isDebug() const     {return m_debug_drawer->debugEnabled(); }
     IrrDebugDrawer* getDebugDrawer() { return m_debug_drawer; }
-    virtual btScalar solveGroup(btCollisionObject** bodies, int numBodies,
-                                btPersistentManifold** manifold,int numManifolds,
-                                btTypedConstraint** constraints,int numConstraints,
-                                const btContactSolverInfo& info,
-                                btIDebugDraw* debugDrawer, btStackAlloc* stackAlloc,
-                                btDispatcher* dispatcher);
+    virtual void onGroupSolved();
 };
 
 #endif // HEADER_PHYSICS_HPP
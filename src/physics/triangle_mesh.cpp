@@ -25,8 +25,11 @@
 #include "utils/time.hpp"
 
 #include "btBulletDynamicsCommon.h"
+#include "BulletCollision/NarrowPhaseCollision/btRaycastCallback.h"
+#include "LinearMath/btAabbUtil2.h"
 
 #include <fstream>
+#include <random>
 
 // -----------------------------------------------------------------------------
 /** Constructor: Initialises all data structures with zero.
@@ -407,3 +410,236 @@ bool TriangleMesh::castRay(const btVector3 &from, const btVector3 &to,
     return ray_callback.hasHit();
 
 }   // castRay
+
+// ----------------------------------------------------------------------------
+/** Casts several rays against this mesh, traversing its bvh only once for
+ *  all rays. Each callback gets exactly the same results reported as
+ *  btCollisionWorld::rayTestSingle would report for this mesh (so casting
+ *  the rays in the dynamics world and skipping this mesh, and then casting
+ *  them here gives the same closest hit). The needsCollision test of the
+ *  callbacks is not done here.
+ *  \param num_rays Number of rays.
+ *  \param from, to Start and end points of each ray (in world space).
+ *  \param callbacks The result callback of each ray.
+ */
+void TriangleMesh::castRays(int num_rays, const btVector3 *from,
+                            const btVector3 *to,
+                            btCollisionWorld::RayResultCallback **callbacks) const
+{
+    if (!m_collision_shape || num_rays == 0)
+        return;
+
+    btCollisionObject *object = m_collision_object ? m_collision_object
+                                                   : m_body;
+    btTransform world_trans;
+    // If there is a body, take the current transform from the body.
+    if(m_body)
+        world_trans = m_body->getWorldTransform();
+    else
+        world_trans.setIdentity();
+
+    if (m_collision_shape->getShapeType() != TRIANGLE_MESH_SHAPE_PROXYTYPE ||
+        num_rays > BT_MAX_RAY_PACKET_SIZE)
+    {
+        for (int i = 0; i < num_rays; i++)
+        {
+            btTransform trans_from(btMatrix3x3::getIdentity(), from[i]);
+            btTransform trans_to(btMatrix3x3::getIdentity(), to[i]);
+            btCollisionWorld::rayTestSingle(trans_from, trans_to, object,
+                                            m_collision_shape, world_trans,
+                                            *callbacks[i]);
+        }
+        return;
+    }
+
+    /** Same as the BridgeTriangleRaycastCallback in rayTestSingle, which
+     *  passes the triangle hits to the ray result callback. */
+    class BridgeTriangleRaycastCallback : public btTriangleRaycastCallback
+    {
+    public:
+        btCollisionWorld::RayResultCallback *m_result_callback;
+        btCollisionObject *m_collision_object;
+        btTransform m_world_trans;
+        // --------------------------------------------------------------------
+        BridgeTriangleRaycastCallback()
+            : btTriangleRaycastCallback(btVector3(0, 0, 0),
+                                        btVector3(0, 0, 0))
+        {
+            m_result_callback  = NULL;
+            m_collision_object = NULL;
+        }   // BridgeTriangleRaycastCallback
+        // --------------------------------------------------------------------
+        virtual btScalar reportHit(const btVector3& hit_normal_local,
+                                   btScalar hit_fraction, int part_id,
+                                   int triangle_index)
+        {
+            btCollisionWorld::LocalShapeInfo shape_info;
+            shape_info.m_shapePart     = part_id;
+            shape_info.m_triangleIndex = triangle_index;
+            btVector3 hit_normal_world =
+                m_world_trans.getBasis() * hit_normal_local;
+            btCollisionWorld::LocalRayResult ray_result(m_collision_object,
+                &shape_info, hit_normal_world, hit_fraction);
+            return m_result_callback->addSingleResult(ray_result,
+                                                      /*world space*/true);
+        }   // reportHit
+    };   // BridgeTriangleRaycastCallback
+
+    const btTransform world_to_object = world_trans.inverse();
+    BridgeTriangleRaycastCallback bridges[BT_MAX_RAY_PACKET_SIZE];
+    btTriangleCallback *triangle_callbacks[BT_MAX_RAY_PACKET_SIZE];
+    btVector3 from_local[BT_MAX_RAY_PACKET_SIZE];
+    btVector3 to_local[BT_MAX_RAY_PACKET_SIZE];
+    for (int i = 0; i < num_rays; i++)
+    {
+        from_local[i] = world_to_object * from[i];
+        to_local[i]   = world_to_object * to[i];
+        BridgeTriangleRaycastCallback &bridge = bridges[i];
+        bridge.m_from             = from_local[i];
+        bridge.m_to               = to_local[i];
+        bridge.m_flags            = callbacks[i]->m_flags;
+        bridge.m_hitFraction      = callbacks[i]->m_closestHitFraction;
+        bridge.m_result_callback  = callbacks[i];
+        bridge.m_collision_object = object;
+        bridge.m_world_trans      = world_trans;
+        triangle_callbacks[i]     = &bridge;
+    }
+    btBvhTriangleMeshShape *shape = (btBvhTriangleMeshShape*)m_collision_shape;
+    shape->performRaycasts(triangle_callbacks, num_rays, from_local, to_local);
+}   // castRays
+
+// ----------------------------------------------------------------------------
+/** Returns if the ray from 'from' to 'to' overlaps the bounding box of this
+ *  mesh. If not, castRay can not hit this mesh.
+ */
+bool TriangleMesh::rayOverlapsAabb(const btVector3 &from,
+                                   const btVector3 &to) const
+{
+    if (!m_collision_shape)
+        return false;
+    btTransform world_trans;
+    if (m_body)
+        world_trans = m_body->getWorldTransform();
+    else
+        world_trans.setIdentity();
+    btVector3 aabb_min, aabb_max;
+    m_collision_shape->getAabb(world_trans, aabb_min, aabb_max);
+    // Add a small tolerance, so rounding errors can never skip a hit
+    const btVector3 tolerance(0.01f, 0.01f, 0.01f);
+    aabb_min -= tolerance;
+    aabb_max += tolerance;
+    btScalar param = 1.0f;
+    btVector3 normal;
+    return btRayAabb(from, to, aabb_min, aabb_max, param, normal);
+}   // rayOverlapsAabb
+
+// ----------------------------------------------------------------------------
+/** Checks that castRays gives bit-identical results to casting each ray on
+ *  its own, for packets of wheel-like rays over a bumpy terrain (including
+ *  axis aligned rays and rays that miss the mesh).
+ */
+void TriangleMesh::unitTesting()
+{
+    class IndexRayResult : public btCollisionWorld::ClosestRayResultCallback
+    {
+    public:
+        int m_index;
+        IndexRayResult(const btVector3 &from, const btVector3 &to)
+            : btCollisionWorld::ClosestRayResultCallback(from, to)
+        {
+            m_index = -1;
+        }   // IndexRayResult
+        virtual btScalar addSingleResult(btCollisionWorld::LocalRayResult& r,
+                                         bool normal_in_world_space)
+        {
+            m_index = r.m_localShapeInfo->m_triangleIndex;
+            return btCollisionWorld::ClosestRayResultCallback
+                ::addSingleResult(r, normal_in_world_space);
+        }   // addSingleResult
+    };   // IndexRayResult
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> height(-0.5f, 0.5f);
+    std::uniform_real_distribution<float> position(-2.0f, 34.0f);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+
+    // A 32x32 grid with random heights
+    const int size = 32;
+    std::vector<float> heights((size + 1) * (size + 1));
+    for (float &h : heights)
+        h = height(random);
+    TriangleMesh tm(/*can_be_transformed*/false);
+    const btVector3 up(0, 1, 0);
+    for (int x = 0; x < size; x++)
+    {
+        for (int z = 0; z < size; z++)
+        {
+            btVector3 p[4];
+            for (int i = 0; i < 4; i++)
+            {
+                const int px = x + (i & 1), pz = z + (i >> 1);
+                p[i] = btVector3(float(px), heights[px * (size + 1) + pz],
+                                 float(pz));
+            }
+            tm.addTriangle(p[0], p[1], p[2], up, up, up, NULL);
+            tm.addTriangle(p[1], p[3], p[2], up, up, up, NULL);
+        }
+    }
+    tm.createCollisionShape();
+
+    for (int n = 0; n < 2000; n++)
+    {
+        // Four wheel-like rays around a centre, sometimes exactly vertical
+        const int num_rays = 1 + n % BT_MAX_RAY_PACKET_SIZE;
+        const btVector3 centre(position(random), 1.0f, position(random));
+        btVector3 from[BT_MAX_RAY_PACKET_SIZE], to[BT_MAX_RAY_PACKET_SIZE];
+        for (int i = 0; i < num_rays; i++)
+        {
+            from[i] = centre + btVector3(offset(random), offset(random),
+                                         offset(random));
+            btVector3 dir(0.0f, -2.0f, 0.0f);
+            if (n % 3 != 0)
+                dir += btVector3(offset(random), offset(random),
+                                 offset(random)) * 0.3f;
+            to[i] = from[i] + dir;
+        }
+
+        IndexRayResult single[BT_MAX_RAY_PACKET_SIZE] =
+        {
+            IndexRayResult(from[0], to[0]), IndexRayResult(from[1], to[1]),
+            IndexRayResult(from[2], to[2]), IndexRayResult(from[3], to[3]),
+            IndexRayResult(from[4], to[4]), IndexRayResult(from[5], to[5]),
+            IndexRayResult(from[6], to[6]), IndexRayResult(from[7], to[7])
+        };
+        IndexRayResult packet[BT_MAX_RAY_PACKET_SIZE] =
+        {
+            IndexRayResult(from[0], to[0]), IndexRayResult(from[1], to[1]),
+            IndexRayResult(from[2], to[2]), IndexRayResult(from[3], to[3]),
+            IndexRayResult(from[4], to[4]), IndexRayResult(from[5], to[5]),
+            IndexRayResult(from[6], to[6]), IndexRayResult(from[7], to[7])
+        };
+        btCollisionWorld::RayResultCallback *callbacks[BT_MAX_RAY_PACKET_SIZE];
+        btTransform identity;
+        identity.setIdentity();
+        for (int i = 0; i < num_rays; i++)
+        {
+            btCollisionWorld::rayTestSingle(
+                btTransform(btMatrix3x3::getIdentity(), from[i]),
+                btTransform(btMatrix3x3::getIdentity(), to[i]),
+                tm.m_collision_object, tm.m_collision_shape, identity,
+                single[i]);
+            callbacks[i] = &packet[i];
+        }
+        tm.castRays(num_rays, from, to, callbacks);
+
+        for (int i = 0; i < num_rays; i++)
+        {
+            assert(single[i].hasHit() == packet[i].hasHit());
+            assert(single[i].m_index == packet[i].m_index);
+            assert(single[i].m_closestHitFraction ==
+                   packet[i].m_closestHitFraction);
+            assert(single[i].m_hitNormalWorld == packet[i].m_hitNormalWorld);
+            assert(single[i].m_hitPointWorld == packet[i].m_hitPointWorld);
+        }
+    }
+}   // unitTesting
@@ -112,6 +112,10 @@ public:
     bool castRay(const btVector3 &from, const btVector3 &to,
                  btVector3 *xyz, const Material **material,
                  btVector3 *normal=NULL, bool interpolate_normal=false) const;
+    void castRays(int num_rays, const btVector3 *from, const btVector3 *to,
+                  btCollisionWorld::RayResultCallback **callbacks) const;
+    bool rayOverlapsAabb(const btVector3 &from, const btVector3 &to) const;
+    static void unitTesting();
     // ------------------------------------------------------------------------
     /** Returns the points of the 'indx' triangle.
      *  \param indx Index of the triangle to get.
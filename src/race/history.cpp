@@ -21,16 +21,27 @@
 #include <stdio.h>
 
 #include "io/file_manager.hpp"
+#include "items/item_manager.hpp"
+#include "items/projectile_manager.hpp"
 #include "modes/world.hpp"
 #include "karts/abstract_kart.hpp"
 #include "karts/controller/controller.hpp"
+#include "karts/kart_rewinder.hpp"
+#include "config/stk_config.hpp"
 #include "network/network_config.hpp"
+#include "network/network_string.hpp"
 #include "network/rewind_manager.hpp"
 #include "physics/physics.hpp"
 #include "race/race_manager.hpp"
+#include "tracks/check_manager.hpp"
 #include "tracks/track.hpp"
+#include "tracks/track_object_manager.hpp"
 #include "utils/constants.hpp"
 
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
 History* history = 0;
 bool History::m_online_history_replay = false;
 //-----------------------------------------------------------------------------
@@ -38,20 +49,109 @@ bool History::m_online_history_replay = false;
  */
 History::History()
 {
-    m_replay_history = false;
+    m_replay_history      = false;
+    m_event_index         = 0;
+    m_stream_file         = NULL;
+    m_checkpoint_interval = 0;
+    m_next_checkpoint_ticks = 0;
+    m_checkpoint_index    = 0;
+    m_check_checkpoints   = false;
+    m_checkpoints_checked = 0;
+    m_checkpoints_differ  = 0;
+    m_seek_ticks          = -1;
 }   // History
 
+//-----------------------------------------------------------------------------
+History::~History()
+{
+    stopRecording();
+}   // ~History
+
 //-----------------------------------------------------------------------------
 /** Initialise the history for a new recording. It especially allocates memory
- *  to store the history.
+ *  to store the history. If streaming is enabled, the file is (re)started,
+ *  so it only contains the current race.
  */
 void History::initRecording()
 {
+    stopRecording();
     allocateMemory();
     m_event_index = 0;
     m_all_input_events.clear();
+    m_checkpoints.clear();
+    if (m_stream_filename.empty())
+        return;
+
+    m_stream_file = fopen(m_stream_filename.c_str(), "wb");
+    if (!m_stream_file)
+    {
+        Log::warn("History", "Can't open '%s' for writing, history is not "
+            "recorded.", m_stream_filename.c_str());
+        return;
+    }
+    m_checkpoint_interval = stk_config->time2Ticks(10.0f);
+    m_next_checkpoint_ticks = m_checkpoint_interval;
+    writeHeader(m_stream_file);
+    Log::info("History", "Recording to '%s'.", m_stream_filename.c_str());
 }   // initRecording
 
+//-----------------------------------------------------------------------------
+/** Writes the remaining events and closes the history file when streaming.
+ */
+void History::stopRecording()
+{
+    if (!m_stream_file)
+        return;
+    writeEvents(m_stream_file);
+    writeRecord(m_stream_file, HR_END, BareNetworkString());
+    fclose(m_stream_file);
+    m_stream_file = NULL;
+}   // stopRecording
+
+//-----------------------------------------------------------------------------
+/** Called once per world update. When streaming, it writes the events to
+ *  the file every second (so that at most one second is lost if the game
+ *  crashes), and a checkpoint every m_checkpoint_interval ticks. When
+ *  replaying, it handles the checkpoints of the replayed history.
+ *  \param world_ticks Current world time in ticks.
+ */
+void History::update(int world_ticks)
+{
+    if (RewindManager::get()->isRewinding())
+        return;
+    if (m_replay_history)
+    {
+        replayCheckpoint(world_ticks);
+        return;
+    }
+    if (!m_stream_file)
+        return;
+
+    bool written = false;
+    if (world_ticks >= m_next_checkpoint_ticks)
+    {
+        // If no checkpoint can be saved now (e.g. a projectile is moving),
+        // it is tried again in the next time step
+        BareNetworkString* state = saveCheckpoint();
+        if (state)
+        {
+            writeEvents(m_stream_file);
+            writeCheckpoint(world_ticks, *state);
+            delete state;
+            m_next_checkpoint_ticks = world_ticks + m_checkpoint_interval;
+            written = true;
+        }
+    }
+    if (!written && !m_all_input_events.empty() &&
+        world_ticks % stk_config->time2Ticks(1.0f) == 0)
+    {
+        writeEvents(m_stream_file);
+        written = true;
+    }
+    if (written)
+        fflush(m_stream_file);
+}   // update
+
 //-----------------------------------------------------------------------------
 /** Allocates memory for the history. This is used when recording as well
  *  as when replaying (since in replay the data is read into memory first).
@@ -95,23 +195,28 @@ void History::updateReplay(int world_ticks)
 {
     World *world = World::getWorld();
 
-    while (m_event_index < m_all_input_events.size() &&
-        m_all_input_events[m_event_index].m_world_ticks <= world_ticks)
+    // Seek once the race has started, so that the phase of the world is
+    // the one used when the checkpoints were saved
+    if (m_seek_ticks > world_ticks && world->isRacePhase())
     {
-        const InputEvent &ie = m_all_input_events[m_event_index];
-        AbstractKart *kart = world->getKart(ie.m_kart_index);
-        Log::verbose("history", "time %d event-time %d action %d %d",
-            world->getTicksSinceStart(), ie.m_world_ticks, ie.m_action,
-            ie.m_value);
-        kart->getController()->action(ie.m_action, ie.m_value);
-        m_event_index++;
-    }   // while we have events for current time step.
+        seek(m_seek_ticks);
+        world_ticks = world->getTicksSinceStart();
+    }
+
+    playEvents(world_ticks);
 
     // Check if we have reached the end of the buffer
     if(m_event_index >= m_all_input_events.size())
     {
         Log::info("History", "Replay finished");
+        if (m_checkpoints_checked > 0)
+        {
+            Log::info("History", "%d of %d checkpoints differ.",
+                m_checkpoints_differ, m_checkpoints_checked);
+        }
         m_event_index= 0;
+        m_checkpoint_index = 0;
+        m_checkpoints_checked = m_checkpoints_differ = 0;
         // This is useful to use a reproducable rewind problem:
         // replay it with history, for debugging only
 #undef DO_REWIND_AT_END_OF_HISTORY
@@ -126,59 +231,432 @@ void History::updateReplay(int world_ticks)
 }   // updateReplay
 
 //-----------------------------------------------------------------------------
-/** Saves the history stored in the internal data structures into a file called
- *  history.dat.
+/** Applies all events up to (and including) the given time.
+ *  \param world_ticks World time in ticks.
  */
-void History::Save()
+void History::playEvents(int world_ticks)
 {
-    FILE *fd = fopen("history.dat","w");
-    if(fd)
-        Log::info("History", "Saved in ./history.dat.");
-    else
+    World *world = World::getWorld();
+
+    while (m_event_index < m_all_input_events.size() &&
+        m_all_input_events[m_event_index].m_world_ticks <= world_ticks)
+    {
+        const InputEvent &ie = m_all_input_events[m_event_index];
+        AbstractKart *kart = world->getKart(ie.m_kart_index);
+        Log::verbose("history", "time %d event-time %d action %d %d",
+            world->getTicksSinceStart(), ie.m_world_ticks, ie.m_action,
+            ie.m_value);
+        kart->getController()->action(ie.m_action, ie.m_value);
+        m_event_index++;
+    }   // while we have events for current time step.
+}   // playEvents
+
+//-----------------------------------------------------------------------------
+/** Restores the last checkpoint before the given time (if it is later than
+ *  now), then simulates the world up to the given time without rendering.
+ *  \param target_ticks The time to seek to.
+ */
+void History::seek(int target_ticks)
+{
+    m_seek_ticks = -1;
+    World *world = World::getWorld();
+
+    const Checkpoint* cp = NULL;
+    for (const Checkpoint& c : m_checkpoints)
     {
-        std::string fn = file_manager->getUserConfigFile("history.dat");
-        fd = fopen(fn.c_str(), "w");
-        if(fd)
-            Log::info("History", "Saved in '%s'.", fn.c_str());
+        if (c.m_world_ticks <= target_ticks &&
+            c.m_world_ticks > world->getTicksSinceStart())
+            cp = &c;
     }
-    if(!fd)
+    if (cp)
     {
-        Log::info("History", "Can't open history.dat file for writing - can't save history.");
-        Log::info("History", "Make sure history.dat in the current directory "
-                             "or the config directory is writable.");
-        return;
+        BareNetworkString state(cp->m_size);
+        bool restored = false;
+        if (readCheckpoint(*cp, &state))
+        {
+            Log::info("History", "Restoring checkpoint at %d ticks.",
+                cp->m_world_ticks);
+            try
+            {
+                restoreCheckpoint(cp->m_world_ticks, &state);
+                restored = true;
+            }
+            catch (std::out_of_range&)
+            {
+            }
+        }
+        if (restored)
+        {
+            m_checkpoint_index = (unsigned)(cp - m_checkpoints.data()) + 1;
+            // The events at the checkpoint time are part of the state
+            auto it = std::upper_bound(m_all_input_events.begin(),
+                m_all_input_events.end(), cp->m_world_ticks,
+                [](int ticks, const InputEvent& ie)
+                {
+                    return ticks < ie.m_world_ticks;
+                });
+            m_event_index = (unsigned)(it - m_all_input_events.begin());
+        }
+        else
+        {
+            Log::warn("History", "Can't restore checkpoint at %d ticks.",
+                cp->m_world_ticks);
+        }
     }
 
-    World *world   = World::getWorld();
-    const int num_karts = world->getNumKarts();
-    fprintf(fd, "STK-version:      %s\n",   STK_VERSION);
-    fprintf(fd, "History-version:  %d\n",   1);
-    fprintf(fd, "numkarts:         %d\n",   num_karts);
-    fprintf(fd, "numplayers:       %d\n", race_manager->getNumPlayers());
-    fprintf(fd, "difficulty:       %d\n", race_manager->getDifficulty());
-    fprintf(fd, "reverse: %c\n", race_manager->getReverseTrack() ? 'y' : 'n');
+    Log::info("History", "Fast forwarding from %d to %d ticks.",
+        world->getTicksSinceStart(), target_ticks);
+    while (world->getTicksSinceStart() < target_ticks &&
+           world->getPhase() < WorldStatus::FINISH_PHASE)
+    {
+        playEvents(world->getTicksSinceStart());
+        world->updateWorld(1);
+        world->updateTime(1);
+    }
+}   // seek
 
-    fprintf(fd, "track: %s\n", Track::getCurrentTrack()->getIdent().c_str());
+//-----------------------------------------------------------------------------
+/** Opens the history file. If no file name was set, history.dat in the
+ *  current directory is used, or in the config directory if that fails.
+ *  \param writeable True if the file is opened for writing.
+ *  \param name If not NULL, the name of the opened file is stored here.
+ */
+FILE* History::openFile(bool writeable, std::string* name)
+{
+    const char* mode = writeable ? "wb" : "rb";
+    std::string fn = m_filename.empty() ? "history.dat" : m_filename;
+    FILE *fd = fopen(fn.c_str(), mode);
+    if (!fd && m_filename.empty())
+    {
+        fn = file_manager->getUserConfigFile("history.dat");
+        fd = fopen(fn.c_str(), mode);
+    }
+    if (name)
+        *name = fn;
+    return fd;
+}   // openFile
 
+//-----------------------------------------------------------------------------
+/** Writes the magic and the header block of a binary history file.
+ */
+void History::writeHeader(FILE* fd)
+{
+    World *world = World::getWorld();
+    const unsigned int num_karts = world->getNumKarts();
     assert(num_karts > 0);
 
-    int k;
-    for(k=0; k<num_karts; k++)
+    BareNetworkString header;
+    header.addUInt32(2).encodeString(std::string(STK_VERSION))
+          .addUInt8((uint8_t)num_karts)
+          .addUInt8((uint8_t)race_manager->getNumPlayers())
+          .addUInt8((uint8_t)race_manager->getDifficulty())
+          .addUInt8(race_manager->getReverseTrack() ? 1 : 0)
+          .encodeString(Track::getCurrentTrack()->getIdent());
+    for (unsigned int k = 0; k < num_karts; k++)
+        header.encodeString(world->getKart(k)->getIdent());
+    header.addUInt32(m_checkpoint_interval);
+
+    BareNetworkString size(4);
+    size.addUInt32(header.getTotalSize());
+    fwrite("STKH", 1, 4, fd);
+    fwrite(size.getData(), 1, 4, fd);
+    fwrite(header.getData(), 1, header.getTotalSize(), fd);
+}   // writeHeader
+
+//-----------------------------------------------------------------------------
+/** Writes a record, which is its type and size followed by the data, so that
+ *  a reader can skip records.
+ */
+bool History::writeRecord(FILE* fd, RecordType type,
+                          const BareNetworkString& data)
+{
+    BareNetworkString head(5);
+    head.addUInt8(type).addUInt32(data.getTotalSize());
+    return fwrite(head.getData(), 1, 5, fd) == 5 &&
+        fwrite(data.getData(), 1, data.getTotalSize(), fd) ==
+        data.getTotalSize();
+}   // writeRecord
+
+//-----------------------------------------------------------------------------
+/** Writes all events that are in memory as one record, and removes them
+ *  from memory.
+ */
+bool History::writeEvents(FILE* fd)
+{
+    if (m_all_input_events.empty())
+        return true;
+    BareNetworkString data((int)m_all_input_events.size() * 10);
+    for (const InputEvent& ie : m_all_input_events)
     {
-        fprintf(fd, "model %d: %s\n",k, world->getKart(k)->getIdent().c_str());
+        data.addUInt32(ie.m_world_ticks).addUInt8(ie.m_kart_index)
+            .addUInt8(ie.m_action).addUInt32((uint32_t)ie.m_value);
     }
-    fprintf(fd, "count:     %zu\n", m_all_input_events.size());
+    m_all_input_events.clear();
+    return writeRecord(fd, HR_EVENTS, data);
+}   // writeEvents
+
+//-----------------------------------------------------------------------------
+/** Writes a checkpoint record.
+ *  \param world_ticks The time the state was saved at.
+ *  \param state The state returned by saveCheckpoint().
+ */
+void History::writeCheckpoint(int world_ticks, const BareNetworkString& state)
+{
+    BareNetworkString data(state.getTotalSize() + 4);
+    data.addUInt32(world_ticks);
+    data += state;
+    writeRecord(m_stream_file, HR_CHECKPOINT, data);
+}   // writeCheckpoint
+
+//-----------------------------------------------------------------------------
+/** Reads the state of a checkpoint from the history file.
+ *  \param cp The checkpoint.
+ *  \param state The state is stored here.
+ *  \return True if the state could be read.
+ */
+bool History::readCheckpoint(const Checkpoint& cp, BareNetworkString* state)
+{
+    FILE *fd = openFile(/*writeable*/false, NULL);
+    if (!fd)
+        return false;
+    state->getBuffer().resize(cp.m_size);
+    state->reset();
+    const bool ok = fseek(fd, cp.m_file_offset, SEEK_SET) == 0 &&
+        fread(state->getData(), 1, cp.m_size, fd) == cp.m_size;
+    fclose(fd);
+    return ok;
+}   // readCheckpoint
 
-    for (unsigned int i = 0; i < m_all_input_events.size(); i++)
+//-----------------------------------------------------------------------------
+/** Saves the complete state of the world, the karts and the items. This
+ *  does not use the RewindManager, so it works in local races, too.
+ *  Saving the karts rounds their physics values (like a network state
+ *  does), so a replay must save the state at the same times as the
+ *  recording.
+ *  \return The state (which the caller must free), or NULL if no state can
+ *          be saved now: outside of the race phase, or while projectiles
+ *          (which are not part of the state) are moving.
+ */
+BareNetworkString* History::saveCheckpoint()
+{
+    World *world = World::getWorld();
+    if (!world->isRacePhase() || projectile_manager->hasActiveProjectiles())
+        return NULL;
+
+    BareNetworkString* state = new BareNetworkString(1024);
+    BareNetworkString world_state;
+    world->saveCompleteState(&world_state);
+    state->addUInt32(world_state.getTotalSize());
+    *state += world_state;
+
+    const unsigned int num_karts = world->getNumKarts();
+    state->addUInt16((uint16_t)num_karts);
+    for (unsigned int i = 0; i < num_karts; i++)
     {
-        fprintf(fd, "%d %d %d %d\n",
-                m_all_input_events[i].m_world_ticks,
-                m_all_input_events[i].m_kart_index,
-                m_all_input_events[i].m_action,
-                m_all_input_events[i].m_value      );
-    }   // for i
+        KartRewinder* kr = dynamic_cast<KartRewinder*>(world->getKart(i));
+        BareNetworkString* kart_state = kr ? kr->saveFullState() : NULL;
+        if (kart_state)
+        {
+            state->addUInt16((uint16_t)kart_state->getTotalSize());
+            *state += *kart_state;
+            delete kart_state;
+        }
+        else
+            state->addUInt16(0);
+    }
+
+    ItemManager::get()->saveItemStates(state);
+    return state;
+}   // saveCheckpoint
+
+//-----------------------------------------------------------------------------
+/** Sets the world time and restores a state saved by saveCheckpoint().
+ *  \param ticks The time the state was saved at.
+ *  \param state The state.
+ *  \throw std::out_of_range if the state is invalid.
+ */
+void History::restoreCheckpoint(int ticks, BareNetworkString* state)
+{
+    World *world = World::getWorld();
+    world->setTicksForRewind(ticks);
+
+    state->reset();
+    const uint32_t world_size = state->getUInt32();
+    if (world_size > state->size())
+        throw std::out_of_range("Invalid world state size");
+    BareNetworkString world_state(state->getCurrentData(), world_size);
+    state->skip(world_size);
+    world->restoreCompleteState(world_state);
+
+    const unsigned int num_karts = state->getUInt16();
+    for (unsigned int i = 0; i < num_karts; i++)
+    {
+        const unsigned int size = state->getUInt16();
+        if (size > state->size())
+            throw std::out_of_range("Invalid kart state size");
+        KartRewinder* kr = i < world->getNumKarts() ?
+            dynamic_cast<KartRewinder*>(world->getKart(i)) : NULL;
+        if (kr && size > 0)
+        {
+            BareNetworkString kart_state(state->getCurrentData(), size);
+            kr->restoreFullState(&kart_state);
+        }
+        state->skip(size);
+    }
+
+    ItemManager::get()->restoreItemStates(*state);
+
+    CheckManager::get()->resetAfterRewind();
+    if (ticks > 0)
+    {
+        world->setTicksForRewind(ticks - 1);
+        Track::getCurrentTrack()->getTrackObjectManager()->resetAfterRewind();
+        world->setTicksForRewind(ticks);
+    }
+}   // restoreCheckpoint
+
+//-----------------------------------------------------------------------------
+/** Called once per world update when replaying. At the time of each
+ *  checkpoint the state is saved again, so that the karts are rounded as
+ *  in the recording. With --history-check the state is then compared with
+ *  the checkpoint, and the checkpoint is restored, so that each checkpoint
+ *  is compared with a replay which started at the previous one.
+ *  \param world_ticks Current world time in ticks.
+ */
+void History::replayCheckpoint(int world_ticks)
+{
+    while (m_checkpoint_index < m_checkpoints.size() &&
+        m_checkpoints[m_checkpoint_index].m_world_ticks < world_ticks)
+        m_checkpoint_index++;
+    if (m_checkpoint_index >= m_checkpoints.size() ||
+        m_checkpoints[m_checkpoint_index].m_world_ticks != world_ticks)
+        return;
+
+    const Checkpoint& cp = m_checkpoints[m_checkpoint_index++];
+    BareNetworkString* state = saveCheckpoint();
+    if (!state)
+    {
+        Log::warn("History", "Can't save the state at %d ticks, the replay "
+            "differs from the recording.", world_ticks);
+        return;
+    }
+    BareNetworkString recorded(cp.m_size);
+    if (m_check_checkpoints && readCheckpoint(cp, &recorded))
+    {
+        m_checkpoints_checked++;
+        if (!compareCheckpoint(world_ticks, state, &recorded))
+            m_checkpoints_differ++;
+        try
+        {
+            restoreCheckpoint(world_ticks, &recorded);
+        }
+        catch (std::out_of_range&)
+        {
+            Log::warn("History", "Can't restore checkpoint at %d ticks.",
+                world_ticks);
+        }
+    }
+    delete state;
+}   // replayCheckpoint
+
+//-----------------------------------------------------------------------------
+/** Compares a state saved during the replay with the recorded checkpoint,
+ *  and logs which parts differ.
+ *  \param ticks Time of the checkpoint.
+ *  \param replayed The state saved during the replay.
+ *  \param recorded The state of the checkpoint.
+ *  \return True if both states are identical.
+ */
+bool History::compareCheckpoint(int ticks, BareNetworkString* replayed,
+                                BareNetworkString* recorded)
+{
+    if (replayed->getTotalSize() == recorded->getTotalSize() &&
+        memcmp(replayed->getData(), recorded->getData(),
+               replayed->getTotalSize()) == 0)
+        return true;
+
+    try
+    {
+        replayed->reset();
+        recorded->reset();
+        const uint32_t world_size = replayed->getUInt32();
+        if (world_size > replayed->size())
+            throw std::out_of_range("Invalid world state size");
+        if (world_size != recorded->getUInt32() ||
+            memcmp(replayed->getCurrentData(), recorded->getCurrentData(),
+                   world_size) != 0)
+        {
+            Log::error("History", "World state differs at %d ticks.", ticks);
+            return false;
+        }
+        replayed->skip(world_size);
+        recorded->skip(world_size);
+        const unsigned int num_karts = replayed->getUInt16();
+        if (num_karts != recorded->getUInt16())
+        {
+            Log::error("History", "Number of karts differs at %d ticks.",
+                ticks);
+            return false;
+        }
+        for (unsigned int i = 0; i < num_karts; i++)
+        {
+            const unsigned int size = replayed->getUInt16();
+            if (size > replayed->size())
+                throw std::out_of_range("Invalid kart state size");
+            if (size != recorded->getUInt16() ||
+                memcmp(replayed->getCurrentData(),
+                       recorded->getCurrentData(), size) != 0)
+            {
+                Log::error("History", "State of kart %d differs at %d ticks.",
+                    i, ticks);
+                return false;
+            }
+            replayed->skip(size);
+            recorded->skip(size);
+        }
+        Log::error("History", "Item state differs at %d ticks.", ticks);
+    }
+    catch (std::out_of_range&)
+    {
+        Log::error("History", "Invalid state at %d ticks.", ticks);
+    }
+    return false;
+}   // compareCheckpoint
 
-    fprintf(fd, "History file end.\n");
+//-----------------------------------------------------------------------------
+/** Saves the history stored in the internal data structures into a file called
+ *  history.dat.
+ */
+void History::Save()
+{
+    // When streaming, all data is already in the file except the last
+    // events
+    if (m_stream_file)
+    {
+        writeEvents(m_stream_file);
+        fflush(m_stream_file);
+        Log::info("History", "Saved in '%s'.", m_stream_filename.c_str());
+        return;
+    }
+
+    std::string fn;
+    FILE *fd = openFile(/*writeable*/true, &fn);
+    if(fd)
+        Log::info("History", "Saved in '%s'.", fn.c_str());
+    if(!fd)
+    {
+        Log::info("History", "Can't open history.dat file for writing - can't save history.");
+        Log::info("History", "Make sure history.dat in the current directory "
+                             "or the config directory is writable.");
+        return;
+    }
+
+    writeHeader(fd);
+    // Keep the events in memory, Save can be called more than once
+    std::vector<InputEvent> events = m_all_input_events;
+    writeEvents(fd);
+    m_all_input_events.swap(events);
+    writeRecord(fd, HR_END, BareNetworkString());
     fclose(fd);
 }   // Save
 
@@ -190,18 +668,29 @@ void History::Load()
     char s[1024], s1[1024];
     int  n;
 
-    FILE *fd = fopen("history.dat","r");
-    if(fd)
-        Log::info("History", "Reading ./history.dat");
-    else
+    std::string fn;
+    FILE *fd = openFile(/*writeable*/false, &fn);
+    if(!fd)
+        Log::fatal("History", "Could not open '%s'.", fn.c_str());
+    Log::info("History", "Reading '%s'.", fn.c_str());
+
+    m_checkpoints.clear();
+    m_checkpoint_index = 0;
+    char magic[4];
+    if (fread(magic, 1, 4, fd) == 4 && memcmp(magic, "STKH", 4) == 0)
     {
-        std::string fn = file_manager->getUserConfigFile("history.dat");
-        fd = fopen(fn.c_str(), "r");
-        if(fd)
-            Log::info("History", "Reading '%s'.", fn.c_str());
+        const bool loaded = loadBinary(fd);
+        fclose(fd);
+        if (!loaded)
+            Log::fatal("History", "Could not read '%s'.", fn.c_str());
+        return;
     }
+
+    // Version 1 text history
+    fclose(fd);
+    fd = fopen(fn.c_str(), "r");
     if(!fd)
-        Log::fatal("History", "Could not open history.dat");
+        Log::fatal("History", "Could not open '%s'.", fn.c_str());
 
     if (fgets(s, 1023, fd) == NULL)
         Log::fatal("History", "Could not read history.dat.");
@@ -308,3 +797,149 @@ void History::Load()
     fclose(fd);
 }   // Load
 
+
+//-----------------------------------------------------------------------------
+/** Loads a binary history file. All events are read, but for checkpoints
+ *  only their position in the file is stored.
+ *  \param fd The file, positioned after the magic.
+ *  \return False if the file is corrupt (sizes which can't be right are
+ *          checked before anything is allocated for them).
+ */
+bool History::loadBinary(FILE* fd)
+{
+    const long start = ftell(fd);
+    fseek(fd, 0, SEEK_END);
+    const long file_size = ftell(fd);
+    fseek(fd, start, SEEK_SET);
+
+    uint8_t size_data[5];
+    if (fread(size_data, 1, 4, fd) != 4)
+    {
+        Log::error("History", "Could not read history file header.");
+        return false;
+    }
+    const uint32_t header_size = BareNetworkString((char*)size_data, 4)
+                                 .getUInt32();
+    if (header_size > 65536)
+    {
+        Log::error("History", "Invalid history file header size %u.",
+            header_size);
+        return false;
+    }
+    BareNetworkString header(header_size);
+    header.getBuffer().resize(header_size);
+    if (fread(header.getData(), 1, header_size, fd) != header_size)
+    {
+        Log::error("History", "Could not read history file header.");
+        return false;
+    }
+
+    try
+    {
+        const uint32_t version = header.getUInt32();
+        if (version != 2)
+            Log::fatal("History", "Unsupported history version %d.", version);
+        std::string stk_version, track;
+        header.decodeString(&stk_version);
+        if (stk_version != STK_VERSION)
+        {
+            Log::warn("History", "History is version '%s', STK version is "
+                "'%s'.", stk_version.c_str(), STK_VERSION);
+        }
+        const unsigned int num_karts = header.getUInt8();
+        race_manager->setNumKarts(num_karts);
+        const unsigned int num_players = header.getUInt8();
+        race_manager->setNumPlayers(num_players);
+        race_manager->setDifficulty(
+            (RaceManager::Difficulty)header.getUInt8());
+        race_manager->setReverseTrack(header.getUInt8() != 0);
+        header.decodeString(&track);
+        race_manager->setTrack(track);
+        // This value doesn't really matter, but should be defined, otherwise
+        // the racing phase can switch to 'ending'
+        race_manager->setNumLaps(100);
+        m_kart_ident.clear();
+        for (unsigned int i = 0; i < num_karts; i++)
+        {
+            std::string ident;
+            header.decodeString(&ident);
+            m_kart_ident.push_back(ident);
+            if (i < num_players && !m_online_history_replay)
+                race_manager->setPlayerKart(i, ident);
+        }
+    }
+    catch (std::out_of_range&)
+    {
+        Log::fatal("History", "Invalid history file header.");
+    }
+
+    allocateMemory();
+    m_event_index = 0;
+    BareNetworkString data;
+    while (true)
+    {
+        if (fread(size_data, 1, 5, fd) != 5)
+        {
+            Log::warn("History", "History file is incomplete, the recording "
+                "was not stopped properly.");
+            break;
+        }
+        BareNetworkString head((char*)size_data, 5);
+        const uint8_t type = head.getUInt8();
+        const uint32_t size = head.getUInt32();
+        if (type == HR_END)
+            break;
+        if (type == HR_CHECKPOINT && size >= 4)
+        {
+            BareNetworkString ticks(4);
+            ticks.getBuffer().resize(4);
+            if (fread(ticks.getData(), 1, 4, fd) != 4)
+                continue;
+            Checkpoint cp;
+            cp.m_world_ticks = ticks.getUInt32();
+            cp.m_file_offset = ftell(fd);
+            cp.m_size        = size - 4;
+            // readCheckpoint allocates m_size bytes
+            if ((long)cp.m_size > file_size - cp.m_file_offset)
+            {
+                Log::warn("History", "History file is incomplete, the "
+                    "recording was not stopped properly.");
+                break;
+            }
+            m_checkpoints.push_back(cp);
+            fseek(fd, cp.m_size, SEEK_CUR);
+            continue;
+        }
+        if (type != HR_EVENTS)
+        {
+            fseek(fd, size, SEEK_CUR);
+            continue;
+        }
+        if ((long)size > file_size - ftell(fd))
+        {
+            Log::warn("History", "History file is incomplete, the recording "
+                "was not stopped properly.");
+            break;
+        }
+        data.getBuffer().resize(size);
+        data.reset();
+        if (fread(data.getData(), 1, size, fd) != size)
+        {
+            Log::warn("History", "History file is incomplete, the recording "
+                "was not stopped properly.");
+            break;
+        }
+        while (data.size() >= 10)
+        {
+            InputEvent ie;
+            ie.m_world_ticks = data.getUInt32();
+            ie.m_kart_index  = data.getUInt8();
+            ie.m_action      = (PlayerAction)data.getUInt8();
+            ie.m_value       = (int)data.getUInt32();
+            m_all_input_events.push_back(ie);
+        }
+    }
+    Log::info("History", "Read %d events and %d checkpoints.",
+        (int)m_all_input_events.size(), (int)m_checkpoints.size());
+    return true;
+}   // loadBinary
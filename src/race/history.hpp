@@ -23,17 +23,36 @@
 #include "input/input.hpp"
 #include "karts/controller/kart_control.hpp"
 
+#include <stdio.h>
 #include <string>
 #include <vector>
 
+class BareNetworkString;
 class Kart;
 
 /**
   * \ingroup race
+  *  Records all input events of a race, so that a race can be reproduced.
+  *  The history is written in a binary format. When streaming is enabled
+  *  (--record-history=file) the events are appended to the file during the
+  *  race, together with a checkpoint of the state of the karts, the world
+  *  and the items every few seconds. A replay can then start at the last
+  *  checkpoint before a given time (--history-seek=t), instead of replaying
+  *  the race from the start. With --history-check each checkpoint is
+  *  compared with the state of the replay. Old text history files can
+  *  still be loaded.
   */
 class History
 {
 private:
+    /** Types of records in a binary history file. */
+    enum RecordType : uint8_t
+    {
+        HR_EVENTS     = 1,
+        HR_CHECKPOINT = 2,
+        HR_END        = 3
+    };
+
     /** True if a history should be replayed, */
     bool m_replay_history;
 
@@ -56,17 +75,80 @@ private:
         int m_value;
     };   // InputEvent
     // ------------------------------------------------------------------------
+    /** A full state stored in a history file, which is only read when the
+     *  replay seeks to it. */
+    struct Checkpoint
+    {
+        /** Time at which the state was saved. */
+        int m_world_ticks;
+        /** Position of the state data in the file. */
+        long m_file_offset;
+        /** Size of the state data. */
+        uint32_t m_size;
+    };   // Checkpoint
+    // ------------------------------------------------------------------------
 
-    /** All input events. */
+    /** All input events. When streaming these are only the events not yet
+     *  written to the file. */
     std::vector<InputEvent> m_all_input_events;
 
+    /** All checkpoints of the loaded history. */
+    std::vector<Checkpoint> m_checkpoints;
+
+    /** Name of the history file, empty to use history.dat in the current
+     *  directory or the config directory. */
+    std::string m_filename;
+
+    /** Name of the file the history is streamed to, empty if the history is
+     *  only saved on request. */
+    std::string m_stream_filename;
+
+    /** The file the history is streamed to while recording. */
+    FILE* m_stream_file;
+
+    /** Number of ticks between two checkpoints when streaming. */
+    int m_checkpoint_interval;
+
+    /** Time at which the next checkpoint is written when streaming. */
+    int m_next_checkpoint_ticks;
+
+    /** Index of the next checkpoint reached when replaying. */
+    unsigned int m_checkpoint_index;
+
+    /** True if the state at each checkpoint is compared when replaying. */
+    bool m_check_checkpoints;
+
+    /** Number of compared checkpoints, and how many of them differ. */
+    int m_checkpoints_checked, m_checkpoints_differ;
+
+    /** Time to seek to when replaying starts, or -1. */
+    int m_seek_ticks;
+
     void  allocateMemory(int size=-1);
+    FILE* openFile(bool writeable, std::string* name);
+    void  writeHeader(FILE* fd);
+    bool  writeRecord(FILE* fd, RecordType type,
+                      const BareNetworkString& data);
+    bool  writeEvents(FILE* fd);
+    void  writeCheckpoint(int world_ticks, const BareNetworkString& state);
+    bool  readCheckpoint(const Checkpoint& cp, BareNetworkString* state);
+    BareNetworkString* saveCheckpoint();
+    void  restoreCheckpoint(int ticks, BareNetworkString* state);
+    void  replayCheckpoint(int world_ticks);
+    bool  compareCheckpoint(int ticks, BareNetworkString* replayed,
+                            BareNetworkString* recorded);
+    bool  loadBinary(FILE* fd);
+    void  playEvents(int world_ticks);
+    void  seek(int target_ticks);
 public:
     static bool m_online_history_replay;
           History        ();
+         ~History        ();
     void  initRecording  ();
+    void  stopRecording  ();
     void  Save           ();
     void  Load           ();
+    void  update(int world_ticks);
     void  updateReplay(int world_ticks);
     void  addEvent(int kart_id, PlayerAction pa, int value);
 
@@ -82,6 +164,26 @@ public:
     // ------------------------------------------------------------------------
     /** Set if replay is enabled or not. */
     void  setReplayHistory(bool b) { m_replay_history=b;  }
+    // ------------------------------------------------------------------------
+    /** Sets the file to load a history from. */
+    void  setFilename(const std::string& fn) { m_filename = fn; }
+    // ------------------------------------------------------------------------
+    /** Enables writing the history to the given file during each race. */
+    void  setStreamFilename(const std::string& fn) { m_stream_filename = fn; }
+    // ------------------------------------------------------------------------
+    /** Sets the time a replay should start at. */
+    void  setSeekTicks(int ticks) { m_seek_ticks = ticks; }
+    // ------------------------------------------------------------------------
+    /** Enables comparing the state at each checkpoint when replaying. */
+    void  setCheckCheckpoints(bool b) { m_check_checkpoints = b; }
+    // ------------------------------------------------------------------------
+    /** Returns true if the karts must support saving their state, i.e. if
+     *  checkpoints are written or replayed. */
+    bool  usesCheckpoints() const
+    {
+        return m_replay_history ? !m_checkpoints.empty()
+                                : !m_stream_filename.empty();
+    }   // usesCheckpoints
 };
 
 extern History* history;
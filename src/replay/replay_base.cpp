@@ -18,6 +18,10 @@
 #include "replay/replay_base.hpp"
 
 #include "io/file_manager.hpp"
+#include "network/network_string.hpp"
+
+#include <cassert>
+#include <cmath>
 
 // -----------------------------------------------------------------------------
 ReplayBase::ReplayBase()
@@ -27,13 +31,17 @@ ReplayBase::ReplayBase()
 /** Opens a replay file which is determined by sub classes.
  *  \param writeable True if the file should be opened for writing.
  *  \param full_path True if the file is full path.
+ *  \param binary True if the file should be opened in binary mode.
  *  \return A FILE *, or NULL if the file could not be opened.
  */
-FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file_number)
+FILE* ReplayBase::openReplayFile(bool writeable, bool full_path,
+                                 int replay_file_number, bool binary)
 {
+    const char* mode = binary ? (writeable ? "wb" : "rb")
+                              : (writeable ? "w"  : "r" );
     FILE *fd = fopen(full_path ? getReplayFilename(replay_file_number).c_str() :
         (file_manager->getReplayDir() + getReplayFilename(replay_file_number)).c_str(),
-        writeable ? "w" : "r");
+        mode);
     if (!fd)
     {
         return NULL;
@@ -41,3 +49,231 @@ FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file
     return fd;
 
 }   // openReplayFile
+
+// -----------------------------------------------------------------------------
+/** Writes an unsigned number using 7 bits per byte, so that small numbers
+ *  only need one byte. */
+void ReplayBase::writeVarUInt(BareNetworkString* out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out->addUInt8((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out->addUInt8((uint8_t)value);
+}   // writeVarUInt
+
+// -----------------------------------------------------------------------------
+uint32_t ReplayBase::readVarUInt(const BareNetworkString& in)
+{
+    uint32_t value = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7)
+    {
+        const uint8_t byte = in.getUInt8();
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            break;
+    }
+    return value;
+}   // readVarUInt
+
+// =============================================================================
+void ReplayBase::FrameCodec::reset()
+{
+    for (int32_t& v : m_last)
+        v = 0;
+}   // reset
+
+// -----------------------------------------------------------------------------
+/** Writes the difference of value to the previous value in the same slot,
+ *  zigzag encoded so that small negative differences are small too. */
+void ReplayBase::FrameCodec::putDelta(BareNetworkString* out, int index,
+                                      int32_t value)
+{
+    const int32_t delta = (int32_t)((uint32_t)value - (uint32_t)m_last[index]);
+    m_last[index] = value;
+    writeVarUInt(out, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+}   // putDelta
+
+// -----------------------------------------------------------------------------
+int32_t ReplayBase::FrameCodec::getDelta(const BareNetworkString& in,
+                                         int index)
+{
+    const uint32_t zigzag = readVarUInt(in);
+    const int32_t delta = (int32_t)((zigzag >> 1) ^ (0u - (zigzag & 1)));
+    m_last[index] = (int32_t)((uint32_t)m_last[index] + (uint32_t)delta);
+    return m_last[index];
+}   // getDelta
+
+// -----------------------------------------------------------------------------
+/** Encodes one frame of a kart. Times are stored in milliseconds, positions
+ *  in millimeters, and the other values with a precision which is not
+ *  visible when a ghost kart is shown.
+ */
+void ReplayBase::FrameCodec::encode(BareNetworkString* out,
+                                    const TransformEvent& te,
+                                    const PhysicInfo& pi, const BonusInfo& bi,
+                                    const KartReplayEvent& kre)
+{
+    auto q = [](float f, float scale)
+        {
+            return (int32_t)std::lround((double)f * scale);
+        };
+    const btVector3& xyz = te.m_transform.getOrigin();
+    const btQuaternion rot = te.m_transform.getRotation();
+    putDelta(out, 0, q(te.m_time, 1000.0f));
+    putDelta(out, 1, q(xyz.getX(), 1000.0f));
+    putDelta(out, 2, q(xyz.getY(), 1000.0f));
+    putDelta(out, 3, q(xyz.getZ(), 1000.0f));
+    putDelta(out, 4, q(rot.getX(), 32767.0f));
+    putDelta(out, 5, q(rot.getY(), 32767.0f));
+    putDelta(out, 6, q(rot.getZ(), 32767.0f));
+    putDelta(out, 7, q(rot.getW(), 32767.0f));
+    putDelta(out, 8, q(pi.m_speed, 100.0f));
+    putDelta(out, 9, q(pi.m_steer, 1000.0f));
+    for (unsigned j = 0; j < 4; j++)
+        putDelta(out, 10 + j, q(pi.m_suspension_length[j], 1000.0f));
+    putDelta(out, 14, pi.m_skidding_state);
+    putDelta(out, 15, bi.m_attachment);
+    putDelta(out, 16, q(bi.m_nitro_amount, 100.0f));
+    putDelta(out, 17, bi.m_item_amount);
+    putDelta(out, 18, bi.m_item_type);
+    putDelta(out, 19, bi.m_special_value);
+    putDelta(out, 20, q(kre.m_distance, 100.0f));
+    putDelta(out, 21, kre.m_nitro_usage);
+    putDelta(out, 22, kre.m_skidding_effect);
+    out->addUInt8((kre.m_zipper_usage ? 1 : 0) |
+                  (kre.m_red_skidding ? 2 : 0) |
+                  (kre.m_jumping      ? 4 : 0));
+}   // encode
+
+// -----------------------------------------------------------------------------
+/** Decodes one frame encoded with encode(), throws std::out_of_range if the
+ *  data is truncated. */
+void ReplayBase::FrameCodec::decode(const BareNetworkString& in,
+                                    TransformEvent* te, PhysicInfo* pi,
+                                    BonusInfo* bi, KartReplayEvent* kre)
+{
+    te->m_time = getDelta(in, 0) / 1000.0f;
+    btVector3 xyz;
+    xyz.setX(getDelta(in, 1) / 1000.0f);
+    xyz.setY(getDelta(in, 2) / 1000.0f);
+    xyz.setZ(getDelta(in, 3) / 1000.0f);
+    btQuaternion rot;
+    rot.setX(getDelta(in, 4) / 32767.0f);
+    rot.setY(getDelta(in, 5) / 32767.0f);
+    rot.setZ(getDelta(in, 6) / 32767.0f);
+    rot.setW(getDelta(in, 7) / 32767.0f);
+    if (rot.length2() > 0.0f)
+        rot.normalize();
+    else
+        rot = btQuaternion(0.0f, 0.0f, 0.0f, 1.0f);
+    te->m_transform = btTransform(rot, xyz);
+    pi->m_speed = getDelta(in, 8) / 100.0f;
+    pi->m_steer = getDelta(in, 9) / 1000.0f;
+    for (unsigned j = 0; j < 4; j++)
+        pi->m_suspension_length[j] = getDelta(in, 10 + j) / 1000.0f;
+    pi->m_skidding_state = getDelta(in, 14);
+    bi->m_attachment = getDelta(in, 15);
+    bi->m_nitro_amount = getDelta(in, 16) / 100.0f;
+    bi->m_item_amount = getDelta(in, 17);
+    bi->m_item_type = getDelta(in, 18);
+    bi->m_special_value = getDelta(in, 19);
+    kre->m_distance = getDelta(in, 20) / 100.0f;
+    kre->m_nitro_usage = getDelta(in, 21);
+    kre->m_skidding_effect = getDelta(in, 22);
+    const uint8_t flags = in.getUInt8();
+    kre->m_zipper_usage = (flags & 1) != 0;
+    kre->m_red_skidding = (flags & 2) != 0;
+    kre->m_jumping      = (flags & 4) != 0;
+}   // decode
+
+// =============================================================================
+/** Checks that frames survive encoding and decoding within the quantization
+ *  precision, and that chunks can be decoded independently.
+ */
+void ReplayBase::unitTesting()
+{
+    BareNetworkString data;
+    std::vector<unsigned> chunk_start;
+    FrameCodec encoder;
+    const unsigned frames = BINARY_CHUNK_FRAMES + 10;
+    auto make_frame = [](unsigned i, TransformEvent* te, PhysicInfo* pi,
+                         BonusInfo* bi, KartReplayEvent* kre)
+        {
+            const float t = i * 0.05f;
+            btQuaternion rot(btVector3(0.0f, 1.0f, 0.0f), t);
+            te->m_time = t;
+            te->m_transform = btTransform(rot,
+                btVector3(100.0f * sinf(t), 0.5f * i, -250.0f + t));
+            pi->m_speed = 20.0f + t;
+            pi->m_steer = -0.5f;
+            for (unsigned j = 0; j < 4; j++)
+                pi->m_suspension_length[j] = 0.1f * j;
+            pi->m_skidding_state = i % 3;
+            bi->m_attachment = i % 6;
+            bi->m_nitro_amount = 10.0f - t;
+            bi->m_item_amount = i % 4;
+            bi->m_item_type = 7;
+            bi->m_special_value = -1;
+            kre->m_distance = 1000.0f + 3.0f * t;
+            kre->m_nitro_usage = i % 2;
+            kre->m_zipper_usage = i % 5 == 0;
+            kre->m_skidding_effect = 2;
+            kre->m_red_skidding = i % 7 == 0;
+            kre->m_jumping = true;
+        };
+
+    for (unsigned i = 0; i < frames; i++)
+    {
+        if (i % BINARY_CHUNK_FRAMES == 0)
+        {
+            encoder.reset();
+            chunk_start.push_back(data.getTotalSize());
+        }
+        TransformEvent te; PhysicInfo pi; BonusInfo bi; KartReplayEvent kre;
+        make_frame(i, &te, &pi, &bi, &kre);
+        encoder.encode(&data, te, pi, bi, kre);
+    }
+    // Much smaller than the text format (about 250 bytes per frame)
+    assert(data.getTotalSize() < frames * 60);
+
+    // Decode only the second chunk
+    FrameCodec decoder;
+    data.reset();
+    data.skip(chunk_start[1]);
+    for (unsigned i = BINARY_CHUNK_FRAMES; i < frames; i++)
+    {
+        TransformEvent te, te_in; PhysicInfo pi, pi_in; BonusInfo bi, bi_in;
+        KartReplayEvent kre, kre_in;
+        make_frame(i, &te_in, &pi_in, &bi_in, &kre_in);
+        decoder.decode(data, &te, &pi, &bi, &kre);
+        assert(fabsf(te.m_time - te_in.m_time) < 0.001f);
+        assert(te.m_transform.getOrigin().distance(
+               te_in.m_transform.getOrigin()) < 0.002f);
+        assert(fabsf(te.m_transform.getRotation().dot(
+               te_in.m_transform.getRotation())) > 0.9999f);
+        assert(fabsf(pi.m_speed - pi_in.m_speed) < 0.01f);
+        assert(fabsf(pi.m_suspension_length[3] -
+                     pi_in.m_suspension_length[3]) < 0.001f);
+        assert(pi.m_skidding_state == pi_in.m_skidding_state);
+        assert(bi.m_attachment == bi_in.m_attachment);
+        assert(bi.m_special_value == bi_in.m_special_value);
+        assert(fabsf(kre.m_distance - kre_in.m_distance) < 0.01f);
+        assert(kre.m_zipper_usage == kre_in.m_zipper_usage);
+        assert(kre.m_red_skidding == kre_in.m_red_skidding);
+        assert(kre.m_jumping == kre_in.m_jumping);
+    }
+    assert(data.size() == 0);
+
+    // A frame with the largest differences still fits MAX_FRAME_SIZE
+    BareNetworkString large;
+    FrameCodec large_encoder;
+    TransformEvent te; PhysicInfo pi; BonusInfo bi; KartReplayEvent kre;
+    make_frame(0, &te, &pi, &bi, &kre);
+    pi.m_skidding_state = bi.m_attachment = bi.m_item_amount =
+        bi.m_item_type = bi.m_special_value = kre.m_nitro_usage =
+        kre.m_skidding_effect = -2147483647 - 1;
+    large_encoder.encode(&large, te, pi, bi, kre);
+    assert(large.getTotalSize() <= FrameCodec::MAX_FRAME_SIZE);
+}   // unitTesting
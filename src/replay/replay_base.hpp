@@ -22,10 +22,13 @@
 #include "LinearMath/btTransform.h"
 #include "utils/no_copy.hpp"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string>
 #include <vector>
 
+class BareNetworkString;
+
 /**
   * \ingroup race
   */
@@ -98,14 +101,61 @@ protected:
     };   // KartReplayEvent
 
     // ------------------------------------------------------------------------
-    FILE *openReplayFile(bool writeable, bool full_path = false, int replay_file_number=1);
+    /** Encodes the frames of one kart in binary replays. Values are
+     *  quantized, and stored as (zigzag, variable length) differences to the
+     *  previous frame. Each chunk of frames starts from zero again, so that
+     *  a chunk can be decoded without the frames before it.
+     */
+    class FrameCodec
+    {
+    private:
+        int32_t m_last[24];
+
+        // --------------------------------------------------------------------
+        void putDelta(BareNetworkString* out, int index, int32_t value);
+        // --------------------------------------------------------------------
+        int32_t getDelta(const BareNetworkString& in, int index);
+
+    public:
+        /** Upper bound of the size of an encoded frame: 23 values of at most
+         *  5 bytes each, and one byte of flags. */
+        static const unsigned MAX_FRAME_SIZE = 23 * 5 + 1;
+        // --------------------------------------------------------------------
+        FrameCodec()                                             { reset(); }
+        // --------------------------------------------------------------------
+        void reset();
+        // --------------------------------------------------------------------
+        void encode(BareNetworkString* out, const TransformEvent& te,
+                    const PhysicInfo& pi, const BonusInfo& bi,
+                    const KartReplayEvent& kre);
+        // --------------------------------------------------------------------
+        void decode(const BareNetworkString& in, TransformEvent* te,
+                    PhysicInfo* pi, BonusInfo* bi, KartReplayEvent* kre);
+    };   // FrameCodec
+
+    /** Marks a binary replay file, text replay files start with "version". */
+    static const char* getBinaryMagic()                     { return "STKR"; }
+    // ------------------------------------------------------------------------
+    /** Number of frames in one chunk of a binary replay. */
+    static const unsigned BINARY_CHUNK_FRAMES = 256;
+    // ------------------------------------------------------------------------
+    static void writeVarUInt(BareNetworkString* out, uint32_t value);
+    // ------------------------------------------------------------------------
+    static uint32_t readVarUInt(const BareNetworkString& in);
+    // ------------------------------------------------------------------------
+    FILE *openReplayFile(bool writeable, bool full_path = false,
+                         int replay_file_number = 1, bool binary = false);
     // ------------------------------------------------------------------------
     /** Returns the filename that was opened. */
     virtual const std::string& getReplayFilename(int replay_file_number = 1) const = 0;
     // ------------------------------------------------------------------------
     /** Returns the version number of the replay file recorderd by this executable.
      *  This is also used as a maximum supported version by this exexcutable. */
-    unsigned int getCurrentReplayVersion() const { return 4; }
+    unsigned int getCurrentReplayVersion() const { return 5; }
+
+    // ------------------------------------------------------------------------
+    /** Replays of this version or later use the binary format. */
+    unsigned int getFirstBinaryReplayVersion() const { return 5; }
 
     // ------------------------------------------------------------------------
     /** This is used to check that a loaded replay file can still
@@ -115,6 +165,8 @@ protected:
 public:
              ReplayBase();
     virtual ~ReplayBase() {};
+    // ------------------------------------------------------------------------
+    static void unitTesting();
 };   // ReplayBase
 
 #endif
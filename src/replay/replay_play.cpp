@@ -23,12 +23,15 @@
 #include "karts/ghost_kart.hpp"
 #include "karts/controller/ghost_controller.hpp"
 #include "modes/world.hpp"
+#include "network/network_string.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
 
 #include <irrlicht.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdexcept>
 #include <string>
 #include <cinttypes>
 
@@ -107,8 +110,9 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
 
     char s[1024], s1[1024];
     if (StringUtils::getExtension(fn) != "replay") return false;
-    FILE *fd = fopen(custom_replay ? fn.c_str() :
-        (file_manager->getReplayDir() + fn).c_str(), "r");
+    const std::string path = custom_replay ? fn
+                                           : file_manager->getReplayDir() + fn;
+    FILE *fd = fopen(path.c_str(), "rb");
     if (fd == NULL) return false;
     ReplayData rd;
 
@@ -116,6 +120,24 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
     rd.m_custom_replay_file = custom_replay;
     rd.m_filename = fn;
 
+    char magic[4];
+    if (fread(magic, 1, 4, fd) == 4 && memcmp(magic, getBinaryMagic(), 4) == 0)
+    {
+        const bool success = readBinaryHeader(fd, &rd);
+        fclose(fd);
+        if (!success)
+            return false;
+        m_replay_file_list.push_back(rd);
+        if (custom_replay)
+            m_current_replay_file = (unsigned int)m_replay_file_list.size() - 1;
+        return true;
+    }
+
+    // Text replay of version 3 or 4
+    fclose(fd);
+    fd = fopen(path.c_str(), "r");
+    if (fd == NULL) return false;
+
     fgets(s, 1023, fd);
     unsigned int version;
     if (sscanf(s,"version: %u", &version) != 1)
@@ -125,7 +147,7 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
         fclose(fd);
         return false;
     }
-    if (version > getCurrentReplayVersion() ||
+    if (version >= getFirstBinaryReplayVersion() ||
         version < getMinSupportedReplayVersion() )
     {
         Log::warn("Replay", "Replay is version '%d'", version);
@@ -296,6 +318,94 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
 
 }   // addReplayFile
 
+//-----------------------------------------------------------------------------
+/** Reads the header block of a binary replay, the file position must be
+ *  after the magic. The frames are not read.
+ *  \param fd The file to read from.
+ *  \param rd The replay data to fill in.
+ *  \return True if the header was read successfully.
+ */
+bool ReplayPlay::readBinaryHeader(FILE *fd, ReplayData* rd)
+{
+    const char* fn = rd->m_filename.c_str();
+    uint8_t size_data[4];
+    if (fread(size_data, 1, 4, fd) != 4)
+    {
+        Log::warn("Replay", "Truncated replay file '%s'.", fn);
+        return false;
+    }
+    const uint32_t header_size = BareNetworkString((char*)size_data, 4)
+                                 .getUInt32();
+    if (header_size > 65536)
+    {
+        Log::warn("Replay", "Invalid header in replay file '%s'.", fn);
+        return false;
+    }
+    BareNetworkString header(header_size);
+    header.getBuffer().resize(header_size);
+    if (header_size > 0 &&
+        fread(header.getData(), 1, header_size, fd) != header_size)
+    {
+        Log::warn("Replay", "Truncated replay file '%s'.", fn);
+        return false;
+    }
+
+    try
+    {
+        rd->m_replay_version = header.getUInt32();
+        if (rd->m_replay_version > getCurrentReplayVersion() ||
+            rd->m_replay_version < getFirstBinaryReplayVersion())
+        {
+            Log::warn("Replay", "Replay is version '%d'",
+                rd->m_replay_version);
+            Log::warn("Replay", "STK replay version is '%d'",
+                getCurrentReplayVersion());
+            Log::warn("Replay", "Skipped '%s'", fn);
+            return false;
+        }
+        std::string stk_version;
+        header.decodeString(&stk_version);
+        rd->m_stk_version = stk_version.c_str();
+
+        const unsigned num_karts = header.getUInt8();
+        for (unsigned i = 0; i < num_karts; i++)
+        {
+            std::string ident;
+            core::stringw name;
+            header.decodeString(&ident);
+            header.decodeStringW(&name);
+            rd->m_kart_list.push_back(ident);
+            rd->m_name_list.push_back(name);
+            rd->m_kart_color.push_back(header.getFloat());
+        }
+        // First user is the game master and the "owner" of this replay file
+        if (!rd->m_name_list.empty())
+            rd->m_user_name = rd->m_name_list[0];
+
+        rd->m_reverse = header.getUInt8() != 0;
+        rd->m_difficulty = header.getUInt8();
+        header.decodeString(&rd->m_minor_mode);
+        header.decodeString(&rd->m_track_name);
+        rd->m_laps = header.getUInt32();
+        rd->m_min_time = header.getFloat();
+        rd->m_replay_uid = header.getUInt64();
+    }
+    catch (std::out_of_range&)
+    {
+        Log::warn("Replay", "Invalid header in replay file '%s'.", fn);
+        return false;
+    }
+
+    rd->m_track = track_manager->getTrack(rd->m_track_name);
+    if (rd->m_track == NULL)
+    {
+        Log::warn("Replay", "Track '%s' used in replay '%s' not found in STK!",
+            rd->m_track_name.c_str(), fn);
+        return false;
+    }
+    return true;
+}   // readBinaryHeader
+
 //-----------------------------------------------------------------------------
 void ReplayPlay::load()
 {
@@ -317,8 +427,11 @@ void ReplayPlay::loadFile(bool second_replay)
     int replay_index = second_replay ? m_second_replay_file : m_current_replay_file;
     int replay_file_number = second_replay ? 2 : 1;
 
+    ReplayData &rd = m_replay_file_list[replay_index];
+    const bool binary = rd.m_replay_version >= getFirstBinaryReplayVersion();
     FILE *fd = openReplayFile(/*writeable*/false,
-            m_replay_file_list.at(replay_index).m_custom_replay_file, replay_file_number);
+            m_replay_file_list.at(replay_index).m_custom_replay_file,
+            replay_file_number, binary);
 
     if(!fd)
     {
@@ -331,9 +444,28 @@ void ReplayPlay::loadFile(bool second_replay)
     Log::info("Replay", "Reading replay file '%s'.",
                     getReplayFilename(replay_file_number).c_str());
 
-    ReplayData &rd = m_replay_file_list[replay_index];
     unsigned int num_kart = (unsigned int)m_replay_file_list.at(replay_index)
                                                             .m_kart_list.size();
+    if (binary)
+    {
+        // Skip the magic and the header block. The world needs all ghost
+        // karts of the replay, so a broken file aborts loading the race.
+        uint8_t size_data[4];
+        bool success = fseek(fd, 4, SEEK_SET) == 0 &&
+            fread(size_data, 1, 4, fd) == 4 &&
+            fseek(fd, BareNetworkString((char*)size_data, 4).getUInt32(),
+                  SEEK_CUR) == 0;
+        for (unsigned int k = 0; success && k < num_kart; k++)
+            success = readBinaryKartData(fd, second_replay);
+        fclose(fd);
+        if (!success)
+        {
+            throw std::runtime_error("Can't read replay file '" +
+                getReplayFilename(replay_file_number) + "'.");
+        }
+        return;
+    }
+
     unsigned int lines_to_skip = (rd.m_replay_version == 3) ? 7 : 10;
     lines_to_skip += (rd.m_replay_version == 3) ? num_kart : 2*num_kart;
 
@@ -362,22 +494,8 @@ void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
 
     int replay_index = second_replay ? m_second_replay_file
                                      : m_current_replay_file;
-
-    const unsigned int kart_num = (unsigned int)m_ghost_karts.size();
-    unsigned int first_loaded_f_num = 0;
-
-    if (!second_replay && m_second_replay_enabled)
-        first_loaded_f_num = (unsigned int)m_replay_file_list.at(m_second_replay_file)
-                                                             .m_kart_list.size();
-
     ReplayData &rd = m_replay_file_list[replay_index];
-    m_ghost_karts.push_back(std::make_shared<GhostKart>
-        (rd.m_kart_list.at(kart_num-first_loaded_f_num), kart_num, kart_num + 1,
-        rd.m_kart_color.at(kart_num-first_loaded_f_num)));
-    m_ghost_karts[kart_num]->init(RaceManager::KT_GHOST);
-    Controller* controller = new GhostController(getGhostKart(kart_num).get(),
-                                                 rd.m_name_list[kart_num-first_loaded_f_num]);
-    getGhostKart(kart_num)->setController(controller);
+    const unsigned int kart_num = createGhostKart(second_replay);
 
     unsigned int size;
     if(sscanf(next_line,"size: %u",&size)!=1)
@@ -494,6 +612,112 @@ void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
 
 }   // readKartData
 
+//-----------------------------------------------------------------------------
+/** Creates the next ghost kart of a replay file.
+ *  \return The index of the new ghost kart.
+ */
+unsigned int ReplayPlay::createGhostKart(bool second_replay)
+{
+    int replay_index = second_replay ? m_second_replay_file
+                                     : m_current_replay_file;
+
+    const unsigned int kart_num = (unsigned int)m_ghost_karts.size();
+    unsigned int first_loaded_f_num = 0;
+
+    if (!second_replay && m_second_replay_enabled)
+        first_loaded_f_num = (unsigned int)m_replay_file_list.at(m_second_replay_file)
+                                                             .m_kart_list.size();
+
+    ReplayData &rd = m_replay_file_list[replay_index];
+    m_ghost_karts.push_back(std::make_shared<GhostKart>
+        (rd.m_kart_list.at(kart_num-first_loaded_f_num), kart_num, kart_num + 1,
+        rd.m_kart_color.at(kart_num-first_loaded_f_num)));
+    m_ghost_karts[kart_num]->init(RaceManager::KT_GHOST);
+    Controller* controller = new GhostController(getGhostKart(kart_num).get(),
+                                                 rd.m_name_list[kart_num-first_loaded_f_num]);
+    getGhostKart(kart_num)->setController(controller);
+    return kart_num;
+}   // createGhostKart
+
+//-----------------------------------------------------------------------------
+/** Reads the frames of one kart from a binary replay file. The frames are
+ *  read one chunk at a time, so only a chunk needs to be in memory besides
+ *  the decoded frames.
+ *  \param fd The file descriptor from which to read.
+ *  \return False if the data of the kart is truncated or invalid.
+ */
+bool ReplayPlay::readBinaryKartData(FILE *fd, bool second_replay)
+{
+    const unsigned int kart_num = createGhostKart(second_replay);
+
+    BareNetworkString chunk(BINARY_CHUNK_FRAMES * 64);
+    auto read_uint32 = [fd, &chunk](uint32_t* value)
+        {
+            chunk.getBuffer().resize(4);
+            chunk.reset();
+            if (fread(chunk.getData(), 1, 4, fd) != 4)
+                return false;
+            *value = chunk.getUInt32();
+            return true;
+        };
+
+    uint32_t size = 0;
+    if (!read_uint32(&size))
+    {
+        Log::warn("Replay", "Number of records not found in replay file "
+            "for kart %d.", kart_num);
+        return false;
+    }
+
+    FrameCodec codec;
+    for (uint32_t i = 0; i < size; i += BINARY_CHUNK_FRAMES)
+    {
+        uint32_t chunk_size = 0;
+        bool success = read_uint32(&chunk_size);
+        // Don't allocate whatever a broken file claims
+        if (chunk_size > BINARY_CHUNK_FRAMES * FrameCodec::MAX_FRAME_SIZE)
+        {
+            Log::warn("Replay", "Invalid chunk size %u for kart %d.",
+                chunk_size, kart_num);
+            return false;
+        }
+        if (success)
+        {
+            chunk.getBuffer().resize(chunk_size);
+            chunk.reset();
+            success = fread(chunk.getData(), 1, chunk_size, fd) == chunk_size;
+        }
+        if (!success)
+        {
+            Log::warn("Replay", "Replay file truncated for kart %d.",
+                kart_num);
+            return false;
+        }
+        codec.reset();
+        const uint32_t last = std::min<uint32_t>(size,
+                                                 i + BINARY_CHUNK_FRAMES);
+        try
+        {
+            for (uint32_t j = i; j < last; j++)
+            {
+                TransformEvent te;
+                PhysicInfo pi;
+                BonusInfo bi;
+                KartReplayEvent kre;
+                codec.decode(chunk, &te, &pi, &bi, &kre);
+                m_ghost_karts[kart_num]->addReplayEvent(te.m_time,
+                    te.m_transform, pi, bi, kre);
+            }
+        }
+        catch (std::out_of_range&)
+        {
+            Log::warn("Replay", "Invalid frames for kart %d.", kart_num);
+            return false;
+        }
+    }   // for i
+    return true;
+}   // readBinaryKartData
+
 //-----------------------------------------------------------------------------
 /** call getReplayIdByUID and set the current replay file to the first one
  *  with a matching UID.
@@ -125,6 +125,9 @@ private:
           ReplayPlay();
          ~ReplayPlay();
     void  readKartData(FILE *fd, char *next_line, bool second_replay);
+    unsigned int createGhostKart(bool second_replay);
+    bool  readBinaryHeader(FILE *fd, ReplayData* rd);
+    bool  readBinaryKartData(FILE *fd, bool second_replay);
 public:
     void  reset();
     void  load();
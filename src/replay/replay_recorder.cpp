@@ -31,6 +31,7 @@
 #include "modes/easter_egg_hunt.hpp"
 #include "modes/linear_world.hpp"
 #include "modes/world.hpp"
+#include "network/network_string.hpp"
 #include "physics/btKart.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/track.hpp"
@@ -38,7 +39,6 @@
 #include <algorithm>
 #include <stdio.h>
 #include <string>
-#include <cinttypes>
 
 ReplayRecorder *ReplayRecorder::m_replay_recorder = NULL;
 
@@ -383,7 +383,8 @@ void ReplayRecorder::save()
         << "_" << num_karts << "_" << time << ".replay";
     m_filename = oss.str();
 
-    FILE *fd = openReplayFile(/*writeable*/true);
+    FILE *fd = openReplayFile(/*writeable*/true, /*full_path*/false,
+                              /*replay_file_number*/1, /*binary*/true);
     if (!fd)
     {
         Log::error("ReplayRecorder", "Can't open '%s' for writing - "
@@ -391,30 +392,34 @@ void ReplayRecorder::save()
         return;
     }
 
-    core::stringw msg = _("Replay saved in \"%s\".",
-        (file_manager->getReplayDir() + getReplayFilename()).c_str());
-    MessageQueue::add(MessageQueue::MT_GENERIC, msg);
-
-    fprintf(fd, "version: %d\n", getCurrentReplayVersion());
-    fprintf(fd, "stk_version: %s\n", STK_VERSION);
+    // The header is written as one block with its size in front, so that
+    // the replay selection can read it without reading the frames.
+    BareNetworkString header;
+    header.addUInt32(getCurrentReplayVersion());
+    header.encodeString(std::string(STK_VERSION));
 
     unsigned int player_count = 0;
-    for (unsigned int real_karts = 0; real_karts < num_karts; real_karts++)
+    std::vector<unsigned int> real_karts;
+    for (unsigned int k = 0; k < num_karts; k++)
     {
-        const AbstractKart *kart = world->getKart(real_karts);
-        if (kart->isGhostKart()) continue;
-
-        // XML encode the username to handle Unicode
-        fprintf(fd, "kart: %s %s\n", kart->getIdent().c_str(),
-                StringUtils::xmlEncode(kart->getController()->getName()).c_str());
+        if (!world->getKart(k)->isGhostKart())
+            real_karts.push_back(k);
+    }
+    header.addUInt8((uint8_t)real_karts.size());
+    for (unsigned int k : real_karts)
+    {
+        const AbstractKart *kart = world->getKart(k);
+        header.encodeString(kart->getIdent());
+        header.encodeString(kart->getController()->getName());
 
         if (kart->getController()->isPlayerController())
         {
-            fprintf(fd, "kart_color: %f\n", StateManager::get()->getActivePlayer(player_count)->getConstProfile()->getDefaultKartColor());
+            header.addFloat(StateManager::get()->getActivePlayer(player_count)
+                ->getConstProfile()->getDefaultKartColor());
             player_count++;
         }
         else
-            fprintf(fd, "kart_color: 0\n");
+            header.addFloat(0.0f);
     }
 
     m_last_uid = computeUID(min_time);
@@ -422,59 +427,67 @@ void ReplayRecorder::save()
     int num_laps = race_manager->getNumLaps();
     if (num_laps == 9999) num_laps = 0; // no lap in that race mode
 
-    fprintf(fd, "kart_list_end\n");
-    fprintf(fd, "reverse: %d\n",    (int)race_manager->getReverseTrack());
-    fprintf(fd, "difficulty: %d\n", race_manager->getDifficulty());
-    fprintf(fd, "mode: %s\n",       race_manager->getMinorModeName().c_str());
-    fprintf(fd, "track: %s\n",      Track::getCurrentTrack()->getIdent().c_str());
-    fprintf(fd, "laps: %d\n",       num_laps);
-    fprintf(fd, "min_time: %f\n",   min_time);
-    fprintf(fd, "replay_uid: %" PRIu64 "\n", m_last_uid);
+    header.addUInt8((uint8_t)race_manager->getReverseTrack())
+          .addUInt8((uint8_t)race_manager->getDifficulty())
+          .encodeString(race_manager->getMinorModeName())
+          .encodeString(Track::getCurrentTrack()->getIdent())
+          .addUInt32(num_laps).addFloat(min_time).addUInt64(m_last_uid);
 
-    for (unsigned int k = 0; k < num_karts; k++)
+    auto write_uint32 = [fd](uint32_t value)
+        {
+            BareNetworkString ns(4);
+            ns.addUInt32(value);
+            return fwrite(ns.getData(), 1, 4, fd) == 4;
+        };
+    bool ok = fwrite(getBinaryMagic(), 1, 4, fd) == 4 &&
+        write_uint32(header.getTotalSize()) &&
+        fwrite(header.getData(), 1, header.getTotalSize(), fd) ==
+        header.getTotalSize();
+
+    // Each kart's frames are written in chunks, each chunk starts with its
+    // size, and can be decoded without the previous chunks.
+    FrameCodec codec;
+    BareNetworkString chunk(BINARY_CHUNK_FRAMES * 64);
+    for (unsigned int k : real_karts)
     {
-        if (world->getKart(k)->isGhostKart()) continue;
-        fprintf(fd, "size:     %d\n", m_count_transforms[k]);
-
+        if (!ok)
+            break;
         unsigned int num_transforms = std::min(m_max_frames,
                                                m_count_transforms[k]);
-        for (unsigned int i = 0; i < num_transforms; i++)
+        ok = write_uint32(num_transforms);
+        for (unsigned int i = 0; ok && i < num_transforms;
+             i += BINARY_CHUNK_FRAMES)
         {
-            const TransformEvent *p  = &(m_transform_events[k][i]);
-            const PhysicInfo *q      = &(m_physic_info[k][i]);
-            const BonusInfo *b      = &(m_bonus_info[k][i]);
-            const KartReplayEvent *r = &(m_kart_replay_event[k][i]);
-            fprintf(fd, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
-                    p->m_time,
-                    p->m_transform.getOrigin().getX(),
-                    p->m_transform.getOrigin().getY(),
-                    p->m_transform.getOrigin().getZ(),
-                    p->m_transform.getRotation().getX(),
-                    p->m_transform.getRotation().getY(),
-                    p->m_transform.getRotation().getZ(),
-                    p->m_transform.getRotation().getW(),
-                    q->m_speed,
-                    q->m_steer,
-                    q->m_suspension_length[0],
-                    q->m_suspension_length[1],
-                    q->m_suspension_length[2],
-                    q->m_suspension_length[3],
-                    q->m_skidding_state,
-                    b->m_attachment,
-                    b->m_nitro_amount,
-                    b->m_item_amount,
-                    b->m_item_type,
-                    b->m_special_value,
-                    r->m_distance,
-                    r->m_nitro_usage,
-                    (int)r->m_zipper_usage,
-                    r->m_skidding_effect,
-                    (int)r->m_red_skidding,
-                    (int)r->m_jumping
-                );
+            codec.reset();
+            chunk.getBuffer().clear();
+            const unsigned int last = std::min(num_transforms,
+                                               i + BINARY_CHUNK_FRAMES);
+            for (unsigned int j = i; j < last; j++)
+            {
+                codec.encode(&chunk, m_transform_events[k][j],
+                    m_physic_info[k][j], m_bonus_info[k][j],
+                    m_kart_replay_event[k][j]);
+            }
+            ok = write_uint32(chunk.getTotalSize()) &&
+                fwrite(chunk.getData(), 1, chunk.getTotalSize(), fd) ==
+                chunk.getTotalSize();
         }   // for i
     }
-    fclose(fd);
+    // Buffered data is only written by fclose, which can fail too
+    ok = fclose(fd) == 0 && ok;
+    if (!ok)
+    {
+        // Don't leave a truncated replay behind, it would show up in the
+        // replay selection
+        Log::error("ReplayRecorder", "Error writing '%s'.",
+            getReplayFilename().c_str());
+        file_manager->removeFile(file_manager->getReplayDir() +
+                                 getReplayFilename());
+        return;
+    }
+    core::stringw msg = _("Replay saved in \"%s\".",
+        (file_manager->getReplayDir() + getReplayFilename()).c_str());
+    MessageQueue::add(MessageQueue::MT_GENERIC, msg);
 }   // save
 
 /* Returns an encoding value for a given attachment type.
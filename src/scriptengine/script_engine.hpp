@@ -33,6 +33,9 @@ class TrackObjectPresentation;
 
 namespace Scripting
 {
+    std::string getScript(std::string script_path);
+    void AngelScript_ErrorCallback(const asSMessageInfo *msg, void *param);
+
     /** Represents a scripting function to execute after a given time */
     struct PendingTimeout : NoCopy
     {
@@ -102,10 +102,11 @@ void CheckStructure::update(float dt)
 {
     World *world = World::getWorld();
     LinearWorld* lw = dynamic_cast<LinearWorld*>(World::getWorld());
-    for(unsigned int i=0; i<world->getNumKarts(); i++)
+    const KartStateSnapshot& snapshot = world->getKartSnapshot();
+    for(unsigned int i=0; i<snapshot.getNumKarts(); i++)
     {
-        const Vec3 &xyz = world->getKart(i)->getFrontXYZ();
-        if(world->getKart(i)->getKartAnimation()) continue;
+        const Vec3 &xyz = snapshot.getFrontXYZ(i);
+        if(snapshot.hasFlag(i, KartStateSnapshot::KF_ANIMATION)) continue;
         // Only check active checklines.
         if(m_is_active[i] && isTriggered(m_previous_position[i], xyz, i))
         {
@@ -48,7 +48,9 @@
 #include "graphics/sp/sp_mesh_node.hpp"
 #include "graphics/sp/sp_shader_manager.hpp"
 #include "graphics/sp/sp_texture_manager.hpp"
+#include "graphics/sp_mesh_loader.hpp"
 #include "io/file_manager.hpp"
+#include "io/utf_writer.hpp"
 #include "io/xml_node.hpp"
 #include "items/item.hpp"
 #include "items/item_manager.hpp"
@@ -90,6 +92,7 @@
 #include <SMeshBuffer.h>
 
 #include <iostream>
+#include <set>
 #include <stdexcept>
 #include <sstream>
 #include <wchar.h>
@@ -102,7 +105,7 @@ bool        Track::m_dont_load_navmesh = false;
 Track      *Track::m_current_track = NULL;
 
 // ----------------------------------------------------------------------------
-Track::Track(const std::string &filename)
+Track::Track(const std::string &filename, const XMLNode *metadata)
 {
 #ifdef DEBUG
     m_magic_number          = 0x17AC3802;
@@ -142,6 +145,7 @@ Track::Track(const std::string &filename)
     m_max_arena_players     = 0;
     m_has_easter_eggs       = false;
     m_has_navmesh           = false;
+    m_has_navmesh_file      = false;
     m_is_soccer             = false;
     m_is_cutscene           = false;
     m_camera_far            = 1000.0f;
@@ -175,7 +179,10 @@ Track::Track(const std::string &filename)
     m_all_nodes.clear();
     m_static_physics_only_nodes.clear();
     m_all_cached_meshes.clear();
-    loadTrackInfo();
+    if (metadata)
+        loadMetadata(*metadata);
+    else
+        loadTrackInfo();
 }   // Track
 
 //-----------------------------------------------------------------------------
@@ -638,7 +645,8 @@ void Track::loadTrackInfo()
         delete easter;
     }
 
-    if(file_manager->fileExists(m_root+"navmesh.xml") && !m_dont_load_navmesh)
+    m_has_navmesh_file = file_manager->fileExists(m_root+"navmesh.xml");
+    if(m_has_navmesh_file && !m_dont_load_navmesh)
         m_has_navmesh = true;
     else if ( (m_is_arena || m_is_soccer) && !m_dont_load_navmesh)
     {
@@ -653,9 +661,81 @@ void Track::loadTrackInfo()
     // Max 10 players supported in arena
     if (m_max_arena_players > 10)
         m_max_arena_players = 10;
-
+    m_metadata_only = false;
 }   // loadTrackInfo
 
+//-----------------------------------------------------------------------------
+/** Loads the metadata of this track which was saved in the track index by
+ *  saveMetadata. All values are already post processed the way loadTrackInfo
+ *  does it.
+ *  \param node The XML node of this track in the track index.
+ */
+void Track::loadMetadata(const XMLNode &node)
+{
+    // Strings are stored xml encoded, see saveMetadata
+    std::string name, designer, screenshot;
+    node.get("name",                   &name);
+    m_name = core::stringc(StringUtils::xmlDecode(name)).c_str();
+    node.get("designer",               &designer);
+    m_designer = StringUtils::xmlDecode(designer);
+    node.get("screenshot",             &screenshot);
+    m_screenshot = core::stringc(StringUtils::xmlDecode(screenshot)).c_str();
+    node.get("groups",                 &m_groups);
+    for (std::string &group : m_groups)
+        group = core::stringc(StringUtils::xmlDecode(group)).c_str();
+    node.get("version",                &m_version);
+    node.get("internal",               &m_internal);
+    node.get("arena",                  &m_is_arena);
+    node.get("soccer",                 &m_is_soccer);
+    node.get("ctf",                    &m_is_ctf);
+    node.get("cutscene",               &m_is_cutscene);
+    node.get("reverse",                &m_reverse_available);
+    node.get("max-arena-players",      &m_max_arena_players);
+    node.get("default-number-of-laps", &m_default_number_of_laps);
+    node.get("easter-eggs",            &m_has_easter_eggs);
+    node.get("navmesh-file",           &m_has_navmesh_file);
+    m_has_navmesh = m_has_navmesh_file && !m_dont_load_navmesh;
+    m_actual_number_of_laps = m_default_number_of_laps;
+    if (m_groups.size() == 0) m_groups.push_back(DEFAULT_GROUP_NAME);
+    m_metadata_only = true;
+}   // loadMetadata
+
+//-----------------------------------------------------------------------------
+/** Writes the metadata of this track as attributes of an XML element for the
+ *  track index. It contains everything the menus and the server need before
+ *  the track is actually loaded.
+ *  \param out The writer to use.
+ */
+void Track::saveMetadata(UTFWriter &out) const
+{
+    // Byte strings are widened unchanged, and xmlEncode makes sure that the
+    // index only contains ASCII characters (and no spaces in the groups)
+    auto encode = [](const std::string &str)
+    {
+        core::stringw wide;
+        for (unsigned int i = 0; i < str.size(); i++)
+            wide += (wchar_t)(unsigned char)str[i];
+        return StringUtils::xmlEncode(wide);
+    };
+    out << "name=\"" << encode(m_name)
+        << "\" designer=\"" << StringUtils::xmlEncode(m_designer)
+        << "\" screenshot=\"" << encode(m_screenshot)
+        << "\" groups=\"";
+    for (unsigned int i = 0; i < m_groups.size(); i++)
+        out << (i == 0 ? "" : " ") << encode(m_groups[i]);
+    out << "\" version=\"" << m_version
+        << "\" internal=\"" << m_internal
+        << "\" arena=\"" << m_is_arena
+        << "\" soccer=\"" << m_is_soccer
+        << "\" ctf=\"" << m_is_ctf
+        << "\" cutscene=\"" << m_is_cutscene
+        << "\" reverse=\"" << m_reverse_available
+        << "\" max-arena-players=\"" << m_max_arena_players
+        << "\" default-number-of-laps=\"" << m_default_number_of_laps
+        << "\" easter-eggs=\"" << m_has_easter_eggs
+        << "\" navmesh-file=\"" << m_has_navmesh_file << "\"";
+}   // saveMetadata
+
 //-----------------------------------------------------------------------------
 /** Loads all curves from the XML node.
  */
@@ -1770,6 +1850,14 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
 {
     assert(!m_current_track);
 
+    if (m_metadata_only)
+    {
+        // Keep the number of laps selected in the track info screen
+        const int laps = m_actual_number_of_laps;
+        loadTrackInfo();
+        m_actual_number_of_laps = laps;
+    }
+
     // Use m_filename to also get the path, not only the identifier
     STKTexManager::getInstance()
         ->setTextureErrorMessage("While loading track '%s'", m_filename);
@@ -1863,6 +1951,29 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
         throw std::runtime_error(msg.str());
     }
 
+    // Decode the meshes of the track used by the scene in parallel, the
+    // mesh loader then only needs to create their materials when the scene
+    // is loaded below. The scope frees unused ones if loading throws.
+    SPMeshLoader::PredecodedScope predecoded_scope;
+    {
+        std::set<std::string> spm_files;
+        std::vector<const XMLNode*> nodes(1, root);
+        while (!nodes.empty())
+        {
+            const XMLNode* node = nodes.back();
+            nodes.pop_back();
+            std::string model;
+            if (node->get("model", &model) &&
+                StringUtils::getExtension(model) == "spm" &&
+                file_manager->fileExists(m_root + model))
+                spm_files.insert(m_root + model);
+            for (unsigned int i = 0; i < node->getNumNodes(); i++)
+                nodes.push_back(node->getNode(i));
+        }
+        SPMeshLoader::predecodeFiles(std::vector<std::string>(
+            spm_files.begin(), spm_files.end()));
+    }
+
     m_current_track = this;
 
     // Load the graph only now: this function is called from world, after
@@ -2246,6 +2357,8 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
     }
     main_loop->renderGUI(6100);
 
+    // Free the meshes which were not used by the scene
+    SPMeshLoader::clearPredecoded();
     STKTexManager::getInstance()->unsetTextureErrorMessage();
 #ifndef SERVER_ONLY
     if (CVS->isGLSL())
@@ -54,6 +54,7 @@ class RenderTarget;
 class TrackObject;
 class TrackObjectManager;
 class TriangleMesh;
+class UTFWriter;
 class XMLNode;
 
 const int HEIGHT_MAP_RESOLUTION = 256;
@@ -167,6 +168,11 @@ private:
      * for the overworld to keep its textures loaded. */
     bool m_materials_loaded;
 
+    /** True if only the metadata from the track index was loaded (which is
+     *  all that the menus and the track voting need). The rest of track.xml
+     *  is then read when the track is loaded for a race. */
+    bool m_metadata_only;
+
     /** True if this track (textures and track data) should be cached. Used
      *  for the overworld. */
     bool m_cache_track;
@@ -211,6 +217,9 @@ private:
     bool                     m_has_easter_eggs;
     /** True if this track has navmesh. */
     bool                     m_has_navmesh;
+    /** True if this track has a navmesh file. Unlike m_has_navmesh it does
+     *  not depend on --dont-load-navmesh, so it is the one in the index. */
+    bool                     m_has_navmesh_file;
     /** True if this track is a soccer arena. */
     bool                     m_is_soccer;
 
@@ -391,6 +400,7 @@ private:
     int m_actual_number_of_laps;
 
     void loadTrackInfo();
+    void loadMetadata(const XMLNode &node);
     void loadDriveGraph(unsigned int mode_id, const bool reverse);
     void loadArenaGraph(const XMLNode &node);
     btQuaternion getArenaStartRotation(const Vec3& xyz, float heading);
@@ -420,11 +430,13 @@ public:
 
     static const float NOHIT;
 
-                       Track             (const std::string &filename);
+                       Track             (const std::string &filename,
+                                          const XMLNode *metadata = NULL);
                       ~Track             ();
     void               cleanup           ();
     void               removeCachedData  ();
     void               startMusic        () const;
+    void               saveMetadata      (UTFWriter &out) const;
 
     void               createPhysicsModel(unsigned int main_track_count);
     void               updateGraphics(float dt);
@@ -21,6 +21,7 @@
 #include "config/stk_config.hpp"
 #include "graphics/irr_driver.hpp"
 #include "io/file_manager.hpp"
+#include "io/utf_writer.hpp"
 #include "tracks/track.hpp"
 
 #include <algorithm>
@@ -32,6 +33,9 @@
 TrackManager* track_manager = 0;
 std::vector<std::string>  TrackManager::m_track_search_path;
 
+/** Increase if the content of the track index changes. */
+static const int TRACK_INDEX_VERSION = 2;
+
 /** Constructor (currently empty). The real work happens in loadTrackList.
  */
 TrackManager::TrackManager()
@@ -132,7 +136,10 @@ std::vector<std::string> TrackManager::getAllTrackIdentifiers()
 }   // getAllTrackNames
 
 //-----------------------------------------------------------------------------
-/** Loads all tracks from the track directory (data/track).
+/** Loads all tracks from the track directory (data/track). Tracks which are
+ *  unchanged since the last run (same modification time of the track
+ *  directory and of track.xml) are created from the track index, which
+ *  only contains their metadata. The rest is loaded on first use.
  */
 void TrackManager::loadTrackList()
 {
@@ -146,13 +153,64 @@ void TrackManager::loadTrackList()
     m_track_avail.clear();
     m_tracks.clear();
 
+    // Read the track index of the last run
+    XMLNode *index = NULL;
+    std::map<std::string, const XMLNode*> index_entries;
+    const std::string index_file = getTrackIndexFile();
+    if (!index_file.empty() && file_manager->fileExists(index_file))
+        index = file_manager->createXMLTree(index_file);
+    int version = 0;
+    if (index && index->getName() == "track-index" &&
+        index->get("version", &version) && version == TRACK_INDEX_VERSION)
+    {
+        for (unsigned int i = 0; i < index->getNumNodes(); i++)
+        {
+            const XMLNode *entry = index->getNode(i);
+            std::string dir;
+            if (entry->getName() == "track" && entry->get("dir", &dir))
+            {
+                dir = StringUtils::wideToUtf8(StringUtils::xmlDecode(dir));
+                index_entries[dir] = entry;
+            }
+        }
+    }
+
+    // Modification times of all track directories and track.xml files
+    std::map<std::string, std::pair<uint64_t, uint64_t> > mtimes;
+    bool index_outdated = false;
+    auto load_track = [&](const std::string &dirname)
+    {
+        std::string config_file = dirname+"track.xml";
+        if (!file_manager->fileExists(config_file))
+            return false;
+        std::pair<uint64_t, uint64_t> mtime(
+            file_manager->getModificationTime(dirname),
+            file_manager->getModificationTime(config_file));
+        mtimes[dirname] = mtime;
+
+        const XMLNode *metadata = NULL;
+        auto it = index_entries.find(dirname);
+        if (it != index_entries.end())
+        {
+            int64_t dir_mtime = 0, xml_mtime = 0;
+            it->second->get("dir-mtime", &dir_mtime);
+            it->second->get("xml-mtime", &xml_mtime);
+            if ((uint64_t)dir_mtime == mtime.first &&
+                (uint64_t)xml_mtime == mtime.second)
+                metadata = it->second;
+        }
+        if (!metadata)
+            index_outdated = true;
+        return loadTrack(dirname, metadata);
+    };   // load_track
+
     for(unsigned int i=0; i<m_track_search_path.size(); i++)
     {
         const std::string &dir = m_track_search_path[i];
 
         // First test if the directory itself contains a track:
         // ----------------------------------------------------
-        if(loadTrack(dir)) continue;  // track found, no more tests
+        if(load_track(dir)) continue;  // track found, no more tests
 
         // Then see if a subdir of this dir contains tracks
         // ------------------------------------------------
@@ -162,17 +220,75 @@ void TrackManager::loadTrackList()
             subdir != dirs.end(); subdir++)
         {
             if(*subdir=="." || *subdir=="..") continue;
-            loadTrack(dir+*subdir+"/");
+            load_track(dir+*subdir+"/");
         }   // for dir in dirs
     }   // for i <m_track_search_path.size()
+
+    // Also rewrite the index if tracks were removed
+    if (index_outdated || index_entries.size() != m_tracks.size())
+        saveTrackIndex(mtimes);
+    delete index;
 }  // loadTrackList
 
+// ----------------------------------------------------------------------------
+/** Returns the name of the file in which the metadata of all tracks is
+ *  stored between runs, or "" if there is no cache directory. */
+std::string TrackManager::getTrackIndexFile() const
+{
+    if (file_manager->getCachedXMLDir().empty())
+        return "";
+    return file_manager->getCachedXMLDir() + "track_index.xml";
+}   // getTrackIndexFile
+
+// ----------------------------------------------------------------------------
+/** Saves the metadata of all loaded tracks, so the next run can skip reading
+ *  the track files of unchanged tracks.
+ *  \param mtimes Modification times of the track directory and track.xml
+ *         of each track, taken before the track was loaded.
+ */
+void TrackManager::saveTrackIndex(const std::map<std::string,
+                                  std::pair<uint64_t, uint64_t> >& mtimes)
+{
+    const std::string filename = getTrackIndexFile();
+    if (filename.empty())
+        return;
+    try
+    {
+        UTFWriter index(filename.c_str(), false);
+        index << "<?xml version=\"1.0\"?>\n";
+        index << "<track-index version=\"" << TRACK_INDEX_VERSION << "\">\n";
+        for (unsigned int i = 0; i < m_tracks.size(); i++)
+        {
+            auto it = mtimes.find(m_all_track_dirs[i]);
+            if (it == mtimes.end())
+                continue;
+            index << "    <track dir=\""
+                  << StringUtils::xmlEncode(
+                         StringUtils::utf8ToWide(m_all_track_dirs[i]))
+                  << "\" dir-mtime=\"" << it->second.first
+                  << "\" xml-mtime=\"" << it->second.second << "\" ";
+            m_tracks[i]->saveMetadata(index);
+            index << "/>\n";
+        }
+        index << "</track-index>\n";
+        index.close();
+    }
+    catch (std::runtime_error& e)
+    {
+        Log::warn("TrackManager", "Failed to write track index '%s': %s",
+                  filename.c_str(), e.what());
+    }
+}   // saveTrackIndex
+
 // ----------------------------------------------------------------------------
 /** Tries to load a track from a single directory. Returns true if a track was
  *  successfully loaded.
  *  \param dirname Name of the directory to load the track from.
+ *  \param metadata If not NULL, the entry of this track in the track index,
+ *         which is used instead of reading track.xml.
  */
-bool TrackManager::loadTrack(const std::string& dirname)
+bool TrackManager::loadTrack(const std::string& dirname,
+                             const XMLNode* metadata)
 {
     std::string config_file = dirname+"track.xml";
     if(!file_manager->fileExists(config_file))
@@ -182,7 +298,7 @@ bool TrackManager::loadTrack(const std::string& dirname)
 
     try
     {
-        track = new Track(config_file);
+        track = new Track(config_file, metadata);
     }
     catch (std::exception& e)
     {
@@ -208,11 +324,7 @@ bool TrackManager::loadTrack(const std::string& dirname)
     m_track_avail.push_back(true);
     updateGroups(track);
 
-    // Populate the texture cache with track screenshots
-    // (internal tracks like end cutscene don't have screenshots)
-    if (!track->isInternal())
-        irr_driver->getTexture(track->getScreenshotFile());
-
+    // Screenshots are loaded by the track screens when they are shown
     return true;
 }   // loadTrack
 
@@ -19,11 +19,13 @@
 #ifndef HEADER_TRACK_MANAGER_HPP
 #define HEADER_TRACK_MANAGER_HPP
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
 
 class Track;
+class XMLNode;
 
 /**
   * \brief Simple class to load and manage track data, track names and such
@@ -68,6 +70,9 @@ private:
     std::vector<bool>                        m_track_avail;
 
     void          updateGroups(const Track* track);
+    std::string   getTrackIndexFile() const;
+    void          saveTrackIndex(const std::map<std::string,
+                                 std::pair<uint64_t, uint64_t> >& mtimes);
 
 public:
                 TrackManager();
@@ -80,7 +85,8 @@ public:
     /** Load all .track files from all directories */
     void  loadTrackList();
     void  removeTrack(const std::string &ident);
-    bool  loadTrack(const std::string& dirname);
+    bool  loadTrack(const std::string& dirname,
+                    const XMLNode* metadata = NULL);
     void  removeAllCachedData();
     int   getNumberOfRaceTracks() const;
     Track* getTrack(const std::string& ident) const;
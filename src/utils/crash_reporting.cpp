@@ -107,6 +107,9 @@
                                 "Call stack:\n";
             msg += callstack;
             Log::error("StackTrace", "%s", msg.c_str());
+            // Make sure the log file has the call stack before the process
+            // is terminated
+            Log::flushBuffers();
             MessageBoxA(NULL, msg.c_str(), "SuperTuxKart crashed :/", MB_OK);
         }   // winCrashHandler
 
@@ -413,6 +416,7 @@
                 // Skip 3 stacks which are crash_reporting doing
                 Log::error("CrashReporting", "%s", each[i].c_str());
             }
+            Log::flushFromSignalHandler();
             exit(0);
         }
 
@@ -507,6 +511,39 @@
         }
     }   // end namespace CrashReporting
 
+#elif !defined(WIN32)
+
+    #include <signal.h>
+    #include <unistd.h>
+
+    namespace CrashReporting
+    {
+        /** Without a backtrace the handler only makes sure that the lines
+         *  logged before the crash are written, then crashes as before. */
+        void signalHandler(int signal_no)
+        {
+            // Only async signal safe calls here
+            const char msg[] = "SuperTuxKart crashed, writing the log.\n";
+            ssize_t written = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+            (void)written;
+            Log::flushFromSignalHandler();
+            signal(signal_no, SIG_DFL);
+            raise(signal_no);
+        }   // signalHandler
+
+        // --------------------------------------------------------------------
+        void installHandlers()
+        {
+            signal(SIGSEGV, signalHandler);
+            signal(SIGABRT, signalHandler);
+            signal(SIGFPE,  signalHandler);
+            signal(SIGILL,  signalHandler);
+        }   // installHandlers
+
+        // --------------------------------------------------------------------
+        void getCallStack(std::string& callstack) {}
+    }   // end namespace CrashReporting
+
 #else
 
     namespace CrashReporting
@@ -0,0 +1,147 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/histogram.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+
+// ----------------------------------------------------------------------------
+/** Returns the upper bound of the bucket which contains the given percentile
+ *  (0 to 100) of all values, limited by the largest value added. If
+ *  \p earlier is given, its counts are subtracted first, so only the values
+ *  added since then are taken into account. If this histogram was reset
+ *  after \p earlier was copied, all its values are used.
+ */
+uint64_t Histogram::getPercentile(float percent,
+                                  const Histogram* earlier) const
+{
+    uint64_t buckets[BUCKETS];
+    uint64_t count = 0;
+    for (unsigned i = 0; i < BUCKETS; i++)
+    {
+        buckets[i] = m_buckets[i].load();
+        if (earlier)
+        {
+            const uint64_t old_count = earlier->m_buckets[i].load();
+            if (old_count > buckets[i])
+                return getPercentile(percent, NULL);
+            buckets[i] -= old_count;
+        }
+        count += buckets[i];
+    }
+    if (count == 0)
+        return 0;
+    uint64_t wanted = (uint64_t)((double)count * percent / 100.0);
+    if (wanted == 0)
+        wanted = 1;
+    uint64_t sum = 0;
+    for (unsigned i = 0; i < BUCKETS; i++)
+    {
+        sum += buckets[i];
+        if (sum >= wanted)
+            return std::min(getBucketUpperBound(i), m_max.load());
+    }
+    return m_max.load();
+}   // getPercentile
+
+// ----------------------------------------------------------------------------
+/** Returns a one line summary with the count, mean and some percentiles. */
+std::string Histogram::getSummary(const std::string& unit) const
+{
+    std::ostringstream oss;
+    oss << "count " << getCount() << ", mean " << getMean() << unit
+        << ", p50 " << getPercentile(50.0f) << unit
+        << ", p90 " << getPercentile(90.0f) << unit
+        << ", p99 " << getPercentile(99.0f) << unit
+        << ", p99.9 " << getPercentile(99.9f) << unit
+        << ", max " << getMax() << unit;
+    return oss.str();
+}   // getSummary
+
+// ----------------------------------------------------------------------------
+/** Returns the summary followed by one line per non-empty power of two
+ *  range of values.
+ */
+std::string Histogram::toString(const std::string& unit) const
+{
+    std::ostringstream oss;
+    oss << getSummary(unit) << "\n";
+    for (unsigned i = 0; i < BUCKETS;)
+    {
+        // Values below SUB_BUCKETS are printed together
+        unsigned last = i < SUB_BUCKETS ? SUB_BUCKETS - 1 :
+            std::min(i + SUB_BUCKETS - 1, BUCKETS - 1);
+        uint64_t n = 0;
+        for (unsigned j = i; j <= last; j++)
+            n += m_buckets[j].load();
+        if (n != 0)
+        {
+            oss << "  " << getBucketLowerBound(i) << "-"
+                << std::min(getBucketUpperBound(last), getMax()) << unit
+                << ": " << n << "\n";
+        }
+        i = last + 1;
+    }
+    return oss.str();
+}   // toString
+
+// ----------------------------------------------------------------------------
+/** Checks the bucket boundaries and the precision of the percentiles. */
+void Histogram::unitTesting()
+{
+    for (unsigned i = 0; i < BUCKETS - 1; i++)
+    {
+        assert(getBucket(getBucketLowerBound(i)) == i);
+        assert(getBucket(getBucketUpperBound(i)) == i);
+        assert(getBucketUpperBound(i) + 1 == getBucketLowerBound(i + 1));
+    }
+    assert(getBucket(std::numeric_limits<uint64_t>::max()) == BUCKETS - 1);
+
+    Histogram h;
+    for (uint64_t v = 1; v <= 100000; v++)
+        h.add(v);
+    assert(h.getCount() == 100000);
+    assert(h.getMax() == 100000);
+    assert(h.getSum() == uint64_t(100000) * 100001 / 2);
+    const float percentiles[] = { 1.0f, 50.0f, 90.0f, 99.0f, 99.9f };
+    for (float p : percentiles)
+    {
+        const double exact = 100000.0 * p / 100.0;
+        const double value = (double)h.getPercentile(p);
+        assert(value >= exact);
+        assert(value <= exact * (1.0 + 1.0 / SUB_BUCKETS) + 1.0);
+        (void)exact;
+        (void)value;
+    }
+    assert(h.getPercentile(100.0f) == 100000);
+
+    Histogram earlier;
+    earlier.copyFrom(h);
+    assert(h.getPercentileSince(earlier, 50.0f) == 0);
+    for (unsigned i = 0; i < 100; i++)
+        h.add(7);
+    assert(h.getPercentileSince(earlier, 1.0f) == 7);
+    assert(h.getPercentileSince(earlier, 100.0f) == 7);
+    assert(h.getPercentile(50.0f) > 7);
+
+    h.reset();
+    assert(h.getCount() == 0 && h.getPercentile(50.0f) == 0);
+    h.add(3);
+    assert(h.getPercentileSince(earlier, 50.0f) == 3);
+}   // unitTesting
@@ -0,0 +1,160 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_HISTOGRAM_HPP
+#define HEADER_HISTOGRAM_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+/** A histogram of unsigned values with log-linear buckets, similar to a
+ *  HdrHistogram: each power of two range is split into SUB_BUCKETS linear
+ *  buckets, so the value of a percentile is accurate to 1 / SUB_BUCKETS
+ *  (6.25%) of the value, independent of its magnitude. Values below
+ *  SUB_BUCKETS are counted exactly. Values can be added from any thread
+ *  without locking, it is meant for cheap runtime statistics (latencies,
+ *  queue sizes, packet sizes ...) which are printed or exported on request.
+ */
+class Histogram : public NoCopy
+{
+public:
+    static const unsigned SUB_BUCKET_BITS = 4;
+
+    static const unsigned SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+    /** Largest power of two which gets its own buckets, larger values are
+     *  counted in the last bucket. */
+    static const unsigned MAX_EXPONENT = 47;
+
+    static const unsigned BUCKETS =
+        SUB_BUCKETS + (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+private:
+    std::atomic<uint64_t> m_buckets[BUCKETS];
+
+    std::atomic<uint64_t> m_count, m_sum, m_max;
+
+    // ------------------------------------------------------------------------
+    uint64_t getPercentile(float percent, const Histogram* earlier) const;
+
+public:
+    // ------------------------------------------------------------------------
+    Histogram()                                                    { reset(); }
+    // ------------------------------------------------------------------------
+    void reset()
+    {
+        for (unsigned i = 0; i < BUCKETS; i++)
+            m_buckets[i].store(0);
+        m_count.store(0);
+        m_sum.store(0);
+        m_max.store(0);
+    }   // reset
+    // ------------------------------------------------------------------------
+    /** Copies all counts of another histogram, e.g. to remember its state
+     *  for getPercentileSince. */
+    void copyFrom(const Histogram& other)
+    {
+        for (unsigned i = 0; i < BUCKETS; i++)
+            m_buckets[i].store(other.m_buckets[i].load());
+        m_count.store(other.m_count.load());
+        m_sum.store(other.m_sum.load());
+        m_max.store(other.m_max.load());
+    }   // copyFrom
+    // ------------------------------------------------------------------------
+    /** Returns the bucket index a value is counted in. */
+    static unsigned getBucket(uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+            return (unsigned)value;
+        unsigned exponent = SUB_BUCKET_BITS;
+        while (exponent < 63 && (value >> (exponent + 1)) != 0)
+            exponent++;
+        if (exponent > MAX_EXPONENT)
+            return BUCKETS - 1;
+        const unsigned sub = (unsigned)(value >>
+            (exponent - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+        return SUB_BUCKETS + (exponent - SUB_BUCKET_BITS) * SUB_BUCKETS + sub;
+    }   // getBucket
+    // ------------------------------------------------------------------------
+    /** Returns the smallest value counted in the given bucket. */
+    static uint64_t getBucketLowerBound(unsigned bucket)
+    {
+        if (bucket < SUB_BUCKETS)
+            return bucket;
+        const unsigned shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+        const uint64_t sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+        return (SUB_BUCKETS + sub) << shift;
+    }   // getBucketLowerBound
+    // ------------------------------------------------------------------------
+    /** Returns the largest value counted in the given bucket. */
+    static uint64_t getBucketUpperBound(unsigned bucket)
+    {
+        if (bucket < SUB_BUCKETS)
+            return bucket;
+        if (bucket == BUCKETS - 1)
+            return std::numeric_limits<uint64_t>::max();
+        const unsigned shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+        return getBucketLowerBound(bucket) + (uint64_t(1) << shift) - 1;
+    }   // getBucketUpperBound
+    // ------------------------------------------------------------------------
+    void add(uint64_t value)
+    {
+        m_buckets[getBucket(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t cur_max = m_max.load(std::memory_order_relaxed);
+        while (value > cur_max &&
+            !m_max.compare_exchange_weak(cur_max, value,
+            std::memory_order_relaxed));
+    }   // add
+    // ------------------------------------------------------------------------
+    uint64_t getCount() const                       { return m_count.load(); }
+    // ------------------------------------------------------------------------
+    uint64_t getSum() const                           { return m_sum.load(); }
+    // ------------------------------------------------------------------------
+    uint64_t getMax() const                           { return m_max.load(); }
+    // ------------------------------------------------------------------------
+    uint64_t getBucketCount(unsigned i) const   { return m_buckets[i].load(); }
+    // ------------------------------------------------------------------------
+    double getMean() const
+    {
+        uint64_t count = m_count.load();
+        return count == 0 ? 0.0 : (double)m_sum.load() / (double)count;
+    }   // getMean
+    // ------------------------------------------------------------------------
+    uint64_t getPercentile(float percent) const
+                                    { return getPercentile(percent, NULL); }
+    // ------------------------------------------------------------------------
+    /** Returns the percentile of only the values added after this histogram
+     *  had the state of \p earlier (see copyFrom). */
+    uint64_t getPercentileSince(const Histogram& earlier, float percent) const
+                                 { return getPercentile(percent, &earlier); }
+    // ------------------------------------------------------------------------
+    std::string getSummary(const std::string& unit) const;
+    // ------------------------------------------------------------------------
+    std::string toString(const std::string& unit) const;
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // Histogram
+
+#endif
@@ -20,10 +20,18 @@
 
 #include "config/user_config.hpp"
 #include "network/network_config.hpp"
+#include "utils/vs.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <cstring>
 #include <ctime>
+#include <mutex>
 #include <stdio.h>
+#include <thread>
 
 #ifdef ANDROID
 #  include <android/log.h>
@@ -42,6 +50,185 @@ size_t        Log::m_buffer_size = 1;
 bool          Log::m_console_log = true;
 Synchronised<std::vector<struct Log::LineInfo> > Log::m_line_buffer;
 
+// ============================================================================
+namespace
+{
+    /** Formatted lines of one thread, written by that thread only and read
+     *  by the log writer thread only, so no lock is needed. Each entry is a
+     *  header followed by the text, padded to 8 bytes, and can wrap around
+     *  the end of the buffer. */
+    class ThreadBuffer
+    {
+    public:
+        static const uint64_t SIZE = 64 * 1024;
+
+        struct EntryHeader
+        {
+            uint64_t m_seq;
+            uint32_t m_length;
+            int32_t  m_level;
+        };
+
+        std::atomic<uint64_t> m_write_pos, m_read_pos, m_dropped;
+
+        /** Set when the owning thread exits, the writer thread deletes the
+         *  buffer after it was drained. */
+        std::atomic_bool m_thread_exited;
+
+        /** Set while the owning thread pushes a line, and when the writer
+         *  is stopped, see tryPush() and close(). */
+        std::atomic_bool m_pushing, m_closed;
+
+        char m_data[SIZE];
+
+        // --------------------------------------------------------------------
+        ThreadBuffer()
+        {
+            m_write_pos.store(0);
+            m_read_pos.store(0);
+            m_dropped.store(0);
+            m_thread_exited.store(false);
+            m_pushing.store(false);
+            m_closed.store(false);
+        }
+        // --------------------------------------------------------------------
+        static uint64_t entrySize(uint32_t length)
+        {
+            return (sizeof(EntryHeader) + length + 7) & ~uint64_t(7);
+        }
+        // --------------------------------------------------------------------
+        void copyIn(uint64_t pos, const void* src, size_t len)
+        {
+            const size_t offset = (size_t)(pos & (SIZE - 1));
+            const size_t first = std::min(len, (size_t)SIZE - offset);
+            memcpy(m_data + offset, src, first);
+            memcpy(m_data, (const char*)src + first, len - first);
+        }
+        // --------------------------------------------------------------------
+        void copyOut(uint64_t pos, void* dst, size_t len) const
+        {
+            const size_t offset = (size_t)(pos & (SIZE - 1));
+            const size_t first = std::min(len, (size_t)SIZE - offset);
+            memcpy(dst, m_data + offset, first);
+            memcpy((char*)dst + first, m_data, len - first);
+        }
+        // --------------------------------------------------------------------
+        /** Called by the owning thread, returns false if the buffer is full
+         *  and the line was dropped. */
+        bool push(uint64_t seq, const char* line, uint32_t length, int level)
+        {
+            const uint64_t size = entrySize(length);
+            const uint64_t w = m_write_pos.load(std::memory_order_relaxed);
+            const uint64_t r = m_read_pos.load(std::memory_order_acquire);
+            if (w - r + size > SIZE)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            EntryHeader header;
+            header.m_seq = seq;
+            header.m_length = length;
+            header.m_level = level;
+            copyIn(w, &header, sizeof(header));
+            copyIn(w + sizeof(header), line, length);
+            m_write_pos.store(w + size, std::memory_order_release);
+            return true;
+        }
+        // --------------------------------------------------------------------
+        /** Called by the owning thread, returns false if the buffer is
+         *  closed and the line must be written directly. Both flags use
+         *  sequentially consistent accesses, so either this thread sees
+         *  m_closed, or close() sees m_pushing and waits for the push. */
+        bool tryPush(uint64_t seq, const char* line, uint32_t length,
+                     int level)
+        {
+            m_pushing.store(true);
+            if (m_closed.load())
+            {
+                m_pushing.store(false);
+                return false;
+            }
+            push(seq, line, length, level);
+            m_pushing.store(false);
+            return true;
+        }
+        // --------------------------------------------------------------------
+        /** Makes all further tryPush() calls fail, and waits for a push which
+         *  is in progress, so that a drain afterwards gets all lines. */
+        void close()
+        {
+            m_closed.store(true);
+            while (m_pushing.load())
+                std::this_thread::yield();
+        }
+    };   // ThreadBuffer
+
+    // ------------------------------------------------------------------------
+    /** Set when the thread local buffer owner of this thread was destroyed.
+     *  It is trivially destructible, so it can still be read by the
+     *  destructors of other thread local objects, which then log directly. */
+    thread_local bool g_thread_buffer_gone = false;
+
+    /** Marks the buffer of a thread as unused when the thread exits. */
+    struct ThreadBufferOwner
+    {
+        ThreadBuffer* m_buffer;
+        ThreadBufferOwner() : m_buffer(NULL) {}
+        ~ThreadBufferOwner()
+        {
+            // The writer thread can delete the buffer any time after this
+            g_thread_buffer_gone = true;
+            if (m_buffer)
+                m_buffer->m_thread_exited.store(true);
+            m_buffer = NULL;
+        }
+    };   // ThreadBufferOwner
+
+    thread_local ThreadBufferOwner g_thread_buffer;
+
+    /** All thread buffers, the mutex is only needed when a thread logs for
+     *  the first time, and in the writer thread. */
+    std::vector<ThreadBuffer*> g_thread_buffers;
+    std::mutex g_thread_buffers_mutex;
+
+    /** Set (with g_thread_buffers_mutex) while the writer is stopped, no new
+     *  buffers are created then. */
+    bool g_thread_buffers_closed = true;
+
+    /** Global order of the lines, so that the writer can merge the lines of
+     *  different threads in the order they were logged. */
+    std::atomic<uint64_t> g_next_seq(0);
+
+    std::atomic_bool g_async_running(false);
+    std::atomic_bool g_writer_exit(false);
+
+    /** Each flush gets a number, the writer thread stores the highest number
+     *  it has seen before a drain pass once that pass is done. */
+    std::atomic<uint64_t> g_flush_requested(0), g_flush_done(0);
+
+    /** Dropped lines of buffers of exited threads, and the total number of
+     *  dropped lines which was already reported in the log. */
+    std::atomic<uint64_t> g_dropped_exited(0), g_dropped_reported(0);
+
+    std::thread g_writer_thread;
+    std::mutex g_writer_mutex;
+    std::condition_variable g_writer_cv;
+
+    /** Entries collected in one drain pass, kept to avoid allocations. */
+    struct BatchEntry
+    {
+        uint64_t m_seq;
+        size_t   m_offset;
+        int      m_level;
+        bool operator<(const BatchEntry& other) const
+        {
+            return m_seq < other.m_seq;
+        }
+    };
+    std::vector<BatchEntry> g_batch_entries;
+    std::string g_batch_text, g_batch_file;
+}   // anonymous namespace
+
 // ----------------------------------------------------------------------------
 /** Selects background/foreground colors for the message depending on
  *  log level. It is only called if messages are not redirected to a file.
@@ -179,6 +366,15 @@ void Log::printMessage(int level, const char *component, const char *format,
     index = index > MAX_LENGTH - 1 ? MAX_LENGTH - 1 : index;
     sprintf(line + index, "\n");
 
+    // Let the writer thread do the output if it is running
+    if (g_async_running.load(std::memory_order_acquire) &&
+        pushToThreadBuffer(line, index + 1, level))
+    {
+        if (level == LL_FATAL)
+            flushBuffers();
+        return;
+    }
+
     // If the data is not buffered, immediately print it:
     if (m_buffer_size <= 1)
     {
@@ -215,7 +411,7 @@ void Log::printMessage(int level, const char *component, const char *format,
  *  \param line The line to write.
  *  \param level Message level. Only used to select terminal colour.
  */
-void Log::writeLine(const char *line, int level)
+void Log::writeLine(const char *line, int level, std::string* file_batch)
 {
 
     // If we don't have a console file, write to stdout and hope for the best
@@ -253,7 +449,13 @@ void Log::writeLine(const char *line, int level)
     if (m_buffer_size <= 1) OutputDebugString(line);
 #endif
 
-    if (m_file_stdout) fprintf(m_file_stdout, "%s", line);
+    if (m_file_stdout)
+    {
+        if (file_batch)
+            file_batch->append(line);
+        else
+            fprintf(m_file_stdout, "%s", line);
+    }
 
 #ifdef WIN32
     if (level >= LL_FATAL)
@@ -261,7 +463,7 @@ void Log::writeLine(const char *line, int level)
         MessageBoxA(NULL, line, "SuperTuxKart - Fatal error", MB_OK);
     }
 #endif
-}   // _fluhBuffers
+}   // writeLine
 
 // ----------------------------------------------------------------------------
 void Log::toggleConsoleLog(bool val)
@@ -271,8 +473,10 @@ void Log::toggleConsoleLog(bool val)
 
 // ----------------------------------------------------------------------------
 /** Flushes all stored log messages to the various output devices (thread safe).
+ *  \param wait If false only a drain pass of the writer thread is requested,
+ *         which is done soon after, but this call does not wait for it.
  */
-void Log::flushBuffers()
+void Log::flushBuffers(bool wait)
 {
     m_line_buffer.lock();
     for (unsigned int i = 0; i < m_line_buffer.getData().size(); i++)
@@ -282,8 +486,232 @@ void Log::flushBuffers()
     }
     m_line_buffer.getData().clear();
     m_line_buffer.unlock();
+
+    if (!g_async_running.load() ||
+        std::this_thread::get_id() == g_writer_thread.get_id())
+        return;
+    if (!wait)
+    {
+        g_flush_requested.fetch_add(1);
+        g_writer_cv.notify_one();
+        return;
+    }
+    // Wait for a drain pass which started after this call. This
+    // does not lock anything and is bounded, so that it can be used when
+    // crashing (e.g. the writer thread itself might have crashed).
+    const int MAX_WAIT_TIME = 1000;
+    const uint64_t flush = g_flush_requested.fetch_add(1) + 1;
+    g_writer_cv.notify_one();
+    for (int i = 0; i < MAX_WAIT_TIME && g_flush_done.load() < flush; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
 }   // flushBuffers
 
+// ----------------------------------------------------------------------------
+/** Version of flushBuffers() which can be called from a signal handler. It
+ *  only bumps the lock free flush counter, which the writer thread checks at
+ *  least every 20 ms without being notified, and then waits with nanosleep
+ *  (at most one second) for the drain pass.
+ */
+void Log::flushFromSignalHandler()
+{
+#ifndef WIN32
+    if (!g_async_running.load())
+        return;
+    const uint64_t flush = g_flush_requested.fetch_add(1) + 1;
+    const struct timespec one_ms = { 0, 1000000 };
+    for (int i = 0; i < 1000 && g_flush_done.load() < flush; i++)
+        nanosleep(&one_ms, NULL);
+#endif
+}   // flushFromSignalHandler
+
+// ----------------------------------------------------------------------------
+/** Adds a formatted line to the lock free buffer of the calling thread,
+ *  creating the buffer if this thread logs for the first time. Returns
+ *  false if the line could not be queued (and must be written directly),
+ *  a line dropped because the buffer is full only increases its drop
+ *  counter.
+ */
+bool Log::pushToThreadBuffer(const char *line, int length, int level)
+{
+    if (length <= 0 || (uint64_t)length > ThreadBuffer::SIZE / 4 ||
+        g_thread_buffer_gone)
+        return false;
+    ThreadBuffer* buffer = g_thread_buffer.m_buffer;
+    if (!buffer)
+    {
+        std::lock_guard<std::mutex> lock(g_thread_buffers_mutex);
+        if (g_thread_buffers_closed)
+            return false;
+        buffer = new ThreadBuffer();
+        g_thread_buffers.push_back(buffer);
+        g_thread_buffer.m_buffer = buffer;
+    }
+    if (!buffer->tryPush(g_next_seq.fetch_add(1, std::memory_order_relaxed),
+        line, (uint32_t)length, level))
+        return false;
+    // Errors are flushed soon, there might be a crash following them
+    if (level >= LL_ERROR)
+        g_writer_cv.notify_one();
+    return true;
+}   // pushToThreadBuffer
+
+// ----------------------------------------------------------------------------
+/** Reads all queued lines of all threads, and writes them in the order they
+ *  were logged. The log file gets one write for all lines. Only called
+ *  from the writer thread. Returns true if any line was written.
+ */
+bool Log::drainThreadBuffers()
+{
+    g_batch_entries.clear();
+    g_batch_text.clear();
+    g_batch_file.clear();
+
+    std::unique_lock<std::mutex> ul(g_thread_buffers_mutex);
+    for (unsigned i = 0; i < g_thread_buffers.size();)
+    {
+        ThreadBuffer* buffer = g_thread_buffers[i];
+        // Load before reading, so that lines which are pushed right before
+        // the thread exits are not lost
+        const bool exited = buffer->m_thread_exited.load();
+        const uint64_t w = buffer->m_write_pos.load(std::memory_order_acquire);
+        uint64_t r = buffer->m_read_pos.load(std::memory_order_relaxed);
+        while (r < w)
+        {
+            ThreadBuffer::EntryHeader header;
+            buffer->copyOut(r, &header, sizeof(header));
+            BatchEntry entry;
+            entry.m_seq = header.m_seq;
+            entry.m_level = header.m_level;
+            entry.m_offset = g_batch_text.size();
+            g_batch_text.resize(entry.m_offset + header.m_length + 1);
+            buffer->copyOut(r + sizeof(header), &g_batch_text[entry.m_offset],
+                header.m_length);
+            g_batch_text[entry.m_offset + header.m_length] = 0;
+            g_batch_entries.push_back(entry);
+            r += ThreadBuffer::entrySize(header.m_length);
+        }
+        buffer->m_read_pos.store(r, std::memory_order_release);
+        if (exited)
+        {
+            g_dropped_exited.fetch_add(buffer->m_dropped.load());
+            delete buffer;
+            g_thread_buffers.erase(g_thread_buffers.begin() + i);
+        }
+        else
+            i++;
+    }
+    ul.unlock();
+    const uint64_t dropped = getDroppedLines();
+
+    std::sort(g_batch_entries.begin(), g_batch_entries.end());
+    for (const BatchEntry& entry : g_batch_entries)
+    {
+        writeLine(&g_batch_text[entry.m_offset], entry.m_level,
+            &g_batch_file);
+    }
+    const uint64_t reported = g_dropped_reported.load();
+    if (dropped > reported)
+    {
+        char line[128];
+        snprintf(line, 128, "[warn   ] Log: %llu lines dropped, log buffer "
+            "full.\n", (unsigned long long)(dropped - reported));
+        writeLine(line, LL_WARN, &g_batch_file);
+        g_dropped_reported.store(dropped);
+    }
+    if (m_file_stdout && !g_batch_file.empty())
+        fwrite(g_batch_file.data(), 1, g_batch_file.size(), m_file_stdout);
+    if (!g_batch_entries.empty())
+        fflush(stdout);
+    return !g_batch_entries.empty();
+}   // drainThreadBuffers
+
+// ----------------------------------------------------------------------------
+void Log::writerLoop()
+{
+    VS::setThreadName("LogWriter");
+    // Without explicit flushes write at most 50 times per second, so that
+    // lines are batched
+    const std::chrono::milliseconds WRITE_INTERVAL(20);
+    while (true)
+    {
+        std::unique_lock<std::mutex> ul(g_writer_mutex);
+        g_writer_cv.wait_for(ul, WRITE_INTERVAL, []()
+            {
+                return g_flush_requested.load() != g_flush_done.load() ||
+                    g_writer_exit.load();
+            });
+        ul.unlock();
+        const uint64_t flush = g_flush_requested.load();
+        const bool exit = g_writer_exit.load();
+        drainThreadBuffers();
+        g_flush_done.store(flush);
+        if (exit)
+            return;
+    }
+}   // writerLoop
+
+// ----------------------------------------------------------------------------
+/** Starts the background thread which does the actual output, after this
+ *  logging only formats the line and adds it to a lock free buffer of the
+ *  calling thread.
+ */
+void Log::startAsyncWriter()
+{
+    if (g_async_running.load())
+        return;
+    g_writer_exit.store(false);
+    g_writer_thread = std::thread(writerLoop);
+    {
+        std::lock_guard<std::mutex> lock(g_thread_buffers_mutex);
+        g_thread_buffers_closed = false;
+        for (ThreadBuffer* buffer : g_thread_buffers)
+            buffer->m_closed.store(false);
+    }
+    g_async_running.store(true);
+    static bool registered = false;
+    if (!registered)
+    {
+        // Make sure all lines are written if exit() is called anywhere
+        atexit(stopAsyncWriter);
+        registered = true;
+    }
+}   // startAsyncWriter
+
+// ----------------------------------------------------------------------------
+/** Writes all remaining lines and stops the writer thread, logging is then
+ *  done directly again. Buffers of threads which are still running are kept
+ *  but closed first, so a line logged at the same time is either in the
+ *  final drain pass of the writer, or written directly by its thread.
+ */
+void Log::stopAsyncWriter()
+{
+    if (!g_async_running.exchange(false))
+        return;
+    {
+        std::lock_guard<std::mutex> lock(g_thread_buffers_mutex);
+        g_thread_buffers_closed = true;
+        for (ThreadBuffer* buffer : g_thread_buffers)
+            buffer->close();
+    }
+    g_writer_exit.store(true);
+    g_writer_cv.notify_one();
+    if (std::this_thread::get_id() == g_writer_thread.get_id())
+        g_writer_thread.detach();
+    else
+        g_writer_thread.join();
+}   // stopAsyncWriter
+
+// ----------------------------------------------------------------------------
+/** Returns the number of lines dropped because a thread buffer was full. */
+uint64_t Log::getDroppedLines()
+{
+    uint64_t dropped = g_dropped_exited.load();
+    std::lock_guard<std::mutex> lock(g_thread_buffers_mutex);
+    for (ThreadBuffer* buffer : g_thread_buffers)
+        dropped += buffer->m_dropped.load();
+    return dropped;
+}   // getDroppedLines
+
 // ----------------------------------------------------------------------------
 /** This function opens the files that will contain the output.
  *  \param logout : name of the file that will contain stdout output
@@ -299,15 +727,20 @@ void Log::openOutputFiles(const std::string &logout)
     }
     else
     {
-        // Disable buffering so that messages are seen asap
+        // Disable buffering so that messages are seen asap, the writer
+        // thread writes all lines it has in one call anyway
         setvbuf(m_file_stdout, NULL, _IONBF, 0);
     }
-} // closeOutputFiles
+    startAsyncWriter();
+} // openOutputFiles
 
 // ----------------------------------------------------------------------------
 /** Function to close output files */
 void Log::closeOutputFiles()
 {
-    fclose(m_file_stdout);
+    stopAsyncWriter();
+    if (m_file_stdout)
+        fclose(m_file_stdout);
+    m_file_stdout = NULL;
 } // closeOutputFiles
 
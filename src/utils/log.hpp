@@ -23,6 +23,7 @@
 #include "utils/synchronised.hpp"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -83,7 +84,11 @@ private:
 
     static void setTerminalColor(LogLevel level);
     static void resetTerminalColor();
-    static void writeLine(const char *line, int level);
+    static void writeLine(const char *line, int level,
+                          std::string* file_batch = NULL);
+    static bool pushToThreadBuffer(const char *line, int length, int level);
+    static void writerLoop();
+    static bool drainThreadBuffers();
 
     static void printMessage(int level, const char *component,
                              const char *format, VALIST va_list);
@@ -119,8 +124,12 @@ public:
     static void openOutputFiles(const std::string &logout);
 
     static void closeOutputFiles();
-    static void flushBuffers();
+    static void flushBuffers(bool wait = true);
+    static void flushFromSignalHandler();
     static void toggleConsoleLog(bool val);
+    static void startAsyncWriter();
+    static void stopAsyncWriter();
+    static uint64_t getDroppedLines();
 
     // ------------------------------------------------------------------------
     /** Sets the number of lines to buffer. Setting the buffer size to a 
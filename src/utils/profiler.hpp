@@ -19,6 +19,7 @@
 #define PROFILER_HPP
 
 #include "utils/synchronised.hpp"
+#include "utils/trace_recorder.hpp"
 
 #include <irrlicht.h>
 #include <pthread.h>
@@ -69,11 +70,31 @@ double getTimeMilliseconds();
 #define ENABLE_PROFILER
 
 #ifdef ENABLE_PROFILER
-    #define PROFILER_PUSH_CPU_MARKER(name, r, g, b) \
-        profiler.pushCPUMarker(name, video::SColor(0xFF, r, g, b))
-
-    #define PROFILER_POP_CPU_MARKER()  \
-        profiler.popCPUMarker()
+    // The name must be a constant, it is interned for the TraceRecorder only
+    // once per call site
+    #define PROFILER_PUSH_CPU_MARKER(name, r, g, b)                         \
+        do                                                                  \
+        {                                                                   \
+            static const uint16_t trace_marker =                            \
+                TraceRecorder::internMarker(name);                          \
+            TraceRecorder::begin(trace_marker);                             \
+            profiler.pushCPUMarker(name, video::SColor(0xFF, r, g, b));     \
+        } while (0)
+
+    // For markers with a name created at runtime
+    #define PROFILER_PUSH_DYNAMIC_CPU_MARKER(name, r, g, b)                 \
+        do                                                                  \
+        {                                                                   \
+            TraceRecorder::begin(TraceRecorder::internMarker(name));        \
+            profiler.pushCPUMarker(name, video::SColor(0xFF, r, g, b));     \
+        } while (0)
+
+    #define PROFILER_POP_CPU_MARKER()                                       \
+        do                                                                  \
+        {                                                                   \
+            TraceRecorder::end();                                           \
+            profiler.popCPUMarker();                                        \
+        } while (0)
 
     #define PROFILER_SYNC_FRAME()   \
         profiler.synchronizeFrame()
@@ -82,6 +103,7 @@ double getTimeMilliseconds();
         profiler.draw()
 #else
     #define PROFILER_PUSH_CPU_MARKER(name, r, g, b)
+    #define PROFILER_PUSH_DYNAMIC_CPU_MARKER(name, r, g, b)
     #define PROFILER_POP_CPU_MARKER()
     #define PROFILER_SYNC_FRAME()
     #define PROFILER_DRAW()
@@ -107,6 +107,17 @@ public:
         return value.count();
     }
     // ------------------------------------------------------------------------
+    /** Same as \ref getMonoTimeMs, but in microseconds. Used for statistics
+     *  where milliseconds are too coarse.
+     */
+    static uint64_t getMonoTimeUs()
+    {
+        auto duration = std::chrono::steady_clock::now() - m_mono_start;
+        auto value =
+            std::chrono::duration_cast<std::chrono::microseconds>(duration);
+        return value.count();
+    }
+    // ------------------------------------------------------------------------
     /**
      * \brief Compare two different times.
      * \return A signed integral indicating the relation between the time.
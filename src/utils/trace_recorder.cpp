@@ -0,0 +1,348 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/trace_recorder.hpp"
+
+#include "io/file_manager.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/time.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <signal.h>
+#include <sstream>
+#include <thread>
+
+#if defined(__linux__) && defined(__GLIBC__)
+#include <pthread.h>
+#endif
+
+std::atomic_bool TraceRecorder::m_enabled(true);
+std::atomic_bool TraceRecorder::m_export_requested(false);
+std::mutex TraceRecorder::m_mutex;
+std::vector<std::string> TraceRecorder::m_marker_names;
+std::unordered_map<std::string, uint16_t> TraceRecorder::m_marker_ids;
+std::vector<TraceRecorder::ThreadBuffer*> TraceRecorder::m_thread_buffers;
+std::vector<TraceRecorder::ThreadBuffer*> TraceRecorder::m_free_buffers;
+
+namespace
+{
+    /** Gives the buffer of a thread back to the TraceRecorder when the
+     *  thread exits. */
+    struct ThreadBufferOwner
+    {
+        void* m_buffer;
+        void (*m_release)(void*);
+        ThreadBufferOwner() : m_buffer(NULL), m_release(NULL) {}
+        ~ThreadBufferOwner()
+        {
+            if (m_buffer)
+                m_release(m_buffer);
+        }
+    };   // ThreadBufferOwner
+
+    thread_local ThreadBufferOwner g_thread_buffer;
+}   // anonymous namespace
+
+// ----------------------------------------------------------------------------
+/** Returns the id of a marker name, adding it if it was not used before.
+ *  Markers with a constant name call this only once (see
+ *  PROFILER_PUSH_CPU_MARKER).
+ */
+uint16_t TraceRecorder::internMarker(const char* name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_marker_ids.find(name);
+    if (it != m_marker_ids.end())
+        return it->second;
+    // Id 0 is used for the end events
+    if (m_marker_names.empty())
+        m_marker_names.push_back("");
+    if (m_marker_names.size() > 65535)
+        return 0;
+    const uint16_t id = (uint16_t)m_marker_names.size();
+    m_marker_names.push_back(name);
+    m_marker_ids[name] = id;
+    return id;
+}   // internMarker
+
+// ----------------------------------------------------------------------------
+/** Returns the buffer of the calling thread, creating one (or reusing one of
+ *  an exited thread) when the thread records its first event.
+ */
+TraceRecorder::ThreadBuffer* TraceRecorder::getThreadBuffer()
+{
+    if (g_thread_buffer.m_buffer)
+        return (ThreadBuffer*)g_thread_buffer.m_buffer;
+
+    std::string name;
+#if defined(__linux__) && defined(__GLIBC__)
+    char thread_name[32] = {};
+    if (pthread_getname_np(pthread_self(), thread_name, 32) == 0)
+        name = thread_name;
+#endif
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ThreadBuffer* buffer = NULL;
+    if (!m_free_buffers.empty())
+    {
+        buffer = m_free_buffers.back();
+        m_free_buffers.pop_back();
+    }
+    else
+    {
+        buffer = new ThreadBuffer();
+        buffer->m_thread_index = (unsigned)m_thread_buffers.size();
+        m_thread_buffers.push_back(buffer);
+    }
+    buffer->m_write_pos.store(0);
+    buffer->m_thread_name = name.empty() ?
+        "Thread " + StringUtils::toString(buffer->m_thread_index) : name;
+    g_thread_buffer.m_buffer = buffer;
+    g_thread_buffer.m_release = [](void* b)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free_buffers.push_back((ThreadBuffer*)b);
+        };
+    return buffer;
+}   // getThreadBuffer
+
+// ----------------------------------------------------------------------------
+void TraceRecorder::record(uint16_t marker, EventType type)
+{
+    ThreadBuffer* buffer = getThreadBuffer();
+    const uint64_t pos = buffer->m_write_pos.load(std::memory_order_relaxed);
+    TraceEvent& e = buffer->m_events[pos % ThreadBuffer::CAPACITY];
+    e.m_time_us = StkTime::getMonoTimeUs();
+    e.m_marker = marker;
+    e.m_type = type;
+    buffer->m_write_pos.store(pos + 1, std::memory_order_release);
+}   // record
+
+// ----------------------------------------------------------------------------
+/** Called once per frame from the main loop, exports the trace if this was
+ *  requested by the signal handler.
+ */
+void TraceRecorder::update()
+{
+    if (m_export_requested.exchange(false))
+        exportChromeTrace();
+}   // update
+
+// ----------------------------------------------------------------------------
+/** Exports the trace when the process receives SIGUSR2, e.g. with
+ *  "kill -USR2 <pid>" on a server without console.
+ */
+void TraceRecorder::installSignalHandler()
+{
+#ifndef WIN32
+    signal(SIGUSR2, [](int) { requestExport(); });
+#endif
+}   // installSignalHandler
+
+// ----------------------------------------------------------------------------
+/** Writes the recorded events of all threads as complete ("X") events. The
+ *  events are copied while \ref m_mutex is locked, so that no buffer can be
+ *  given to a new thread meanwhile, and written out after unlocking it.
+ *  Threads keep recording while their buffer is copied, events which might
+ *  have been overwritten during the copy are skipped.
+ */
+void TraceRecorder::writeChromeTrace(std::ostream& out)
+{
+    struct ThreadEvents
+    {
+        unsigned m_thread_index;
+        std::string m_thread_name;
+        std::vector<TraceEvent> m_events;
+    };
+    std::vector<ThreadEvents> threads;
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        names = m_marker_names;
+        threads.reserve(m_thread_buffers.size());
+        for (ThreadBuffer* buffer : m_thread_buffers)
+        {
+            const uint64_t last =
+                buffer->m_write_pos.load(std::memory_order_acquire);
+            const uint64_t first_pos = last > ThreadBuffer::CAPACITY ?
+                last - ThreadBuffer::CAPACITY : 0;
+            if (last == first_pos)
+                continue;
+            threads.emplace_back();
+            ThreadEvents& thread = threads.back();
+            thread.m_thread_index = buffer->m_thread_index;
+            thread.m_thread_name = buffer->m_thread_name;
+            std::vector<TraceEvent>& events = thread.m_events;
+            events.reserve((size_t)(last - first_pos));
+            for (uint64_t i = first_pos; i < last; i++)
+                events.push_back(buffer->m_events[i % ThreadBuffer::CAPACITY]);
+            // Drop the events which were overwritten while copying
+            const uint64_t now =
+                buffer->m_write_pos.load(std::memory_order_acquire);
+            if (now > first_pos + ThreadBuffer::CAPACITY)
+            {
+                events.erase(events.begin(), events.begin() +
+                    (size_t)std::min<uint64_t>(events.size(),
+                    now - first_pos - ThreadBuffer::CAPACITY));
+            }
+            if (events.empty())
+                threads.pop_back();
+        }
+    }
+
+    auto escape = [](const std::string& s)
+        {
+            std::string result;
+            for (char c : s)
+            {
+                if (c == '"' || c == '\\')
+                    result += '\\';
+                if ((unsigned char)c >= 0x20)
+                    result += c;
+            }
+            return result;
+        };
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    std::vector<const TraceEvent*> stack;
+    for (const ThreadEvents& thread : threads)
+    {
+        const unsigned tid = thread.m_thread_index;
+        out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\","
+            "\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":\""
+            << escape(thread.m_thread_name) << "\"}}";
+        first = false;
+
+        stack.clear();
+        for (const TraceEvent& e : thread.m_events)
+        {
+            if (e.m_type == EVENT_BEGIN)
+            {
+                stack.push_back(&e);
+                continue;
+            }
+            // The begin event might have been overwritten already
+            if (stack.empty())
+                continue;
+            const TraceEvent* b = stack.back();
+            stack.pop_back();
+            if (b->m_marker >= names.size())
+                continue;
+            out << ",\n{\"name\":\"" << escape(names[b->m_marker])
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":"
+                << b->m_time_us << ",\"dur\":"
+                << (e.m_time_us - b->m_time_us) << "}";
+        }
+        // Markers which are still running
+        for (const TraceEvent* b : stack)
+        {
+            if (b->m_marker >= names.size())
+                continue;
+            out << ",\n{\"name\":\"" << escape(names[b->m_marker])
+                << "\",\"ph\":\"B\",\"pid\":1,\"tid\":" << tid << ",\"ts\":"
+                << b->m_time_us << "}";
+        }
+    }
+    out << "\n]}\n";
+}   // writeChromeTrace
+
+// ----------------------------------------------------------------------------
+/** Writes the trace to the given file, or next to the stdout log file if no
+ *  name is given. Returns true if successful.
+ */
+bool TraceRecorder::exportChromeTrace(const std::string& filename)
+{
+    std::string name = filename;
+    if (name.empty())
+    {
+        name = file_manager->getUserConfigFile(file_manager->getStdoutName())
+            + ".trace-" + StringUtils::toString(StkTime::getTimeSinceEpoch())
+            + ".json";
+    }
+    std::ofstream f(name);
+    if (!f.is_open())
+    {
+        Log::error("TraceRecorder", "Can't open '%s' for writing.",
+            name.c_str());
+        return false;
+    }
+    writeChromeTrace(f);
+    f.close();
+    Log::info("TraceRecorder", "Trace written to '%s'.", name.c_str());
+    return true;
+}   // exportChromeTrace
+
+// ----------------------------------------------------------------------------
+/** Checks that nested markers of two threads are exported as complete
+ *  events, and that a full buffer keeps the newest events.
+ */
+void TraceRecorder::unitTesting()
+{
+    const bool enabled = isEnabled();
+    setEnabled(true);
+    const uint16_t outer = internMarker("TraceTestOuter");
+    const uint16_t inner = internMarker("TraceTestInner");
+    assert(internMarker("TraceTestOuter") == outer);
+    assert(outer != inner && outer != 0 && inner != 0);
+
+    // Record in this thread first, so that it does not reuse the buffer of
+    // the exited thread
+    begin(outer);
+    begin(inner);
+    end();
+    end();
+    begin(outer);
+    std::thread t([outer, inner]()
+        {
+            // Wrap around the buffer once, only the newest are kept
+            for (unsigned i = 0; i < ThreadBuffer::CAPACITY; i++)
+            {
+                begin(outer);
+                begin(inner);
+                end();
+                end();
+            }
+        });
+    t.join();
+
+    std::stringstream ss;
+    writeChromeTrace(ss);
+    const std::string trace = ss.str();
+    auto count = [&trace](const std::string& s)
+        {
+            unsigned n = 0;
+            for (size_t pos = trace.find(s); pos != std::string::npos;
+                pos = trace.find(s, pos + 1))
+                n++;
+            return n;
+        };
+    // The exited thread has exactly CAPACITY / 4 pairs left
+    const unsigned pairs = ThreadBuffer::CAPACITY / 4 + 1;
+    assert(count("\"name\":\"TraceTestInner\",\"ph\":\"X\"") == pairs);
+    assert(count("\"name\":\"TraceTestOuter\",\"ph\":\"X\"") == pairs);
+    assert(count("\"name\":\"TraceTestOuter\",\"ph\":\"B\"") == 1);
+    assert(trace.front() == '{' && trace.find("]}") != std::string::npos);
+    (void)count;
+    (void)pairs;
+    end();
+    setEnabled(enabled);
+}   // unitTesting
@@ -0,0 +1,132 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_TRACE_RECORDER_HPP
+#define HEADER_TRACE_RECORDER_HPP
+
+#include "utils/types.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** Records the profiler markers of all threads into a fixed size ring buffer
+ *  per thread, so that the last seconds before e.g. a tick spike on a server
+ *  can be exported to the Chrome trace event format (which can be loaded in
+ *  chrome://tracing or Perfetto). Unlike the on-screen Profiler it works
+ *  without graphics and is cheap enough to be always on: a marker is a
+ *  number interned once per call site (see PROFILER_PUSH_CPU_MARKER), and
+ *  recording it only writes to the buffer of the calling thread, without
+ *  any lock.
+ *  \ingroup utils
+ */
+class TraceRecorder
+{
+private:
+    enum EventType : uint8_t
+    {
+        EVENT_BEGIN,
+        EVENT_END
+    };
+
+    struct TraceEvent
+    {
+        uint64_t m_time_us;
+        uint16_t m_marker;
+        uint8_t  m_type;
+    };
+
+    /** Events of one thread, written only by that thread. When the buffer
+     *  is full the oldest events are overwritten. */
+    struct ThreadBuffer
+    {
+        static const unsigned CAPACITY = 16384;
+
+        TraceEvent m_events[CAPACITY];
+
+        /** Number of events written so far. */
+        std::atomic<uint64_t> m_write_pos;
+
+        /** Index of the thread in the exported trace. */
+        unsigned m_thread_index;
+
+        std::string m_thread_name;
+    };
+
+    static std::atomic_bool m_enabled, m_export_requested;
+
+    /** Protects the marker names and the list of thread buffers, it is only
+     *  used when a marker or a thread is seen for the first time. */
+    static std::mutex m_mutex;
+
+    static std::vector<std::string> m_marker_names;
+
+    static std::unordered_map<std::string, uint16_t> m_marker_ids;
+
+    static std::vector<ThreadBuffer*> m_thread_buffers;
+
+    /** Buffers of exited threads, reused by new threads. */
+    static std::vector<ThreadBuffer*> m_free_buffers;
+
+    // ------------------------------------------------------------------------
+    static ThreadBuffer* getThreadBuffer();
+    // ------------------------------------------------------------------------
+    static void record(uint16_t marker, EventType type);
+
+public:
+    // ------------------------------------------------------------------------
+    static uint16_t internMarker(const char* name);
+    // ------------------------------------------------------------------------
+    /** Records the start of the given marker in the calling thread. */
+    static void begin(uint16_t marker)
+    {
+        if (m_enabled.load(std::memory_order_relaxed))
+            record(marker, EVENT_BEGIN);
+    }   // begin
+    // ------------------------------------------------------------------------
+    /** Records the end of the last started marker in the calling thread. */
+    static void end()
+    {
+        if (m_enabled.load(std::memory_order_relaxed))
+            record(0, EVENT_END);
+    }   // end
+    // ------------------------------------------------------------------------
+    static void setEnabled(bool enabled)             { m_enabled = enabled; }
+    // ------------------------------------------------------------------------
+    static bool isEnabled()                          { return m_enabled;    }
+    // ------------------------------------------------------------------------
+    /** Requests an export from the main loop, can be called from a signal
+     *  handler. */
+    static void requestExport()                { m_export_requested = true; }
+    // ------------------------------------------------------------------------
+    static void update();
+    // ------------------------------------------------------------------------
+    static void installSignalHandler();
+    // ------------------------------------------------------------------------
+    static void writeChromeTrace(std::ostream& out);
+    // ------------------------------------------------------------------------
+    static bool exportChromeTrace(const std::string& filename = "");
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // TraceRecorder
+
+#endif // HEADER_TRACE_RECORDER_HPP
@@ -0,0 +1,171 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/worker_pool.hpp"
+
+#include "utils/string_utils.hpp"
+#include "utils/vs.hpp"
+
+#include <cassert>
+
+// ----------------------------------------------------------------------------
+/** Starts the worker threads.
+ *  \param worker_count Number of threads besides the calling thread, with 0
+ *         all jobs are run by the calling thread.
+ *  \param name Name of the threads (prefixed with their index).
+ */
+WorkerPool::WorkerPool(unsigned worker_count, const std::string& name)
+{
+    m_job = NULL;
+    m_job_count = 0;
+    m_job_generation = 0;
+    m_busy_workers = 0;
+    m_next_item.store(0);
+    m_exit = false;
+    for (unsigned i = 0; i < worker_count; i++)
+    {
+        m_workers.emplace_back([this, i, name]()
+            {
+                VS::setThreadName((StringUtils::toString(i) + name)
+                    .c_str());
+                workerLoop(i + 1);
+            });
+    }
+}   // WorkerPool
+
+// ----------------------------------------------------------------------------
+WorkerPool::~WorkerPool()
+{
+    std::unique_lock<std::mutex> ul(m_job_mutex);
+    m_exit = true;
+    m_job_cv.notify_all();
+    ul.unlock();
+    for (std::thread& t : m_workers)
+        t.join();
+}   // ~WorkerPool
+
+// ----------------------------------------------------------------------------
+void WorkerPool::workerLoop(unsigned thread)
+{
+    uint64_t last_generation = 0;
+    std::unique_lock<std::mutex> ul(m_job_mutex);
+    while (true)
+    {
+        m_job_cv.wait(ul, [this, last_generation]
+            {
+                return m_exit || m_job_generation != last_generation;
+            });
+        if (m_exit)
+            return;
+        // Take the whole job while holding the lock, so it can't change
+        // while this worker runs it
+        last_generation = m_job_generation;
+        const Job* job = m_job;
+        const unsigned count = m_job_count;
+        ul.unlock();
+        runItems(*job, count, thread);
+        ul.lock();
+        if (--m_busy_workers == 0)
+            m_job_done_cv.notify_all();
+    }
+}   // workerLoop
+
+// ----------------------------------------------------------------------------
+/** Takes items of a job until none are left. */
+void WorkerPool::runItems(const Job& job, unsigned count, unsigned thread)
+{
+    while (true)
+    {
+        const unsigned item = m_next_item.fetch_add(1);
+        if (item >= count)
+            return;
+        job(item, thread);
+    }
+}   // runItems
+
+// ----------------------------------------------------------------------------
+/** Runs the job for each index in [0, count) on the worker threads and the
+ *  calling thread. Returns when all items are done and all workers have
+ *  left the job.
+ */
+void WorkerPool::parallelFor(unsigned count, const Job& job)
+{
+    if (m_workers.empty() || count < 2)
+    {
+        for (unsigned i = 0; i < count; i++)
+            job(i, 0);
+        return;
+    }
+
+    std::unique_lock<std::mutex> ul(m_job_mutex);
+    assert(m_busy_workers == 0);
+    m_job = &job;
+    m_job_count = count;
+    m_next_item.store(0);
+    m_busy_workers = (unsigned)m_workers.size();
+    m_job_generation++;
+    m_job_cv.notify_all();
+    ul.unlock();
+
+    runItems(job, count, 0);
+
+    ul.lock();
+    m_job_done_cv.wait(ul, [this] { return m_busy_workers == 0; });
+    m_job = NULL;
+}   // parallelFor
+
+// ----------------------------------------------------------------------------
+/** Checks that every item of many small back-to-back jobs (where a late
+ *  worker would take items of the next job) runs exactly once, and that
+ *  the thread indices are in range.
+ */
+void WorkerPool::unitTesting()
+{
+    WorkerPool pool(3, "Test");
+    assert(pool.getWorkerCount() == 3);
+    std::vector<std::atomic<int> > counter(64);
+    std::atomic<unsigned> max_thread(0);
+    for (int round = 0; round < 2000; round++)
+    {
+        const unsigned count = 1 + round % (unsigned)counter.size();
+        for (unsigned i = 0; i < counter.size(); i++)
+            counter[i].store(0);
+        pool.parallelFor(count, [&counter, &max_thread](unsigned i,
+                                                        unsigned thread)
+            {
+                counter[i].fetch_add(1);
+                unsigned m = max_thread.load();
+                while (thread > m && !max_thread.compare_exchange_weak(m,
+                    thread)) {}
+            });
+        for (unsigned i = 0; i < counter.size(); i++)
+            assert(counter[i].load() == (i < count ? 1 : 0));
+    }
+    assert(max_thread.load() <= 3);
+
+    // Without workers everything runs on the calling thread
+    WorkerPool serial(0, "Test");
+    unsigned sum = 0;
+    serial.parallelFor(10, [&sum](unsigned i, unsigned thread)
+        {
+            assert(thread == 0);
+            sum += i;
+        });
+    assert(sum == 45);
+    (void)sum;
+}   // unitTesting
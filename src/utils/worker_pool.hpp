@@ -0,0 +1,90 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_WORKER_POOL_HPP
+#define HEADER_WORKER_POOL_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** A small pool of worker threads which run the items of one job at a time
+ *  in parallel, the thread calling \ref parallelFor works on items too.
+ *  Each worker takes the job under the mutex, and \ref parallelFor only
+ *  returns once every worker has left the job, so a slow worker can never
+ *  take an item of the next job. \ref parallelFor must not be called from
+ *  two threads at once, or from inside a job.
+ */
+class WorkerPool : public NoCopy
+{
+public:
+    /** A job is called with the index of the item, and the index of the
+     *  thread running it: 0 for the calling thread, 1 to the number of
+     *  workers for the workers. */
+    typedef std::function<void(unsigned /*item*/, unsigned /*thread*/)> Job;
+
+private:
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_job_mutex;
+
+    std::condition_variable m_job_cv, m_job_done_cv;
+
+    /** Current job, only valid while \ref parallelFor is running. */
+    const Job* m_job;
+
+    unsigned m_job_count;
+
+    /** Incremented for each new job so workers can tell them apart. */
+    uint64_t m_job_generation;
+
+    /** Number of workers which have not left the current job. */
+    unsigned m_busy_workers;
+
+    /** Index of the next item to be taken by a thread. */
+    std::atomic<unsigned> m_next_item;
+
+    bool m_exit;
+
+    // ------------------------------------------------------------------------
+    void workerLoop(unsigned thread);
+    // ------------------------------------------------------------------------
+    void runItems(const Job& job, unsigned count, unsigned thread);
+
+public:
+    // ------------------------------------------------------------------------
+    WorkerPool(unsigned worker_count, const std::string& name);
+    // ------------------------------------------------------------------------
+    ~WorkerPool();
+    // ------------------------------------------------------------------------
+    void parallelFor(unsigned count, const Job& job);
+    // ------------------------------------------------------------------------
+    unsigned getWorkerCount() const       { return (unsigned)m_workers.size(); }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // WorkerPool
+
+#endif // HEADER_WORKER_POOL_HPP